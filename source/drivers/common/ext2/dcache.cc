@@ -0,0 +1,154 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <fs/common.h>
+#include <sys/common.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dcache.h"
+
+/* protects the entries, the lists and the statistics */
+#define DCACHE_LOCK	0xF7180004
+
+Ext2DirCache::Ext2DirCache(size_t size)
+		: _size(size), _used(), _hits(), _negHits(), _misses(),
+		  _entries(new uint8_t[size * (sizeof(Ext2DEntry) + MAX_NAME_LEN)]), _hashmap(),
+		  _newest(), _oldest(), _free() {
+	for(size_t i = 0; i < _size; ++i) {
+		Ext2DEntry *e = get(i);
+		e->next = _free;
+		_free = e;
+	}
+}
+
+Ext2DirCache::~Ext2DirCache() {
+	delete[] _entries;
+}
+
+bool Ext2DirCache::lookup(ino_t dir,const char *name,size_t nameLen,ino_t *ino) {
+	if(nameLen > MAX_NAME_LEN)
+		return false;
+
+	sassert(tpool_lock(DCACHE_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
+	Ext2DEntry *e = find(dir,name,nameLen,hash(dir,name,nameLen));
+	if(e) {
+		/* move it to the front */
+		unlink(e);
+		prepend(e);
+		*ino = e->ino;
+		if(e->ino < 0)
+			_negHits++;
+		else
+			_hits++;
+	}
+	else
+		_misses++;
+	sassert(tpool_unlock(DCACHE_LOCK) == 0);
+	return e != NULL;
+}
+
+void Ext2DirCache::insert(ino_t dir,const char *name,size_t nameLen,ino_t ino) {
+	if(nameLen > MAX_NAME_LEN)
+		return;
+
+	size_t h = hash(dir,name,nameLen);
+	sassert(tpool_lock(DCACHE_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
+	Ext2DEntry *e = find(dir,name,nameLen,h);
+	if(e)
+		unlink(e);
+	else {
+		/* take a free one or evict the least recently used */
+		if(_free) {
+			e = _free;
+			_free = _free->next;
+			_used++;
+		}
+		else {
+			e = _oldest;
+			unlink(e);
+			Ext2DEntry **p = _hashmap + hash(e->dir,e->name,e->nameLen);
+			while(*p != e)
+				p = &(*p)->hnext;
+			*p = e->hnext;
+		}
+
+		e->dir = dir;
+		e->nameLen = nameLen;
+		memcpy(e->name,name,nameLen);
+		e->hnext = _hashmap[h];
+		_hashmap[h] = e;
+	}
+	e->ino = ino;
+	prepend(e);
+	sassert(tpool_unlock(DCACHE_LOCK) == 0);
+}
+
+void Ext2DirCache::print(FILE *f) {
+	float hitrate;
+	size_t hits = _hits + _negHits;
+	fprintf(f,"\t\tTotal entries: %zu\n",_size);
+	fprintf(f,"\t\tUsed entries: %zu\n",_used);
+	fprintf(f,"\t\tHits: %zu\n",_hits);
+	fprintf(f,"\t\tNegative hits: %zu\n",_negHits);
+	fprintf(f,"\t\tMisses: %zu\n",_misses);
+	if(hits == 0)
+		hitrate = 0;
+	else
+		hitrate = 100.0f / ((float)(_misses + hits) / hits);
+	fprintf(f,"\t\tHitrate: %.3f%%\n",hitrate);
+}
+
+size_t Ext2DirCache::hash(ino_t dir,const char *name,size_t nameLen) {
+	size_t h = dir;
+	for(size_t i = 0; i < nameLen; ++i)
+		h = h * 31 + (uchar)name[i];
+	return h % HASH_SIZE;
+}
+
+Ext2DEntry *Ext2DirCache::find(ino_t dir,const char *name,size_t nameLen,size_t h) {
+	for(Ext2DEntry *e = _hashmap[h]; e != NULL; e = e->hnext) {
+		if(e->dir == dir && e->nameLen == nameLen && memcmp(e->name,name,nameLen) == 0)
+			return e;
+	}
+	return NULL;
+}
+
+void Ext2DirCache::unlink(Ext2DEntry *e) {
+	if(e->prev)
+		e->prev->next = e->next;
+	else
+		_newest = e->next;
+	if(e->next)
+		e->next->prev = e->prev;
+	else
+		_oldest = e->prev;
+}
+
+void Ext2DirCache::prepend(Ext2DEntry *e) {
+	e->prev = NULL;
+	e->next = _newest;
+	if(_newest)
+		_newest->prev = e;
+	else
+		_oldest = e;
+	_newest = e;
+}
@@ -0,0 +1,104 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <sys/common.h>
+#include <stdio.h>
+
+/* a cached directory-entry */
+struct Ext2DEntry {
+	Ext2DEntry *prev;
+	Ext2DEntry *next;
+	Ext2DEntry *hnext;
+	/* the directory and the inode-number of the entry or -ENOENT for negative entries */
+	ino_t dir;
+	ino_t ino;
+	uint8_t nameLen;
+	char name[];
+};
+
+/**
+ * A LRU cache for the mapping of (directory, name) to inode-number, including negative entries.
+ * Lookups and updates of a directory are done while holding its inode, so that the cache stays
+ * consistent with the directory as long as all changes are reported by Ext2Link.
+ */
+class Ext2DirCache {
+	static const size_t HASH_SIZE	= 128;
+
+public:
+	/* longer names are not cached */
+	static const size_t MAX_NAME_LEN	= 40;
+
+	/**
+	 * Inits the cache with <size> entries
+	 *
+	 * @param size the number of entries
+	 */
+	explicit Ext2DirCache(size_t size);
+	~Ext2DirCache();
+
+	/**
+	 * Looks up the entry <name> in <dir>.
+	 *
+	 * @param dir the inode-number of the directory
+	 * @param name the name
+	 * @param nameLen the length of the name
+	 * @param ino will be set to the inode-number or -ENOENT if the entry is known not to exist
+	 * @return true if the entry was found in the cache
+	 */
+	bool lookup(ino_t dir,const char *name,size_t nameLen,ino_t *ino);
+
+	/**
+	 * Inserts or updates the entry <name> in <dir>.
+	 *
+	 * @param dir the inode-number of the directory
+	 * @param name the name
+	 * @param nameLen the length of the name
+	 * @param ino the inode-number or -ENOENT for a negative entry
+	 */
+	void insert(ino_t dir,const char *name,size_t nameLen,ino_t ino);
+
+	/**
+	 * Prints statistics about the cache into the given file
+	 *
+	 * @param f the file
+	 */
+	void print(FILE *f);
+
+private:
+	Ext2DEntry *get(size_t i) {
+		return reinterpret_cast<Ext2DEntry*>(_entries + i * (sizeof(Ext2DEntry) + MAX_NAME_LEN));
+	}
+	static size_t hash(ino_t dir,const char *name,size_t nameLen);
+	Ext2DEntry *find(ino_t dir,const char *name,size_t nameLen,size_t h);
+	void unlink(Ext2DEntry *e);
+	void prepend(Ext2DEntry *e);
+
+	size_t _size;
+	size_t _used;
+	size_t _hits;
+	size_t _negHits;
+	size_t _misses;
+	uint8_t *_entries;
+	Ext2DEntry *_hashmap[HASH_SIZE];
+	Ext2DEntry *_newest;
+	Ext2DEntry *_oldest;
+	Ext2DEntry *_free;
+};
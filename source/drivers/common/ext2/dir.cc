@@ -28,6 +28,7 @@
 #include "dir.h"
 #include "ext2.h"
 #include "file.h"
+#include "htree.h"
 #include "inodecache.h"
 #include "link.h"
 
@@ -69,9 +70,28 @@ int Ext2Dir::create(Ext2FileSystem *e,User *u,Ext2CInode *dir,const char *name,m
 }
 
 ino_t Ext2Dir::find(Ext2FileSystem *e,Ext2CInode *dir,const char *name,size_t nameLen) {
+	ino_t ino;
+	if(e->dirCache.lookup(dir->inodeNo,name,nameLen,&ino))
+		return ino;
+
+	ino = findUncached(e,dir,name,nameLen);
+	if(ino >= 0 || ino == -ENOENT)
+		e->dirCache.insert(dir->inodeNo,name,nameLen,ino);
+	return ino;
+}
+
+ino_t Ext2Dir::findUncached(Ext2FileSystem *e,Ext2CInode *dir,const char *name,size_t nameLen) {
 	ino_t ino;
 	size_t size = le32tocpu(dir->inode.size);
 	int res;
+
+	/* use the index, if there is a usable one */
+	if(Ext2HTree::isIndexed(e,dir)) {
+		ino = Ext2HTree::find(e,dir,name,nameLen);
+		if(ino != -ENOTSUP)
+			return ino;
+	}
+
 	Ext2DirEntry *buffer = (Ext2DirEntry*)malloc(size);
 	if(buffer == NULL)
 		return -ENOMEM;
@@ -91,10 +111,11 @@ ino_t Ext2Dir::findIn(Ext2DirEntry *buffer,size_t bufSize,const char *name,size_
 	ssize_t rem = bufSize;
 	Ext2DirEntry *entry = buffer;
 
-	/* search the directory-entries */
-	while(rem > 0 && le32tocpu(entry->inode) != 0) {
+	/* search the directory-entries; unused ones (and index blocks) have inode 0 */
+	while(rem > 0 && le16tocpu(entry->recLen) != 0) {
 		/* found a match? */
-		if(nameLen == le16tocpu(entry->nameLen) && strncmp(entry->name,name,nameLen) == 0) {
+		if(le32tocpu(entry->inode) != 0 && nameLen == le16tocpu(entry->nameLen) &&
+				strncmp(entry->name,name,nameLen) == 0) {
 			ino_t ino = le32tocpu(entry->inode);
 			return ino;
 		}
@@ -121,6 +142,9 @@ int Ext2Dir::remove(Ext2FileSystem *e,User *u,Ext2CInode *dir,const char *name)
 	ino = Ext2Dir::find(e,dir,name,strlen(name));
 	if(ino < 0)
 		return ino;
+	/* we can't remove '.' and we hold the lock of <dir> already */
+	if(ino == dir->inodeNo)
+		return -EINVAL;
 	/* get inode of directory to delete */
 	delIno = e->inodeCache.request(ino,IMODE_WRITE);
 	if(delIno == NULL)
@@ -141,10 +165,10 @@ int Ext2Dir::remove(Ext2FileSystem *e,User *u,Ext2CInode *dir,const char *name)
 
 	/* search for other entries than '.' and '..' */
 	entry = buffer;
-	while(size > 0 && entry->inode != 0) {
+	while(size > 0 && le16tocpu(entry->recLen) != 0) {
 		uint16_t namelen = le16tocpu(entry->nameLen);
 		/* found a match? */
-		if(namelen != 1 && namelen != 2 &&
+		if(entry->inode != 0 && namelen != 1 && namelen != 2 &&
 				strncmp(entry->name,".",namelen) != 0 &&
 				strncmp(entry->name,"..",namelen) != 0) {
 			res = -ENOTEMPTY;
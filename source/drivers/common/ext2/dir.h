@@ -43,7 +43,8 @@ public:
 	static int create(Ext2FileSystem *e,fs::User *u,Ext2CInode *dir,const char *name,mode_t mode);
 
 	/**
-	 * Finds the inode-number to the entry <name> in <dir>
+	 * Finds the inode-number to the entry <name> in <dir>. The result is taken from and stored in
+	 * the dir-cache.
 	 *
 	 * @param e the ext2-fs
 	 * @param dir the directory
@@ -53,6 +54,11 @@ public:
 	 */
 	static ino_t find(Ext2FileSystem *e,Ext2CInode *dir,const char *name,size_t nameLen);
 
+	/**
+	 * Like find(), but does always search the directory itself instead of using the dir-cache.
+	 */
+	static ino_t findUncached(Ext2FileSystem *e,Ext2CInode *dir,const char *name,size_t nameLen);
+
 	/**
 	 * Finds the inode-number to the entry <name> in the given buffer
 	 *
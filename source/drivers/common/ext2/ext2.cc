@@ -49,7 +49,7 @@ static void sigTermHndl(int) {
 	/* notify init that we're alive and promise to terminate as soon as possible */
 	esc::Init init("/dev/init");
 	init.iamalive();
-	fsdev->stop();
+	fsdev->shutdown();
 }
 
 int main(int argc,char *argv[]) {
@@ -63,8 +63,8 @@ int main(int argc,char *argv[]) {
 	if(signal(SIGTERM,sigTermHndl) == SIG_ERR)
 		error("Unable to set signal-handler for SIGTERM");
 
-	fsdev = new fs::FSDevice<fs::OpenFile>(new Ext2FileSystem(argv[2]),argv[1]);
-	fsdev->loop();
+	fsdev = new fs::FSDevice<fs::OpenFile>(new Ext2FileSystem(argv[2]),argv[1],DEV_PAGECACHE);
+	fsdev->loop(EXT2_THREAD_COUNT);
 	return 0;
 }
 
@@ -78,7 +78,7 @@ bool Ext2FileSystem::Ext2BlockCache::writeBlocks(const void *buffer,size_t start
 
 Ext2FileSystem::Ext2FileSystem(const char *device)
 		: fd(::open(device,O_RDWR)), sb(this), bgs(this),
-		  inodeCache(this), blockCache(this) {
+		  inodeCache(this), blockCache(this), dirCache(EXT2_DCACHE_SIZE) {
 	if(fd < 0)
 		VTHROWE("Unable to open device '" << device << "'",fd);
 }
@@ -131,7 +131,7 @@ ino_t Ext2FileSystem::open(fs::User *u,const char *path,uint flags,mode_t mode,i
 	 * to prevent that somebody else deletes the file while another one uses it. of course, this
 	 * means that we can never have more open files that inode-cache-slots. so, we might have to
 	 * increase that at sometime. */
-	cnode->refs++;
+	inodeCache.pin(cnode);
 	inodeCache.release(cnode);
 
 	/* truncate? */
@@ -149,7 +149,7 @@ ino_t Ext2FileSystem::open(fs::User *u,const char *path,uint flags,mode_t mode,i
 void Ext2FileSystem::close(fs::OpenFile *file) {
 	/* decrease references so that we can remove the cached inode and maybe even delete the file */
 	Ext2CInode *cnode = inodeCache.request(file->ino,IMODE_READ);
-	cnode->refs--;
+	inodeCache.unpin(cnode);
 	inodeCache.release(cnode);
 }
 
@@ -215,15 +215,17 @@ int Ext2FileSystem::linkIno(fs::User *u,ino_t dst,fs::OpenFile *dir,const char *
 	int res;
 	Ext2CInode *cdir,*cdst;
 	cdir = inodeCache.request(dir->ino,IMODE_WRITE);
-	cdst = inodeCache.request(dst,IMODE_WRITE);
+	/* the inode locks are not recursive, so don't request the directory twice */
+	cdst = dst == dir->ino ? cdir : inodeCache.request(dst,IMODE_WRITE);
 	if(cdir == NULL || cdst == NULL)
 		res = -ENOBUFS;
 	else if(!isdir && S_ISDIR(le16tocpu(cdst->inode.mode)))
 		res = -EISDIR;
 	else
 		res = Ext2Link::create(this,u,cdir,cdst,name);
+	if(cdst != cdir)
+		inodeCache.release(cdst);
 	inodeCache.release(cdir);
-	inodeCache.release(cdst);
 	return res;
 }
 
@@ -258,8 +260,9 @@ int Ext2FileSystem::rmdir(fs::User *u,fs::OpenFile *dir,const char *name) {
 	if(cdir == NULL)
 		return -ENOBUFS;
 	if(!S_ISDIR(le16tocpu(cdir->inode.mode)))
-		return -ENOTDIR;
-	res = Ext2Dir::remove(this,u,cdir,name);
+		res = -ENOTDIR;
+	else
+		res = Ext2Dir::remove(this,u,cdir,name);
 	inodeCache.release(cdir);
 	return res;
 }
@@ -306,6 +309,8 @@ void Ext2FileSystem::print(FILE *f) {
 	fprintf(f,"Max mount count: %u\n",le16tocpu(sb.get()->maxMountCount));
 	fprintf(f,"Block cache:\n");
 	blockCache.printStats(f);
+	fprintf(f,"Directory cache:\n");
+	dirCache.print(f);
 	fprintf(f,"Inode cache:\n");
 	inodeCache.print(f);
 }
@@ -27,6 +27,7 @@
 #include <sys/endian.h>
 
 #include "bgmng.h"
+#include "dcache.h"
 #include "dir.h"
 #include "inodecache.h"
 #include "sbmng.h"
@@ -34,8 +35,13 @@
 static const size_t DISK_SECTOR_SIZE		= 512;
 static const size_t EXT2_ICACHE_SIZE		= 64;
 static const size_t EXT2_BCACHE_SIZE		= 2048;
+static const size_t EXT2_DCACHE_SIZE		= 512;
+
+static const size_t EXT2_THREAD_COUNT		= 4;
 
 static const uint EXT2_SUPERBLOCK_LOCK		= 0xF7180002;
+/* the disk is accessed via seek and read/write, which has to be done atomically */
+static const uint EXT2_DISK_LOCK			= 0xF7180003;
 
 class Ext2FileSystem : public fs::FileSystem<fs::OpenFile> {
 public:
@@ -216,4 +222,5 @@ public:
 	/* caches */
 	Ext2INodeCache inodeCache;
 	Ext2BlockCache blockCache;
+	Ext2DirCache dirCache;
 };
@@ -0,0 +1,745 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/common.h>
+#include <sys/endian.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dir.h"
+#include "ext2.h"
+#include "file.h"
+#include "htree.h"
+#include "inodecache.h"
+#include "link.h"
+
+using namespace fs;
+
+/* '..' directly follows '.', which is 12 bytes long */
+static const size_t DX_DOTDOT_OFF		= 12;
+/* the root info follows the header of '..', whose record spans the rest of the block */
+static const size_t DX_ROOT_INFO_OFF	= 24;
+/* index nodes start with an empty directory-entry that spans the whole block */
+static const size_t DX_NODE_OFF			= 8;
+
+/* the largest hash; it is reserved as end-of-directory marker for readdir */
+static const uint32_t DX_HASH_EOF		= 0x7FFFFFFFu << 1;
+static const uint32_t TEA_DELTA			= 0x9E3779B9;
+
+static size_t rootLimit(size_t blockSize) {
+	return (blockSize - DX_ROOT_INFO_OFF - sizeof(Ext2DxRootInfo)) / sizeof(Ext2DxEntry);
+}
+
+static size_t nodeLimit(size_t blockSize) {
+	return (blockSize - DX_NODE_OFF) / sizeof(Ext2DxEntry);
+}
+
+static Ext2DxCountLimit *countLimit(Ext2DxEntry *entries) {
+	return reinterpret_cast<Ext2DxCountLimit*>(entries);
+}
+
+static void initNode(uint8_t *block,size_t blockSize) {
+	Ext2DirEntry *fake = reinterpret_cast<Ext2DirEntry*>(block);
+	memset(block,0,blockSize);
+	fake->inode = cputole32(0);
+	fake->recLen = cputole16(blockSize);
+	fake->nameLen = cputole16(0);
+	Ext2DxCountLimit *cl = countLimit(reinterpret_cast<Ext2DxEntry*>(block + DX_NODE_OFF));
+	cl->limit = cputole16(nodeLimit(blockSize));
+	cl->count = cputole16(0);
+}
+
+static int compareItems(const void *a,const void *b) {
+	uint32_t ha = *static_cast<const uint32_t*>(a);
+	uint32_t hb = *static_cast<const uint32_t*>(b);
+	return ha < hb ? -1 : (ha > hb ? 1 : 0);
+}
+
+static inline uint32_t rol32(uint32_t x,int s) {
+	return (x << s) | (x >> (32 - s));
+}
+
+static int charOf(const char *s,size_t i,bool unsignedChars) {
+	return unsignedChars ? (int)(unsigned char)s[i] : (int)(signed char)s[i];
+}
+
+static uint32_t legacyHash(const char *name,size_t len,bool unsignedChars) {
+	uint32_t hash,hash0 = 0x12A3FE2D,hash1 = 0x37ABE8F9;
+	for(size_t i = 0; i < len; ++i) {
+		hash = hash1 + (hash0 ^ (uint32_t)(charOf(name,i,unsignedChars) * 7152373));
+		if(hash & 0x80000000)
+			hash -= 0x7FFFFFFF;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+	return hash0 << 1;
+}
+
+static void str2hashbuf(const char *msg,size_t len,uint32_t *buf,int num,bool unsignedChars) {
+	uint32_t pad = (uint32_t)len | ((uint32_t)len << 8);
+	pad |= pad << 16;
+
+	uint32_t val = pad;
+	if(len > (size_t)num * 4)
+		len = num * 4;
+	for(size_t i = 0; i < len; i++) {
+		val = (uint32_t)charOf(msg,i,unsignedChars) + (val << 8);
+		if((i % 4) == 3) {
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+	if(--num >= 0)
+		*buf++ = val;
+	while(--num >= 0)
+		*buf++ = pad;
+}
+
+static void teaTransform(uint32_t buf[4],const uint32_t in[4]) {
+	uint32_t sum = 0;
+	uint32_t b0 = buf[0],b1 = buf[1];
+	uint32_t a = in[0],b = in[1],c = in[2],d = in[3];
+	for(int n = 0; n < 16; ++n) {
+		sum += TEA_DELTA;
+		b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+		b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+	}
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+/* the basic MD4 functions: selection, majority and parity */
+#define F(x,y,z)				((z) ^ ((x) & ((y) ^ (z))))
+#define G(x,y,z)				(((x) & (y)) + (((x) ^ (y)) & (z)))
+#define H(x,y,z)				((x) ^ (y) ^ (z))
+#define ROUND(f,a,b,c,d,x,s)	(a += f(b,c,d) + (x), a = rol32(a,s))
+
+static void halfMD4Transform(uint32_t buf[4],const uint32_t in[8]) {
+	const uint32_t K2 = 013240474631UL;
+	const uint32_t K3 = 015666365641UL;
+	uint32_t a = buf[0],b = buf[1],c = buf[2],d = buf[3];
+
+	ROUND(F,a,b,c,d,in[0], 3);
+	ROUND(F,d,a,b,c,in[1], 7);
+	ROUND(F,c,d,a,b,in[2],11);
+	ROUND(F,b,c,d,a,in[3],19);
+	ROUND(F,a,b,c,d,in[4], 3);
+	ROUND(F,d,a,b,c,in[5], 7);
+	ROUND(F,c,d,a,b,in[6],11);
+	ROUND(F,b,c,d,a,in[7],19);
+
+	ROUND(G,a,b,c,d,in[1] + K2, 3);
+	ROUND(G,d,a,b,c,in[3] + K2, 5);
+	ROUND(G,c,d,a,b,in[5] + K2, 9);
+	ROUND(G,b,c,d,a,in[7] + K2,13);
+	ROUND(G,a,b,c,d,in[0] + K2, 3);
+	ROUND(G,d,a,b,c,in[2] + K2, 5);
+	ROUND(G,c,d,a,b,in[4] + K2, 9);
+	ROUND(G,b,c,d,a,in[6] + K2,13);
+
+	ROUND(H,a,b,c,d,in[3] + K3, 3);
+	ROUND(H,d,a,b,c,in[7] + K3, 9);
+	ROUND(H,c,d,a,b,in[2] + K3,11);
+	ROUND(H,b,c,d,a,in[6] + K3,15);
+	ROUND(H,a,b,c,d,in[1] + K3, 3);
+	ROUND(H,d,a,b,c,in[5] + K3, 9);
+	ROUND(H,c,d,a,b,in[0] + K3,11);
+	ROUND(H,b,c,d,a,in[4] + K3,15);
+
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+#undef F
+#undef G
+#undef H
+#undef ROUND
+
+bool Ext2HTree::isEnabled(Ext2FileSystem *e) {
+	const Ext2SuperBlock *sb = e->sb.get();
+	return le32tocpu(sb->revLevel) >= EXT2_DYNAMIC_REV &&
+		(le32tocpu(sb->featureCompat) & EXT2_FEATURE_COMPAT_DIR_INDEX);
+}
+
+bool Ext2HTree::isIndexed(Ext2FileSystem *e,const Ext2CInode *dir) {
+	return (le32tocpu(dir->inode.flags) & EXT2_INDEX_FL) && isEnabled(e);
+}
+
+uint32_t Ext2HTree::hash(int version,const uint32_t *seed,const char *name,size_t nameLen) {
+	uint32_t buf[4] = {0x67452301,0xEFCDAB89,0x98BADCFE,0x10325476};
+	uint32_t in[8];
+	uint32_t hash;
+	bool unsignedChars = version >= EXT2_HASH_LEGACY_UNSIGNED;
+
+	/* an all-zero seed means that the default should be used */
+	if(seed[0] || seed[1] || seed[2] || seed[3])
+		memcpy(buf,seed,sizeof(buf));
+
+	switch(version) {
+		case EXT2_HASH_LEGACY:
+		case EXT2_HASH_LEGACY_UNSIGNED:
+			hash = legacyHash(name,nameLen,unsignedChars);
+			break;
+
+		case EXT2_HASH_HALF_MD4:
+		case EXT2_HASH_HALF_MD4_UNSIGNED:
+			for(ssize_t len = nameLen; len > 0; len -= 32, name += 32) {
+				str2hashbuf(name,len,in,8,unsignedChars);
+				halfMD4Transform(buf,in);
+			}
+			hash = buf[1];
+			break;
+
+		default:
+			for(ssize_t len = nameLen; len > 0; len -= 16, name += 16) {
+				str2hashbuf(name,len,in,4,unsignedChars);
+				teaTransform(buf,in);
+			}
+			hash = buf[0];
+			break;
+	}
+
+	hash &= ~1;
+	if(hash == DX_HASH_EOF)
+		hash = DX_HASH_EOF - 2;
+	return hash;
+}
+
+ino_t Ext2HTree::find(Ext2FileSystem *e,Ext2CInode *dir,const char *name,size_t nameLen) {
+	Frame frames[MAX_LEVELS];
+	size_t bs = e->blockSize();
+	uint32_t hash;
+	int version;
+
+	int levels = probe(e,dir,name,nameLen,&hash,&version,frames);
+	uint8_t *leaf = levels < 0 ? NULL : static_cast<uint8_t*>(malloc(bs));
+	ino_t res = levels < 0 ? levels : -ENOMEM;
+	while(leaf) {
+		uint32_t lbno = le32tocpu(frames[levels - 1].at->block);
+		if(lbno == 0) {
+			res = -ENOTSUP;
+			break;
+		}
+		if((res = readBlock(e,dir,leaf,lbno)) < 0)
+			break;
+		res = Ext2Dir::findIn(reinterpret_cast<Ext2DirEntry*>(leaf),bs,name,nameLen);
+		if(res != -ENOENT)
+			break;
+
+		/* entries with the same hash might continue in the next leaf */
+		int next = nextLeaf(e,dir,hash,frames,levels);
+		if(next <= 0) {
+			res = next < 0 ? next : -ENOENT;
+			break;
+		}
+	}
+
+	free(leaf);
+	release(frames);
+	return res;
+}
+
+int Ext2HTree::add(Ext2FileSystem *e,Ext2CInode *dir,ino_t ino,const char *name,size_t nameLen) {
+	Frame frames[MAX_LEVELS];
+	size_t bs = e->blockSize();
+	uint32_t hash,lbno;
+	int version,levels,res;
+	uint8_t *leaf = NULL;
+
+	/* check if the entry exists */
+	ino_t existing = find(e,dir,name,nameLen);
+	if(existing >= 0)
+		return -EEXIST;
+	if(existing != -ENOENT) {
+		if(existing == -ENOTSUP)
+			dropIndex(e,dir);
+		return existing;
+	}
+
+	levels = probe(e,dir,name,nameLen,&hash,&version,frames);
+	if(levels < 0) {
+		res = levels;
+		goto done;
+	}
+
+	leaf = static_cast<uint8_t*>(malloc(bs));
+	if(leaf == NULL) {
+		res = -ENOMEM;
+		goto done;
+	}
+	lbno = le32tocpu(frames[levels - 1].at->block);
+	if(lbno == 0) {
+		res = -ENOTSUP;
+		goto done;
+	}
+	if((res = readBlock(e,dir,leaf,lbno)) < 0)
+		goto done;
+
+	if(!insertInto(leaf,bs,ino,name,nameLen)) {
+		/* the leaf is full, so split it. this requires a free slot in its index block */
+		Ext2DxCountLimit *cl = countLimit(frames[levels - 1].entries);
+		if(le16tocpu(cl->count) == le16tocpu(cl->limit)) {
+			if((res = growIndex(e,dir,frames,&levels)) < 0)
+				goto done;
+		}
+		if((res = splitLeaf(e,dir,frames + levels - 1,version,leaf,&lbno,hash)) < 0)
+			goto done;
+		if(!insertInto(leaf,bs,ino,name,nameLen)) {
+			res = -ENOTSUP;
+			goto done;
+		}
+	}
+	res = writeBlock(e,dir,leaf,lbno);
+
+done:
+	/* if we can't maintain the index, the directory continues in the linear format */
+	if(res == -ENOTSUP)
+		dropIndex(e,dir);
+	free(leaf);
+	release(frames);
+	return res;
+}
+
+int Ext2HTree::build(Ext2FileSystem *e,Ext2CInode *dir,uint8_t *block,ino_t ino,const char *name,
+		size_t nameLen) {
+	size_t bs = e->blockSize();
+	Ext2DirEntry *dot = reinterpret_cast<Ext2DirEntry*>(block);
+	Ext2DirEntry *dotdot = reinterpret_cast<Ext2DirEntry*>(block + DX_DOTDOT_OFF);
+	int res;
+
+	/* we need '.' and '..' at the beginning, because the root info is stored behind them */
+	if(le16tocpu(dot->recLen) != DX_DOTDOT_OFF || le16tocpu(dot->nameLen) != 1 ||
+			dot->name[0] != '.' || le16tocpu(dotdot->nameLen) != 2 ||
+			strncmp(dotdot->name,"..",2) != 0)
+		return -ENOTSUP;
+
+	Item *items = static_cast<Item*>(malloc((bs / sizeof(Ext2DirEntry)) * sizeof(Item)));
+	uint8_t *leaf = static_cast<uint8_t*>(malloc(bs));
+	if(items == NULL || leaf == NULL) {
+		res = -ENOMEM;
+		goto error;
+	}
+
+	{
+		/* move all other entries to the first leaf */
+		size_t count = 0;
+		Ext2DirEntry *dire = dotdot;
+		while(reinterpret_cast<uint8_t*>(dire) < block + bs) {
+			uint16_t recLen = le16tocpu(dire->recLen);
+			if(recLen == 0) {
+				res = -ENOTSUP;
+				goto error;
+			}
+			if(dire != dotdot && le32tocpu(dire->inode) != 0) {
+				items[count].hash = 0;
+				items[count].entry = dire;
+				items[count].size = Ext2Link::getDirESize(le16tocpu(dire->nameLen));
+				count++;
+			}
+			dire = reinterpret_cast<Ext2DirEntry*>(reinterpret_cast<uintptr_t>(dire) + recLen);
+		}
+		pack(leaf,bs,items,count);
+	}
+	if((res = writeBlock(e,dir,leaf,1)) < 0)
+		goto error;
+
+	{
+		/* turn the first block into the root, pointing to the leaf */
+		dotdot->recLen = cputole16(bs - DX_DOTDOT_OFF);
+		memset(block + DX_ROOT_INFO_OFF,0,bs - DX_ROOT_INFO_OFF);
+		Ext2DxRootInfo *info = reinterpret_cast<Ext2DxRootInfo*>(block + DX_ROOT_INFO_OFF);
+		uint8_t version = e->sb.get()->defHashVersion;
+		info->hashVersion = version <= EXT2_HASH_TEA ? version : EXT2_HASH_HALF_MD4;
+		info->infoLength = sizeof(Ext2DxRootInfo);
+		info->indirectLevels = 0;
+		Ext2DxEntry *entries = reinterpret_cast<Ext2DxEntry*>(info + 1);
+		countLimit(entries)->limit = cputole16(rootLimit(bs));
+		countLimit(entries)->count = cputole16(1);
+		entries[0].block = cputole32(1);
+	}
+	if((res = writeBlock(e,dir,block,0)) < 0)
+		goto error;
+
+	dir->inode.flags = cputole32(le32tocpu(dir->inode.flags) | EXT2_INDEX_FL);
+	e->inodeCache.markDirty(dir);
+	free(leaf);
+	free(items);
+
+	/* now add the new entry, which will split the leaf */
+	return add(e,dir,ino,name,nameLen);
+
+error:
+	free(leaf);
+	free(items);
+	return res;
+}
+
+uint32_t Ext2HTree::hashOf(Ext2FileSystem *e,int version,const char *name,size_t nameLen) {
+	const Ext2SuperBlock *sb = e->sb.get();
+	uint32_t seed[4];
+	for(size_t i = 0; i < ARRAY_SIZE(seed); ++i)
+		seed[i] = le32tocpu(sb->hashSeed[i]);
+	return hash(version,seed,name,nameLen);
+}
+
+int Ext2HTree::probe(Ext2FileSystem *e,Ext2CInode *dir,const char *name,size_t nameLen,
+		uint32_t *hash,int *version,Frame *frames) {
+	size_t bs = e->blockSize();
+	int res;
+
+	for(int i = 0; i < MAX_LEVELS; ++i)
+		frames[i].block = NULL;
+	for(int i = 0; i < MAX_LEVELS; ++i) {
+		frames[i].block = static_cast<uint8_t*>(malloc(bs));
+		if(frames[i].block == NULL)
+			return -ENOMEM;
+	}
+
+	if((res = readBlock(e,dir,frames[0].block,0)) < 0)
+		return res;
+
+	const Ext2DirEntry *dotdot = reinterpret_cast<Ext2DirEntry*>(frames[0].block + DX_DOTDOT_OFF);
+	const Ext2DxRootInfo *info = reinterpret_cast<Ext2DxRootInfo*>(frames[0].block + DX_ROOT_INFO_OFF);
+	if(le16tocpu(dotdot->recLen) != bs - DX_DOTDOT_OFF || info->reservedZero != 0 ||
+			info->infoLength != sizeof(Ext2DxRootInfo) ||
+			info->hashVersion > EXT2_HASH_TEA_UNSIGNED || info->indirectLevels >= MAX_LEVELS)
+		return -ENOTSUP;
+
+	/* the hash-version in the root doesn't say whether chars are signed; the superblock does */
+	*version = info->hashVersion;
+	if(*version <= EXT2_HASH_TEA && (le32tocpu(e->sb.get()->flags) & EXT2_FLAGS_UNSIGNED_HASH))
+		*version += EXT2_HASH_LEGACY_UNSIGNED;
+	*hash = hashOf(e,*version,name,nameLen);
+
+	frames[0].bno = 0;
+	frames[0].entries = reinterpret_cast<Ext2DxEntry*>(frames[0].block + DX_ROOT_INFO_OFF +
+		info->infoLength);
+	if(!validNode(frames,rootLimit(bs)))
+		return -ENOTSUP;
+	frames[0].at = search(frames[0].entries,*hash);
+
+	int levels = info->indirectLevels + 1;
+	for(int i = 1; i < levels; ++i) {
+		if((res = readNode(e,dir,frames + i,le32tocpu(frames[i - 1].at->block))) < 0)
+			return res;
+		frames[i].at = search(frames[i].entries,*hash);
+	}
+	return levels;
+}
+
+int Ext2HTree::readNode(Ext2FileSystem *e,Ext2CInode *dir,Frame *f,uint32_t bno) {
+	size_t bs = e->blockSize();
+	int res;
+	/* block 0 is the root */
+	if(bno == 0)
+		return -ENOTSUP;
+	if((res = readBlock(e,dir,f->block,bno)) < 0)
+		return res;
+
+	const Ext2DirEntry *fake = reinterpret_cast<Ext2DirEntry*>(f->block);
+	if(le32tocpu(fake->inode) != 0 || le16tocpu(fake->recLen) != bs)
+		return -ENOTSUP;
+	f->bno = bno;
+	f->entries = reinterpret_cast<Ext2DxEntry*>(f->block + DX_NODE_OFF);
+	return validNode(f,nodeLimit(bs)) ? 0 : -ENOTSUP;
+}
+
+int Ext2HTree::nextLeaf(Ext2FileSystem *e,Ext2CInode *dir,uint32_t hash,Frame *frames,int levels) {
+	/* go up until we find a level that has another entry */
+	int i = levels - 1;
+	while(frames[i].at + 1 >= frames[i].entries + le16tocpu(countLimit(frames[i].entries)->count)) {
+		if(i == 0)
+			return 0;
+		i--;
+	}
+
+	/* the next block continues our hash only if the collision bit is set */
+	frames[i].at++;
+	if((le32tocpu(frames[i].at->hash) & ~1) != hash || !(le32tocpu(frames[i].at->hash) & 1))
+		return 0;
+
+	/* walk down to the leaf again */
+	for(i++; i < levels; ++i) {
+		int res = readNode(e,dir,frames + i,le32tocpu(frames[i - 1].at->block));
+		if(res < 0)
+			return res;
+		frames[i].at = frames[i].entries;
+	}
+	return 1;
+}
+
+int Ext2HTree::growIndex(Ext2FileSystem *e,Ext2CInode *dir,Frame *frames,int *levels) {
+	size_t bs = e->blockSize();
+	uint32_t nbno = le32tocpu(dir->inode.size) / bs;
+	Frame *root = frames;
+	Frame *node = frames + 1;
+	Ext2DxCountLimit *rcl = countLimit(root->entries);
+	int res;
+
+	if(*levels == 1) {
+		/* the root is full: move its entries into a new index node below it */
+		size_t count = le16tocpu(rcl->count);
+		initNode(node->block,bs);
+		node->bno = nbno;
+		node->entries = reinterpret_cast<Ext2DxEntry*>(node->block + DX_NODE_OFF);
+		memcpy(node->entries + 1,root->entries + 1,(count - 1) * sizeof(Ext2DxEntry));
+		node->entries[0].block = root->entries[0].block;
+		countLimit(node->entries)->count = cputole16(count);
+		node->at = node->entries + (root->at - root->entries);
+		if((res = writeBlock(e,dir,node->block,nbno)) < 0)
+			return res;
+
+		rcl->count = cputole16(1);
+		root->entries[0].block = cputole32(nbno);
+		root->at = root->entries;
+		reinterpret_cast<Ext2DxRootInfo*>(root->block + DX_ROOT_INFO_OFF)->indirectLevels = 1;
+		*levels = 2;
+		return writeBlock(e,dir,root->block,0);
+	}
+
+	/* the index node is full. split it, if there is room in the root */
+	if(le16tocpu(rcl->count) == le16tocpu(rcl->limit))
+		return -ENOTSUP;
+
+	uint8_t *nblock = static_cast<uint8_t*>(malloc(bs));
+	if(nblock == NULL)
+		return -ENOMEM;
+
+	Ext2DxCountLimit *ncl = countLimit(node->entries);
+	size_t count = le16tocpu(ncl->count);
+	size_t half = count / 2;
+	uint32_t hash2 = le32tocpu(node->entries[half].hash);
+	initNode(nblock,bs);
+	Ext2DxEntry *nentries = reinterpret_cast<Ext2DxEntry*>(nblock + DX_NODE_OFF);
+	memcpy(nentries + 1,node->entries + half + 1,(count - half - 1) * sizeof(Ext2DxEntry));
+	nentries[0].block = node->entries[half].block;
+	countLimit(nentries)->count = cputole16(count - half);
+	ncl->count = cputole16(half);
+
+	if((res = writeBlock(e,dir,nblock,nbno)) < 0 ||
+			(res = writeBlock(e,dir,node->block,node->bno)) < 0)
+		goto done;
+	insertEntry(root,hash2,nbno);
+	if((res = writeBlock(e,dir,root->block,0)) < 0)
+		goto done;
+
+	/* continue in the half that contains our position */
+	if(node->at >= node->entries + half) {
+		size_t idx = node->at - (node->entries + half);
+		memcpy(node->block,nblock,bs);
+		node->bno = nbno;
+		node->at = node->entries + idx;
+		root->at++;
+	}
+
+done:
+	free(nblock);
+	return res;
+}
+
+int Ext2HTree::splitLeaf(Ext2FileSystem *e,Ext2CInode *dir,Frame *parent,int version,uint8_t *leaf,
+		uint32_t *lbno,uint32_t hash) {
+	size_t bs = e->blockSize();
+	uint32_t nbno = le32tocpu(dir->inode.size) / bs;
+	size_t count = 0,total = 0,split = 0,size = 0;
+	uint32_t hash2;
+	int res;
+
+	Item *items = static_cast<Item*>(malloc((bs / sizeof(Ext2DirEntry)) * sizeof(Item)));
+	uint8_t *lo = static_cast<uint8_t*>(malloc(bs));
+	uint8_t *hi = static_cast<uint8_t*>(malloc(bs));
+	if(items == NULL || lo == NULL || hi == NULL) {
+		res = -ENOMEM;
+		goto done;
+	}
+
+	{
+		/* collect the used entries with their hashes */
+		Ext2DirEntry *dire = reinterpret_cast<Ext2DirEntry*>(leaf);
+		while(reinterpret_cast<uint8_t*>(dire) < leaf + bs) {
+			uint16_t recLen = le16tocpu(dire->recLen);
+			if(recLen == 0) {
+				res = -ENOTSUP;
+				goto done;
+			}
+			if(le32tocpu(dire->inode) != 0) {
+				size_t nameLen = le16tocpu(dire->nameLen);
+				items[count].hash = hashOf(e,version,dire->name,nameLen);
+				items[count].entry = dire;
+				items[count].size = Ext2Link::getDirESize(nameLen);
+				total += items[count].size;
+				count++;
+			}
+			dire = reinterpret_cast<Ext2DirEntry*>(reinterpret_cast<uintptr_t>(dire) + recLen);
+		}
+	}
+	if(count < 2) {
+		res = -ENOTSUP;
+		goto done;
+	}
+
+	/* sort them by hash and move the upper half (in bytes) to a new block */
+	qsort(items,count,sizeof(Item),compareItems);
+	while(split < count - 1 && size + items[split].size <= total / 2)
+		size += items[split++].size;
+	if(split == 0)
+		split = 1;
+
+	/* if the hash continues in the new block, lookups have to check both */
+	hash2 = items[split].hash;
+	if(items[split - 1].hash == hash2)
+		hash2 |= 1;
+
+	pack(lo,bs,items,split);
+	pack(hi,bs,items + split,count - split);
+	if((res = writeBlock(e,dir,hi,nbno)) < 0 || (res = writeBlock(e,dir,lo,*lbno)) < 0)
+		goto done;
+
+	insertEntry(parent,hash2,nbno);
+	if((res = writeBlock(e,dir,parent->block,parent->bno)) < 0)
+		goto done;
+
+	/* continue with the block that should receive the new entry */
+	if(hash >= hash2) {
+		memcpy(leaf,hi,bs);
+		*lbno = nbno;
+	}
+	else
+		memcpy(leaf,lo,bs);
+
+done:
+	free(hi);
+	free(lo);
+	free(items);
+	return res;
+}
+
+bool Ext2HTree::insertInto(uint8_t *block,size_t blockSize,ino_t ino,const char *name,size_t nameLen) {
+	size_t tlen = Ext2Link::getDirESize(nameLen);
+	Ext2DirEntry *dire = reinterpret_cast<Ext2DirEntry*>(block);
+	while(reinterpret_cast<uint8_t*>(dire) < block + blockSize) {
+		uint16_t recLen = le16tocpu(dire->recLen);
+		if(recLen == 0)
+			return false;
+
+		/* reuse an unused entry, if it's large enough */
+		if(le32tocpu(dire->inode) == 0 && recLen >= tlen)
+			break;
+
+		/* or take the space behind the entry */
+		size_t elen = Ext2Link::getDirESize(le16tocpu(dire->nameLen));
+		if(elen < recLen && recLen - elen >= tlen) {
+			dire->recLen = cputole16(elen);
+			dire = reinterpret_cast<Ext2DirEntry*>(reinterpret_cast<uintptr_t>(dire) + elen);
+			dire->recLen = cputole16(recLen - elen);
+			break;
+		}
+
+		dire = reinterpret_cast<Ext2DirEntry*>(reinterpret_cast<uintptr_t>(dire) + recLen);
+	}
+	if(reinterpret_cast<uint8_t*>(dire) >= block + blockSize)
+		return false;
+
+	dire->inode = cputole32(ino);
+	dire->nameLen = cputole16(nameLen);
+	memcpy(dire->name,name,nameLen);
+	return true;
+}
+
+void Ext2HTree::pack(uint8_t *block,size_t blockSize,Item *items,size_t count) {
+	Ext2DirEntry *last = NULL;
+	size_t off = 0;
+	memset(block,0,blockSize);
+	for(size_t i = 0; i < count; ++i) {
+		last = reinterpret_cast<Ext2DirEntry*>(block + off);
+		memcpy(last,items[i].entry,sizeof(Ext2DirEntry) + le16tocpu(items[i].entry->nameLen));
+		last->recLen = cputole16(items[i].size);
+		off += items[i].size;
+	}
+
+	/* the last entry spans the rest of the block */
+	if(last == NULL) {
+		last = reinterpret_cast<Ext2DirEntry*>(block);
+		last->recLen = cputole16(blockSize);
+	}
+	else
+		last->recLen = cputole16(le16tocpu(last->recLen) + blockSize - off);
+}
+
+void Ext2HTree::insertEntry(Frame *f,uint32_t hash,uint32_t block) {
+	Ext2DxCountLimit *cl = countLimit(f->entries);
+	size_t count = le16tocpu(cl->count);
+	Ext2DxEntry *pos = f->at + 1;
+	memmove(pos + 1,pos,(f->entries + count - pos) * sizeof(Ext2DxEntry));
+	pos->hash = cputole32(hash);
+	pos->block = cputole32(block);
+	cl->count = cputole16(count + 1);
+}
+
+bool Ext2HTree::validNode(Frame *f,size_t limit) {
+	Ext2DxCountLimit *cl = countLimit(f->entries);
+	size_t count = le16tocpu(cl->count);
+	return le16tocpu(cl->limit) == limit && count >= 1 && count <= limit;
+}
+
+Ext2DxEntry *Ext2HTree::search(Ext2DxEntry *entries,uint32_t hash) {
+	/* find the last entry with a hash <= <hash>. the first one has no hash and covers 0 */
+	Ext2DxEntry *p = entries + 1;
+	Ext2DxEntry *q = entries + le16tocpu(countLimit(entries)->count) - 1;
+	while(p <= q) {
+		Ext2DxEntry *m = p + (q - p) / 2;
+		if(le32tocpu(m->hash) > hash)
+			q = m - 1;
+		else
+			p = m + 1;
+	}
+	return p - 1;
+}
+
+int Ext2HTree::readBlock(Ext2FileSystem *e,Ext2CInode *dir,void *buffer,uint32_t bno) {
+	size_t bs = e->blockSize();
+	if((off_t)bno * bs >= (off_t)le32tocpu(dir->inode.size))
+		return -ENOTSUP;
+	ssize_t res = Ext2File::readIno(e,dir,buffer,(off_t)bno * bs,bs);
+	if(res < 0)
+		return res;
+	return res == (ssize_t)bs ? 0 : -EIO;
+}
+
+int Ext2HTree::writeBlock(Ext2FileSystem *e,Ext2CInode *dir,const void *buffer,uint32_t bno) {
+	size_t bs = e->blockSize();
+	ssize_t res = Ext2File::writeIno(e,dir,buffer,(off_t)bno * bs,bs);
+	if(res < 0)
+		return res;
+	return res == (ssize_t)bs ? 0 : -EIO;
+}
+
+void Ext2HTree::dropIndex(Ext2FileSystem *e,Ext2CInode *dir) {
+	dir->inode.flags = cputole32(le32tocpu(dir->inode.flags) & ~EXT2_INDEX_FL);
+	e->inodeCache.markDirty(dir);
+}
+
+void Ext2HTree::release(Frame *frames) {
+	for(int i = 0; i < MAX_LEVELS; ++i)
+		free(frames[i].block);
+}
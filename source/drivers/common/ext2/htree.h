@@ -0,0 +1,137 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <fs/ext2/ext2.h>
+#include <sys/common.h>
+
+struct Ext2CInode;
+class Ext2FileSystem;
+
+/**
+ * Support for hash-indexed directories (the dir_index feature of ext2/ext3). The first block of
+ * such a directory holds '.', '..' and the root of a tree that maps name-hashes to leaf blocks,
+ * which are ordinary blocks with directory-entries. Index blocks look like a single empty entry
+ * to all code that walks the directory linearly, so that readers without index-support still
+ * work. All functions return -ENOTSUP if the index can't be used, in which case the caller
+ * should fall back to the linear format.
+ */
+class Ext2HTree {
+	Ext2HTree() = delete;
+
+	/* we support the root plus one level of index nodes, as ext3 does */
+	static const int MAX_LEVELS		= 2;
+
+	struct Frame {
+		uint8_t *block;
+		uint32_t bno;
+		fs::Ext2DxEntry *entries;
+		fs::Ext2DxEntry *at;
+	};
+
+	struct Item {
+		uint32_t hash;
+		fs::Ext2DirEntry *entry;
+		size_t size;
+	};
+
+public:
+	/**
+	 * @param e the ext2-fs
+	 * @return true if the filesystem has the dir_index feature enabled
+	 */
+	static bool isEnabled(Ext2FileSystem *e);
+
+	/**
+	 * @param e the ext2-fs
+	 * @param dir the directory
+	 * @return true if <dir> is an indexed directory and we should use the index
+	 */
+	static bool isIndexed(Ext2FileSystem *e,const Ext2CInode *dir);
+
+	/**
+	 * Finds the inode-number to the entry <name> in the indexed directory <dir>
+	 *
+	 * @param e the ext2-fs
+	 * @param dir the directory
+	 * @param name the name of the entry to find
+	 * @param nameLen the length of the name
+	 * @return the inode-number or < 0
+	 */
+	static ino_t find(Ext2FileSystem *e,Ext2CInode *dir,const char *name,size_t nameLen);
+
+	/**
+	 * Adds an entry for <ino> with given name to the indexed directory <dir>. If the index is
+	 * corrupt or full, the index-flag is removed from the directory and -ENOTSUP is returned.
+	 *
+	 * @param e the ext2-fs
+	 * @param dir the directory (requested for writing!)
+	 * @param ino the inode-number
+	 * @param name the name
+	 * @param nameLen the length of the name
+	 * @return 0 on success
+	 */
+	static int add(Ext2FileSystem *e,Ext2CInode *dir,ino_t ino,const char *name,size_t nameLen);
+
+	/**
+	 * Converts the directory <dir>, which consists of the single block <block>, into an indexed
+	 * directory and adds the given entry to it.
+	 *
+	 * @param e the ext2-fs
+	 * @param dir the directory (requested for writing!)
+	 * @param block the content of the first and only block of the directory
+	 * @param ino the inode-number
+	 * @param name the name
+	 * @param nameLen the length of the name
+	 * @return 0 on success
+	 */
+	static int build(Ext2FileSystem *e,Ext2CInode *dir,uint8_t *block,ino_t ino,const char *name,
+		size_t nameLen);
+
+	/**
+	 * Calculates the hash of given name, as used in the index.
+	 *
+	 * @param version the hash-version (EXT2_HASH_*)
+	 * @param seed the seed from the superblock (4 words)
+	 * @param name the name
+	 * @param nameLen the length of the name
+	 * @return the hash (the lowest bit is always 0)
+	 */
+	static uint32_t hash(int version,const uint32_t *seed,const char *name,size_t nameLen);
+
+private:
+	static uint32_t hashOf(Ext2FileSystem *e,int version,const char *name,size_t nameLen);
+	static int probe(Ext2FileSystem *e,Ext2CInode *dir,const char *name,size_t nameLen,
+		uint32_t *hash,int *version,Frame *frames);
+	static int readNode(Ext2FileSystem *e,Ext2CInode *dir,Frame *f,uint32_t bno);
+	static int nextLeaf(Ext2FileSystem *e,Ext2CInode *dir,uint32_t hash,Frame *frames,int levels);
+	static int growIndex(Ext2FileSystem *e,Ext2CInode *dir,Frame *frames,int *levels);
+	static int splitLeaf(Ext2FileSystem *e,Ext2CInode *dir,Frame *parent,int version,uint8_t *leaf,
+		uint32_t *lbno,uint32_t hash);
+	static bool insertInto(uint8_t *block,size_t blockSize,ino_t ino,const char *name,size_t nameLen);
+	static void pack(uint8_t *block,size_t blockSize,Item *items,size_t count);
+	static void insertEntry(Frame *f,uint32_t hash,uint32_t block);
+	static bool validNode(Frame *f,size_t limit);
+	static fs::Ext2DxEntry *search(fs::Ext2DxEntry *entries,uint32_t hash);
+	static int readBlock(Ext2FileSystem *e,Ext2CInode *dir,void *buffer,uint32_t bno);
+	static int writeBlock(Ext2FileSystem *e,Ext2CInode *dir,const void *buffer,uint32_t bno);
+	static void dropIndex(Ext2FileSystem *e,Ext2CInode *dir);
+	static void release(Frame *frames);
+};
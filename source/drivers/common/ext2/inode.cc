@@ -59,6 +59,7 @@ int Ext2INode::create(Ext2FileSystem *e,User *u,Ext2CInode *dirNode,Ext2CInode *
 	cnode->inode.mode = cputole16(mode);
 	cnode->inode.linkCount = cputole16(0);
 	cnode->inode.size = cputole32(0);
+	cnode->inode.flags = cputole32(0);
 	cnode->inode.singlyIBlock = cputole32(0);
 	cnode->inode.doublyIBlock = cputole32(0);
 	cnode->inode.triplyIBlock = cputole32(0);
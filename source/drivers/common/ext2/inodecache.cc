@@ -33,6 +33,9 @@
 #include "inodecache.h"
 #include "rw.h"
 
+/* protects the cache-entries and their reference-counts */
+#define ALLOC_LOCK	0xF7180001
+
 using namespace fs;
 
 Ext2INodeCache::Ext2INodeCache(Ext2FileSystem *fs)
@@ -108,12 +111,11 @@ Ext2CInode *Ext2INodeCache::request(ino_t no,uint mode) {
 		}
 	}
 
-	/* write the old inode back, if necessary */
-	if(inode->dirty && inode->inodeNo != EXT2_BAD_INO) {
-		acquire(inode,IMODE_READ);
+	/* write the old inode back, if necessary. this only copies it into the block-cache, so that we
+	 * can keep the alloc-lock meanwhile. otherwise, somebody could fetch the old inode from the
+	 * block-cache before we've written it back. nobody else uses it, since it has no references */
+	if(inode->dirty && inode->inodeNo != EXT2_BAD_INO)
 		write(inode);
-		doRelease(inode,false);
-	}
 
 	/* build node */
 	inode->inodeNo = no;
@@ -155,10 +157,23 @@ void Ext2INodeCache::print(FILE *f) {
 	fprintf(f,"\t\tHitrate: %.3f%%\n",hitrate);
 }
 
-void Ext2INodeCache::acquire(Ext2CInode *inode,A_UNUSED uint mode) {
+void Ext2INodeCache::pin(Ext2CInode *inode) {
+	sassert(tpool_lock(ALLOC_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
+	inode->refs++;
+	sassert(tpool_unlock(ALLOC_LOCK) == 0);
+}
+
+void Ext2INodeCache::unpin(Ext2CInode *inode) {
+	sassert(tpool_lock(ALLOC_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
+	assert(inode->refs > 1);
+	inode->refs--;
+	sassert(tpool_unlock(ALLOC_LOCK) == 0);
+}
+
+void Ext2INodeCache::acquire(Ext2CInode *inode,uint mode) {
 	inode->refs++;
 	sassert(tpool_unlock(ALLOC_LOCK) == 0);
-	sassert(tpool_lock((uint)inode,(mode & IMODE_WRITE) ? LOCK_EXCLUSIVE : 0) == 0);
+	sassert(tpool_lock((ulong)inode,(mode & IMODE_WRITE) ? LOCK_EXCLUSIVE : 0) == 0);
 }
 
 void Ext2INodeCache::doRelease(Ext2CInode *ino,bool unlockAlloc) {
@@ -179,7 +194,7 @@ void Ext2INodeCache::doRelease(Ext2CInode *ino,bool unlockAlloc) {
 	}
 	if(unlockAlloc)
 		sassert(tpool_unlock(ALLOC_LOCK) == 0);
-	sassert(tpool_unlock((uint)ino) == 0);
+	sassert(tpool_unlock((ulong)ino) == 0);
 }
 
 void Ext2INodeCache::read(Ext2CInode *inode) {
@@ -83,6 +83,21 @@ public:
 		doRelease((Ext2CInode*)inode,true);
 	}
 
+	/**
+	 * Adds a reference to the given inode, which has to be requested already. This keeps it in the
+	 * cache until unpin() is called.
+	 *
+	 * @param inode the inode
+	 */
+	void pin(Ext2CInode *inode);
+
+	/**
+	 * Removes a reference that has been added by pin(). The inode has to be requested.
+	 *
+	 * @param inode the inode
+	 */
+	void unpin(Ext2CInode *inode);
+
 	/**
 	 * Prints statistics and information about the inode-cache into the givne file
 	 *
@@ -27,6 +27,7 @@
 #include "dir.h"
 #include "ext2.h"
 #include "file.h"
+#include "htree.h"
 #include "inodecache.h"
 #include "link.h"
 
@@ -45,10 +46,21 @@ int Ext2Link::create(Ext2FileSystem *e,User *u,Ext2CInode *dir,Ext2CInode *cnode
 	if((res = e->hasPermission(dir,u,MODE_WRITE)) < 0)
 		return res;
 
+	/* indexed directories only need to touch one leaf. if the index can't take the entry, it is
+	 * dropped and we continue with the linear format */
+	if(Ext2HTree::isIndexed(e,dir)) {
+		res = Ext2HTree::add(e,dir,cnode->inodeNo,name,len);
+		if(res < 0 && res != -ENOTSUP)
+			return res;
+		if(res == 0)
+			goto linked;
+		dirSize = le32tocpu(dir->inode.size);
+	}
+
 	/* TODO we don't have to read the whole directory at once */
 
-	/* read directory-entries */
-	buf = static_cast<uint8_t*>(malloc(dirSize + tlen));
+	/* read directory-entries (with room for a new block) */
+	buf = static_cast<uint8_t*>(malloc(dirSize + e->blockSize()));
 	if(buf == NULL)
 		return -ENOMEM;
 	if((res = Ext2File::readIno(e,dir,buf,0,dirSize)) != dirSize) {
@@ -79,8 +91,20 @@ int Ext2Link::create(Ext2FileSystem *e,User *u,Ext2CInode *dir,Ext2CInode *cnode
 	}
 	/* nothing found yet? so store it on the next block */
 	if(recLen == 0) {
+		/* if the directory grows beyond one block, switch to an index */
+		if(dirSize == (int32_t)e->blockSize() && Ext2HTree::isEnabled(e)) {
+			res = Ext2HTree::build(e,dir,buf,cnode->inodeNo,name,len);
+			if(res != -ENOTSUP) {
+				free(buf);
+				if(res < 0)
+					return res;
+				goto linked;
+			}
+		}
+
 		dire = (Ext2DirEntry*)(buf + dirSize);
 		recLen = e->blockSize();
+		memset(dire,0,recLen);
 		dirSize += recLen;
 	}
 
@@ -97,6 +121,9 @@ int Ext2Link::create(Ext2FileSystem *e,User *u,Ext2CInode *dir,Ext2CInode *cnode
 	}
 	free(buf);
 
+linked:
+	e->dirCache.insert(dir->inodeNo,name,len,cnode->inodeNo);
+
 	/* increase link-count */
 	cnode->inode.linkCount = cputole16(le16tocpu(cnode->inode.linkCount) + 1);
 	e->inodeCache.markDirty(cnode);
@@ -131,7 +158,8 @@ int Ext2Link::remove(Ext2FileSystem *e,User *u,Ext2CInode *pdir,Ext2CInode *dir,
 	prev = NULL;
 	dire = (Ext2DirEntry*)buf;
 	while((uint8_t*)dire < buf + dirSize) {
-		if(nameLen == le16tocpu(dire->nameLen) && strncmp(dire->name,name,nameLen) == 0) {
+		if(le32tocpu(dire->inode) != 0 && nameLen == le16tocpu(dire->nameLen) &&
+				strncmp(dire->name,name,nameLen) == 0) {
 			ino = le32tocpu(dire->inode);
 			if(pdir && ino == pdir->inodeNo)
 				cnode = pdir;
@@ -154,6 +182,8 @@ int Ext2Link::remove(Ext2FileSystem *e,User *u,Ext2CInode *pdir,Ext2CInode *dir,
 
 			/* check permissions (sticky bit) */
 			if((res = e->canRemove(dir,cnode,u)) < 0) {
+				if(cnode != pdir && cnode != dir)
+					e->inodeCache.release(cnode);
 				free(buf);
 				return res;
 			}
@@ -167,9 +197,11 @@ int Ext2Link::remove(Ext2FileSystem *e,User *u,Ext2CInode *pdir,Ext2CInode *dir,
 			break;
 		}
 
-		/* to next */
+		/* to next; entries can only be merged within a block */
 		prev = dire;
 		dire = (Ext2DirEntry*)((uintptr_t)dire + le16tocpu(dire->recLen));
+		if(((uint8_t*)dire - buf) % e->blockSize() == 0)
+			prev = NULL;
 	}
 
 	/* no match? */
@@ -186,6 +218,7 @@ int Ext2Link::remove(Ext2FileSystem *e,User *u,Ext2CInode *pdir,Ext2CInode *dir,
 		return res;
 	}
 	free(buf);
+	e->dirCache.insert(dir->inodeNo,name,nameLen,-ENOENT);
 
 	/* update inode */
 	if(cnode != NULL) {
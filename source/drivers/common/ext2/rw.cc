@@ -22,39 +22,52 @@
 #include <sys/io.h>
 #include <sys/messages.h>
 #include <sys/thread.h>
+#include <assert.h>
 #include <stdio.h>
 
 #include "ext2.h"
 #include "rw.h"
 
 int Ext2RW::readSectors(Ext2FileSystem *e,void *buffer,uint64_t lba,size_t secCount) {
+	ssize_t res;
+	sassert(tpool_lock(EXT2_DISK_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
 	off_t off = seek(e->fd,lba * DISK_SECTOR_SIZE,SEEK_SET);
 	if(off < 0) {
 		printe("Unable to seek to %x",lba * DISK_SECTOR_SIZE);
-		return off;
+		res = off;
+		goto done;
 	}
 
-	ssize_t res = IGNSIGS(read(e->fd,buffer,secCount * DISK_SECTOR_SIZE));
+	res = IGNSIGS(read(e->fd,buffer,secCount * DISK_SECTOR_SIZE));
 	if(res != (ssize_t)(secCount * DISK_SECTOR_SIZE)) {
 		printe("Unable to read %d sectors @ %x",secCount,lba * DISK_SECTOR_SIZE);
-		return res;
+		goto done;
 	}
+	res = 0;
 
-	return 0;
+done:
+	sassert(tpool_unlock(EXT2_DISK_LOCK) == 0);
+	return res;
 }
 
 int Ext2RW::writeSectors(Ext2FileSystem *e,const void *buffer,uint64_t lba,size_t secCount) {
+	ssize_t res;
+	sassert(tpool_lock(EXT2_DISK_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
 	off_t off = seek(e->fd,lba * DISK_SECTOR_SIZE,SEEK_SET);
 	if(off < 0) {
 		printe("Unable to seek to %x",lba * DISK_SECTOR_SIZE);
-		return off;
+		res = off;
+		goto done;
 	}
 
-	ssize_t res = write(e->fd,buffer,secCount * DISK_SECTOR_SIZE);
+	res = write(e->fd,buffer,secCount * DISK_SECTOR_SIZE);
 	if(res != (ssize_t)(secCount * DISK_SECTOR_SIZE)) {
 		printe("Unable to write %d sectors @ %x",secCount,lba * DISK_SECTOR_SIZE);
-		return res;
+		goto done;
 	}
+	res = 0;
 
-	return 0;
+done:
+	sassert(tpool_unlock(EXT2_DISK_LOCK) == 0);
+	return res;
 }
@@ -77,7 +77,7 @@ int main(int argc,char *argv[]) {
 			error("Unable to find cd-device with /boot/escape on it");
 	}
 
-	fs::FSDevice<fs::OpenFile> fsdev(fs,argv[1]);
+	fs::FSDevice<fs::OpenFile> fsdev(fs,argv[1],DEV_PAGECACHE);
 	fsdev.loop();
 	return 0;
 }
@@ -20,12 +20,24 @@
 #include <esc/ipc/nicdevice.h>
 #include <esc/proto/nic.h>
 #include <sys/common.h>
+#include <sys/thread.h>
+#include <sys/time.h>
+#include <list>
+#include <mutex>
 #include <stdio.h>
 #include <stdlib.h>
 
 class LoDriver : public esc::NICDriver {
 public:
-	explicit LoDriver() : esc::NICDriver(), handler() {
+	/**
+	 * Creates a loopback device that drops <loss> percent of the packets and delivers the others
+	 * after <delay> milliseconds, which is useful to test how the protocols above deal with packet
+	 * loss and long round-trip times.
+	 */
+	explicit LoDriver(int loss,int delay)
+		: esc::NICDriver(), handler(), _loss(loss), _delay(delay), _delayMutex(), _delayed() {
+		if(_delay > 0 && startthread(delayThread,this) < 0)
+			error("Unable to start delay thread");
 	}
 
 	virtual esc::NIC::MAC mac() const {
@@ -35,22 +47,72 @@ public:
 		return 64 * 1024;
 	}
 	virtual ssize_t send(const void *packet,size_t size) {
+		if(_loss > 0 && rand() % 100 < _loss)
+			return size;
+
 		Packet *pkt = (Packet*)malloc(sizeof(Packet) + size);
+		if(!pkt)
+			return -ENOMEM;
 		pkt->length = size;
 		memcpy(pkt->data,packet,size);
+		if(_delay > 0) {
+			// the delay is constant, so that the list stays sorted
+			std::lock_guard<std::mutex> guard(_delayMutex);
+			_delayed.push_back(Delayed(tsctotime(rdtsc()) + _delay * 1000,pkt));
+			return size;
+		}
+
 		insert(pkt);
 		(*handler)();
 		return size;
 	}
 
 	std::Functor<void> *handler;
+
+private:
+	struct Delayed {
+		explicit Delayed(uint64_t _due,Packet *_pkt) : due(_due), pkt(_pkt) {
+		}
+
+		uint64_t due;
+		Packet *pkt;
+	};
+
+	static int delayThread(void *arg) {
+		LoDriver *lo = reinterpret_cast<LoDriver*>(arg);
+		while(1) {
+			usleep(1000);
+
+			bool received = false;
+			{
+				std::lock_guard<std::mutex> guard(lo->_delayMutex);
+				uint64_t now = tsctotime(rdtsc());
+				while(lo->_delayed.size() > 0 && lo->_delayed.front().due <= now) {
+					lo->insert(lo->_delayed.front().pkt);
+					lo->_delayed.pop_front();
+					received = true;
+				}
+			}
+			if(received)
+				(*lo->handler)();
+		}
+		return 0;
+	}
+
+	int _loss;
+	int _delay;
+	std::mutex _delayMutex;
+	std::list<Delayed> _delayed;
 };
 
 int main(int argc,char **argv) {
 	if(argc != 2)
 		error("Usage: %s <device>\n",argv[0]);
 
-	LoDriver *lo = new LoDriver();
+	/* the loss rate in percent and the delay in milliseconds can be set via environment variables */
+	const char *loss = getenv("LOLOSS");
+	const char *delay = getenv("LODELAY");
+	LoDriver *lo = new LoDriver(loss ? atoi(loss) : 0,delay ? atoi(delay) : 0);
 	esc::NICDevice dev(argv[1],0700,lo);
 	lo->handler = std::make_memfun(&dev,&esc::NICDevice::checkPending);
 	dev.loop();
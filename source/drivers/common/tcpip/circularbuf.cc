@@ -33,8 +33,11 @@ ssize_t CircularBuf::push(seq_type seqNo,uint8_t type,const void *data,size_t si
 	if(_current == _max)
 		return -EINVAL;
 
-	// normalize numbers so that the window starts at 0
+	// normalize numbers so that the window starts at 0. the data might have been pulled already
+	// before it has been ACKed
 	seq_type winStart = _seqAcked - _seqStart;
+	if(winStart > _current)
+		winStart = 0;
 	seq_type winEnd = _max;
 	seq_type relStart = seqNo - _seqStart;
 	seq_type relEnd = seqNo + (seq_type)seqadd - _seqStart;
@@ -43,78 +46,116 @@ ssize_t CircularBuf::push(seq_type seqNo,uint8_t type,const void *data,size_t si
 		(relEnd < winStart || (relEnd > winEnd || relEnd == 0)))
 		return -EINVAL;
 
-	// adjust the received data accordingly
+	// adjust the received data accordingly. note that relStart >= winEnd means that it starts in
+	// front of _seqStart
 	const uint8_t *begin = reinterpret_cast<const uint8_t*>(data);
-	if(relStart < winStart) {
-		size_t diff = winStart - relStart;
+	if(relStart < winStart || relStart >= winEnd) {
+		seq_type diff = winStart - relStart;
 		begin += diff;
 		seqNo += diff;
-		seqadd -= diff;
 		relStart = winStart;
 	}
-	else if(relStart >= winEnd) {
-		begin -= (int32_t)relStart;
-		seqNo -= (int32_t)relStart;
-		seqadd += (int32_t)relStart;
-		relStart = 0;
+	if(relEnd > winEnd)
+		relEnd = winEnd;
+	if(relEnd <= relStart)
+		return 0;
+	// now we know that seqNo and [begin,begin+size] fits into our window
+
+	if(type == TYPE_CTRL) {
+		size_t added = mark(relStart,relEnd);
+		if(added) {
+			// it's at _seqAcked and doesn't overlap with existing data, i.e. it's the last one
+			_ctrls.push_back(SeqPacket(seqNo,begin,size));
+		}
+		return added;
 	}
 
-	if(relEnd > winEnd) {
-		seqadd -= relEnd - winEnd;
-		relEnd = winEnd;
+	// just overwrite the data we might already have; it's the same
+	reserve(relEnd);
+	copyIn(seqNo,begin,relEnd - relStart);
+	size_t added = mark(relStart,relEnd);
+	_curData += added;
+	return added;
+}
+
+size_t CircularBuf::mark(seq_type relStart,seq_type relEnd) {
+	// determine the number of new bytes
+	seq_type relCont = _seqEnd - _seqStart;
+	size_t added = relEnd - relStart;
+	if(relStart < relCont)
+		added -= std::min(relEnd,relCont) - relStart;
+	for(auto it = _ooo.begin(); it != _ooo.end(); ++it) {
+		seq_type rs = it->start - _seqStart;
+		seq_type re = it->end - _seqStart;
+		if(rs < relEnd && re > relStart)
+			added -= std::min(re,relEnd) - std::max(rs,relStart);
 	}
-	// now we know that seqNo and [begin,begin+size] fits into our window
 
-	// find the position in the list
-	size_t oldcur = _current;
-	if(_packets.size() == 0)
-		add(_packets.end(),seqNo,type,begin,size,seqadd);
+	if(relStart <= relCont) {
+		// extend the contiguous part and take over the out-of-order ranges we've reached
+		relCont = std::max(relCont,relEnd);
+		auto it = _ooo.begin();
+		for(; it != _ooo.end() && (seq_type)(it->start - _seqStart) <= relCont; ++it)
+			relCont = std::max(relCont,(seq_type)(it->end - _seqStart));
+		_ooo.erase(_ooo.begin(),it);
+		_seqEnd = _seqStart + relCont;
+	}
 	else {
-		for(auto it = _packets.begin(); seqadd > 0 && it != _packets.end(); ++it) {
-			seq_type relSeq = it->start - _seqStart;
-			// skip packet if it is already acked, but not yet pulled data
-			// this might have a start before _seqStart if we already pulled some of that data
-			if(relSeq >= _max)
-				continue;
+		// insert it sorted and merge it with overlapping or adjacent ranges
+		auto it = _ooo.begin();
+		for(; it != _ooo.end() && (seq_type)(it->end - _seqStart) < relStart; ++it)
+			;
+		while(it != _ooo.end() && (seq_type)(it->start - _seqStart) <= relEnd) {
+			relStart = std::min(relStart,(seq_type)(it->start - _seqStart));
+			relEnd = std::max(relEnd,(seq_type)(it->end - _seqStart));
+			it = _ooo.erase(it);
+		}
+		_ooo.insert(it,Range(_seqStart + relStart,_seqStart + relEnd));
+	}
 
-			// is there something missing?
-			if(relStart < relSeq) {
-				size_t amount = std::min(seqadd,static_cast<size_t>(relSeq - relStart));
-				add(it,seqNo,type,begin,size,amount);
-				relStart += amount;
-				seqNo += amount;
-				begin += amount;
-				seqadd -= amount;
-			}
+	_current += added;
+	return added;
+}
 
-			// duplicate data?
-			if(relStart < relSeq + it->size()) {
-				// we're done
-				if(relEnd <= relSeq + it->size())
-					seqadd = 0;
-				else {
-					// skip this part
-					size_t diff = relSeq + it->size() - relStart;
-					relStart += diff;
-					seqNo += diff;
-					begin += diff;
-					seqadd -= diff;
-				}
-			}
+void CircularBuf::reserve(size_t size) {
+	if(size <= _ringSize)
+		return;
+
+	size_t nsize = _ringSize ? _ringSize : MIN_RING_SIZE;
+	while(nsize < size)
+		nsize *= 2;
+	uint8_t *nring = new uint8_t[nsize];
+
+	// move everything from _seqStart to the end of the last range to the same sequence numbers
+	if(_ring) {
+		seq_type seqNo = _seqStart;
+		size_t total = (_ooo.size() > 0 ? _ooo.back().end : _seqEnd) - _seqStart;
+		while(total > 0) {
+			size_t oldOff = seqNo & (_ringSize - 1);
+			size_t newOff = seqNo & (nsize - 1);
+			size_t amount = std::min(total,std::min(_ringSize - oldOff,nsize - newOff));
+			memcpy(nring + newOff,_ring + oldOff,amount);
+			seqNo += amount;
+			total -= amount;
 		}
-		// something left to insert?
-		if(seqadd > 0)
-			add(_packets.end(),seqNo,type,begin,size,seqadd);
+		delete[] _ring;
 	}
-	return _current - oldcur;
+	_ring = nring;
+	_ringSize = nsize;
 }
 
-void CircularBuf::add(std::list<SeqPacket>::iterator it,seq_type seqNo,uint8_t type,
-		const uint8_t *data,size_t size,size_t dataSize) {
-	_packets.insert(it,SeqPacket(seqNo,type,data,type == TYPE_CTRL ? size : dataSize));
-	_current += dataSize;
-	if(type == TYPE_DATA)
-		_curData += dataSize;
+void CircularBuf::copyIn(seq_type seqNo,const uint8_t *data,size_t size) {
+	size_t off = seqNo & (_ringSize - 1);
+	size_t first = std::min(size,_ringSize - off);
+	memcpy(_ring + off,data,first);
+	memcpy(_ring,data + first,size - first);
+}
+
+void CircularBuf::copyOut(seq_type seqNo,uint8_t *buf,size_t size) const {
+	size_t off = seqNo & (_ringSize - 1);
+	size_t first = std::min(size,_ringSize - off);
+	memcpy(buf,_ring + off,first);
+	memcpy(buf + first,_ring,size - first);
 }
 
 int CircularBuf::forget(seq_type seqNo) {
@@ -124,61 +165,102 @@ int CircularBuf::forget(seq_type seqNo) {
 
 	_seqAcked = seqNo;
 	pull(NULL,relSeq);
+
+	// the SACKed ranges in front of the ACK position are irrelevant now
+	while(_sacked.size() > 0) {
+		Range &r = _sacked.front();
+		if((seq_type)(r.end - _seqAcked) <= _current && r.end != _seqAcked) {
+			if((seq_type)(r.start - _seqAcked) > _current)
+				r.start = _seqAcked;
+			break;
+		}
+		_sacked.pop_front();
+	}
 	return 0;
 }
 
-CircularBuf::seq_type CircularBuf::getAck() {
-	// search for the first not acked packet
-	auto it = _packets.begin();
-	for(; it != _packets.end() && it->start != _seqAcked; ++it)
+size_t CircularBuf::getSackBlocks(Range *blocks,size_t max) const {
+	size_t count = std::min(max,_ooo.size());
+	std::copy(_ooo.begin(),_ooo.begin() + count,blocks);
+	return count;
+}
+
+void CircularBuf::sack(seq_type start,seq_type end) {
+	// ignore everything that is not in the sent, but not yet ACKed area
+	seq_type relStart = start - _seqAcked;
+	seq_type relEnd = end - _seqAcked;
+	if(relStart == 0 || relStart >= relEnd || relEnd > _current)
+		return;
+
+	// insert it sorted and merge it with overlapping or adjacent ranges
+	auto it = _sacked.begin();
+	for(; it != _sacked.end() && (seq_type)(it->end - _seqAcked) < relStart; ++it)
 		;
+	while(it != _sacked.end() && (seq_type)(it->start - _seqAcked) <= relEnd) {
+		if((seq_type)(it->start - _seqAcked) < relStart)
+			start = it->start, relStart = it->start - _seqAcked;
+		if((seq_type)(it->end - _seqAcked) > relEnd)
+			end = it->end, relEnd = it->end - _seqAcked;
+		it = _sacked.erase(it);
+	}
+	_sacked.insert(it,Range(start,end));
+}
 
-	// search for the next hole
-	seq_type last = _seqAcked;
-	for(; it != _packets.end(); ++it) {
-		// is there still something missing?
-		if(it->start != last)
+CircularBuf::seq_type CircularBuf::skipSacked(seq_type seqNo) const {
+	seq_type rel = seqNo - _seqAcked;
+	for(auto it = _sacked.begin(); it != _sacked.end(); ++it) {
+		seq_type relStart = it->start - _seqAcked;
+		if(rel < relStart)
 			break;
-		last += it->size();
+		if(rel < (seq_type)(it->end - _seqAcked))
+			return it->end;
 	}
-	_seqAcked = last;
-	return last;
+	return seqNo;
 }
 
-size_t CircularBuf::getOffset(const SeqPacket &pkt,seq_type seqNo) {
-	size_t offset = 0;
-	if(pkt.start != seqNo) {
-		if(pkt.start < seqNo)
-			offset = seqNo - pkt.start;
-		else
-			offset = (std::numeric_limits<seq_type>::max() - pkt.start) + seqNo + 1;
+size_t CircularBuf::holeSize(seq_type seqNo) const {
+	seq_type rel = seqNo - _seqAcked;
+	for(auto it = _sacked.begin(); it != _sacked.end(); ++it) {
+		seq_type relStart = it->start - _seqAcked;
+		if(rel < relStart)
+			return relStart - rel;
 	}
-	return offset;
+	return std::numeric_limits<size_t>::max();
 }
 
-size_t CircularBuf::get(seq_type seqNo,void *buf,size_t size) {
-	// search for the first not acked packet
-	auto it = _packets.begin();
-	for(; it != _packets.end() && it->start != _seqAcked; ++it)
-		;
+CircularBuf::seq_type CircularBuf::getAck() {
+	// everything up to the next hole can be ACKed
+	_seqAcked = _seqEnd;
+	return _seqAcked;
+}
 
+size_t CircularBuf::get(seq_type seqNo,void *buf,size_t size) {
 	uint8_t *pos = reinterpret_cast<uint8_t*>(buf);
 	seq_type relSeq = seqNo - _seqStart;
+	seq_type relEnd = _seqEnd - _seqStart;
 	size_t orgsize = size;
-	for(; size > 0 && it != _packets.end(); ++it) {
-		// skip packets that are in front of what we're looking for
-		seq_type relPktNo = it->start - _seqStart;
-		if(relPktNo + it->size() <= relSeq)
-			continue;
-
-		size_t offset = getOffset(*it,seqNo);
-		size_t amount = std::min(size,it->size() - offset);
+	// only the contiguous part can be read
+	auto ctrl = _ctrls.begin();
+	while(size > 0 && relSeq < relEnd) {
+		size_t amount = std::min<size_t>(size,relEnd - relSeq);
+
 		// skip control packets
-		if(it->type == TYPE_DATA) {
-			memcpy(pos,it->data + offset,amount);
-			pos += amount;
-			size -= amount;
+		for(; ctrl != _ctrls.end() && (seq_type)(ctrl->start - _seqStart) < relSeq; ++ctrl)
+			;
+		if(ctrl != _ctrls.end()) {
+			seq_type relCtrl = ctrl->start - _seqStart;
+			if(relCtrl == relSeq) {
+				relSeq++;
+				seqNo++;
+				continue;
+			}
+			amount = std::min<size_t>(amount,relCtrl - relSeq);
 		}
+
+		copyOut(seqNo,pos,amount);
+		pos += amount;
+		size -= amount;
+		relSeq += amount;
 		seqNo += amount;
 	}
 	return orgsize - size;
@@ -187,75 +269,75 @@ size_t CircularBuf::get(seq_type seqNo,void *buf,size_t size) {
 size_t CircularBuf::pull(void *buf,size_t size) {
 	size_t oldsize = size;
 	uint8_t *pos = reinterpret_cast<uint8_t*>(buf);
-	while(size > 0 && _packets.size() > 0) {
-		SeqPacket &pkt = _packets.front();
-		seq_type relAcked = _seqAcked - _seqStart;
-		seq_type relStart = pkt.start - _seqStart;
-		seq_type offset = getOffset(pkt,_seqStart);
-		if(relStart + offset >= relAcked)
-			break;
+	while(size > 0 && _seqStart != _seqEnd) {
+		size_t amount = std::min<size_t>(size,_seqEnd - _seqStart);
 
-		size_t pktsize = pkt.size();
-		size_t amount = std::min(size,pktsize - offset);
 		// skip control packets when we want to pull data
-		if(pos && pkt.type == TYPE_DATA) {
-			memcpy(pos,pkt.data + offset,amount);
+		if(_ctrls.size() > 0) {
+			seq_type relCtrl = _ctrls.front().start - _seqStart;
+			if(relCtrl == 0) {
+				if(!pos)
+					size--;
+				_seqStart++;
+				_current--;
+				_ctrls.pop_front();
+				continue;
+			}
+			amount = std::min<size_t>(amount,relCtrl);
+		}
+
+		if(pos) {
+			copyOut(_seqStart,pos,amount);
 			pos += amount;
-			size -= amount;
 		}
-		else if(!pos)
-			size -= amount;
+		size -= amount;
 		_seqStart += amount;
-		if(amount != pktsize - offset)
-			break;
-
-		_current -= pktsize;
-		if(pkt.type == TYPE_DATA)
-			_curData -= pktsize;
-		_packets.pop_front();
+		_current -= amount;
+		_curData -= amount;
 	}
 	return oldsize - size;
 }
 
 size_t CircularBuf::pullctrl(void *buf,size_t size,seq_type *seqNo) {
-	if(_packets.size() > 0) {
-		SeqPacket &pkt = _packets.front();
-		assert(pkt.type == TYPE_CTRL);
-
+	if(_ctrls.size() > 0 && _ctrls.front().start == _seqStart) {
+		SeqPacket &pkt = _ctrls.front();
 		size_t amount = std::min(pkt._size,size);
 		memcpy(buf,pkt.data,amount);
-		_seqStart += pkt.size();
-		_current -= pkt.size();
+		if(_seqAcked == _seqStart)
+			_seqAcked++;
+		_seqStart++;
+		_current--;
 		*seqNo = pkt.start;
-		_packets.pop_front();
+		_ctrls.pop_front();
 		return amount;
 	}
 	return false;
 }
 
 void CircularBuf::print(esc::OStream &os,bool data) {
-	os << "CircularBuffer[start=" << _seqStart << ", ack=" << _seqAcked
-	   << ", cur=" << _current << ", curdata=" << _curData << ", max=" << _max << "]\n";
-	for(auto it = _packets.begin(); it != _packets.end(); ++it) {
-		os << "[" << it->start << " .. " << (it->start + it->size()) << ":" << it->size();
-		os << "b:" << it->type << "]";
-		if(data) {
-			for(size_t i = 0; i < it->_size; ++i) {
-				if(i % 16 == 0)
-					os << "\n ";
-				os << esc::fmt(it->data[i],"0x",2) << ' ';
-			}
+	os << "CircularBuffer[start=" << _seqStart << ", ack=" << _seqAcked << ", end=" << _seqEnd
+	   << ", cur=" << _current << ", curdata=" << _curData << ", max=" << _max
+	   << ", ring=" << _ringSize << "]\n";
+	for(auto it = _ctrls.begin(); it != _ctrls.end(); ++it)
+		os << "[ctrl " << it->start << ":" << it->_size << "b]\n";
+	for(auto it = _ooo.begin(); it != _ooo.end(); ++it)
+		os << "[" << it->start << " .. " << it->end << ":" << (it->end - it->start) << "b]\n";
+	if(data) {
+		size_t total = (_ooo.size() > 0 ? _ooo.back().end : _seqEnd) - _seqStart;
+		for(size_t i = 0; i < total; ++i) {
+			if(i % 16 == 0)
+				os << "\n ";
+			os << esc::fmt(_ring[(_seqStart + i) & (_ringSize - 1)],"0x",2) << ' ';
 		}
 		os << "\n";
 	}
 }
 
-static void test_assertSequence(const CircularBuf &cb) {
-	size_t i = 0;
-	for(auto it = cb.packets().begin(); it != cb.packets().end(); ++it) {
-		for(size_t start = i, end = i + it->size(); i < end; ++i)
-			test_assertInt(it->data[i - start],i);
-	}
+static void test_assertSequence(CircularBuf &cb,CircularBuf::seq_type start,size_t count) {
+	uint8_t buf[128];
+	test_assertSize(cb.get(start,buf,count),count);
+	for(size_t i = 0; i < count; ++i)
+		test_assertInt(buf[i],i);
 }
 
 void CircularBuf::unittest() {
@@ -272,37 +354,37 @@ void CircularBuf::unittest() {
 		buf.push(4,TYPE_DATA,data + 4,8);
 		buf.push(12,TYPE_DATA,data + 12,4);
 
-		test_assertSequence(buf);
+		test_assertSequence(buf,0,16);
 
 		// overlap of a complete packet
 		test_assertSSize(buf.push(0,TYPE_DATA,data,4),0);
-		test_assertSequence(buf);
+		test_assertSequence(buf,0,16);
 
 		test_assertSSize(buf.push(4,TYPE_DATA,data + 4,8),0);
-		test_assertSequence(buf);
+		test_assertSequence(buf,0,16);
 
 		// overlap at the end
 		test_assertSSize(buf.push(6,TYPE_DATA,data + 6,6),0);
-		test_assertSequence(buf);
+		test_assertSequence(buf,0,16);
 
 		// overlap at the beginning
 		test_assertSSize(buf.push(4,TYPE_DATA,data + 4,4),0);
-		test_assertSequence(buf);
+		test_assertSequence(buf,0,16);
 
 		// overlap in the middle
 		test_assertSSize(buf.push(2,TYPE_DATA,data + 2,4),0);
-		test_assertSequence(buf);
+		test_assertSequence(buf,0,16);
 
 		// overlap of multiple packets
 		test_assertSSize(buf.push(2,TYPE_DATA,data + 2,12),0);
-		test_assertSequence(buf);
+		test_assertSequence(buf,0,16);
 
 		// out of window
 		test_assertSSize(buf.push(1024,TYPE_DATA,data,1),-EINVAL);
 		test_assertSSize(buf.push(1026,TYPE_DATA,data,4),-EINVAL);
 		test_assertSSize(buf.push(-4,TYPE_DATA,data,2),-EINVAL);
 		test_assertSSize(buf.push(-4,TYPE_DATA,data,4),-EINVAL);
-		test_assertSequence(buf);
+		test_assertSequence(buf,0,16);
 
 		fflush(stdout);
 	}
@@ -338,7 +420,7 @@ void CircularBuf::unittest() {
 		// complete overlap
 		test_assertSSize(buf.push(0,TYPE_DATA,data + 0,32),0);
 
-		test_assertSequence(buf);
+		test_assertSequence(buf,0,32);
 
 		fflush(stdout);
 	}
@@ -425,6 +507,29 @@ void CircularBuf::unittest() {
 		fflush(stdout);
 	}
 
+	// pull before the ACK (delayed ACKs)
+	{
+		CircularBuf buf;
+		buf.init(0,16);
+		memset(testdata,0,sizeof(testdata));
+
+		test_assertSSize(buf.push(0,TYPE_DATA,data + 0,4),4);
+		test_assertSSize(buf.pull(testdata,16),4);
+		test_assertInt(buf.nextExp(),0);
+
+		// a retransmission of the pulled data is outside of the window
+		test_assertSSize(buf.push(0,TYPE_DATA,data + 0,4),-EINVAL);
+		test_assertSSize(buf.push(2,TYPE_DATA,data + 2,4),2);
+		test_assertSSize(buf.push(6,TYPE_DATA,data + 6,2),2);
+		test_assertInt(buf.getAck(),8);
+		test_assertSSize(buf.pull(testdata + 4,16),4);
+
+		for(size_t i = 0; i < 8; ++i)
+			test_assertInt(testdata[i],i);
+
+		fflush(stdout);
+	}
+
 	// window full
 	{
 		CircularBuf buf;
@@ -436,9 +541,135 @@ void CircularBuf::unittest() {
 		// pull not the entire packet
 		test_assertSSize(buf.pull(testdata,4),4);
 
-		// now our window is still full, but _seqAcked - _seqStart is less than 16
-		test_assertSSize(buf.push(116,TYPE_DATA,data,1),-EINVAL);
-		test_assertSSize(buf.push(116,TYPE_DATA,data,12),-EINVAL);
+		// the pulled bytes are free again
+		test_assertSSize(buf.push(116,TYPE_DATA,data,1),1);
+		test_assertSSize(buf.push(117,TYPE_DATA,data,12),3);
+		test_assertSSize(buf.push(120,TYPE_DATA,data,1),-EINVAL);
+
+		fflush(stdout);
+	}
+
+	// control packets
+	{
+		CircularBuf buf;
+		CircularBuf::seq_type seqNo;
+		buf.init(10,16);
+		memset(testdata,0,sizeof(testdata));
+
+		test_assertSSize(buf.push(11,TYPE_CTRL,NULL,0),-EINVAL);
+		test_assertSSize(buf.push(10,TYPE_CTRL,data,4),1);
+		test_assertSSize(buf.push(11,TYPE_DATA,data,8),8);
+		test_assertSize(buf.available(),8);
+
+		// get skips the control packet
+		test_assertSize(buf.get(10,testdata,16),8);
+		for(size_t i = 0; i < 8; ++i)
+			test_assertInt(testdata[i],i);
+
+		test_assertSize(buf.pullctrl(testdata,sizeof(testdata),&seqNo),4);
+		test_assertInt(seqNo,10);
+		for(size_t i = 0; i < 4; ++i)
+			test_assertInt(testdata[i],i);
+		test_assertSize(buf.pullctrl(testdata,sizeof(testdata),&seqNo),0);
+
+		// a FIN behind the data
+		test_assertInt(buf.getAck(),19);
+		test_assertSSize(buf.push(19,TYPE_CTRL,NULL,0),1);
+		test_assertInt(buf.getAck(),20);
+		test_assertSize(buf.pull(testdata,16),8);
+		test_assertSize(buf.available(),0);
+		test_assertSize(buf.windowSize(),16);
+
+		fflush(stdout);
+	}
+
+	// wrap around and growth of the ring
+	{
+		CircularBuf buf;
+		CircularBuf::seq_type start = -static_cast<CircularBuf::seq_type>(MIN_RING_SIZE / 2);
+		size_t total = MIN_RING_SIZE * 4;
+		buf.init(start,total);
+
+		// leave a hole at the beginning to grow the ring with out-of-order data
+		for(size_t off = ARRAY_SIZE(data); off < total; off += ARRAY_SIZE(data))
+			test_assertSSize(buf.push(start + off,TYPE_DATA,data,ARRAY_SIZE(data)),ARRAY_SIZE(data));
+		test_assertInt(buf.getAck(),start);
+		test_assertSSize(buf.push(start,TYPE_DATA,data,ARRAY_SIZE(data)),ARRAY_SIZE(data));
+		test_assertInt(buf.getAck(),start + total);
+
+		for(size_t off = 0; off < total; off += ARRAY_SIZE(data)) {
+			memset(testdata,0,sizeof(testdata));
+			test_assertSize(buf.pull(testdata,sizeof(testdata)),sizeof(testdata));
+			test_assertTrue(memcmp(testdata,data,sizeof(data)) == 0);
+		}
+		test_assertSize(buf.available(),0);
+
+		fflush(stdout);
+	}
+
+	// SACK blocks of the receiver
+	{
+		CircularBuf buf;
+		Range blocks[4];
+		buf.init(-8,64);
+
+		test_assertSSize(buf.push(-8,TYPE_DATA,data + 0,4),4);
+		test_assertSize(buf.getSackBlocks(blocks,ARRAY_SIZE(blocks)),0);
+
+		test_assertSSize(buf.push(0,TYPE_DATA,data + 8,4),4);
+		test_assertSSize(buf.push(4,TYPE_DATA,data + 12,4),4);
+		test_assertSSize(buf.push(12,TYPE_DATA,data + 20,2),2);
+		test_assertInt(buf.getAck(),-4);
+
+		test_assertSize(buf.getSackBlocks(blocks,ARRAY_SIZE(blocks)),2);
+		test_assertInt(blocks[0].start,0);
+		test_assertInt(blocks[0].end,8);
+		test_assertInt(blocks[1].start,12);
+		test_assertInt(blocks[1].end,14);
+		test_assertSize(buf.getSackBlocks(blocks,1),1);
+
+		// fill the first hole
+		test_assertSSize(buf.push(-4,TYPE_DATA,data + 4,4),4);
+		test_assertInt(buf.getAck(),8);
+		test_assertSize(buf.getSackBlocks(blocks,ARRAY_SIZE(blocks)),1);
+		test_assertInt(blocks[0].start,12);
+		test_assertInt(blocks[0].end,14);
+
+		fflush(stdout);
+	}
+
+	// SACKed ranges of the sender
+	{
+		CircularBuf buf;
+		buf.init(-8,64);
+		test_assertSSize(buf.push(-8,TYPE_DATA,data,32),32);
+
+		// outside of the sent data
+		buf.sack(-12,-4);
+		buf.sack(20,28);
+		test_assertInt(buf.skipSacked(-8),-8);
+		test_assertSize(buf.holeSize(-8),std::numeric_limits<size_t>::max());
+
+		buf.sack(0,4);
+		buf.sack(8,12);
+		test_assertInt(buf.skipSacked(-8),-8);
+		test_assertInt(buf.skipSacked(0),4);
+		test_assertInt(buf.skipSacked(2),4);
+		test_assertInt(buf.skipSacked(4),4);
+		test_assertSize(buf.holeSize(-8),8);
+		test_assertSize(buf.holeSize(4),4);
+		test_assertSize(buf.holeSize(12),std::numeric_limits<size_t>::max());
+
+		// merge them
+		buf.sack(4,8);
+		test_assertInt(buf.skipSacked(0),12);
+
+		// ACK parts of it
+		test_assertInt(buf.forget(2),0);
+		test_assertInt(buf.skipSacked(2),12);
+		test_assertInt(buf.forget(12),0);
+		test_assertInt(buf.skipSacked(12),12);
+		test_assertSize(buf.holeSize(12),std::numeric_limits<size_t>::max());
 
 		fflush(stdout);
 	}
@@ -27,26 +27,31 @@
 #include <limits>
 #include <list>
 #include <string.h>
+#include <vector>
 
 /**
- * +----------------+                  \
- * |                |                  |
- * |   unreached    |                  |- free
- * |                |                  |
- * +-------vv-------+ <-- seqStart     /  <-- _packets
+ *       ring (power of two)
+ * +----------------+
+ * |                |
+ * |      free      |
+ * |                |
+ * +-------vv-------+ <-- seqStart & mask
  * |                |
  * |     acked      |
  * |                |
- * +-------vv-------+ <-- seqAcked
+ * +-------vv-------+ <-- seqAcked & mask
  * |                |
- * |    not yet     |
  * |   contiguous   |
  * |                |
- * +-------vv-------+                  \ <-- _packets + _max
- * |                |                  |
- * |   unreached    |                  |- free
- * |                |                  |
- * +----------------+                  /
+ * +-------vv-------+ <-- seqEnd & mask
+ * |     hole       |
+ * +----------------+
+ * |  out of order  |
+ * +----------------+
+ * |                |
+ * |      free      |
+ * |                |
+ * +----------------+
  */
 
 class CircularBuf;
@@ -59,10 +64,16 @@ static esc::OStream &operator<<(esc::OStream &os,const CircularBuf &cb);
  * triggers. To do so, we use get() to get the already sent data again. When we receive the ACK,
  * we forget() the data.
  * For receiving, we push() received data into the buffer. When sending the next packet, we use
- * getAck() to ACK the data. Later we use pull() to pull the data out of the circular buffer and
- * pass it to the application.
- * The data is kept in a std::list of SeqPacket, ordered by the sequence number. Additionally, we
- * keep the start of the window (_seqStart) and the ACK position (_seqAcked).
+ * getAck() to ACK the data. We use pull() to pull the contiguous data out of the circular buffer
+ * and pass it to the application, which does not need to wait for the ACK.
+ * The data is kept in a ring of bytes whose size is a power of two, so that the sequence number
+ * determines the position in the ring. Everything between _seqStart and _seqEnd is present, the
+ * out-of-order data behind it is described by a sorted list of ranges. Control packets occupy a
+ * sequence number, but no space in the ring; they are kept in a separate list.
+ * The ring starts small and grows up to the capacity, so that idle connections stay cheap.
+ * With selective acknowledgements (RFC 2018), the receiving side reports the out-of-order data
+ * via getSackBlocks() and the sending side remembers the SACKed ranges via sack(), so that
+ * retransmissions can skip them.
  */
 class CircularBuf {
 	friend esc::OStream &operator<<(esc::OStream &os,const CircularBuf &cb);
@@ -70,42 +81,61 @@ class CircularBuf {
 public:
 	typedef uint32_t seq_type;
 
+	/* the initial size of the ring */
+	static const size_t MIN_RING_SIZE	= 4096;
+
 	enum {
 		TYPE_CTRL,
 		TYPE_DATA
 	};
 
 	/**
-	 * A packet that was pushed. Holds the data with the associated sequence number
+	 * A control packet that was pushed. Holds the data with the associated sequence number
 	 */
 	struct SeqPacket {
-		explicit SeqPacket(seq_type _start,uint8_t _type,const uint8_t *_data,size_t sz)
-			: start(_start), type(_type), data(sz ? new uint8_t[sz] : NULL), _size(sz) {
-			memcpy(data,_data,_size);
+		explicit SeqPacket(seq_type _start,const uint8_t *_data,size_t sz)
+			: start(_start), data(sz ? new uint8_t[sz] : NULL), _size(sz) {
+			if(_size)
+				memcpy(data,_data,_size);
 		}
 		SeqPacket(const SeqPacket&) = delete;
 		SeqPacket &operator=(const SeqPacket&) = delete;
-		SeqPacket(SeqPacket &&p) : start(p.start), type(p.type), data(p.data), _size(p._size) {
+		SeqPacket(SeqPacket &&p) : start(p.start), data(p.data), _size(p._size) {
 			p.data = NULL;
 		}
 		~SeqPacket() {
 			delete[] data;
 		}
 
-		size_t size() const {
-			return type == TYPE_CTRL ? 1 : _size;
-		}
-
 		seq_type start;
-		uint8_t type;
 		uint8_t *data;
 		size_t _size;
 	};
 
+	/**
+	 * A range of sequence numbers, [start, end)
+	 */
+	struct Range {
+		explicit Range() : start(), end() {
+		}
+		explicit Range(seq_type _start,seq_type _end) : start(_start), end(_end) {
+		}
+
+		seq_type start;
+		seq_type end;
+	};
+
 	/**
 	 * Creates an uninitialized circular buffer, i.e. with sequence number 0.
 	 */
-	explicit CircularBuf() : _max(), _current(), _curData(), _packets(), _seqStart(), _seqAcked() {
+	explicit CircularBuf()
+		: _ring(), _ringSize(), _max(), _current(), _curData(), _ctrls(), _ooo(), _sacked(),
+		  _seqStart(), _seqAcked(), _seqEnd() {
+	}
+	CircularBuf(const CircularBuf&) = delete;
+	CircularBuf &operator=(const CircularBuf&) = delete;
+	~CircularBuf() {
+		delete[] _ring;
 	}
 
 	/**
@@ -115,16 +145,14 @@ public:
 	 * @param size the maximum number of bytes to hold
 	 */
 	void init(seq_type start,size_t size) {
-		_seqStart = _seqAcked = start;
+		_seqStart = _seqAcked = _seqEnd = start;
 		_max = size;
+		_current = _curData = 0;
+		_ctrls.clear();
+		_ooo.clear();
+		_sacked.clear();
 	}
 
-	/**
-	 * @return the packet list
-	 */
-	const std::list<SeqPacket> &packets() const {
-		return _packets;
-	}
 	/**
 	 * @return the number of data-bytes to pull()
 	 */
@@ -149,6 +177,18 @@ public:
 	seq_type nextExp() const {
 		return _seqAcked;
 	}
+	/**
+	 * @return the sequence number behind the contiguous data, i.e. what getAck() would return
+	 */
+	seq_type contEnd() const {
+		return _seqEnd;
+	}
+	/**
+	 * @return true if there is out-of-order data behind a hole
+	 */
+	bool hasHoles() const {
+		return _ooo.size() > 0;
+	}
 	/**
 	 * @return the next sequence number that is used (meaningless for the receive buffer)
 	 */
@@ -204,8 +244,9 @@ public:
 	size_t get(seq_type seqNo,void *buf,size_t size);
 
 	/**
-	 * Pulls ACKed data into <buf>. That is, it starts at the beginning and copies all data into
-	 * <buf> and throws it away afterwards (rotates the window forward).
+	 * Pulls contiguous data into <buf>, regardless of whether it has been ACKed yet. That is, it
+	 * starts at the beginning and copies all data into <buf> and throws it away afterwards
+	 * (rotates the window forward).
 	 *
 	 * @param buf the buffer to write to
 	 * @param size the size of the buffer
@@ -223,6 +264,37 @@ public:
 	 */
 	size_t pullctrl(void *buf,size_t size,seq_type *seqNo);
 
+	/**
+	 * Determines the ranges of data that have been received behind the ACK position, i.e. after
+	 * a hole. The first block is the one closest to the ACK position.
+	 *
+	 * @param blocks the array to fill
+	 * @param max the maximum number of blocks
+	 * @return the number of blocks
+	 */
+	size_t getSackBlocks(Range *blocks,size_t max) const;
+
+	/**
+	 * Remembers that the receiver has got <start> .. <end>, although not all data in front of
+	 * it has been ACKed yet. Ranges outside of the sent data are ignored.
+	 *
+	 * @param start the first sequence number
+	 * @param end the sequence number behind the last byte
+	 */
+	void sack(seq_type start,seq_type end);
+
+	/**
+	 * @param seqNo the sequence number
+	 * @return the first sequence number at or behind <seqNo> that has not been SACKed
+	 */
+	seq_type skipSacked(seq_type seqNo) const;
+
+	/**
+	 * @param seqNo the sequence number
+	 * @return the number of bytes from <seqNo> to the next SACKed range (or the maximum)
+	 */
+	size_t holeSize(seq_type seqNo) const;
+
 	/**
 	 * Prints the state of the circular buffer to <os>.
 	 *
@@ -234,16 +306,25 @@ public:
 	static void unittest();
 
 private:
-	void add(std::list<SeqPacket>::iterator,seq_type seqNo,uint8_t type,const uint8_t *data,
-		size_t size,size_t dataSize);
-	size_t getOffset(const SeqPacket &pkt,seq_type seqNo);
+	void reserve(size_t size);
+	size_t mark(seq_type relStart,seq_type relEnd);
+	void copyIn(seq_type seqNo,const uint8_t *data,size_t size);
+	void copyOut(seq_type seqNo,uint8_t *buf,size_t size) const;
 
+	uint8_t *_ring;
+	size_t _ringSize;
 	size_t _max;
 	size_t _current;
 	size_t _curData;
-	std::list<SeqPacket> _packets;
+	/* the control packets, ordered by the sequence number */
+	std::list<SeqPacket> _ctrls;
+	/* the out-of-order data behind _seqEnd, sorted and disjoint */
+	std::vector<Range> _ooo;
+	/* the SACKed ranges behind the ACK position, sorted and disjoint */
+	std::list<Range> _sacked;
 	seq_type _seqStart;
 	seq_type _seqAcked;
+	seq_type _seqEnd;
 };
 
 static inline esc::OStream &operator<<(esc::OStream &os,const CircularBuf &cb) {
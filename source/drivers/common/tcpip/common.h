@@ -58,8 +58,6 @@ struct PendingRequest {
 		} read;
 		struct {
 			const void *data;
-			size_t remaining;
-			uint32_t seqNo;
 		} write;
 		struct {
 			int fd;
@@ -81,6 +81,9 @@ public:
 	virtual int abort() {
 		return -ENOTSUP;
 	}
+	virtual int setopt(esc::Socket::Option,int) {
+		return -ENOTSUP;
+	}
 	virtual void disconnect() {
 		delete this;
 	}
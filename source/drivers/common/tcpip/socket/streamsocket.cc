@@ -18,6 +18,9 @@
  */
 
 #include <sys/common.h>
+#include <sys/time.h>
+#include <limits>
+#include <stdlib.h>
 
 #include "../proto/ethernet.h"
 #include "../proto/ipv4.h"
@@ -77,13 +80,22 @@
 
 PortMng<PRIVATE_PORTS_CNT> StreamSocket::_ports(PRIVATE_PORTS);
 
+/**
+ * @return the value for the timestamp option, a clock in milliseconds
+ */
+static uint32_t timestamp() {
+	return tsctotime(rdtsc()) / 1000;
+}
+
 StreamSocket::~StreamSocket() {
 	if(_localPort != 0) {
 		TCP::remSocket(this,_localPort,remotePort());
 		if(_localPort >= PRIVATE_PORTS)
 			_ports.release(_localPort);
 	}
-	Timeouts::cancel(_timeoutId);
+	Timeouts::releaseId(_timeoutId);
+	Timeouts::releaseId(_ackTimeoutId);
+	releaseWrite();
 }
 
 void StreamSocket::state(State st) {
@@ -112,13 +124,11 @@ int StreamSocket::connect(const esc::Socket::Addr *sa,msgid_t mid) {
 		TCP::addSocket(this,_localPort,remotePort());
 	}
 
-	MSSOption option;
-	option.kind = OPTION_MSS;
-	option.length = sizeof(option);
-	option.mss = cputobe16(route.link->mtu() - IPv4<TCP>().size());
+	// offer all options; the SYN-ACK tells us what the peer supports
+	_wsOk = _sackOk = _tsOk = true;
 
 	// send SYN packet
-	ssize_t res = sendCtrlPkt(TCP::FL_SYN,&option);
+	ssize_t res = sendCtrlPkt(TCP::FL_SYN);
 	if(res < 0)
 		return res;
 
@@ -171,28 +181,29 @@ int StreamSocket::accept(msgid_t mid,int nfd,esc::ClientDevice<Socket> *dev) {
 ssize_t StreamSocket::sendto(msgid_t mid,const esc::Socket::Addr *,const void *data,size_t size) {
 	if(_state != STATE_ESTABLISHED)
 		return -ENOTCONN;
-
-	CircularBuf::seq_type seqNo = _txCircle.nextSeq();
 	// TODO handle requests that are larger. probably we want to increase the txCircle in this case
-	if(size > _txCircle.windowSize())
+	if(size == 0 || size > _txCircle.capacity())
 		return -EINVAL;
 	if(_pending.count > 0)
 		return -EAGAIN;
 
 	PRINT_TCP(_localPort,remotePort(),"Application wants to send %zu bytes",size);
 
-	// push it into our txCircle
-	size_t amount = std::min(_remoteWinSize,size);
-	sassert(_txCircle.push(seqNo,CircularBuf::TYPE_DATA,data,amount) == (ssize_t)amount);
-	// send it
-	sendData(true);
+	// if it fits into our txCircle, the application can continue immediately. sendData() decides
+	// how much of it can be sent right away
+	if(size <= _txCircle.windowSize()) {
+		sassert(_txCircle.push(_txCircle.nextSeq(),CircularBuf::TYPE_DATA,data,size) == (ssize_t)size);
+		sendData();
+		return size;
+	}
 
-	// register request; the response is sent as soon as the sent data has been ACKed
+	// otherwise keep a copy and register the request; flushWrite() pushes it as soon as the ACKs
+	// have made enough room
+	uint8_t *copy = new uint8_t[size];
+	memcpy(copy,data,size);
 	_pending.mid = mid;
 	_pending.count = size;
-	_pending.d.write.data = data;
-	_pending.d.write.remaining = size - amount;
-	_pending.d.write.seqNo = seqNo + size;
+	_pending.d.write.data = copy;
 	return 0;
 }
 
@@ -209,8 +220,9 @@ ssize_t StreamSocket::recvfrom(msgid_t mid,bool needsSrc,void *buffer,size_t siz
 
 	if(shouldPush()) {
 		if(replyRead(mid,needsSrc,buffer,size)) {
-			/* inform the sender about our increased window-size */
-			sendCtrlPkt(TCP::FL_ACK,NULL,true);
+			/* inform the sender about our increased window-size, if it's worth it */
+			if(windowUpdateDue())
+				sendCtrlPkt(TCP::FL_ACK,true);
 			return 0;
 		}
 	}
@@ -251,6 +263,32 @@ int StreamSocket::abort() {
 	return 0;
 }
 
+int StreamSocket::setopt(esc::Socket::Option opt,int value) {
+	switch(opt) {
+		case esc::Socket::OPT_TCP_NODELAY:
+			_nodelay = value != 0;
+			break;
+
+		case esc::Socket::OPT_TCP_CORK:
+			_cork = value != 0;
+			break;
+
+		default:
+			return -EINVAL;
+	}
+
+	// send what we might have held back so far
+	if(_state == STATE_ESTABLISHED || _state == STATE_CLOSE_WAIT)
+		sendData();
+	return 0;
+}
+
+int StreamSocket::cancel(msgid_t mid) {
+	if(_pending.count > 0 && _pending.mid == mid)
+		releaseWrite();
+	return Socket::cancel(mid);
+}
+
 void StreamSocket::disconnect() {
 	_closed = true;
 	switch(_state) {
@@ -270,18 +308,24 @@ void StreamSocket::disconnect() {
 			// nothing to do. we wait until we're in STATE_CLOSED.
 			break;
 
-		case STATE_CLOSE_WAIT:
-			sendCtrlPkt(TCP::FL_FIN | TCP::FL_ACK);
-			state(STATE_LAST_ACK);
-			break;
-
 		default:
-			sendCtrlPkt(TCP::FL_FIN | TCP::FL_ACK);
-			state(STATE_FIN_WAIT_1);
+			// the FIN has to wait until the buffered data has been ACKed
+			if(_txCircle.available() > 0) {
+				_finPending = true;
+				_cork = false;
+				sendData();
+			}
+			else
+				sendFin();
 			break;
 	}
 }
 
+void StreamSocket::sendFin() {
+	sendCtrlPkt(TCP::FL_FIN | TCP::FL_ACK);
+	state(_state == STATE_CLOSE_WAIT ? STATE_LAST_ACK : STATE_FIN_WAIT_1);
+}
+
 void StreamSocket::timeout() {
 	switch(_state) {
 		case STATE_FIN_WAIT_2:
@@ -290,27 +334,39 @@ void StreamSocket::timeout() {
 			break;
 
 		case STATE_ESTABLISHED:
-			if(_pending.count > 0) {
-				PRINT_TCP(_localPort,remotePort(),"timeout. Resending data.");
-				sendData(true);
+		case STATE_CLOSE_WAIT: {
+			CircularBuf::seq_type una = _txCircle.nextExp();
+			if(seqBefore(una,_sndMax)) {
+				PRINT_TCP(_localPort,remotePort(),"timeout. Resending data (rto=%u).",_rto);
+				// the segments in flight are probably lost; start again with slow start
+				// (RFC 5681, section 3.1) and back off the timer (RFC 6298, section 5)
+				_ssthresh = std::max<size_t>((_sndMax - una) / 2,2 * _mss);
+				_cwnd = _mss;
+				_rto = std::min<uint>(_rto * 2,static_cast<uint>(MAX_RTO));
+				_recover = _sndMax;
+				_recovery = false;
+				_dupAcks = 0;
+				_rttTiming = false;
+				_sndNxt = una;
+				sendData();
 			}
-			break;
+		}
+		break;
 
 		default: {
 			// if there is an un-ACKed control-packet, resend it
 			if(_ctrlpkt.flags) {
 				PRINT_TCP(_localPort,remotePort(),"timeout. Resending control-packet.");
-				if(_ctrlpkt.timeout < 8000) {
+				if(_ctrlpkt.timeout < MAX_CTRL_TIMEOUT) {
 					_ctrlpkt.timeout *= 2;
 					ssize_t res = TCP::send(remoteIP(),_localPort,remotePort(),
-						_ctrlpkt.flags,&_ctrlpkt.option,_ctrlpkt.optSize,_ctrlpkt.optSize,
-						_ctrlpkt.seqNo,_rxCircle.nextExp(),_rxCircle.windowSize());
+						_ctrlpkt.flags,_ctrlpkt.options,_ctrlpkt.optSize,_ctrlpkt.optSize,
+						_ctrlpkt.seqNo,_rxCircle.nextExp(),rcvWindow(_ctrlpkt.flags));
 					if(res < 0) {
 						// TODO handle error
 						printe("TCP::send");
 					}
-					Timeouts::program(_timeoutId,std::make_memfun(this,&StreamSocket::timeout),
-						_ctrlpkt.timeout);
+					programTimeout(_ctrlpkt.timeout);
 				}
 				else {
 					replyPending<int>(-ETIMEOUT);
@@ -336,7 +392,11 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 
   	CircularBuf::seq_type seqNo = be32tocpu(tcp->seqNumber);
 	CircularBuf::seq_type ackNo = be32tocpu(tcp->ackNumber);
+	size_t oldWinSize = _remoteWinSize;
+	// the window in SYN segments is never scaled (RFC 7323, section 2.2)
 	_remoteWinSize = be16tocpu(tcp->windowSize);
+	if(~tcp->ctrlFlags & TCP::FL_SYN)
+		_remoteWinSize <<= _sndWScale;
 
 	// validate checksum
 	uint16_t checksum = esc::Net::ipv4PayloadChecksum(ip->src,ip->dst,TCP::IP_PROTO,
@@ -368,30 +428,62 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 	}
 
 	bool ackForced = false;
+	Options opts;
+	parseOptions(tcp,&opts);
+	bool hasTS = _tsOk && opts.hasTS;
 
 	// in state SYN_SENT we don't have a initialized _rxCircle yet
 	if(_state != STATE_SYN_SENT && _state != STATE_LISTEN) {
+		// protection against wrapped sequence numbers (RFC 7323, section 5.3)
+		if(hasTS && synchronized() && seqBefore(opts.tsVal,_tsRecent)) {
+			PRINT_TCP(_localPort,remotePort(),"received old timestamp %u, expected >= %u",
+				opts.tsVal,_tsRecent);
+			sendCtrlPkt(TCP::FL_ACK,true);
+			return;
+		}
+
 		// do we have received a non-ACK packet?
 		if(((tcp->ctrlFlags & ~TCP::FL_ACK) || seglen > 0)) {
 			// determine type of packet
 			uint8_t type = seglen ? CircularBuf::TYPE_DATA : CircularBuf::TYPE_CTRL;
 		  	const uint8_t *data = seglen ? reinterpret_cast<const uint8_t*>(tcp) + dataOff : NULL;
 
+			// SYN and FIN are ACKed immediately. and since control packets have to follow the ACKed
+			// data, ACK the data that is still waiting for the delayed ACK now
+			if(tcp->ctrlFlags & (TCP::FL_SYN | TCP::FL_FIN)) {
+				ackForced = true;
+				if(type == CircularBuf::TYPE_CTRL)
+					_rxCircle.getAck();
+			}
+			// out-of-order segments and the ones that fill a hole are ACKed immediately as well,
+			// so that the sender gets its duplicate ACKs (RFC 5681, section 4.2)
+			if(seqNo != _rxCircle.contEnd() || _rxCircle.hasHoles())
+				ackForced = true;
+
 		  	// only accept data in established state
-	  		if(_rxCircle.push(seqNo,type,data,seglen) < 0) {
+			ssize_t res = _rxCircle.push(seqNo,type,data,seglen);
+	  		if(res < 0) {
 	  			if(synchronized()) {
 					PRINT_TCP(_localPort,remotePort(),"received unexpected seq %u, expected %u",
 						seqNo,_rxCircle.nextExp());
 					// always sent an ACK here
-	  				sendCtrlPkt(TCP::FL_ACK,NULL,true);
+	  				sendCtrlPkt(TCP::FL_ACK,true);
 	  			}
 				return;
 			}
+			// a duplicate probably means that our ACK got lost
+			if(res == 0)
+				ackForced = true;
 		}
+
+		// remember the timestamp to echo, if the segment is not behind our last ACK
+		if(hasTS && !seqBefore(opts.tsVal,_tsRecent) && !seqBefore(_rxCircle.nextExp(),seqNo))
+			_tsRecent = opts.tsVal;
 	}
 
 	// handle acks
 	if(tcp->ctrlFlags & TCP::FL_ACK) {
+		CircularBuf::seq_type una = _txCircle.nextExp();
 		int res = _txCircle.forget(ackNo);
 		if(res < 0) {
 			PRINT_TCP(_localPort,remotePort(),"received unexpected ack %u, expected %u",
@@ -401,29 +493,46 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 			else
 				ackForced = true;
 		}
-		else if(_pending.count > 0 && _pending.isWrite()) {
-			if(ackNo >= _pending.d.write.seqNo) {
-				replyPending<ssize_t>(_pending.count);
-				Timeouts::cancel(_timeoutId);
-			}
-		}
 		// if this is an ACK for our last control packet, stop waiting for it
 		else if(ackNo > _ctrlpkt.seqNo && _ctrlpkt.flags != 0) {
 			_ctrlpkt.flags = 0;
 			Timeouts::cancel(_timeoutId);
 		}
+		// otherwise it's an ACK for our data
+		else if(_state == STATE_ESTABLISHED || _state == STATE_CLOSE_WAIT) {
+			// remember what the receiver has got behind the holes
+			if(_sackOk) {
+				for(size_t i = 0; i < opts.sackCount; ++i)
+					_txCircle.sack(opts.sacks[i].start,opts.sacks[i].end);
+			}
+
+			// only a pure ACK that doesn't change the window can be a duplicate
+			bool dupCandidate = seglen == 0 && _remoteWinSize == oldWinSize &&
+				!(tcp->ctrlFlags & (TCP::FL_SYN | TCP::FL_FIN));
+			handleAck(una,ackNo,dupCandidate,hasTS ? opts.tsEcr : 0);
+
+			// everything ACKed?
+			if(!seqBefore(ackNo,_sndMax))
+				Timeouts::cancel(_timeoutId);
+			// the ACKed data has made room for a pending write
+			flushWrite();
+		}
 	}
 
 	// send outstanding data
-	sendData(false);
+	sendData();
 
 	// handle state changes
 	switch(_state) {
 		case STATE_LISTEN: {
 			if(tcp->ctrlFlags == TCP::FL_SYN) {
 				SynPacket syn;
-				syn.mss = parseMSS(tcp);
+				syn.mss = opts.mss;
 				syn.winSize = be16tocpu(tcp->windowSize);
+				syn.wscale = opts.wscale;
+				syn.sackOk = opts.sackPerm;
+				syn.tsOk = opts.hasTS;
+				syn.tsVal = opts.tsVal;
 				syn.src.family = esc::Socket::AF_INET;
 				syn.src.d.ipv4.addr = ip->src.value();
 				syn.src.d.ipv4.port = be16tocpu(tcp->srcPort);
@@ -445,9 +554,18 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 				if((tcp->ctrlFlags & (TCP::FL_ACK | TCP::FL_SYN)) == (TCP::FL_ACK | TCP::FL_SYN)) {
 					_txCircle.init(_txCircle.nextSeq(),SEND_BUF_SIZE);
 					_rxCircle.init(seqNo + 1,RECV_BUF_SIZE);
-					_mss = parseMSS(tcp);
-					PRINT_TCP(_localPort,remotePort(),"Got MSS: %zu",_mss);
-
+					_mss = opts.mss;
+					// we've offered all options, so take what the peer has agreed to
+					_wsOk = opts.wscale >= 0;
+					_sndWScale = _wsOk ? opts.wscale : 0;
+					_rcvWScale = _wsOk ? WSCALE : 0;
+					_sackOk = opts.sackPerm;
+					_tsOk = opts.hasTS;
+					_tsRecent = opts.tsVal;
+					PRINT_TCP(_localPort,remotePort(),"Got MSS: %zu, wscale: %d, SACK: %d, TS: %d",
+						_mss,opts.wscale,_sackOk,_tsOk);
+
+					initCongestion();
 					state(STATE_ESTABLISHED);
 					replyPending<int>(0);
 
@@ -472,6 +590,7 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 				esc::IPCStream is(_pending.d.accept.fd,buffer,sizeof(buffer),_pending.mid);
 				is << esc::DevCreatSibl::Response(0) << esc::Reply();
 				_pending.count = 0;
+				initCongestion();
 				state(STATE_ESTABLISHED);
 			}
 		}
@@ -486,7 +605,7 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 			}
 			else if(ackNo > _ctrlpkt.seqNo && (tcp->ctrlFlags & TCP::FL_ACK)) {
 				state(STATE_FIN_WAIT_2);
-				Timeouts::program(_timeoutId,std::make_memfun(this,&StreamSocket::timeout),3000);
+				programTimeout(3000);
 			}
 		}
 		break;
@@ -515,59 +634,235 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 			break;
 	}
 
-	// first ACK data and send ACK packet, if required
+	// send the FIN as soon as the data in front of it has been ACKed
+	if(_finPending && _txCircle.available() == 0 &&
+			(_state == STATE_ESTABLISHED || _state == STATE_CLOSE_WAIT)) {
+		_finPending = false;
+		sendFin();
+	}
+
+	// ACK the received data, if required. the ACK might have been sent along with our data already
 	if(_state != STATE_CLOSED)
-		sendCtrlPkt(TCP::FL_ACK,NULL,ackForced);
+		sendAck(ackForced);
 
 	// push data to application if either PSH is set, we don't have much window space left or the
 	// state is not ESTABLISHED anymore
 	if(tcp->ctrlFlags & TCP::FL_PSH)
 		_push = true;
-	if(_pending.count > 0 && _pending.isRead() && shouldPush()) {
-		if(replyRead(_pending.mid,_pending.d.read.needsSrc,_pending.d.read.data,_pending.count))
-			_pending.count = 0;
-	}
+	replyPendingRead();
 
 	// program timeout, if we went into TIME_WAIT state
 	if(oldstate != STATE_TIME_WAIT && _state == STATE_TIME_WAIT)
-		Timeouts::program(_timeoutId,std::make_memfun(this,&StreamSocket::timeout),1000);
+		programTimeout(1000);
 }
 
-uint16_t StreamSocket::parseMSS(const TCP *tcp) {
+void StreamSocket::parseOptions(const TCP *tcp,Options *opts) {
 	size_t dataOff = (tcp->dataOffset >> 4) * 4;
-	size_t optSize = dataOff - sizeof(TCP);
-	if(optSize > 0) {
-		const uint8_t* options = reinterpret_cast<const uint8_t*>(tcp + 1);
-		while(optSize > 0) {
-			const OptionHeader *optHead = reinterpret_cast<const OptionHeader*>(options);
-			switch(optHead->kind) {
-				case OPTION_MSS:
+	const uint8_t *pos = reinterpret_cast<const uint8_t*>(tcp + 1);
+	const uint8_t *end = reinterpret_cast<const uint8_t*>(tcp) + dataOff;
+	while(pos < end) {
+		const OptionHeader *optHead = reinterpret_cast<const OptionHeader*>(pos);
+		if(optHead->kind == OPTION_END)
+			break;
+		// NOP is the only option without length
+		if(optHead->kind == OPTION_NOP) {
+			pos++;
+			continue;
+		}
+		// stop at malformed options
+		if(pos + sizeof(OptionHeader) > end || optHead->length < sizeof(OptionHeader) ||
+				pos + optHead->length > end)
+			break;
+
+		switch(optHead->kind) {
+			case OPTION_MSS:
+				if(optHead->length == sizeof(MSSOption)) {
 					const MSSOption *mssOpt = reinterpret_cast<const MSSOption*>(optHead);
-					return be16tocpu(mssOpt->mss);
+					if(mssOpt->mss != 0)
+						opts->mss = be16tocpu(mssOpt->mss);
+				}
+				break;
+
+			case OPTION_WSCALE:
+				if(optHead->length == sizeof(WScaleOption)) {
+					const WScaleOption *wsOpt = reinterpret_cast<const WScaleOption*>(optHead);
+					opts->wscale = std::min<int>(wsOpt->shift,MAX_WSCALE);
+				}
+				break;
+
+			case OPTION_SACK_PERM:
+				opts->sackPerm = true;
+				break;
+
+			case OPTION_SACK: {
+				const SACKBlock *blocks = reinterpret_cast<const SACKBlock*>(optHead + 1);
+				size_t count = (optHead->length - sizeof(OptionHeader)) / sizeof(SACKBlock);
+				opts->sackCount = std::min(count,static_cast<size_t>(MAX_SACK_BLOCKS));
+				for(size_t i = 0; i < opts->sackCount; ++i) {
+					opts->sacks[i] = CircularBuf::Range(be32tocpu(blocks[i].start),
+						be32tocpu(blocks[i].end));
+				}
 			}
+			break;
 
-			options += optHead->length;
-			optSize -= optHead->length;
+			case OPTION_TIMESTAMP:
+				if(optHead->length == sizeof(TimestampOption)) {
+					const TimestampOption *tsOpt = reinterpret_cast<const TimestampOption*>(optHead);
+					opts->hasTS = true;
+					opts->tsVal = be32tocpu(tsOpt->value);
+					opts->tsEcr = be32tocpu(tsOpt->echo);
+				}
+				break;
 		}
+
+		pos += optHead->length;
 	}
-	// use the default size
-	return DEF_MSS;
 }
 
-ssize_t StreamSocket::sendCtrlPkt(uint8_t flags,MSSOption *opt,bool forceACK) {
+size_t StreamSocket::buildOptions(uint8_t *opts,uint8_t flags) const {
+	uint8_t *pos = opts;
+	// all options are padded with NOPs to 4 bytes
+	if(flags & TCP::FL_SYN) {
+		Route route = Route::find(remoteIP());
+		MSSOption *mssOpt = reinterpret_cast<MSSOption*>(pos);
+		mssOpt->kind = OPTION_MSS;
+		mssOpt->length = sizeof(MSSOption);
+		mssOpt->mss = cputobe16(route.valid() ? route.link->mtu() - IPv4<TCP>().size() : DEF_MSS);
+		pos += sizeof(MSSOption);
+
+		// in a SYN-ACK, the flags are only set if the peer has offered the option
+		if(_wsOk) {
+			*pos++ = OPTION_NOP;
+			WScaleOption *wsOpt = reinterpret_cast<WScaleOption*>(pos);
+			wsOpt->kind = OPTION_WSCALE;
+			wsOpt->length = sizeof(WScaleOption);
+			wsOpt->shift = WSCALE;
+			pos += sizeof(WScaleOption);
+		}
+		if(_sackOk) {
+			*pos++ = OPTION_NOP;
+			*pos++ = OPTION_NOP;
+			OptionHeader *sackOpt = reinterpret_cast<OptionHeader*>(pos);
+			sackOpt->kind = OPTION_SACK_PERM;
+			sackOpt->length = sizeof(OptionHeader);
+			pos += sizeof(OptionHeader);
+		}
+	}
+
+	if(_tsOk) {
+		*pos++ = OPTION_NOP;
+		*pos++ = OPTION_NOP;
+		TimestampOption *tsOpt = reinterpret_cast<TimestampOption*>(pos);
+		tsOpt->kind = OPTION_TIMESTAMP;
+		tsOpt->length = sizeof(TimestampOption);
+		tsOpt->value = cputobe32(timestamp());
+		// the echo is only valid if the ACK flag is set
+		tsOpt->echo = cputobe32((flags & TCP::FL_ACK) ? _tsRecent : 0);
+		pos += sizeof(TimestampOption);
+	}
+
+	// tell the sender which data we've got behind the holes (RFC 2018)
+	if(_sackOk && !(flags & TCP::FL_SYN) && (flags & TCP::FL_ACK)) {
+		CircularBuf::Range ranges[MAX_SACK_BLOCKS];
+		size_t max = (MAX_OPT_SIZE - (pos - opts) - 2 - sizeof(OptionHeader)) / sizeof(SACKBlock);
+		max = std::min(max,static_cast<size_t>(MAX_SACK_BLOCKS));
+		size_t count = _rxCircle.getSackBlocks(ranges,max);
+		if(count > 0) {
+			*pos++ = OPTION_NOP;
+			*pos++ = OPTION_NOP;
+			OptionHeader *sackOpt = reinterpret_cast<OptionHeader*>(pos);
+			sackOpt->kind = OPTION_SACK;
+			sackOpt->length = sizeof(OptionHeader) + count * sizeof(SACKBlock);
+			SACKBlock *blocks = reinterpret_cast<SACKBlock*>(sackOpt + 1);
+			for(size_t i = 0; i < count; ++i) {
+				blocks[i].start = cputobe32(ranges[i].start);
+				blocks[i].end = cputobe32(ranges[i].end);
+			}
+			pos += sackOpt->length;
+		}
+	}
+	return pos - opts;
+}
+
+uint16_t StreamSocket::rcvWindow(uint8_t flags) {
+	// the window in SYN segments is never scaled (RFC 7323, section 2.2)
+	uint shift = (flags & TCP::FL_SYN) ? 0 : _rcvWScale;
+	size_t win = std::min<size_t>(_rxCircle.windowSize() >> shift,0xFFFF);
+	// remember the right edge of the window we're announcing
+	_rcvAdvEdge = _rxCircle.nextExp() + (win << shift);
+	return win;
+}
+
+bool StreamSocket::windowUpdateDue() const {
+	// as long as the sender has at least half of the buffer left, it doesn't need to know yet
+	size_t cap = _rxCircle.capacity();
+	if(seqBefore(_rxCircle.contEnd(),_rcvAdvEdge) && _rcvAdvEdge - _rxCircle.contEnd() >= cap / 2)
+		return false;
+
+	// only announce a larger window if it has grown by a full segment or by half of the buffer, to
+	// avoid the silly window syndrome (RFC 1122, section 4.2.3.3)
+	CircularBuf::seq_type edge = _rxCircle.contEnd() + _rxCircle.windowSize();
+	size_t thres = std::min(cap / 2,_mss);
+	return seqBefore(_rcvAdvEdge,edge) && edge - _rcvAdvEdge >= thres;
+}
+
+size_t StreamSocket::fullSegment() const {
+	// the timestamp option (with two NOPs) is in every segment, if it has been agreed on
+	size_t size = std::min(_mtu,_mss);
+	return _tsOk ? size - (sizeof(TimestampOption) + 2) : size;
+}
+
+void StreamSocket::sendAck(bool force) {
+	// nothing new to ACK?
+	if(!force && _rxCircle.nextExp() == _rxCircle.contEnd())
+		return;
+
+	// ACK at least every second full segment, but delay it otherwise, hoping that we can send it
+	// along with data (RFC 1122, section 4.2.3.2)
+	if(force || ++_unackedSegs >= DELAYED_ACK_SEGS)
+		sendCtrlPkt(TCP::FL_ACK,true);
+	else if(!_ackPending) {
+		_ackPending = true;
+		Timeouts::program(_ackTimeoutId,std::make_memfun(this,&StreamSocket::ackTimeout),
+			DELAYED_ACK_TIMEOUT);
+	}
+}
+
+void StreamSocket::ackTimeout() {
+	_ackPending = false;
+	sendCtrlPkt(TCP::FL_ACK);
+	// the application doesn't wait for the ACK, but make sure that nothing is left behind
+	replyPendingRead();
+}
+
+void StreamSocket::ackSent() {
+	_unackedSegs = 0;
+	if(_ackPending) {
+		_ackPending = false;
+		Timeouts::cancel(_ackTimeoutId);
+	}
+}
+
+ssize_t StreamSocket::sendCtrlPkt(uint8_t flags,bool forceACK) {
 	assert(flags != 0);
 	CircularBuf::seq_type lastAck = _rxCircle.nextExp();
 	CircularBuf::seq_type ack = _rxCircle.getAck();
-	size_t optSize = opt ? sizeof(*opt) : 0;
+	uint8_t opts[MAX_OPT_SIZE];
+	size_t optSize = 0;
 
 	// automatically ACK the any not-yet-ACKed packets, or if we are forced to send an ACK
 	if((flags & ~TCP::FL_ACK) || lastAck != ack || forceACK) {
 		if(lastAck != ack)
 			flags |= TCP::FL_ACK;
-		ssize_t res = TCP::send(remoteIP(),_localPort,remotePort(),flags,opt,optSize,optSize,
-			_txCircle.nextSeq(),(flags & TCP::FL_ACK) ? ack : 0,_rxCircle.windowSize());
+		optSize = buildOptions(opts,flags);
+		// pure ACKs carry the next sequence number we send; data might be queued behind it
+		CircularBuf::seq_type seqNo = (flags & ~TCP::FL_ACK) ? _txCircle.nextSeq() : _sndNxt;
+		ssize_t res = TCP::send(remoteIP(),_localPort,remotePort(),flags,opts,optSize,optSize,
+			seqNo,(flags & TCP::FL_ACK) ? ack : 0,rcvWindow(flags));
 		if(res < 0)
 			return res;
+		if(flags & TCP::FL_ACK)
+			ackSent();
 	}
 
 	// do we expect an response?
@@ -576,63 +871,205 @@ ssize_t StreamSocket::sendCtrlPkt(uint8_t flags,MSSOption *opt,bool forceACK) {
 		_ctrlpkt.seqNo = _txCircle.nextSeq();
 		_ctrlpkt.flags = flags;
 		_ctrlpkt.optSize = optSize;
-		if(opt)
-			_ctrlpkt.option = *opt;
-		_ctrlpkt.timeout = 1000;
+		memcpy(_ctrlpkt.options,opts,optSize);
+		_ctrlpkt.timeout = _rto;
 		_txCircle.push(_txCircle.nextSeq(),CircularBuf::TYPE_CTRL,NULL,0);
-		Timeouts::program(_timeoutId,std::make_memfun(this,&StreamSocket::timeout),_ctrlpkt.timeout);
+		// the control-packet has been sent, if there is no unsent data in front of it
+		if(_sndNxt == _ctrlpkt.seqNo)
+			_sndNxt = _txCircle.nextSeq();
+		if(seqBefore(_sndMax,_sndNxt))
+			_sndMax = _sndNxt;
+		programTimeout(_ctrlpkt.timeout);
 	}
 	return 0;
 }
 
-void StreamSocket::sendData(bool resend) {
-	CircularBuf::seq_type seqNo = _txCircle.nextExp();
-	CircularBuf::seq_type start = resend ? seqNo : _txCircle.nextSeq();
-	/* have all bytes we've sent so far been ACKed? */
-	if(_pending.count && _pending.isWrite() &&
-			seqNo >= _pending.d.write.seqNo - (CircularBuf::seq_type)_pending.d.write.remaining) {
-		/* in this case push new data into the tx-circle in order to send them afterwards */
-		size_t amount = std::min(_remoteWinSize,_pending.d.write.remaining);
-		size_t offset = _pending.count - _pending.d.write.remaining;
-		const char *data = reinterpret_cast<const char*>(_pending.d.write.data) + offset;
-		sassert(_txCircle.push(seqNo,CircularBuf::TYPE_DATA,data,amount) == (ssize_t)amount);
-		_pending.d.write.remaining -= amount;
-	}
-
+void StreamSocket::sendData() {
 	if(_txCircle.available() > 0) {
-		CircularBuf::seq_type lastAck = _rxCircle.nextExp();
-		CircularBuf::seq_type ackNo = _rxCircle.getAck();
+		// we may have up to min(cwnd,rwnd) bytes in flight
+		size_t wnd = std::min(_cwnd,_remoteWinSize);
+		bool idle = inFlight() == 0;
+		size_t sent = 0;
 		// TODO allocate that just once
-		uint8_t *buf = new uint8_t[_mss];
-		size_t left = _remoteWinSize;
-		while(left > 0) {
-			size_t limit = std::min(left,std::min(_mtu,_mss));
-			size_t amount = _txCircle.get(start,buf,limit);
-			if(amount == 0)
+		uint8_t *buf = new uint8_t[MAX_OPT_SIZE + _mss];
+		while(true) {
+			// don't send what the receiver has already got
+			_sndNxt = _txCircle.skipSacked(_sndNxt);
+			size_t flight = inFlight();
+			if(flight >= wnd)
 				break;
 
-			// TODO don't use FL_PSH all the time
-			ssize_t res = TCP::send(remoteIP(),_localPort,remotePort(),
-				TCP::FL_ACK | TCP::FL_PSH,buf,amount,0,start,ackNo,_rxCircle.windowSize());
-			if(res < 0) {
-				print("Sending data failed: %s",strerror(res));
+			// Nagle's algorithm (RFC 896): while data is in flight, hold back new data that doesn't
+			// fill a segment, so that it can grow. if corked, we wait for full segments in any case
+			if(!seqBefore(_sndNxt,_sndMax) && (_cork || (!_nodelay && flight > 0)) &&
+					_txCircle.nextSeq() - _sndNxt < fullSegment())
 				break;
-			}
 
-			start += amount;
-			left -= amount;
+			ssize_t amount = sendSegment(_sndNxt,buf,wnd - flight);
+			if(amount <= 0)
+				break;
+			sent += amount;
 		}
+
+		// start the retransmission timer, if it's not running yet
+		if(sent > 0 && idle)
+			programTimeout(_rto);
 		delete[] buf;
+	}
+}
+
+void StreamSocket::flushWrite() {
+	if(_pending.count > 0 && _pending.isWrite() && _pending.count <= _txCircle.windowSize()) {
+		const void *data = _pending.d.write.data;
+		sassert(_txCircle.push(_txCircle.nextSeq(),CircularBuf::TYPE_DATA,data,_pending.count) ==
+			(ssize_t)_pending.count);
+		replyPending<ssize_t>(_pending.count);
+	}
+}
 
-		// no packet sent yet and something to ACK?
-		if(left == _remoteWinSize && lastAck != ackNo) {
-			seqNo = _txCircle.nextSeq();
-			TCP::send(remoteIP(),_localPort,remotePort(),
-				TCP::FL_ACK,buf,0,0,seqNo,ackNo,_rxCircle.windowSize());
+ssize_t StreamSocket::sendSegment(CircularBuf::seq_type seqNo,uint8_t *buf,size_t limit) {
+	// the options are put in front of the data and count against the MSS (RFC 6691)
+	size_t optSize = buildOptions(buf,TCP::FL_ACK);
+	size_t segSize = std::min(_mtu,_mss);
+	if(segSize <= optSize)
+		return 0;
+	limit = std::min(limit,segSize - optSize);
+	// only fill the hole in front of the next SACKed range
+	limit = std::min(limit,_txCircle.holeSize(seqNo));
+	size_t amount = _txCircle.get(seqNo,buf + optSize,limit);
+	if(amount == 0)
+		return 0;
+
+	// every segment ACKs what we have received so far. PSH is only set on the one that empties
+	// the buffer, so that the receiver doesn't pass every segment on to the application
+	uint8_t flags = TCP::FL_ACK;
+	if(seqNo + amount == _txCircle.nextSeq())
+		flags |= TCP::FL_PSH;
+	CircularBuf::seq_type ackNo = _rxCircle.getAck();
+	ssize_t res = TCP::send(remoteIP(),_localPort,remotePort(),flags,
+		buf,optSize + amount,optSize,seqNo,ackNo,rcvWindow(TCP::FL_ACK));
+	if(res < 0) {
+		print("Sending data failed: %s",strerror(res));
+		return res;
+	}
+	ackSent();
+
+	// measure the RTT of one segment at a time, but never of retransmitted ones (Karn's algorithm)
+	if(!_rttTiming && !seqBefore(seqNo,_sndMax)) {
+		_rttTiming = true;
+		_rttSeq = seqNo + amount;
+		_rttStart = tsctotime(rdtsc());
+	}
+
+	seqNo += amount;
+	if(seqBefore(_sndNxt,seqNo))
+		_sndNxt = seqNo;
+	if(seqBefore(_sndMax,seqNo))
+		_sndMax = seqNo;
+	return amount;
+}
+
+void StreamSocket::retransmit() {
+	PRINT_TCP(_localPort,remotePort(),"retransmitting %u",_txCircle.nextExp());
+	uint8_t *buf = new uint8_t[MAX_OPT_SIZE + _mss];
+	sendSegment(_txCircle.nextExp(),buf,_mss);
+	delete[] buf;
+	// the segment we're timing might have been lost as well
+	_rttTiming = false;
+}
+
+void StreamSocket::initCongestion() {
+	// the initial window (RFC 5681, section 3.1)
+	_cwnd = std::min(4 * _mss,std::max<size_t>(2 * _mss,4380));
+	_ssthresh = std::numeric_limits<size_t>::max();
+	_sndNxt = _sndMax = _txCircle.nextSeq();
+	_recover = _sndNxt - 1;
+	_recovery = false;
+	_dupAcks = 0;
+}
+
+void StreamSocket::handleAck(CircularBuf::seq_type una,CircularBuf::seq_type ackNo,
+		bool dupCandidate,uint32_t tsEcr) {
+	size_t acked = ackNo - una;
+	if(acked == 0) {
+		if(!dupCandidate || !seqBefore(una,_sndMax))
+			return;
+
+		// three duplicate ACKs indicate a lost segment (RFC 5681, section 3.2). but only start a
+		// new recovery if the ACK covers more than the last one (RFC 6582, section 3.2)
+		if(++_dupAcks == DUP_ACK_THRES && !_recovery && seqBefore(_recover,ackNo)) {
+			_ssthresh = std::max<size_t>((_sndMax - una) / 2,2 * _mss);
+			_recover = _sndMax;
+			_recovery = true;
+			retransmit();
+			_cwnd = _ssthresh + DUP_ACK_THRES * _mss;
+		}
+		// every additional duplicate ACK means that a segment has left the network
+		else if(_recovery)
+			_cwnd += _mss;
+		return;
+	}
+
+	// after a timeout we go back to the first unACKed segment, but the old ones might still arrive
+	if(seqBefore(_sndNxt,ackNo))
+		_sndNxt = ackNo;
+
+	// with timestamps, every ACK that advances yields a measurement (RFC 7323, section 4)
+	if(tsEcr != 0) {
+		_rttTiming = false;
+		updateRTT((long)(timestamp() - tsEcr) * 1000);
+	}
+	else if(_rttTiming && !seqBefore(ackNo,_rttSeq)) {
+		_rttTiming = false;
+		updateRTT(tsctotime(rdtsc()) - _rttStart);
+	}
+
+	if(_recovery) {
+		// full ACK: deflate the window and leave fast recovery
+		if(!seqBefore(ackNo,_recover)) {
+			_cwnd = std::min(_ssthresh,std::max<size_t>(_sndMax - ackNo,_mss) + _mss);
+			_recovery = false;
+			_dupAcks = 0;
 		}
-		else if(left != _remoteWinSize)
-			Timeouts::program(_timeoutId,std::make_memfun(this,&StreamSocket::timeout),1000);
+		// partial ACK: the next segment has been lost, too (RFC 6582, section 3.2)
+		else {
+			retransmit();
+			_cwnd -= std::min(_cwnd,acked);
+			if(acked >= _mss)
+				_cwnd += _mss;
+		}
+	}
+	else {
+		_dupAcks = 0;
+		// slow start or congestion avoidance
+		if(_cwnd < _ssthresh)
+			_cwnd += std::min(acked,_mss);
+		else
+			_cwnd += std::max<size_t>(1,(_mss * _mss) / _cwnd);
 	}
+
+	// restart the retransmission timer (RFC 6298, section 5.3)
+	if(seqBefore(ackNo,_sndMax))
+		programTimeout(_rto);
+}
+
+void StreamSocket::updateRTT(long rtt) {
+	// Jacobson/Karels (RFC 6298, section 2)
+	if(_srtt < 0) {
+		_srtt = rtt;
+		_rttvar = rtt / 2;
+	}
+	else {
+		long delta = rtt - _srtt;
+		_srtt += delta / 8;
+		_rttvar += (labs(delta) - _rttvar) / 4;
+	}
+
+	// the clock granularity is the tick of the timeouts
+	long rto = (_srtt + std::max<long>(Timeouts::TICK * 1000,4 * _rttvar)) / 1000;
+	_rto = std::max<long>(MIN_RTO,std::min<long>(MAX_RTO,rto));
+	PRINT_TCP(_localPort,remotePort(),"rtt=%ldus srtt=%ldus rttvar=%ldus rto=%ums",
+		rtt,_srtt,_rttvar,_rto);
 }
 
 int StreamSocket::forkSocket(int nfd,msgid_t mid,esc::ClientDevice<Socket> *dev,SynPacket &syn,
@@ -640,10 +1077,20 @@ int StreamSocket::forkSocket(int nfd,msgid_t mid,esc::ClientDevice<Socket> *dev,
 	StreamSocket *s = new StreamSocket(nfd,esc::Socket::PROTO_TCP);
 	s->_mss = syn.mss;
 	s->_remoteAddr = syn.src;
+	Route route = Route::find(s->remoteIP());
+	if(route.valid())
+		s->_mtu = route.link->mtu() - Ethernet<IPv4<TCP>>().size();
 	s->_localPort = _localPort;
 	s->state(STATE_SYN_RECEIVED);
-	syn.winSize = std::max<size_t>(1024,std::min<size_t>(64 * 1024,syn.winSize));
-	s->_txCircle.init(s->_txCircle.nextSeq(),syn.winSize);
+	// only use the options the peer has offered
+	s->_wsOk = syn.wscale >= 0;
+	s->_sndWScale = s->_wsOk ? syn.wscale : 0;
+	s->_rcvWScale = s->_wsOk ? WSCALE : 0;
+	s->_sackOk = syn.sackOk;
+	s->_tsOk = syn.tsOk;
+	s->_tsRecent = syn.tsVal;
+	s->_txCircle.init(s->_txCircle.nextSeq(),SEND_BUF_SIZE);
+	s->_remoteWinSize = syn.winSize;
 	s->_rxCircle.init(seqNo + 1,RECV_BUF_SIZE);
 	int res = TCP::addSocket(s,s->_localPort,s->remotePort());
 	if(res < 0) {
@@ -661,6 +1108,13 @@ int StreamSocket::forkSocket(int nfd,msgid_t mid,esc::ClientDevice<Socket> *dev,
 	return 0;
 }
 
+void StreamSocket::replyPendingRead() {
+	if(_pending.count > 0 && _pending.isRead() && shouldPush()) {
+		if(replyRead(_pending.mid,_pending.d.read.needsSrc,_pending.d.read.data,_pending.count))
+			_pending.count = 0;
+	}
+}
+
 bool StreamSocket::replyRead(msgid_t mid,bool needsSrc,void *buffer,size_t size) {
 	ssize_t res = _rxCircle.available();
 	uint8_t *buf = reinterpret_cast<uint8_t*>(buffer);
@@ -32,10 +32,28 @@ class TCP;
 
 class StreamSocket : public Socket {
 public:
-	static const size_t SEND_BUF_SIZE	= 32 * 1024;
-	static const size_t RECV_BUF_SIZE	= 32 * 1024;
+	static const size_t SEND_BUF_SIZE	= 256 * 1024;
+	static const size_t RECV_BUF_SIZE	= 256 * 1024;
+	/* the window scale we offer; RECV_BUF_SIZE >> WSCALE has to fit into 16 bits (RFC 7323) */
+	static const uint8_t WSCALE			= 3;
+	static const uint8_t MAX_WSCALE		= 14;
+	/* the maximum size of the TCP options and the max. number of SACK blocks we handle */
+	static const size_t MAX_OPT_SIZE	= 40;
+	static const size_t MAX_SACK_BLOCKS	= 4;
 	static const size_t FORCE_PSH_PERC	= 50;
 	static const size_t DEF_MSS			= 536;
+	/* retransmission timeouts in milliseconds (RFC 6298) */
+	static const uint INIT_RTO			= 1000;
+	static const uint MIN_RTO			= 200;
+	static const uint MAX_RTO			= 60000;
+	/* we give up to send a control-packet if the timeout reaches this value */
+	static const uint MAX_CTRL_TIMEOUT	= 8000;
+	/* the number of duplicate ACKs that trigger a fast retransmit (RFC 5681) */
+	static const size_t DUP_ACK_THRES	= 3;
+	/* ACKs are delayed by up to this number of milliseconds, but at most for this number of
+	 * segments (RFC 1122, section 4.2.3.2) */
+	static const uint DELAYED_ACK_TIMEOUT	= 200;
+	static const size_t DELAYED_ACK_SEGS	= 2;
 
 	enum State {
 		STATE_CLOSED,
@@ -62,9 +80,45 @@ public:
 		uint16_t mss;
 	} A_PACKED;
 
+	struct WScaleOption {
+		uint8_t kind;
+		uint8_t length;
+		uint8_t shift;
+	} A_PACKED;
+
+	struct TimestampOption {
+		uint8_t kind;
+		uint8_t length;
+		uint32_t value;
+		uint32_t echo;
+	} A_PACKED;
+
+	struct SACKBlock {
+		uint32_t start;
+		uint32_t end;
+	} A_PACKED;
+
+	/**
+	 * The options we understand, as received in a segment
+	 */
+	struct Options {
+		explicit Options()
+			: mss(DEF_MSS), wscale(-1), sackPerm(false), hasTS(false), tsVal(), tsEcr(), sackCount() {
+		}
+
+		size_t mss;
+		int wscale;
+		bool sackPerm;
+		bool hasTS;
+		uint32_t tsVal;
+		uint32_t tsEcr;
+		size_t sackCount;
+		CircularBuf::Range sacks[MAX_SACK_BLOCKS];
+	};
+
 	struct CtrlPacket {
 		uint8_t flags;
-		MSSOption option;
+		uint8_t options[MAX_OPT_SIZE];
 		CircularBuf::seq_type seqNo;
 		size_t optSize;
 		uint timeout;
@@ -73,21 +127,37 @@ public:
 		uint16_t mss;
 		esc::Socket::Addr src;
 		uint16_t winSize;
+		int wscale;
+		bool sackOk;
+		bool tsOk;
+		uint32_t tsVal;
 	};
 
 	enum {
-		OPTION_MSS	= 0x2,
+		OPTION_END			= 0x0,
+		OPTION_NOP			= 0x1,
+		OPTION_MSS			= 0x2,
+		OPTION_WSCALE		= 0x3,
+		OPTION_SACK_PERM	= 0x4,
+		OPTION_SACK			= 0x5,
+		OPTION_TIMESTAMP	= 0x8,
 	};
 
 	explicit StreamSocket(int f,int proto)
-			: Socket(f,proto), _closed(false), _timeoutId(Timeouts::allocateId()), _localPort(),
-			  _remoteAddr(), _mtu(), _mss(DEF_MSS), _state(STATE_CLOSED), _ctrlpkt(), _txCircle(),
-			  _rxCircle(), _push() {
+			: Socket(f,proto), _closed(false), _timeoutId(Timeouts::allocateId()),
+			  _ackTimeoutId(Timeouts::allocateId()), _localPort(),
+			  _remoteAddr(), _mtu(), _mss(DEF_MSS), _remoteWinSize(), _state(STATE_CLOSED), _ctrlpkt(),
+			  _txCircle(), _rxCircle(), _push(), _sndNxt(), _sndMax(), _cwnd(), _ssthresh(),
+			  _dupAcks(), _recovery(), _recover(), _srtt(-1), _rttvar(), _rto(INIT_RTO),
+			  _rttTiming(), _rttSeq(), _rttStart(), _wsOk(), _sackOk(), _tsOk(), _sndWScale(),
+			  _rcvWScale(), _tsRecent(), _nodelay(false), _cork(false), _finPending(false),
+			  _ackPending(false), _unackedSegs(), _rcvAdvEdge() {
 		if(proto != esc::Socket::PROTO_TCP)
 			VTHROWE("Protocol " << proto << " is not supported by stream socket",-ENOTSUP);
 
 		_rxCircle.init(0,SEND_BUF_SIZE);
 		_txCircle.init((rand() << 16) | rand(),RECV_BUF_SIZE);
+		_sndNxt = _sndMax = _txCircle.nextSeq();
 	}
 	virtual ~StreamSocket();
 
@@ -99,6 +169,8 @@ public:
 	virtual ssize_t recvfrom(msgid_t mid,bool needsSockAddr,void *buffer,size_t size);
 	virtual void push(const esc::Socket::Addr &sa,const Packet &pkt,size_t offset);
 	virtual int abort();
+	virtual int setopt(esc::Socket::Option opt,int value);
+	virtual int cancel(msgid_t mid);
 	virtual void disconnect();
 
 	esc::port_t localPort() const {
@@ -116,7 +188,24 @@ public:
 
 private:
 	void state(State st);
-	static uint16_t parseMSS(const TCP *tcp);
+	static void parseOptions(const TCP *tcp,Options *opts);
+	size_t buildOptions(uint8_t *opts,uint8_t flags) const;
+	uint16_t rcvWindow(uint8_t flags);
+	bool windowUpdateDue() const;
+
+	static bool seqBefore(CircularBuf::seq_type a,CircularBuf::seq_type b) {
+		return (int32_t)(a - b) < 0;
+	}
+	/**
+	 * @return the size of a full data segment, i.e. without the options in every segment
+	 */
+	size_t fullSegment() const;
+	/**
+	 * @return the number of bytes that have been sent, but not ACKed yet
+	 */
+	size_t inFlight() const {
+		return _sndNxt - _txCircle.nextExp();
+	}
 
 	bool closing() const {
 		return _state == STATE_CLOSED || _state == STATE_CLOSING || _state == STATE_CLOSE_WAIT ||
@@ -137,16 +226,38 @@ private:
 	}
 
 	const char *stateName(State st) const;
-	ssize_t sendCtrlPkt(uint8_t flags,MSSOption *opt = NULL,bool forceACK = false);
-	void sendData(bool resend);
+	ssize_t sendCtrlPkt(uint8_t flags,bool forceACK = false);
+	void sendFin();
+	void sendData();
+	void flushWrite();
+	ssize_t sendSegment(CircularBuf::seq_type seqNo,uint8_t *buf,size_t limit);
+	void retransmit();
 	void timeout();
+	void programTimeout(uint msecs) {
+		Timeouts::program(_timeoutId,std::make_memfun(this,&StreamSocket::timeout),msecs);
+	}
+	void sendAck(bool force);
+	void ackTimeout();
+	void ackSent();
+
+	void initCongestion();
+	void handleAck(CircularBuf::seq_type una,CircularBuf::seq_type ackNo,bool dupCandidate,
+		uint32_t tsEcr);
+	void updateRTT(long rtt);
 
 	int forkSocket(int nfd,msgid_t mid,esc::ClientDevice<Socket> *dev,SynPacket &syn,
 		CircularBuf::seq_type seqNo);
 	bool replyRead(msgid_t mid,bool needsSrc,void *buffer,size_t size);
+	void replyPendingRead();
+	void releaseWrite() {
+		// a pending write has kept a copy of the data
+		if(_pending.count > 0 && _pending.isWrite())
+			delete[] static_cast<const uint8_t*>(_pending.d.write.data);
+	}
 	template<typename T>
 	void replyPending(T result) {
 		if(_pending.count > 0) {
+			releaseWrite();
 			ulong buffer[1];
 			esc::IPCStream is(fd(),buffer,sizeof(buffer),_pending.mid);
 			is << esc::ReplyData(&result,sizeof(T));
@@ -157,8 +268,9 @@ private:
 	/* true if the client closed the socket */
 	bool _closed;
 
-	/* our id for programming timeouts */
+	/* our ids for programming timeouts: retransmissions/state changes and delayed ACKs */
 	int _timeoutId;
+	int _ackTimeoutId;
 
 	/* connection information */
 	esc::port_t _localPort;
@@ -178,5 +290,49 @@ private:
 	CircularBuf _rxCircle;
 	bool _push;
 
+	/* the next sequence number to send and the highest one we've sent so far. the data between
+	 * _txCircle.nextExp() and _sndNxt is in flight, the data behind _sndNxt is not sent yet */
+	CircularBuf::seq_type _sndNxt;
+	CircularBuf::seq_type _sndMax;
+
+	/* congestion control with slow start, congestion avoidance and NewReno's fast
+	 * retransmit/recovery (RFC 5681 and RFC 6582) */
+	size_t _cwnd;
+	size_t _ssthresh;
+	size_t _dupAcks;
+	bool _recovery;
+	CircularBuf::seq_type _recover;
+
+	/* round-trip time estimation (RFC 6298). _srtt and _rttvar are in microseconds; _srtt is
+	 * negative as long as we have no measurement yet */
+	long _srtt;
+	long _rttvar;
+	uint _rto;
+	bool _rttTiming;
+	CircularBuf::seq_type _rttSeq;
+	uint64_t _rttStart;
+
+	/* the negotiated options: window scaling, selective acknowledgements and timestamps
+	 * (RFC 7323 and RFC 2018). the flags are set while we offer an option and cleared if the
+	 * peer doesn't agree. _tsRecent is the timestamp we echo */
+	bool _wsOk;
+	bool _sackOk;
+	bool _tsOk;
+	uint8_t _sndWScale;
+	uint8_t _rcvWScale;
+	uint32_t _tsRecent;
+
+	/* Nagle's algorithm (RFC 896) and the options to control it */
+	bool _nodelay;
+	bool _cork;
+	/* true if the client has closed the socket, but the FIN has to wait for the data in front */
+	bool _finPending;
+
+	/* delayed ACKs: whether the timer is running and the number of segments not ACKed yet */
+	bool _ackPending;
+	size_t _unackedSegs;
+	/* the right edge of the window we've advertised last (for the receiver-side SWS avoidance) */
+	CircularBuf::seq_type _rcvAdvEdge;
+
 	static PortMng<PRIVATE_PORTS_CNT> _ports;
 };
@@ -65,6 +65,7 @@ public:
 		set(MSG_SOCK_RECVFROM,std::make_memfun(this,&SocketDevice::recvfrom));
 		set(MSG_SOCK_SENDTO,std::make_memfun(this,&SocketDevice::sendto));
 		set(MSG_SOCK_ABORT,std::make_memfun(this,&SocketDevice::abort));
+		set(MSG_SOCK_SETOPT,std::make_memfun(this,&SocketDevice::setopt));
 	}
 
 	void open(esc::IPCStream &is) {
@@ -199,6 +200,20 @@ public:
 		is << res << esc::Reply();
 	}
 
+	void setopt(esc::IPCStream &is) {
+		Socket *sock = get(is.fd());
+		esc::Socket::Option opt;
+		int value;
+		is >> opt >> value;
+
+		errcode_t res;
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			res = sock->setopt(opt,value);
+		}
+		is << res << esc::Reply();
+	}
+
 	void close(esc::IPCStream &is) {
 		Socket *sock = get(is.fd());
 		std::lock_guard<std::mutex> guard(mutex);
@@ -18,56 +18,162 @@
  */
 
 #include <sys/common.h>
+#include <sys/test.h>
 #include <sys/thread.h>
 
 #include "timeouts.h"
 
 uint Timeouts::_now;
-int Timeouts::_nextId;
-std::list<Timeouts::Entry> Timeouts::_list;
+std::vector<Timeouts::Entry*> Timeouts::_entries;
+std::vector<int> Timeouts::_freeIds;
+Timeouts::Entry Timeouts::_wheels[LEVELS][SLOTS];
 extern std::mutex mutex;
 
+int Timeouts::allocateId() {
+	if(_freeIds.size() > 0) {
+		int id = _freeIds.back();
+		_freeIds.pop_back();
+		return id;
+	}
+	_entries.push_back(new Entry());
+	return _entries.size() - 1;
+}
+
+void Timeouts::releaseId(int id) {
+	cancel(id);
+	_freeIds.push_back(id);
+}
+
 void Timeouts::program(int id,callback_type *cb,uint msecs) {
 	// first cancel the old one
 	cancel(id);
 
-	// insert new timeout, sorted in ascending order
-	uint ts = _now + msecs;
-	auto it = _list.begin();
-	for(; it != _list.end(); ++it) {
-		if(it->timestamp > ts)
-			break;
-	}
-	_list.insert(it,Entry(id,cb,ts));
+	// fire it with the first tick at which at least <msecs> have passed
+	Entry *e = _entries[id];
+	e->cb = cb;
+	e->expires = _now + std::max<uint>(1,(msecs + TICK - 1) / TICK);
+	insert(e);
 }
 
 void Timeouts::cancel(int id) {
-	for(auto it = _list.begin(); it != _list.end(); ++it) {
-		if(it->id == id) {
-			delete it->cb;
-			_list.erase(it);
+	Entry *e = _entries[id];
+	if(e->cb) {
+		e->unlink();
+		delete e->cb;
+		e->cb = NULL;
+	}
+}
+
+void Timeouts::insert(Entry *e) {
+	uint delta = e->expires - _now;
+	// everything behind the highest wheel is put at its end
+	if(delta >= 1U << (LEVELS * SLOT_BITS)) {
+		delta = (1U << (LEVELS * SLOT_BITS)) - 1;
+		e->expires = _now + delta;
+	}
+
+	uint level = 0;
+	while(delta >= 1U << ((level + 1) * SLOT_BITS))
+		level++;
+	uint slot = (e->expires >> (level * SLOT_BITS)) & (SLOTS - 1);
+	_wheels[level][slot].append(e);
+}
+
+void Timeouts::cascade(uint level) {
+	// all timeouts in this slot expire within the next turn of the wheel below
+	Entry list;
+	list.takeAll(&_wheels[level][(_now >> (level * SLOT_BITS)) & (SLOTS - 1)]);
+	while(!list.empty()) {
+		Entry *e = list.next;
+		e->unlink();
+		insert(e);
+	}
+}
+
+void Timeouts::tick() {
+	_now++;
+
+	// whenever a wheel has turned around, take the next slot of the wheel above
+	for(uint level = 1; level < LEVELS; ++level) {
+		if(_now & ((1U << (level * SLOT_BITS)) - 1))
 			break;
-		}
+		cascade(level);
+	}
+
+	// fire all timeouts of this tick. the callbacks might program and cancel timeouts, including
+	// the ones in our list
+	Entry expired;
+	expired.takeAll(&_wheels[0][_now & (SLOTS - 1)]);
+	while(!expired.empty()) {
+		Entry *e = expired.next;
+		e->unlink();
+		callback_type *cb = e->cb;
+		e->cb = NULL;
+
+		(*cb)();
+
+		delete cb;
 	}
 }
 
 int Timeouts::thread(void*) {
 	while(1) {
 		// TODO we shouldn't wake up all the time when there is no timeout to trigger
-		usleep(1000 * 100);
-		_now += 100;
+		usleep(1000 * TICK);
 
-		// it's sorted
 		std::lock_guard<std::mutex> guard(mutex);
-		while(_list.size() > 0 && _list.front().timestamp <= _now) {
-			auto it = _list.begin();
-			callback_type *cb = it->cb;
-			_list.erase(it);
+		tick();
+	}
+	return 0;
+}
 
-			(*cb)();
+static uint testTicks;
+static uint testFired[8];
 
-			delete cb;
-		}
+static void test_fire(int idx) {
+	testFired[idx] = testTicks;
+}
+
+static void test_cancel(int id) {
+	Timeouts::cancel(id);
+}
+
+void Timeouts::unittest() {
+	static const uint msecs[] = {
+		0, TICK, TICK + TICK / 2, SLOTS * TICK, (SLOTS + 1) * TICK, SLOTS * SLOTS * TICK,
+		5000 * TICK, 3 * TICK
+	};
+	static const uint expected[] = {1, 1, 2, SLOTS, SLOTS + 1, SLOTS * SLOTS, 5000, 0};
+	int ids[ARRAY_SIZE(msecs)];
+
+	testTicks = 0;
+	for(size_t i = 0; i < ARRAY_SIZE(msecs); ++i) {
+		ids[i] = allocateId();
+		testFired[i] = 0;
+		program(ids[i],std::make_bind1_fun<int>(i,test_fire),msecs[i]);
 	}
-	return 0;
+
+	// reprogramming replaces the old timeout
+	program(ids[3],std::make_bind1_fun<int>(3,test_fire),SLOTS * TICK);
+	// canceling works for all wheels
+	cancel(ids[7]);
+
+	// a callback can cancel a timeout that expires in the same tick
+	int first = allocateId();
+	int second = allocateId();
+	program(first,std::make_bind1_fun<int>(second,test_cancel),10 * TICK);
+	program(second,std::make_bind1_fun<int>(7,test_fire),10 * TICK);
+
+	while(testTicks < 5000) {
+		testTicks++;
+		tick();
+	}
+
+	for(size_t i = 0; i < ARRAY_SIZE(msecs); ++i)
+		test_assertUInt(testFired[i],expected[i]);
+
+	for(size_t i = 0; i < ARRAY_SIZE(msecs); ++i)
+		releaseId(ids[i]);
+	releaseId(first);
+	releaseId(second);
 }
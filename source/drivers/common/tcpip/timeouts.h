@@ -21,36 +21,113 @@
 
 #include <sys/common.h>
 #include <functor.h>
-#include <list>
 #include <mutex>
+#include <vector>
 
+/**
+ * The timeouts are kept in a hierarchical timing wheel (Varghese and Lauck). There are LEVELS
+ * wheels with SLOTS slots each, where a slot of one wheel spans a complete turn of the wheel
+ * below. A timeout is put into the lowest wheel that reaches far enough and whenever a wheel has
+ * turned around, the next slot of the wheel above is cascaded down. Thus, programming and
+ * canceling a timeout is O(1) and all timeouts of one tick are fired at once.
+ */
 class Timeouts {
 	Timeouts() = delete;
 
 public:
 	typedef std::Functor<void> callback_type;
 
+	/* the granularity of timeouts in milliseconds */
+	static const uint TICK			= 100;
+	/* 4 wheels with 64 slots each reach 2^24 ticks, i.e. about 19 days */
+	static const uint SLOT_BITS		= 6;
+	static const uint SLOTS			= 1 << SLOT_BITS;
+	static const uint LEVELS		= 4;
+
+private:
+	/* an entry is either a timeout or the list head of a slot */
 	struct Entry {
-		explicit Entry(int _id,callback_type *_cb,uint _timestamp)
-			: id(_id), cb(_cb), timestamp(_timestamp) {
+		explicit Entry() : cb(), expires(), prev(this), next(this) {
+		}
+		Entry(const Entry&) = delete;
+		Entry &operator=(const Entry&) = delete;
+
+		bool empty() const {
+			return next == this;
+		}
+		void append(Entry *e) {
+			e->prev = prev;
+			e->next = this;
+			prev->next = e;
+			prev = e;
+		}
+		void unlink() {
+			prev->next = next;
+			next->prev = prev;
+			prev = next = this;
+		}
+		void takeAll(Entry *head) {
+			if(!head->empty()) {
+				next = head->next;
+				prev = head->prev;
+				next->prev = this;
+				prev->next = this;
+				head->prev = head->next = head;
+			}
 		}
 
-		int id;
 		callback_type *cb;
-		uint timestamp;
+		uint expires;
+		Entry *prev;
+		Entry *next;
 	};
 
+public:
 	static int thread(void*);
 
-	static int allocateId() {
-		return _nextId++;
-	}
+	/**
+	 * Allocates a new id for programming timeouts.
+	 *
+	 * @return the id
+	 */
+	static int allocateId();
+	/**
+	 * Cancels the timeout with given id, if any, and releases the id.
+	 *
+	 * @param id the id
+	 */
+	static void releaseId(int id);
 
+	/**
+	 * Programs a timeout for <id> that calls <cb> in <msecs> milliseconds. A timeout that is
+	 * still programmed for <id> is canceled.
+	 *
+	 * @param id the id
+	 * @param cb the callback (will be deleted after the call)
+	 * @param msecs the number of milliseconds
+	 */
 	static void program(int id,callback_type *cb,uint msecs);
+	/**
+	 * Cancels the timeout with given id, if any.
+	 *
+	 * @param id the id
+	 */
 	static void cancel(int id);
 
+	/**
+	 * Advances the time by one tick and fires all timeouts that expire.
+	 */
+	static void tick();
+
+	static void unittest();
+
 private:
+	static void insert(Entry *e);
+	static void cascade(uint level);
+
+	/* the current time in ticks */
 	static uint _now;
-	static int _nextId;
-	static std::list<Entry> _list;
+	static std::vector<Entry*> _entries;
+	static std::vector<int> _freeIds;
+	static Entry _wheels[LEVELS][SLOTS];
 };
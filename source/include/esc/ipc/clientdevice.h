@@ -119,10 +119,12 @@ public:
 	 * @return the client with given file-descriptor
 	 */
 	C *operator[](int fd) {
+		std::lock_guard<std::mutex> guard(_mutex);
 		typename map_type::iterator it = _clients.find(fd);
 		return it != _clients.end() ? it->second : NULL;
 	}
 	const C *operator[](int fd) const {
+		std::lock_guard<std::mutex> guard(_mutex);
 		typename map_type::const_iterator it = _clients.find(fd);
 		return it != _clients.end() ? it->second : NULL;
 	}
@@ -134,16 +136,16 @@ public:
 	 * @throws if the client does not exist
 	 */
 	C *get(int fd) {
-		typename map_type::iterator it = _clients.find(fd);
-		if(it == _clients.end())
+		C *c = (*this)[fd];
+		if(c == NULL)
 			VTHROWE("No client with id " << fd,-ENOTFOUND);
-		return it->second;
+		return c;
 	}
 	const C *get(int fd) const {
-		typename map_type::const_iterator it = _clients.find(fd);
-		if(it == _clients.end())
+		const C *c = (*this)[fd];
+		if(c == NULL)
 			VTHROWE("No client with id " << fd,-ENOTFOUND);
-		return it->second;
+		return c;
 	}
 
 	/**
@@ -247,7 +249,8 @@ protected:
 
 private:
 	map_type _clients;
-	std::mutex _mutex;
+	/* protects the client-list, because a device might be served by multiple threads */
+	mutable std::mutex _mutex;
 };
 
 }
@@ -45,6 +45,9 @@ public:
 	};
 	typedef std::map<msgid_t,Handler> oplist_type;
 
+	/* the number of messages that are fetched at once in loop() */
+	static const size_t BATCH_SIZE	= 8;
+
 	/**
 	 * Creates the device at given path
 	 *
@@ -110,8 +113,8 @@ public:
 	void unset(msgid_t op);
 
 	/**
-	 * Executes the device-loop, i.e. uses getwork() to get a messages and handles it with the
-	 * appropriate handler.
+	 * Executes the device-loop, i.e. uses getworkv() to get up to BATCH_SIZE messages at once and
+	 * handles them with the appropriate handler.
 	 */
 	void loop();
 
@@ -20,6 +20,7 @@
 #pragma once
 
 #include <esc/ipc/ipcbuf.h>
+#include <sys/arch.h>
 #include <sys/common.h>
 #include <sys/io.h>
 #include <utility>
@@ -390,18 +391,22 @@ private:
 };
 
 class DataBuf {
+	/* buffers of at least this size are page-aligned, so that the kernel can lend their pages to
+	 * the message instead of copying them (see VFSChannel::MIN_LEND_PAGES) */
+	static const size_t ALIGN_MIN	= 4 * PAGE_SIZE;
+
 public:
 	explicit DataBuf(char *d,bool free)
-		: _data(d), _free(free) {
+		: _mem(free ? d : NULL), _data(d) {
 	}
 	explicit DataBuf(size_t size,char *shm,ssize_t shmoff)
-		: _data(shmoff == -1 ? new char[size] : shm + shmoff), _free(shmoff == -1) {
+		: _mem(shmoff == -1 ? alloc(size) : NULL),
+		  _data(shmoff == -1 ? align(_mem,size) : shm + shmoff) {
 	}
 	DataBuf(const DataBuf&) = delete;
 	DataBuf &operator=(const DataBuf&) = delete;
 	~DataBuf() {
-		if(_free)
-			delete[] _data;
+		delete[] _mem;
 	}
 
 	char *data() {
@@ -409,8 +414,17 @@ public:
 	}
 
 private:
+	static char *alloc(size_t size) {
+		return new char[size >= ALIGN_MIN ? size + PAGE_SIZE - 1 : size];
+	}
+	static char *align(char *mem,size_t size) {
+		if(size < ALIGN_MIN)
+			return mem;
+		return reinterpret_cast<char*>(ROUND_PAGE_UP(reinterpret_cast<uintptr_t>(mem)));
+	}
+
+	char *_mem;
 	char *_data;
-	bool _free;
 };
 
 static inline IPCStream &operator<<(IPCStream &is,Send op) {
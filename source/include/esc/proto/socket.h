@@ -54,6 +54,12 @@ public:
 		PROTO_TCP	= 6,
 		PROTO_ICMP	= 1,
 	};
+	enum Option {
+		/* send segments as soon as possible, i.e. disable Nagle's algorithm (SOCK_STREAM) */
+		OPT_TCP_NODELAY,
+		/* send only full segments until the option is cleared again (SOCK_STREAM) */
+		OPT_TCP_CORK,
+	};
 
 	struct Addr {
 	 	friend OStream &operator<<(OStream &os,const Addr &a);
@@ -278,6 +284,20 @@ public:
 		return resp.res;
 	}
 
+	/**
+	 * Sets the option <opt> to <value>.
+	 *
+	 * @param opt the option
+	 * @param value the value (0 = off)
+	 * @throws if the operation failed
+	 */
+	void setopt(Option opt,int value) {
+		errcode_t res;
+		_is << opt << value << SendReceive(MSG_SOCK_SETOPT) >> res;
+		if(res < 0)
+			VTHROWE("setopt(" << opt << ", " << value << ")",res);
+	}
+
 	/**
 	 * Aborts the connection. Obviously, this is only possible for SOCK_STREAM. This operation
 	 * forces an abort of the connection, i.e. it sends an reset if necessary and directly puts
@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <fs/cachepolicy.h>
 #include <sys/common.h>
 #include <stdio.h>
 
@@ -26,18 +27,29 @@ namespace fs {
 
 /* a cached block */
 struct CBlock {
+	/* the queue-id for unused blocks */
+	static const ushort FREE	= 0;
+
 	CBlock *prev;
 	CBlock *next;
 	CBlock *hnext;
 	size_t blockNo;
 	ushort dirty;
 	ushort refs;
+	/* the queue of the replacement policy the block is in */
+	ushort queue;
 	/* NULL indicates an unused entry */
 	void *buffer;
 };
 
 class BlockCache {
-	static const size_t HASH_SIZE	= 256;
+	/* the maximum number of blocks that are read or written at once */
+	static const size_t MAX_BATCH		= 32;
+
+	struct DirtyBlock {
+		block_t blockNo;
+		CBlock *block;
+	};
 
 public:
 	enum {
@@ -51,8 +63,10 @@ public:
 	 * @param fd the file descriptor for the disk device
 	 * @param blocks the number of blocks in the cache
 	 * @param bsize the block size
+	 * @param policy the replacement policy
 	 */
-	explicit BlockCache(int fd,size_t blocks,size_t bsize);
+	explicit BlockCache(int fd,size_t blocks,size_t bsize,
+		CachePolicy::Type policy = CachePolicy::TWO_Q);
 
 	/**
 	 * Destroyes the given cache
@@ -80,7 +94,7 @@ public:
 	virtual bool writeBlocks(const void *buffer,size_t start,size_t blockCount) = 0;
 
 	/**
-	 * Writes all dirty blocks to disk
+	 * Writes all dirty blocks to disk. Contiguous blocks are written at once.
 	 */
 	void flush();
 
@@ -136,7 +150,7 @@ public:
 #if DEBUGGING
 
 	/**
-	 * Prints the used and free blocks
+	 * Prints the used blocks
 	 */
 	void print();
 
@@ -148,29 +162,61 @@ private:
 	 */
 	void acquire(CBlock *b,uint mode);
 	/**
-	 * Releases the tpool_lock for given block
+	 * Releases the tpool_lock for given block. If <invalid> is true, the block is put back into
+	 * the freelist while holding ALLOC_LOCK.
 	 */
-	void doRelease(CBlock *b,bool unlockAlloc);
+	void doRelease(CBlock *b,bool unlockAlloc,bool invalid = false);
 	/**
 	 * Requests the given block and reads it from disk if desired
 	 */
 	CBlock *doRequest(block_t blockNo,bool doRead,uint mode);
 	/**
-	 * Fetches a block-cache-entry
+	 * Reads <block> from disk and, if we're reading sequentially, the following blocks as well.
+	 * Assumes that ALLOC_LOCK is acquired and keeps it.
+	 */
+	bool fetch(CBlock *block);
+	/**
+	 * Writes the given dirty blocks, which have to be contiguous and acquired, to disk
+	 */
+	void writeRun(CBlock **blocks,size_t count);
+	/**
+	 * Fetches a block-cache-entry. If <quiet> is true, no error is printed if all are in use.
+	 */
+	CBlock *getBlock(block_t blockNo,bool quiet = false);
+	/**
+	 * Removes the given block from the hashmap and puts it back into the freelist
+	 */
+	void invalidate(CBlock *b);
+	/**
+	 * Searches for the given block in the hashmap
+	 */
+	CBlock *lookup(block_t blockNo);
+	/**
+	 * Inserts/removes the given block into/from the hashmap
 	 */
-	CBlock *getBlock(block_t blockNo);
+	void hashInsert(CBlock *b);
+	void hashRemove(CBlock *b);
 
 	size_t _blockCacheSize;
 	size_t _blockSize;
+	/* the number of buckets grows with the cache size (always a power of 2) */
+	size_t _hashSize;
 	CBlock **_hashmap;
-	CBlock *_oldestBlock;
-	CBlock *_newestBlock;
+	CachePolicy *_policy;
 	CBlock *_freeBlocks;
 	CBlock *_blockCache;
 	void *_blockmem;
+	/* behind the blocks in the shared buffer, for multi-block transfers */
+	void *_batchmem;
 	ulong _blockshm;
 	ulong _hits;
 	ulong _misses;
+	/* read-ahead state: the block we expect next and the current window size */
+	block_t _raNext;
+	size_t _raWindow;
+	ulong _raBlocks;
+	ulong _writes;
+	ulong _writeBlocks;
 };
 
 }
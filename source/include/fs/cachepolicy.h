@@ -0,0 +1,202 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <sys/common.h>
+#include <stdio.h>
+
+namespace fs {
+
+struct CBlock;
+
+/**
+ * A queue of cached blocks, linked via CBlock::prev and CBlock::next. The newest block is at the
+ * head, the oldest at the tail.
+ */
+class BlockQueue {
+public:
+	explicit BlockQueue(ushort id) : _id(id), _head(), _tail(), _count() {
+	}
+
+	size_t count() const {
+		return _count;
+	}
+	CBlock *head() const {
+		return _head;
+	}
+
+	/**
+	 * Puts <b> at the head of this queue
+	 */
+	void push(CBlock *b);
+	/**
+	 * Removes <b> from this queue
+	 */
+	void remove(CBlock *b);
+	/**
+	 * Removes and returns the oldest block that is not in use
+	 */
+	CBlock *popUnused();
+
+private:
+	ushort _id;
+	CBlock *_head;
+	CBlock *_tail;
+	size_t _count;
+};
+
+/**
+ * The replacement policy of the block cache. It decides which block is reused if the cache is
+ * full. All functions are called with the alloc-lock of the block cache held.
+ */
+class CachePolicy {
+public:
+	enum Type {
+		LRU,
+		TWO_Q,
+	};
+
+	/**
+	 * Creates the policy of given type
+	 *
+	 * @param type the policy
+	 * @param blocks the number of blocks in the cache
+	 * @return the policy
+	 */
+	static CachePolicy *create(Type type,size_t blocks);
+
+	/**
+	 * Determines the number of buckets for a hashmap with <entries> entries
+	 *
+	 * @param entries the number of entries
+	 * @return the number of buckets (a power of 2)
+	 */
+	static size_t hashSize(size_t entries);
+
+	virtual ~CachePolicy() {
+	}
+
+	/**
+	 * Adds the block <b>, that is used for block <blockNo> now, to the cache.
+	 */
+	virtual void insert(CBlock *b,block_t blockNo) = 0;
+	/**
+	 * Notifies the policy that the cached block <b> has been requested.
+	 */
+	virtual void access(CBlock *b) = 0;
+	/**
+	 * Removes <b> from the cache
+	 */
+	virtual void remove(CBlock *b) = 0;
+	/**
+	 * Chooses a block that is not in use, removes it from the cache and returns it.
+	 *
+	 * @return the block or NULL if all blocks are in use
+	 */
+	virtual CBlock *victim() = 0;
+
+	/**
+	 * Prints statistics about the policy to <f>
+	 */
+	virtual void printStats(FILE *f) = 0;
+
+#if DEBUGGING
+	/**
+	 * Prints the cached blocks
+	 */
+	virtual void print() = 0;
+#endif
+};
+
+/**
+ * Least recently used: all blocks are kept in one queue, ordered by the time of the last access.
+ */
+class LRUPolicy : public CachePolicy {
+	static const ushort USED	= 1;
+
+public:
+	explicit LRUPolicy() : CachePolicy(), _used(USED) {
+	}
+
+	virtual void insert(CBlock *b,block_t blockNo);
+	virtual void access(CBlock *b);
+	virtual void remove(CBlock *b);
+	virtual CBlock *victim();
+	virtual void printStats(FILE *f);
+#if DEBUGGING
+	virtual void print();
+#endif
+
+private:
+	BlockQueue _used;
+};
+
+/**
+ * The 2Q algorithm of Johnson and Shasha. Blocks are put into the FIFO queue A1in first and are
+ * only promoted to the LRU queue Am if they are requested again after they have been evicted from
+ * A1in. For that, A1out remembers the numbers of the recently evicted blocks. Thus, blocks that
+ * are touched only once, as by a sequential scan, do not replace the working set in Am.
+ */
+class TwoQPolicy : public CachePolicy {
+	/* the queue-ids */
+	static const ushort IN		= 1;
+	static const ushort MAIN	= 2;
+
+	struct Ghost {
+		block_t blockNo;
+		Ghost *hnext;
+	};
+
+public:
+	/**
+	 * @param blocks the number of blocks in the cache
+	 */
+	explicit TwoQPolicy(size_t blocks);
+	virtual ~TwoQPolicy();
+
+	virtual void insert(CBlock *b,block_t blockNo);
+	virtual void access(CBlock *b);
+	virtual void remove(CBlock *b);
+	virtual CBlock *victim();
+	virtual void printStats(FILE *f);
+#if DEBUGGING
+	virtual void print();
+#endif
+
+private:
+	void remember(block_t blockNo);
+	bool forget(block_t blockNo);
+
+	size_t _inMax;
+	BlockQueue _in;
+	BlockQueue _main;
+	/* A1out as ring-buffer with a hashmap on top */
+	Ghost *_ghosts;
+	size_t _ghostMax;
+	size_t _ghostCount;
+	size_t _ghostPos;
+	Ghost **_ghostMap;
+	size_t _ghostMapSize;
+	ulong _inHits;
+	ulong _mainHits;
+	ulong _ghostHits;
+};
+
+}
@@ -21,8 +21,30 @@
 
 #include <sys/common.h>
 
-#define tpool_lock(...)		0
-#define tpool_unlock(...)	0
+enum {
+	/* request the lock exclusively instead of shared */
+	LOCK_EXCLUSIVE	= 1 << 0,
+	/* keep the lock-entry after the last unlock (for frequently used locks) */
+	LOCK_KEEP		= 1 << 1,
+};
+
+/**
+ * Acquires the readers-writer-lock identified by <ident>. Multiple readers can hold the lock in
+ * parallel, while a writer (LOCK_EXCLUSIVE) always has to be alone. The lock is not recursive.
+ *
+ * @param ident the lock-identifier (e.g., the address of the protected object)
+ * @param flags the flags (LOCK_*)
+ * @return 0 on success
+ */
+int tpool_lock(ulong ident,uint flags);
+
+/**
+ * Releases the lock identified by <ident> again.
+ *
+ * @param ident the lock-identifier
+ * @return 0 on success
+ */
+int tpool_unlock(ulong ident);
 
 namespace fs {
 
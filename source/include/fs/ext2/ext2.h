@@ -84,6 +84,19 @@
 #define EXT2_FEATURE_RO_COMPAT_LARGE_FILE	0x0002
 #define EXT2_FEATURE_RO_COMPAT_BTREE_DIR	0x0004
 
+/* hash algorithms for indexed directories */
+#define EXT2_HASH_LEGACY					0
+#define EXT2_HASH_HALF_MD4					1
+#define EXT2_HASH_TEA						2
+/* the same, but with unsigned chars */
+#define EXT2_HASH_LEGACY_UNSIGNED			3
+#define EXT2_HASH_HALF_MD4_UNSIGNED			4
+#define EXT2_HASH_TEA_UNSIGNED				5
+
+/* superblock flags: whether the directory hashes have been built with signed or unsigned chars */
+#define EXT2_FLAGS_SIGNED_HASH				0x0001
+#define EXT2_FLAGS_UNSIGNED_HASH			0x0002
+
 /* compression algorithms */
 #define EXT2_LZV1_ALG						0x0001
 #define EXT2_LZRW3A_ALG						0x0002
@@ -140,10 +153,10 @@
 #define EXT2_NOCOMPR_FL						0x00000400	/* access raw compressed data */
 #define EXT2_ECOMPR_FL						0x00000800	/* compression error */
 /* compression end */
-#define EXT2_BTREE_FL						0x00010000	/* b-tree format directory */
-#define EXT2_INDEX_FL						0x00010000  /* hash indexed directory */
-#define EXT2_IMAGIC_FL						0x00020000	/* AFS directory */
-#define EXT3_JOURNAL_DATA_FL				0x00040000	/* journal file data */
+#define EXT2_BTREE_FL						0x00001000	/* b-tree format directory */
+#define EXT2_INDEX_FL						0x00001000	/* hash indexed directory */
+#define EXT2_IMAGIC_FL						0x00002000	/* AFS directory */
+#define EXT3_JOURNAL_DATA_FL				0x00004000	/* journal file data */
 #define EXT2_RESERVED_FL					0x80000000	/* reserved for ext2 library */
 
 namespace fs {
@@ -243,7 +256,11 @@ struct Ext2SuperBlock {
 	/* A 32bit value indicating the block group ID of the first meta block group. */
 	uint32_t firstMetaBg;
 	/* UNUSED */
-	uint8_t unused[760];
+	uint8_t reserved[88];
+	/* A 32bit value with miscellaneous flags (EXT2_FLAGS_*). */
+	uint32_t flags;
+	/* UNUSED */
+	uint8_t unused[668];
 } A_PACKED;
 
 struct Ext2BlockGrp {
@@ -273,6 +290,35 @@ struct Ext2DirEntry {
 	char name[];
 } A_PACKED;
 
+/* the root of an indexed directory. It is stored in the first block, behind the '.' entry and
+ * the header of the '..' entry, which spans the rest of the block. */
+struct Ext2DxRootInfo {
+	uint32_t reservedZero;
+	/* the hash algorithm (EXT2_HASH_*) */
+	uint8_t hashVersion;
+	/* the length of this structure, i.e. 8 */
+	uint8_t infoLength;
+	/* the number of index levels below the root; 0 means that the root points to leaves */
+	uint8_t indirectLevels;
+	uint8_t unusedFlags;
+} A_PACKED;
+
+/* an entry in an index block. All entries with a hash >= <hash> are in <block> (a block number
+ * relative to the directory), up to the hash of the next entry. The lowest bit of the hash is set
+ * if the previous block contains entries with the same hash. */
+struct Ext2DxEntry {
+	uint32_t hash;
+	uint32_t block;
+} A_PACKED;
+
+/* the first entry in an index block has the count and limit instead of the hash */
+struct Ext2DxCountLimit {
+	/* the maximum number of entries that fit into this block */
+	uint16_t limit;
+	/* the number of entries in this block, including this one */
+	uint16_t count;
+} A_PACKED;
+
 struct Ext2Inode {
 	uint16_t mode;
 	uint16_t uid;
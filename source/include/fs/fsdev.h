@@ -23,8 +23,10 @@
 #include <esc/proto/fs.h>
 #include <esc/proto/init.h>
 #include <fs/common.h>
+#include <sys/atomic.h>
 #include <sys/common.h>
 #include <sys/stat.h>
+#include <sys/thread.h>
 #include <stdio.h>
 
 namespace fs {
@@ -44,9 +46,18 @@ struct OpenFile : public esc::Client {
 template<class F>
 class FSDevice : public esc::ClientDevice<F> {
 public:
-	explicit FSDevice(FileSystem<F> *fs,const char *fsDev)
-		: esc::ClientDevice<F>(fsDev,0700,DEV_TYPE_FS,DEV_OPEN | DEV_READ | DEV_WRITE | DEV_CLOSE | DEV_SHFILE),
-		  _fs(fs), _clients(0) {
+	/**
+	 * Creates the device for given filesystem
+	 *
+	 * @param fs the filesystem
+	 * @param fsDev the path of the device to create
+	 * @param ops additional operations (e.g., DEV_PAGECACHE, if the files can't change without
+	 *  us knowing it)
+	 */
+	explicit FSDevice(FileSystem<F> *fs,const char *fsDev,uint ops = 0)
+		: esc::ClientDevice<F>(fsDev,0700,DEV_TYPE_FS,
+			DEV_OPEN | DEV_READ | DEV_WRITE | DEV_CLOSE | DEV_SHFILE | ops),
+		  _fs(fs), _clients(0), _workers(NULL), _workerCount(0), _nextWorker(0), _busy(0) {
 		this->set(MSG_FILE_OPEN,std::make_memfun(this,&FSDevice::devopen));
 		this->set(MSG_FILE_CLOSE,std::make_memfun(this,&FSDevice::devclose),false);
 		this->set(MSG_FS_OPEN,std::make_memfun(this,&FSDevice::open));
@@ -70,35 +81,58 @@ public:
 		_fs->sync();
 	}
 
-	void loop() {
-		ulong buf[IPC_DEF_SIZE / sizeof(ulong)];
-		while(1) {
-			msgid_t mid;
-			int fd = getwork(this->id(),&mid,buf,sizeof(buf),this->isStopped() ? GW_NOBLOCK : 0);
-			if(EXPECT_FALSE(fd < 0)) {
-				if(fd != -EINTR) {
-					/* no requests anymore and we should shutdown? */
-					if(this->isStopped())
-						break;
-					printe("getwork failed");
+	/**
+	 * Executes the device-loop. If <threads> is larger than 1, it starts <threads> - 1 additional
+	 * threads and distributes the channels among all threads on open. Thus, requests from
+	 * different channels can be handled in parallel, while the requests of one channel are still
+	 * handled one after another. Note that the filesystem needs to do the locking in this case.
+	 *
+	 * @param threads the number of threads to handle requests
+	 */
+	void loop(size_t threads = 1) {
+		if(threads > 1) {
+			_workers = new tid_t[threads];
+			_workers[_workerCount++] = gettid();
+			for(size_t i = 1; i < threads; ++i) {
+				int tid = startthread(workerThread,this);
+				if(tid < 0) {
+					printe("Unable to start worker thread");
+					break;
 				}
-				continue;
+				_workers[_workerCount++] = tid;
 			}
+		}
+
+		handleRequests();
 
-			esc::IPCStream is(fd,buf,sizeof(buf),mid);
-			this->handleMsg(mid,is);
+		if(_workerCount > 1) {
+			/* the others might still handle a request. wait for them before we quit */
+			while(_busy > 0)
+				yield();
 		}
 	}
 
+	/**
+	 * Stops the device-loop after all remaining requests have been handled.
+	 */
+	void shutdown() {
+		/* let the main thread handle all remaining requests, because it's the only one that does
+		 * not block forever in getworkv after we've stopped */
+		if(_workerCount > 1)
+			this->bindto(_workers[0]);
+		this->stop();
+	}
+
 	void devopen(esc::IPCStream &is) {
-		_clients++;
+		atomic_add(&_clients,+1);
+		assign(is.fd());
 		is << esc::FileOpen::Response::success(0) << esc::Reply();
 	}
 
 	void devclose(esc::IPCStream &is) {
 		::close(is.fd());
-		if(--_clients == 0)
-			this->stop();
+		if(atomic_add(&_clients,-1) == 1)
+			shutdown();
 	}
 
 	void open(esc::IPCStream &is) {
@@ -108,8 +142,10 @@ public:
 
 		F *file;
 		ino_t no = _fs->open(&r.u,path,r.flags,S_IFREG | (r.mode & MODE_PERM),is.fd(),&file);
-		if(no >= 0)
+		if(no >= 0) {
 			this->add(is.fd(),file);
+			assign(is.fd());
+		}
 		is << esc::FileOpen::Response::result(no) << esc::Reply();
 	}
 
@@ -263,6 +299,50 @@ public:
 	}
 
 private:
+	static int workerThread(void *arg) {
+		FSDevice<F> *dev = static_cast<FSDevice<F>*>(arg);
+		dev->handleRequests();
+		return 0;
+	}
+
+	void handleRequests() {
+		ulong bufs[esc::Device::BATCH_SIZE][IPC_DEF_SIZE / sizeof(ulong)];
+		tWorkSlot slots[esc::Device::BATCH_SIZE];
+		for(size_t i = 0; i < esc::Device::BATCH_SIZE; ++i) {
+			slots[i].msg = bufs[i];
+			slots[i].size = sizeof(bufs[i]);
+		}
+
+		while(1) {
+			int count = getworkv(this->id(),slots,esc::Device::BATCH_SIZE,
+				this->isStopped() ? GW_NOBLOCK : 0);
+			if(EXPECT_FALSE(count < 0)) {
+				if(count != -EINTR) {
+					/* no requests anymore and we should shutdown? */
+					if(this->isStopped())
+						break;
+					printe("getwork failed");
+				}
+				continue;
+			}
+
+			atomic_add(&_busy,+1);
+			for(int i = 0; i < count; ++i) {
+				esc::IPCStream is(slots[i].fd,bufs[i],sizeof(bufs[i]),slots[i].mid);
+				this->handleMsg(slots[i].mid,is);
+			}
+			atomic_add(&_busy,-1);
+		}
+	}
+
+	void assign(int fd) {
+		/* the channels are distributed round-robin among the worker threads */
+		if(_workerCount > 1) {
+			size_t next = atomic_add(&_nextWorker,+1);
+			::bindto(fd,_workers[next % _workerCount]);
+		}
+	}
+
 	void handleInfoRead(esc::IPCStream &is,const esc::FileRead::Request &r) {
 		FILE *str = fopendyn();
 		char *data = NULL;
@@ -289,7 +369,11 @@ private:
 	}
 
 	FileSystem<F> *_fs;
-	size_t _clients;
+	long volatile _clients;
+	tid_t *_workers;
+	size_t _workerCount;
+	long volatile _nextWorker;
+	long volatile _busy;
 };
 
 }
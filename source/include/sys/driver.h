@@ -32,6 +32,7 @@ enum {
 	DEV_CANCELSIG					= 1 << 6,	/* cancel-signal (SIGCANCEL) */
 	DEV_CREATSIBL					= 1 << 7,	/* cancelable, if DEV_CANCEL is supported */
 	DEV_SIZE						= 1 << 8,
+	DEV_PAGECACHE					= 1 << 9,	/* file contents may be kept in the page cache */
 };
 
 enum {
@@ -51,6 +52,19 @@ static const int BITS_DEV_TYPE		= 3;
 
 static const int GW_NOBLOCK			= 1;
 
+/* the maximum number of slots for getworkv() */
+static const size_t GW_MAX_SLOTS	= 32;
+
+/* a slot for getworkv() */
+typedef struct {
+	/* the buffer for the message and its size (set by the caller) */
+	void *msg;
+	size_t size;
+	/* the file-descriptor for the client and the message-id (set by getworkv) */
+	int fd;
+	msgid_t mid;
+} tWorkSlot;
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -95,6 +109,22 @@ A_CHECKRET static inline int getwork(int fd,msgid_t *mid,void *msg,size_t size,u
 	return syscall4(SYSCALL_GETWORK,(fd << 2) | flags,(ulong)mid,(ulong)msg,size);
 }
 
+/**
+ * For drivers: Like getwork(), but fetches up to <count> messages at once. That is, it waits (if
+ * GW_NOBLOCK is not provided) until at least one message is available and fills as many slots as
+ * possible afterwards without blocking again. At most one message per client is fetched, so that
+ * the handler for a message can still receive further data from its client.
+ *
+ * @param fd the device fd
+ * @param slots the slots to fill
+ * @param count the number of slots (at most GW_MAX_SLOTS)
+ * @param flags the flags
+ * @return the number of filled slots (> 0) or a negative error-code
+ */
+A_CHECKRET static inline int getworkv(int fd,tWorkSlot *slots,size_t count,uint flags) {
+	return syscall3(SYSCALL_GETWORKV,(fd << 2) | flags,(ulong)slots,count);
+}
+
 /**
  * Binds the device or channel, referenced by <fd>, to the thread with given id.
  * For devices it means that all channels are bound to thread <tid>, i.e. thread <tid> will receive
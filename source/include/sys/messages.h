@@ -133,6 +133,7 @@ enum {
 	MSG_SOCK_RECVFROM				= 1503,	/* receive data from a socket */
 	MSG_SOCK_SENDTO					= 1504,	/* send data to a socket */
 	MSG_SOCK_ABORT					= 1505,	/* aborts the connection, i.e. sends a RST */
+	MSG_SOCK_SETOPT					= 1506,	/* sets an option of a socket */
 
 	/* DNS */
 	MSG_DNS_RESOLVE					= 1600,	/* resolve a name to an address */
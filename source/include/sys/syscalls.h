@@ -116,6 +116,7 @@ enum {
 	SYSCALL_GETTOD,
 	SYSCALL_UTIME,
 	SYSCALL_TRUNCATE,
+	SYSCALL_GETWORKV,
 #	ifdef __x86__
 	SYSCALL_REQIOPORTS,
 	SYSCALL_RELIOPORTS,
@@ -101,6 +101,11 @@ inline bool PageDirBase::isPresent(uintptr_t virt) const {
 	return pdir->pts.isPresent(virt);
 }
 
+inline bool PageDirBase::clearAccessed(A_UNUSED uintptr_t virt) {
+	/* the TLB is managed by software and we don't track accesses */
+	return false;
+}
+
 inline frameno_t PageDirBase::getFrameNo(uintptr_t virt) const {
 	const PageDir *pdir = static_cast<const PageDir*>(this);
 	return pdir->pts.getFrameNo(virt);
@@ -23,11 +23,14 @@
 #define PT_BPL					10
 #define PT_BITS					32
 #define PT_ENTRY_COUNT			(PAGE_SIZE >> 2)
+/* large pages are not supported */
+#define LARGE_PAGE_SIZE			0
 
 /* pte fields */
 #define PTE_PRESENT				(1UL << 0)
 #define PTE_WRITABLE			(1UL << 1)
 #define PTE_NOTSUPER			0
+#define PTE_ACCESSED			0
 #define PTE_LARGE				0
 #define PTE_GLOBAL				0
 #define PTE_EXISTS				(1UL << 2)
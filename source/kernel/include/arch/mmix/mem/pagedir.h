@@ -112,6 +112,11 @@ inline bool PageDirBase::isPresent(uintptr_t virt) const {
 	return pte & PTE_EXISTS;
 }
 
+inline bool PageDirBase::clearAccessed(A_UNUSED uintptr_t virt) {
+	/* the TLB is managed by software and we don't track accesses */
+	return false;
+}
+
 inline frameno_t PageDirBase::getFrameNo(uintptr_t virt) const {
 	const PageDir *pdir = static_cast<const PageDir*>(this);
 	uint64_t pte = pdir->getPTE(virt);
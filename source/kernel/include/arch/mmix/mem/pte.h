@@ -31,9 +31,11 @@
 #define PT_LEVELS					4
 #define PT_BPL						10
 #define PT_BITS						64
+#define LARGE_PAGE_SIZE				0
 
 #define PTE_PRESENT					PTE_READABLE
 #define PTE_LARGE					0
+#define PTE_ACCESSED				0
 #define PTE_NOTSUPER				0
 #define PTE_GLOBAL					0
 #define PTE_NO_EXEC					0
@@ -45,7 +45,8 @@ inline void SMPBase::haltOthers() {
 	/* nothing to do */
 }
 
-inline void SMPBase::ensureTLBFlushed() {
+inline void SMPBase::flushTLB(A_UNUSED PageDir *pdir,A_UNUSED uintptr_t virt,
+		A_UNUSED size_t count) {
 	/* nothing to do */
 }
 
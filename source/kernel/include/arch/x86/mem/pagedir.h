@@ -20,6 +20,7 @@
 #pragma once
 
 #include <common.h>
+#include <atomic.h>
 #include <mem/layout.h>
 #include <mem/pagetables.h>
 #include <spinlock.h>
@@ -56,18 +57,54 @@ class PageDir : public PageDirBase {
 		uintptr_t _end;
 	};
 
+	/* the number of CPUs we can track in <cpus>. the others are assumed to use every pagedir */
+	static const size_t MAX_TRACKED_CPUS	= sizeof(ulong) * 8;
+
 public:
-	explicit PageDir() : PageDirBase(), freeKStack(), lock(), pts() {
+	explicit PageDir() : PageDirBase(), freeKStack(), lock(), pts(), cpus() {
 	}
 
 	PageTables *getPageTables() {
 		return &pts;
 	}
 
+	/**
+	 * Marks this page-directory as loaded or not loaded on CPU <id>. This has to be done before
+	 * CR3 is changed on that CPU.
+	 *
+	 * @param id the CPU-id
+	 * @param loaded whether it will be loaded
+	 */
+	void setLoadedOn(cpuid_t id,bool loaded) {
+		if(id < MAX_TRACKED_CPUS) {
+			if(loaded)
+				Atomic::fetch_and_or(&cpus,1UL << id);
+			else
+				Atomic::fetch_and_and(&cpus,~(1UL << id));
+		}
+	}
+
+	/**
+	 * @param id the CPU-id
+	 * @return true if CPU <id> might have TLB-entries of this page-directory
+	 */
+	bool isLoadedOn(cpuid_t id) const {
+		return id >= MAX_TRACKED_CPUS || (cpus & (1UL << id));
+	}
+
 	static void flushTLB() {
 		CPU::setCR3(CPU::getCR3());
 	}
 
+	/**
+	 * Removes the TLB-entry for <addr> on this CPU
+	 *
+	 * @param addr the virtual address
+	 */
+	static void flushAddr(uintptr_t addr) {
+		asm volatile ("invlpg (%0)" : : "r" (addr));
+	}
+
 	/**
 	 * Enables NXE if possible.
 	 */
@@ -101,6 +138,8 @@ private:
 	uintptr_t freeKStack;
 	SpinLock lock;
 	PageTables pts;
+	/* the CPUs that have this page-directory loaded */
+	volatile ulong cpus;
 
 	static uintptr_t freeAreaAddr;
 	static uint8_t sharedPtbls[][PAGE_SIZE];
@@ -108,7 +147,7 @@ private:
 
 inline void PageTables::flushAddr(uintptr_t addr,bool wasPresent) {
 	if(wasPresent)
-		asm volatile ("invlpg (%0)" : : "r" (addr));
+		PageDir::flushAddr(addr);
 }
 
 inline uintptr_t PageDirBase::getPhysAddr() const {
@@ -136,6 +175,11 @@ inline bool PageDirBase::isPresent(uintptr_t virt) const {
 	return pdir->pts.isPresent(virt);
 }
 
+inline bool PageDirBase::clearAccessed(uintptr_t virt) {
+	PageDir *pdir = static_cast<PageDir*>(this);
+	return pdir->pts.clearAccessed(virt);
+}
+
 inline frameno_t PageDirBase::getFrameNo(uintptr_t virt) const {
 	const PageDir *pdir = static_cast<const PageDir*>(this);
 	return pdir->pts.getFrameNo(virt);
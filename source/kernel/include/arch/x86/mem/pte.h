@@ -35,6 +35,9 @@
 #	define PT_SIZE				(1 << (PAGE_BITS + PT_BPL * 1))
 #endif
 
+/* a page-directory entry with PTE_LARGE maps a whole page-table area (2 MiB or 4 MiB) */
+#define LARGE_PAGE_SIZE			PT_SIZE
+
 /* pte fields */
 #define PTE_PRESENT				(1UL << 0)
 #define PTE_WRITABLE			(1UL << 1)
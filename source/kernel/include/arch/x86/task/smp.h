@@ -40,8 +40,21 @@ public:
 	 */
 	static void apIsRunning();
 
+	/**
+	 * Performs the TLB-flush that has been requested for CPU <id>, if there is any, and
+	 * acknowledges it.
+	 *
+	 * @param id the CPU-id
+	 */
+	static void handleFlush(cpuid_t id);
+
 private:
 	static cpuid_t *log2Phys;
+	/* the state of the current TLB shootdown */
+	static volatile uint8_t *flushPending;
+	static uintptr_t flushAddr;
+	static size_t flushPages;
+	static volatile size_t flushAcks;
 };
 
 inline cpuid_t SMP::getPhysId(cpuid_t logId) {
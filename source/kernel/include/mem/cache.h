@@ -28,6 +28,11 @@ class OStream;
 class Cache {
 	Cache() = delete;
 
+	/* the number of objects per magazine and the number we move from/to the freelist at once */
+	static const size_t MAG_SIZE		= 16;
+	static const size_t MAG_BATCH		= MAG_SIZE / 2;
+	static const size_t CACHE_COUNT		= 11;
+
 	struct Entry {
 		const size_t objSize;
 		size_t totalObjs;
@@ -35,7 +40,25 @@ class Cache {
 		void *freeList;
 	};
 
+	/* a small per-CPU stack of free objects of one cache */
+	struct Magazine {
+		size_t count;
+		void *objs[MAG_SIZE];
+	};
+
+	struct PerCPU {
+		Magazine mags[CACHE_COUNT];
+		ulong hits;
+		ulong misses;
+	};
+
 public:
+	/**
+	 * Creates the per-CPU magazines. Until this has been called, all allocations go directly to
+	 * the global freelists.
+	 */
+	static void init();
+
 	/**
 	 * Allocates <size> bytes from the cache
 	 *
@@ -113,10 +136,15 @@ private:
 	static size_t totalObjSize(size_t sz);
 	static void printBar(OStream &os,size_t mem,size_t maxMem,size_t total,size_t free);
 	static void *get(Entry *c,size_t i);
+	static void *take(Entry *c);
+	static bool refill(Entry *c,Magazine *m);
+	static void flush(Entry *c,Magazine *m,size_t count);
+	static size_t magazineObjs(size_t i);
 
 #if DEBUGGING
 	static bool aafEnabled;
 #endif
 	static SpinLock lock;
 	static Entry caches[];
+	static PerCPU *perCPU;
 };
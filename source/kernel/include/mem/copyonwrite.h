@@ -19,23 +19,26 @@
 
 #pragma once
 
-#include <esc/col/slist.h>
 #include <task/proc.h>
 #include <common.h>
 
+/**
+ * Copy-on-write keeps a reference count for every frame, indexed by the frame-number. The count
+ * is the number of processes that share the frame and is changed with atomic operations, so that
+ * no lock is required.
+ */
 class CopyOnWrite {
 	CopyOnWrite() = delete;
 
-	struct Entry : public esc::SListItem {
-		explicit Entry(frameno_t frameNo) : esc::SListItem(), frameNumber(frameNo), refCount(0) {
-		}
-		frameno_t frameNumber;
-		size_t refCount;
-	};
-
-	static const size_t HEAP_SIZE	= 64;
-
 public:
+	/**
+	 * Creates the reference counts for the frames 0 .. <frames> - 1. Has to be called during the
+	 * initialization of the physical memory management.
+	 *
+	 * @param frames the number of frames
+	 */
+	static void init(size_t frames);
+
 	/**
 	 * Handles a pagefault for given address. Assumes that the pagefault was caused by a write access
 	 * to a copy-on-write page!
@@ -64,11 +67,11 @@ public:
 	static size_t remove(frameno_t frameNo,bool *foundOther);
 
 	/**
-	 * Note that this is intended for debugging or similar only! (not very efficient)
-	 *
 	 * @return the number of different frames that are in the cow-list
 	 */
-	static size_t getFrmCount();
+	static size_t getFrmCount() {
+		return frameCount;
+	}
 
 	/**
 	 * Prints the cow-list
@@ -78,8 +81,9 @@ public:
 	static void print(OStream &os);
 
 private:
-	static Entry *getByFrame(frameno_t frameNo,bool dec);
+	static uint32_t release(frameno_t frameNo);
 
-	static esc::SList<Entry> frames[];
-	static SpinLock lock;
+	static volatile uint32_t *refs;
+	static size_t refsSize;
+	static volatile size_t frameCount;
 };
@@ -35,11 +35,19 @@ class KHeap {
 	struct MemArea {
 		size_t size;
 		void *address;
+		/* next in occupied-map, bucket or freelist */
 		MemArea *next;
+		/* prev in bucket */
+		MemArea *prev;
+		/* next in the start- and end-map of usable areas */
+		MemArea *nextStart;
+		MemArea *nextEnd;
 	};
 
 	/* the number of entries in the occupied map */
 	static const size_t OCC_MAP_SIZE			= 1024;
+	/* usable areas are put into bucket floor(log2(size)) */
+	static const size_t BUCKET_COUNT			= sizeof(size_t) * 8;
 	static const ulong GUARD_MAGIC				= 0xDEADBEEF;
 
 public:
@@ -103,6 +111,15 @@ public:
 	 */
 	static size_t getFreeMem();
 
+	/**
+	 * Note that this function is intended for testing-purposes only!
+	 *
+	 * @return the total number of areas that have been inspected to find usable areas so far
+	 */
+	static size_t getLookupSteps() {
+		return lookupSteps;
+	}
+
 	/**
 	 * Prints the kernel-heap data-structure
 	 *
@@ -137,12 +154,24 @@ private:
 	static bool addMemory(uintptr_t addr,size_t size);
 
 	static bool loadNewAreas();
-	static bool doAddMemory(uintptr_t addr,size_t size);
-	static bool loadNewSpace(size_t size);
+	static MemArea *doAddMemory(uintptr_t addr,size_t size);
+	static MemArea *loadNewSpace(size_t size);
+	static MemArea *findUsable(size_t size);
+	static MemArea *findByStart(uintptr_t addr);
+	static MemArea *findByEnd(uintptr_t addr);
+	static void insertUsable(MemArea *area);
+	static void removeUsable(MemArea *area);
+	static void putFree(MemArea *area);
+	static size_t getBucket(size_t size);
 	static size_t getHash(void *addr);
 
-	/* a linked list of free and usable areas. That means the areas have an address and size */
-	static MemArea *usableList;
+	/* the free and usable areas (that means the areas have an address and size), segregated by
+	 * their size. bit i in bucketMask is set if buckets[i] is not empty */
+	static MemArea *buckets[];
+	static size_t bucketMask;
+	/* hashmaps with the usable areas, key is getHash(start) and getHash(end), respectively */
+	static MemArea *startMap[];
+	static MemArea *endMap[];
 	/* a linked list of free but not usable areas. That means the areas have no address and size */
 	static MemArea *freeList;
 	/* a hashmap with occupied-lists, key is getHash(address) */
@@ -150,10 +179,11 @@ private:
 	/* currently occupied memory */
 	static size_t memUsage;
 	static size_t pages;
+	static size_t lookupSteps;
 	static SpinLock lock;
 };
 
 inline bool KHeap::addMemory(uintptr_t addr,size_t size) {
 	LockGuard<SpinLock> g(&lock);
-	return doAddMemory(addr,size);
+	return doAddMemory(addr,size) != NULL;
 }
@@ -0,0 +1,216 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <esc/col/dlist.h>
+#include <esc/col/treap.h>
+#include <vfs/fileid.h>
+#include <common.h>
+#include <spinlock.h>
+
+class OStream;
+
+/**
+ * The page cache holds the content of files, page by page, indexed by the file and the page-number
+ * in that file. It is used to share the pages of read-only file mappings among all processes that
+ * map them, even if they don't map it at the same time, and to serve read() for filesystems that
+ * support it (DEV_PAGECACHE).
+ *
+ * Every page has a reference count that counts the mappings of the page and the readers that
+ * are currently copying from it. Pages without references stay in the cache until the memory is
+ * needed. In this case, the least recently used ones are reclaimed.
+ */
+class PageCache {
+	PageCache() = delete;
+
+	static const size_t HASH_SIZE	= 512;
+
+	struct FileNode;
+
+	struct Page : public esc::DListItem {
+		explicit Page(FileNode *f,size_t no,frameno_t frm,size_t sz)
+			: esc::DListItem(), file(f), pageNo(no), frame(frm), size(sz), refs(), hnext(), fnext(),
+			  lprev(), lnext() {
+		}
+
+		/* the file or NULL if the page has been invalidated */
+		FileNode *file;
+		size_t pageNo;
+		frameno_t frame;
+		/* the number of valid bytes; the rest is zero */
+		size_t size;
+		size_t refs;
+		/* next page in the same bucket of the page- and frame-hashmap */
+		Page *hnext;
+		Page *fnext;
+		/* the list of unused pages */
+		Page *lprev;
+		Page *lnext;
+	};
+
+	struct FileNode : public esc::TreapNode<FileId> {
+		explicit FileNode(const FileId &id) : esc::TreapNode<FileId>(id), pages() {
+		}
+
+		virtual void print(OStream &os) {
+			os.writef("file=(%u,%u) with %zu pages\n",key().dev,key().ino,pages.length());
+		}
+
+		esc::DList<Page> pages;
+	};
+
+public:
+	/**
+	 * Searches for the given page of the given file and adds a reference to it, if found.
+	 *
+	 * @param id the file
+	 * @param pageNo the page-number in the file
+	 * @param size will be set to the number of valid bytes in the page
+	 * @return the frame of the page or PhysMem::INVALID_FRAME if it is not in the cache
+	 */
+	static frameno_t get(const FileId &id,size_t pageNo,size_t *size);
+
+	/**
+	 * Returns the current generation of the given file, which changes with every invalidation.
+	 * Read it before reading the content that should be passed to insert() or add().
+	 *
+	 * @param id the file
+	 * @return the generation
+	 */
+	static ulong getGeneration(const FileId &id);
+
+	/**
+	 * Puts the given frame into the cache as page <pageNo> of the given file and adds a
+	 * reference to it. If the cache has this page already, a reference to the existing one is
+	 * added instead and the caller has to free <frame>. If the file has been invalidated since
+	 * <gen> has been read, nothing is done.
+	 *
+	 * @param id the file
+	 * @param pageNo the page-number in the file
+	 * @param frame the frame with the content
+	 * @param size the number of valid bytes in the page
+	 * @param gen the generation of the file before the content has been read
+	 * @return the frame of the cached page or PhysMem::INVALID_FRAME if there is not enough memory
+	 *  or the file has changed
+	 */
+	static frameno_t insert(const FileId &id,size_t pageNo,frameno_t frame,size_t size,ulong gen);
+
+	/**
+	 * Copies the given page into a new frame and puts it into the cache, without references. If
+	 * there are no free frames or the file has been invalidated since <gen> has been read, nothing
+	 * is done.
+	 *
+	 * @param id the file
+	 * @param pageNo the page-number in the file
+	 * @param buffer the content (PAGE_SIZE bytes)
+	 * @param size the number of valid bytes in the page
+	 * @param gen the generation of the file before the content has been read
+	 */
+	static void add(const FileId &id,size_t pageNo,const void *buffer,size_t size,ulong gen);
+
+	/**
+	 * Adds a reference to the cached page in the given frame
+	 *
+	 * @param frame the frame
+	 */
+	static void ref(frameno_t frame);
+
+	/**
+	 * Removes a reference from the cached page in the given frame
+	 *
+	 * @param frame the frame
+	 */
+	static void release(frameno_t frame);
+
+	/**
+	 * Removes all pages of the given file from the cache, because the file has changed. Pages
+	 * that are still in use are removed as soon as the last reference is gone.
+	 *
+	 * @param id the file
+	 */
+	static void invalidate(const FileId &id);
+
+	/**
+	 * Frees up to <count> unused pages, starting with the least recently used one.
+	 *
+	 * @param count the number of frames to free
+	 * @return the number of freed frames
+	 */
+	static size_t reclaim(size_t count);
+
+	/**
+	 * @return the number of pages in the cache
+	 */
+	static size_t getPageCount() {
+		return pageCount;
+	}
+	/**
+	 * @return the number of requests that have been served from the cache
+	 */
+	static ulong getHits() {
+		return hits;
+	}
+	/**
+	 * @return the number of requests that were not in the cache
+	 */
+	static ulong getMisses() {
+		return misses;
+	}
+
+	/**
+	 * Prints the page cache
+	 *
+	 * @param os the output-stream
+	 */
+	static void print(OStream &os);
+
+private:
+	static size_t pageHash(const FileId &id,size_t pageNo) {
+		return (id.dev * 31 + id.ino * 17 + pageNo) % HASH_SIZE;
+	}
+	static size_t fileHash(const FileId &id) {
+		return (id.dev * 31 + id.ino * 17) % HASH_SIZE;
+	}
+	static size_t frameHash(frameno_t frame) {
+		return frame % HASH_SIZE;
+	}
+	static Page *find(const FileId &id,size_t pageNo);
+	static Page *findByFrame(frameno_t frame);
+	static void doRef(Page *p);
+	static void remove(Page *p);
+	static void detach(Page *p);
+	static void appendUnused(Page *p);
+	static void removeUnused(Page *p);
+
+	static esc::Treap<FileNode> files;
+	static Page *pages[HASH_SIZE];
+	static Page *frames[HASH_SIZE];
+	/* the generations of the files, which can't be stored in the file-nodes because these are
+	 * deleted together with the last page. files with the same hash share one */
+	static ulong gens[HASH_SIZE];
+	static Page *unusedHead;
+	static Page *unusedTail;
+	static size_t pageCount;
+	static size_t unusedCount;
+	static ulong hits;
+	static ulong misses;
+	static ulong reclaimed;
+	static SpinLock lock;
+};
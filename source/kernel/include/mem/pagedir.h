@@ -173,6 +173,14 @@ public:
 	 */
 	bool isPresent(uintptr_t virt) const;
 
+	/**
+	 * Clears the accessed-bit of the given page, if the architecture maintains one.
+	 *
+	 * @param virt the virtual address
+	 * @return true if the page has been accessed since the last call
+	 */
+	bool clearAccessed(uintptr_t virt);
+
 	/**
 	 * Returns the frame-number of the given virtual address. Assumes that its present.
 	 *
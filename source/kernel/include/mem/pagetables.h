@@ -22,6 +22,7 @@
 #include <mem/physmem.h>
 #include <mem/layout.h>
 #include <assert.h>
+#include <atomic.h>
 #include <common.h>
 #include <cppsupport.h>
 
@@ -50,6 +51,16 @@ public:
 		 */
 		virtual frameno_t allocPage() = 0;
 
+		/**
+		 * Allocates PT_ENTRY_COUNT contiguous frames for a large page, aligned to its size.
+		 *
+		 * @return the first frame, 0 to keep the current frames or PhysMem::INVALID_FRAME if
+		 *  this allocator can't provide them
+		 */
+		virtual frameno_t allocLarge() {
+			return PhysMem::INVALID_FRAME;
+		}
+
 		/**
 		 * Allocates a frame for a page-table
 		 */
@@ -84,6 +95,9 @@ public:
 		virtual frameno_t allocPage() {
 			return 0;
 		}
+		virtual frameno_t allocLarge() {
+			return 0;
+		}
 		virtual void freePage(frameno_t) {
 		}
 	};
@@ -99,6 +113,13 @@ public:
 		virtual frameno_t allocPage() {
 			return _frame++;
 		}
+		virtual frameno_t allocLarge() {
+			if(_frame % PT_ENTRY_COUNT)
+				return PhysMem::INVALID_FRAME;
+			frameno_t res = _frame;
+			_frame += PT_ENTRY_COUNT;
+			return res;
+		}
 		virtual void freePage(frameno_t);
 
 	private:
@@ -203,6 +224,22 @@ public:
 		return pte ? *pte & PTE_PRESENT : false;
 	}
 
+	/**
+	 * Clears the accessed-bit of the given page.
+	 *
+	 * @param virt the virtual address
+	 * @return true if the page has been accessed since the last call
+	 */
+	bool clearAccessed(uintptr_t virt) {
+		uintptr_t base;
+		pte_t *pte = getPTE(virt,&base);
+		if(!pte || !(*pte & PTE_ACCESSED))
+			return false;
+		/* the CPU might set the dirty-bit in the meantime */
+		Atomic::fetch_and_and(pte,~(pte_t)PTE_ACCESSED);
+		return true;
+	}
+
 	/**
 	 * Returns the frame-number of the given virtual address. Assumes that its present.
 	 *
@@ -232,7 +269,9 @@ public:
 	int clone(PageTables *dst,uintptr_t virtSrc,uintptr_t virtDst,size_t count,bool share);
 
 	/**
-	 * Maps <count> pages starting at <virt> in this page-directory.
+	 * Maps <count> pages starting at <virt> in this page-directory. If the allocator provides
+	 * contiguous frames, suitably aligned parts are mapped with large pages (see LARGE_PAGE_SIZE).
+	 * Large pages are split up as soon as only a part of them is changed.
 	 *
 	 * @param virt the virt start-address
 	 * @param count the number of pages to map
@@ -274,6 +313,8 @@ private:
 	static void printPTE(OStream &os,uintptr_t from,uintptr_t to,pte_t page,int level);
 
 	int mapPage(uintptr_t virt,frameno_t frame,pte_t flags,Allocator &alloc);
+	pte_t *getLargePTE(uintptr_t virt,pte_t flags,Allocator &alloc);
+	static int splitLarge(pte_t *pte,Allocator &alloc);
 	frameno_t unmapPage(uintptr_t virt);
 	pte_t *getPTE(uintptr_t virt,uintptr_t *base) const;
 	bool gc(uintptr_t virt,pte_t pte,int level,uint bits,Allocator &alloc);
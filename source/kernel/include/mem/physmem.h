@@ -56,16 +56,32 @@ class PhysMem {
 		frameno_t *frames;
 	};
 
+	static const size_t FRAME_CACHE_SIZE			= 32;
+	static const size_t FRAME_CACHE_BATCH			= 16;
+
+	/* a small per-CPU stack of free user frames */
+	struct FrameCache {
+		SpinLock lock;
+		size_t count;
+		ulong hits;
+		ulong misses;
+		frameno_t frames[FRAME_CACHE_SIZE];
+	};
+
 	static const size_t BITS_PER_BMWORD				= sizeof(tBitmap) * 8;
 	static const ulong KERNEL_MEM_PERCENT			= 20;
 	static const ulong KERNEL_MEM_MIN				= 750;
-	static const ulong MAX_SWAP_AT_ONCE				= 10;
 	static const ulong SWAPIN_JOB_COUNT				= 64;
-	/* the amount of memory at which we should start to set the region-timestamp */
-	static const size_t REG_TS_BEGIN				= 4 * 1024 * PAGE_SIZE;
+	/* the number of buckets for the swap latencies; bucket i counts latencies < 2^i us */
+	static const size_t SWAP_HIST_SIZE				= 20;
+	/* the maximum and the default number of pre-zeroed frames */
+	static const size_t ZERO_POOL_MAX				= 512;
+	static const size_t ZERO_POOL_DEF				= 64;
 
 public:
 	static const frameno_t INVALID_FRAME			= -1;
+	/* the maximum number of pages to swap out at once */
+	static const ulong MAX_SWAP_AT_ONCE				= 10;
 
 	enum MemType {
 		CONT	= 1,
@@ -87,6 +103,12 @@ public:
 	 */
 	static void init();
 
+	/**
+	 * Creates the per-CPU frame caches. Until this has been called, all frames are taken from and
+	 * put back onto the global stacks.
+	 */
+	static void initCaches();
+
 	/**
 	 * @return the total amount of memory
 	 */
@@ -141,13 +163,6 @@ public:
 	 */
 	static size_t getFreeFrames(uint types);
 
-	/**
-	 * Determines whether the region-timestamp should be set (depending on the still available memory)
-	 *
-	 * @return true if so
-	 */
-	static bool shouldSetRegTimestamp();
-
 	/**
 	 * Allocates <count> contiguous frames from the MM-bitmap
 	 *
@@ -181,6 +196,13 @@ public:
 	 */
 	static bool reserve(size_t frameCount,bool swap);
 
+	/**
+	 * Gives back <frameCount> frames that have been reserved with reserve(), but not allocated.
+	 *
+	 * @param frameCount the number of frames
+	 */
+	static void unreserve(size_t frameCount);
+
 	/**
 	 * Allocates one frame. Assumes that it is available. You should announce it with reserve()
 	 * first!
@@ -198,6 +220,45 @@ public:
 	 */
 	static void free(frameno_t frame,FrameType type);
 
+	/**
+	 * Exchanges <frame> for a frame from the pool of pre-zeroed frames, if there is one. Note that
+	 * both have to be user frames.
+	 *
+	 * @param frame the frame that has been allocated for the caller
+	 * @return the zeroed frame or <frame>, if the pool is empty
+	 */
+	static frameno_t getZeroed(frameno_t frame);
+
+	/**
+	 * Clears a free frame and puts it into the pool of pre-zeroed frames, if the pool has not
+	 * reached its target size yet. This is done by the idle-threads with interrupts disabled.
+	 *
+	 * @return true if a frame has been added
+	 */
+	static bool fillZeroPool();
+
+	/**
+	 * @return the number of frames in the pool of pre-zeroed frames
+	 */
+	static size_t getZeroPoolSize() {
+		return zeroCount;
+	}
+
+	/**
+	 * @return the number of frames the idle-threads should keep zeroed
+	 */
+	static size_t getZeroPoolTarget() {
+		return zeroTarget;
+	}
+
+	/**
+	 * Sets the number of frames the idle-threads should keep zeroed. If the pool is larger than
+	 * that, the superfluous frames are freed.
+	 *
+	 * @param frames the target size (at most ZERO_POOL_MAX)
+	 */
+	static void setZeroPoolTarget(size_t frames);
+
 	/**
 	 * Swaps the page with given address for the current process in
 	 *
@@ -213,6 +274,20 @@ public:
 	 */
 	static void print(OStream &os);
 
+	/**
+	 * Prints the swap statistics, including the latency histograms
+	 *
+	 * @param os the output-stream
+	 */
+	static void printSwap(OStream &os);
+
+	/**
+	 * Prints the state of the pool of pre-zeroed frames
+	 *
+	 * @param os the output-stream
+	 */
+	static void printZeroPool(OStream &os);
+
 	/**
 	 * Prints the free frames on the stack
 	 *
@@ -244,10 +319,19 @@ private:
 	static uintptr_t lowerEnd();
 	static frameno_t allocFrame(bool forceLower);
 	static void freeFrame(frameno_t frame);
+	static frameno_t allocUser();
+	static void refill(FrameCache *fc);
+	static void drain(FrameCache *fc,size_t count);
+	static frameno_t steal(FrameCache *own);
+	static frameno_t takeZeroed();
 	static size_t getFreeDef();
+	static size_t getStackFrames();
+	static size_t getCachedFrames();
 	static void markRangeUsed(uintptr_t from,uintptr_t to,bool used);
 	static void doMarkRangeUsed(uintptr_t from,uintptr_t to,bool used);
 	static void markUsed(frameno_t frame,bool used);
+	static void addLatency(volatile ulong *hist,uint64_t cycles);
+	static void printLatency(OStream &os,const char *name,volatile ulong *hist);
 	static void appendJob(SwapInJob *job);
 	static SwapInJob *getJob();
 	static void freeJob(SwapInJob *job);
@@ -265,6 +349,17 @@ private:
 	static StackFrames lower;
 	static StackFrames upper;
 	static SpinLock defLock;
+	/* the free user frames of each CPU; these count as free as well */
+	static FrameCache *frameCaches;
+	/* the pre-zeroed frames; these count as free as well */
+	static frameno_t zeroPool[ZERO_POOL_MAX];
+	static size_t zeroCount;
+	static size_t zeroTarget;
+	/* the number of frames that belong to the pool, including the ones that are being cleared */
+	static volatile size_t zeroFrames;
+	static ulong zeroHits;
+	static ulong zeroMisses;
+	static SpinLock zeroLock;
 
 	static bool initialized;
 
@@ -274,9 +369,11 @@ private:
 	static bool swapEnabled;
 	static bool swapping;
 	static Thread *swapperThread;
+	static volatile ulong swapInHist[SWAP_HIST_SIZE];
+	static volatile ulong swapOutHist[SWAP_HIST_SIZE];
 	static size_t cframes;	/* critical frames; for dynarea, cache and heap */
 	static size_t kframes;	/* kernel frames: for pagedirs, page-tables, kstacks, ... */
-	static size_t uframes;	/* user frames */
+	static volatile size_t uframes;	/* user frames */
 	/* swap-in jobs */
 	static SwapInJob siJobs[];
 	static SwapInJob *siFreelist;
@@ -285,10 +382,3 @@ private:
 	static size_t jobWaiters;
 };
 
-inline bool PhysMem::shouldSetRegTimestamp() {
-	if(!swapEnabled)
-		return false;
-
-	LockGuard<SpinLock> g(&defLock);
-	return getFreeDef() * PAGE_SIZE < REG_TS_BEGIN;
-}
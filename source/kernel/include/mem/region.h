@@ -26,10 +26,11 @@
 #include <mutex.h>
 
 enum {
-	PF_BITCOUNT			= 3,		/* number of bits occupied by real flags */
+	PF_BITCOUNT			= 4,		/* number of bits occupied by real flags */
 	PF_COPYONWRITE		= 1UL,
 	PF_DEMANDLOAD		= 2UL,
 	PF_SWAPPED			= 4UL,
+	PF_CACHED			= 8UL,		/* the frame belongs to the page cache */
 };
 
 enum {
@@ -46,8 +47,13 @@ enum {
 class OStream;
 class VirtMem;
 class OpenFile;
+struct VMRegion;
 
 class Region : public CacheAllocatable {
+	/* the number of pages to load at once from the file on a pagefault */
+	static const size_t FAULT_WINDOW_MIN	= 4;
+	static const size_t FAULT_WINDOW_MAX	= 16;
+
 public:
 	typedef esc::ISList<VirtMem*>::iterator iterator;
 
@@ -144,13 +150,13 @@ public:
 		return pfSize;
 	}
 	/**
-	 * @return the timestamp of last usage (for swapping)
+	 * @return the page at which the swapper continues to search for pages to swap out
 	 */
-	uint64_t getTimestamp() const {
-		return timestamp;
+	size_t getClockHand() const {
+		return clockHand;
 	}
-	void setTimestamp(uint64_t ts) {
-		timestamp = ts;
+	void setClockHand(size_t page) {
+		clockHand = page;
 	}
 
 	/**
@@ -163,6 +169,29 @@ public:
 		pageFlags[page] = flags;
 	}
 
+	/**
+	 * Determines the number of pages to load from file for a pagefault at page <page>. If the
+	 * pagefaults in this region turn out to be sequential, the window grows.
+	 *
+	 * @param page the page that caused the pagefault
+	 * @return the maximum number of pages to load, starting at <page>
+	 */
+	size_t getFaultWindow(size_t page) {
+		if(page == faultNext)
+			faultWindow = MIN(faultWindow * 2,FAULT_WINDOW_MAX);
+		else
+			faultWindow = FAULT_WINDOW_MIN;
+		return faultWindow;
+	}
+	/**
+	 * Sets the page behind the last one that has been loaded from file
+	 *
+	 * @param page the page
+	 */
+	void setFaultEnd(size_t page) {
+		faultNext = page;
+	}
+
 	/**
 	 * @return begin/end for the virtmem objects that use this region
 	 */
@@ -173,6 +202,29 @@ public:
 		return vms.end();
 	}
 
+	/**
+	 * The reverse index from the region to its mappings: all vm-regions that map this region are
+	 * linked via VMRegion::regNext. This way, we can walk through them without searching the
+	 * trees of the virtmem objects.
+	 *
+	 * @return the first vm-region that maps this region (NULL if there is none)
+	 */
+	VMRegion *getVMRegs() const {
+		return vmregs;
+	}
+	/**
+	 * Adds the given vm-region to the mappings of this region
+	 *
+	 * @param vm the vm-region
+	 */
+	void addVMReg(VMRegion *vm);
+	/**
+	 * Removes the given vm-region from the mappings of this region, if it is there
+	 *
+	 * @param vm the vm-region
+	 */
+	void remVMReg(VMRegion *vm);
+
 	/**
 	 * Counts the number of present and swapped out pages in the region
 	 *
@@ -212,7 +264,7 @@ public:
 	bool addTo(VirtMem *vm);
 
 	/**
-	 * Removes the given virtmem-object as user from the region
+	 * Removes the given virtmem-object as user from the region, including its mapping
 	 *
 	 * @param vm the virtmem-object
 	 * @return true if found
@@ -254,10 +306,14 @@ private:
 	off_t offset;
 	size_t loadCount;
 	size_t byteCount;
-	uint64_t timestamp;
+	size_t clockHand;
+	/* the state for loading multiple pages at once */
+	size_t faultNext;
+	size_t faultWindow;
 	size_t pfSize;			/* size of pageFlags */
 	ulong *pageFlags;		/* flags for each page; upper bits: swap-block, if swapped */
 	esc::ISList<VirtMem*> vms;
+	VMRegion *vmregs;
 	Mutex lock;				/* lock for the procs-field (all others can't change or belong to
 	 	 	 	 	 	 	   exactly 1 process, which is locked anyway) */
 };
@@ -280,7 +336,3 @@ inline bool Region::addTo(VirtMem *vm) {
 	assert(vms.length() == 0 || (flags & RF_SHAREABLE));
 	return vms.append(vm);
 }
-
-inline bool Region::remFrom(VirtMem *vm) {
-	return vms.remove(vm);
-}
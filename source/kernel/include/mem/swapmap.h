@@ -30,7 +30,6 @@ class SwapMap {
 
 	struct Block {
 		uint refCount;
-		Block *next;
 	};
 
 public:
@@ -45,11 +44,13 @@ public:
 	static bool init(size_t swapSize);
 
 	/**
-	 * Allocates 1 block on the swap-device
+	 * Allocates <count> contiguous blocks on the swap-device
 	 *
-	 * @return the starting block on the swap-device or INVALID if no free space is left
+	 * @param count the number of blocks
+	 * @return the starting block on the swap-device or INVALID if there are not enough
+	 *  contiguous free blocks
 	 */
-	static ulong alloc();
+	static ulong alloc(size_t count = 1);
 
 	/**
 	 * Increases the references of the given block
@@ -96,7 +97,7 @@ private:
 	static size_t totalBlocks;
 	static size_t freeBlocks;
 	static Block *swapBlocks;
-	static Block *freeList;
+	static size_t rover;
 	static SpinLock lock;
 };
 
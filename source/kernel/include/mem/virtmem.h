@@ -81,7 +81,8 @@ public:
 	static int pagefault(uintptr_t addr,bool write);
 
 	/**
-	 * Swaps <count> pages out. It searches for the best suited page to swap out.
+	 * Swaps <count> pages out. The pages are chosen by the CLOCK algorithm, based on the
+	 * accessed-bits in the page tables, and written to contiguous blocks on the device, if possible.
 	 *
 	 * @param pid the process-id for writing the page-content to <file>
 	 * @param file the file to write to
@@ -100,14 +101,6 @@ public:
 	 */
 	static bool swapIn(pid_t pid,OpenFile *file,Thread *t,uintptr_t addr);
 
-	/**
-	 * Sets the timestamp for all regions that are used by the given thread
-	 *
-	 * @param t the thread
-	 * @param timestamp the timestamp to set
-	 */
-	static void setTimestamp(Thread *t,uint64_t timestamp);
-
 	explicit VirtMem(Proc *p)
 		: proc(p), pagedir(), ownFrames(), sharedFrames(), swapped(), freeStackAddr(),
 		  dataAddr(), freemap(FREE_AREA_BEGIN,FREE_AREA_END - FREE_AREA_BEGIN), regtree(this),
@@ -314,6 +307,32 @@ public:
 	 */
 	int cloneAll(VirtMem *dst);
 
+	/**
+	 * Lends the <count> pages at <addr> (current) to somebody else, e.g. a message. That is, the
+	 * pages are marked copy-on-write and an additional reference is added to every frame, which
+	 * belongs to the borrower. This is only possible for present pages of private and writable
+	 * regions.
+	 *
+	 * @param addr the page-aligned address
+	 * @param count the number of pages
+	 * @param frames will be set to the frames of the pages
+	 * @return true if the pages have been lent, false if they have to be copied instead
+	 */
+	bool lendPages(uintptr_t addr,size_t count,frameno_t *frames);
+
+	/**
+	 * Replaces the <count> pages at <addr> (current) by copy-on-write mappings of the given frames,
+	 * which have been lent by lendPages(). The reference of the borrower is taken over and the
+	 * corresponding entry in <frames> is set to PhysMem::INVALID_FRAME. Pages that can't be
+	 * replaced are left alone and the caller has to copy the frame content to them.
+	 *
+	 * @param addr the page-aligned address
+	 * @param count the number of pages
+	 * @param frames the frames
+	 * @return the number of replaced pages
+	 */
+	size_t borrowPages(uintptr_t addr,size_t count,frameno_t *frames);
+
 	/**
 	 * If <amount> is positive, the region will be grown by <amount> pages. If negative it
 	 * will be shrinked. If 0 it returns the current offset to the region-beginning, in pages.
@@ -398,10 +417,13 @@ private:
 		swapCount = 0;
 	}
 
-	static Region *getLRURegion();
-	static ssize_t getPgIdxForSwap(const Region *reg);
+	static Region *getSwapPages(size_t *pages,size_t max,size_t *count);
+	static size_t getSwapPagesOf(Region *reg,size_t *pages,size_t max);
+	static bool clearAccessed(Region *reg,size_t index);
 	static void setSwappedOut(Region *reg,size_t index);
 	static void setSwappedIn(Region *reg,size_t index,frameno_t frameNo);
+	static void setDropped(Region *reg,size_t index);
+	static bool isCacheable(const Region *reg,size_t page);
 
 	int lockRegion(VMRegion *vm,int flags);
 	int populatePages(VMRegion *vm,size_t count);
@@ -410,7 +432,9 @@ private:
 	void doUnmap(VMRegion *vm);
 	size_t doGrow(VMRegion *vm,ssize_t amount);
 	int demandLoad(VMRegion *vm,uintptr_t addr);
-	int loadFromFile(VMRegion *vm,uintptr_t addr,size_t loadCount);
+	size_t faultAround(VMRegion *vm,uintptr_t addr);
+	int loadFromFile(VMRegion *vm,uintptr_t addr,size_t pages);
+	void mapDemandLoaded(VMRegion *vm,uintptr_t addr,frameno_t frame);
 	uintptr_t findFreeStack(size_t byteCount,ulong rflags);
 	bool isOccupied(uintptr_t start,uintptr_t end) const;
 	uintptr_t getFirstUsableAddr() const;
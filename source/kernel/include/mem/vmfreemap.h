@@ -55,9 +55,10 @@ public:
 	 *
 	 * @param map the map
 	 * @param size the size of the area
+	 * @param align the alignment of the area (0 or PAGE_SIZE = none)
 	 * @return the address of 0 if failed
 	 */
-	uintptr_t allocate(size_t size);
+	uintptr_t allocate(size_t size,size_t align = 0);
 
 	/**
 	 * Allocates an area in the given map at the specified address, that is <size> bytes large.
@@ -28,11 +28,12 @@
 
 class Region;
 class VirtMem;
+class VMTree;
 class OStream;
 
 struct VMRegion : public esc::DListTreapNode<uintptr_t> {
     explicit VMRegion(Region *_reg,uintptr_t _virt)
-    	: esc::DListTreapNode<uintptr_t>(_virt), fileuse(), reg(_reg) {
+    	: esc::DListTreapNode<uintptr_t>(_virt), fileuse(), reg(_reg), tree(), regNext() {
     }
 
     virtual bool matches(uintptr_t key);
@@ -51,12 +52,21 @@ struct VMRegion : public esc::DListTreapNode<uintptr_t> {
     	key(_virt);
     }
 
+    /**
+     * @return the virtmem object this vm-region belongs to
+     */
+    VirtMem *getVM() const;
+
     virtual void print(OStream &os) {
 		os.writef("virt=%p region=%p\n",virt(),reg);
     }
 
     ShFiles::FileUsage *fileuse;
 	Region *reg;
+	/* the tree we're in */
+	VMTree *tree;
+	/* the next vm-region that maps <reg> (see Region::getVMRegs) */
+	VMRegion *regNext;
 };
 
 class VMTree {
@@ -69,7 +79,7 @@ public:
 	 *
 	 * @param vm the VirtMem object to which it belongs
 	 */
-	explicit VMTree(VirtMem *vm) : virtmem(vm), regs(), next() {
+	explicit VMTree(VirtMem *vm) : virtmem(vm), regs(), lastHit(), next() {
 	}
 
 	/**
@@ -103,6 +113,22 @@ public:
 		regMutex.up();
 	}
 
+	/**
+	 * The clock hand of the swapper: the tree and the index of the region in that tree at which
+	 * the next search for pages to swap out starts. Requires the list of trees to be locked.
+	 *
+	 * @param index will be set to the index of the region
+	 * @return the tree (NULL = the first one)
+	 */
+	static VMTree *getClockHand(size_t *index) {
+		*index = clockIndex;
+		return clockTree;
+	}
+	static void setClockHand(VMTree *tree,size_t index) {
+		clockTree = tree;
+		clockIndex = index;
+	}
+
 	/**
 	 * @return the virtmem object it belongs to
 	 */
@@ -145,19 +171,26 @@ public:
 	bool available(uintptr_t addr,size_t size) const;
 
 	/**
-	 * Finds a vm-region in the tree by an address. That is, it walks through the binary tree,
-	 * which is pretty fast.
+	 * Finds a vm-region in the tree by an address. Since consecutive pagefaults and user-accesses
+	 * tend to hit the same region, we check the last found region first. Otherwise, it walks
+	 * through the binary tree, which is pretty fast as well.
 	 *
 	 * @param addr the address to search for
 	 * @return the region or NULL if not found
 	 */
 	VMRegion *getByAddr(uintptr_t addr) const {
-		return regs.find(addr);
+		VMRegion *vm = lastHit;
+		if(vm && vm->matches(addr))
+			return vm;
+		vm = regs.find(addr);
+		if(vm)
+			lastHit = vm;
+		return vm;
 	}
 
 	/**
-	 * Finds a vm-region in the tree by a region. That is, it walks through the linked list,
-	 * which takes a bit longer than searching for an address.
+	 * Finds a vm-region in the tree by a region. That is, it walks through the vm-regions that
+	 * map <reg>, which are usually only a few. Requires <reg> to be locked.
 	 *
 	 * @param reg the region to search for.
 	 * @return the region or NULL if not found
@@ -183,10 +216,17 @@ public:
 private:
 	VirtMem *virtmem;
 	esc::DListTreap<VMRegion> regs;
+	mutable VMRegion *lastHit;
 	VMTree *next;
 
 	/* mutex for accessing/changing the list of all vm-regions */
 	static Mutex regMutex;
 	static VMTree *regList;
 	static VMTree *regListEnd;
+	static VMTree *clockTree;
+	static size_t clockIndex;
 };
+
+inline VirtMem *VMRegion::getVM() const {
+	return tree->getVM();
+}
@@ -78,6 +78,7 @@ private:
 	// driver
 	static int createdev(Thread *t,IntrptStackFrame *stack);
 	static int getwork(Thread *t,IntrptStackFrame *stack);
+	static int getworkv(Thread *t,IntrptStackFrame *stack);
 	static int bindto(Thread *t,IntrptStackFrame *stack);
 
 	// io
@@ -74,11 +74,16 @@ public:
 	static void wakeup(uint event,evobj_t object,bool all = true);
 
 	/**
-	 * @return the current ready-mask. 1 bit per priority.
+	 * @param cpu the CPU
+	 * @return the current ready-mask of CPU <cpu>. 1 bit per priority.
+	 */
+	static ulong getReadyMask(cpuid_t cpu);
+
+	/**
+	 * @param cpu the CPU
+	 * @return the lock that is held while CPU <cpu> switches from one thread to another
 	 */
-	static ulong getReadyMask() {
-		return readyMask;
-	}
+	static SpinLock *getSwitchLock(cpuid_t cpu);
 
 	/**
 	 * Blocks the given thread
@@ -102,7 +107,7 @@ public:
 	static void unblockQuick(Thread *t);
 
 	/**
-	 * Prints the status of the scheduler
+	 * Prints the status of the scheduler, i.e. the ready-queues of all CPUs
 	 *
 	 * @param os the output-stream
 	 */
@@ -122,6 +127,10 @@ public:
 	static const char *getEventName(uint event);
 
 private:
+	/* the ready-queues of one CPU. the threads in it belong to this CPU, i.e. it is only changed
+	 * by this CPU, unless other CPUs make threads ready or steal them when they are idle */
+	struct RunQueue;
+
 	/**
 	 * Adds the given thread as an idle-thread to the scheduler
 	 *
@@ -174,6 +183,22 @@ private:
 	 */
 	static void removeThread(Thread *t);
 
+	/**
+	 * Locks the ready-queue of the CPU the given thread belongs to
+	 *
+	 * @param t the thread
+	 * @return the locked queue
+	 */
+	static RunQueue *lockQueue(Thread *t);
+
+	/**
+	 * Tries to steal a ready thread from another CPU. Expects that the queue of <cpu> is locked.
+	 *
+	 * @param cpu the CPU that steals
+	 * @return the stolen thread or NULL
+	 */
+	static Thread *steal(cpuid_t cpu);
+
 	static void enqueue(Thread *t);
 	static void enqueueQuick(Thread *t);
 	static void dequeue(Thread *t);
@@ -181,28 +206,8 @@ private:
 	static bool setReadyState(Thread *t);
 	static void print(OStream &os,esc::DList<Thread> *q);
 
+	/* protects the event-lists. if the queue of a thread is locked as well, this one comes first */
 	static SpinLock lock;
-	static ulong readyMask;
-	static esc::DList<Thread> rdyQueues[];
+	static RunQueue *runQueues;
 	static esc::DList<Thread> evlists[EV_COUNT];
-	static size_t rdyCount;
-	static Thread **idleThreads;
 };
-
-inline void Sched::block(Thread *t) {
-	assert(t != NULL);
-	LockGuard<SpinLock> g(&lock);
-	setBlocked(t);
-}
-
-inline void Sched::unblock(Thread *t) {
-	assert(t != NULL);
-	LockGuard<SpinLock> g(&lock);
-	setReady(t);
-}
-
-inline void Sched::unblockQuick(Thread *t) {
-	assert(t != NULL);
-	LockGuard<SpinLock> g(&lock);
-	setReadyQuick(t);
-}
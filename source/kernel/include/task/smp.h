@@ -28,7 +28,6 @@
 #define IPI_FLUSH_TLB		52
 #define IPI_WAIT			53
 #define IPI_HALT			54
-#define IPI_FLUSH_TLB_ACK	55
 #define IPI_CALLBACK		56
 
 class Sched;
@@ -120,22 +119,21 @@ public:
 	 */
 	static void haltOthers();
 
-	/**
-	 * Tells all other CPUs to flush their TLB and waits until they have done that
-	 */
-	static void ensureTLBFlushed();
-
 	/**
 	 * Wakes up another CPU, so that it can run a thread
 	 */
 	static void wakeupCPU();
 
 	/**
-	 * If there is any CPU that uses the given pagedir, it is flushed
+	 * Removes the TLB-entries for the <count> pages at <virt> of the given pagedir on all other
+	 * CPUs that use it and waits until they have done that. Small ranges are flushed page by
+	 * page, larger ones by flushing the whole TLB.
 	 *
 	 * @param pdir the pagedir
+	 * @param virt the virtual start-address
+	 * @param count the number of pages
 	 */
-	static void flushTLB(PageDir *pdir);
+	static void flushTLB(PageDir *pdir,uintptr_t virt,size_t count);
 
 	/**
 	 * Calls the callback for CPU <id>
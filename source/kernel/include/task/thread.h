@@ -305,12 +305,13 @@ public:
 	}
 
 	/**
-	 * Tests whether there are other threads with a higher priority than this one.
+	 * Tests whether there are other threads with a higher priority than this one on its CPU.
+	 * Ready threads of other CPUs are not considered, because we would not switch to them.
 	 *
 	 * @return true if so
 	 */
 	bool haveHigherPrio() {
-		ulong mask = Sched::getReadyMask();
+		ulong mask = Sched::getReadyMask(cpu);
 		return mask & ~((1UL << (priority + 1)) - 1);
 	}
 
@@ -433,6 +434,15 @@ public:
 	 */
 	bool reserveFrames(size_t count,bool swap = true);
 
+	/**
+	 * Tries to reserve <count> additional frames without swapping. In contrast to reserveFrames(),
+	 * the frames that have already been reserved are kept, if that fails.
+	 *
+	 * @param count the number of frames to reserve
+	 * @return the number of frames that have been reserved
+	 */
+	size_t tryReserveFrames(size_t count);
+
 	/**
 	 * Removes one frame from the collection of frames of this thread. This will always succeed,
 	 * because the function assumes that you have called reserveFrames() previously.
@@ -670,3 +680,11 @@ inline void ThreadBase::discardFrames() {
  * The start-function for the idle-thread
  */
 EXTERN_C void thread_idle();
+
+/**
+ * Does the work that is left for idle CPUs, like clearing frames in advance. Is called by the
+ * idle-thread with interrupts disabled.
+ *
+ * @return true if there might be more work to do
+ */
+EXTERN_C bool thread_idleWork();
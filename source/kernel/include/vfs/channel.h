@@ -19,11 +19,25 @@
 
 #pragma once
 
+#include <esc/col/dlist.h>
 #include <esc/col/slist.h>
 #include <vfs/node.h>
 #include <common.h>
 
 class VFSChannel : public VFSNode {
+	friend class VFSDevice;
+
+	/* the maximum number of pages to read at once when filling the page cache */
+	static const size_t MAX_READ_PAGES	= 16;
+	/* the minimum number of pages of a message to lend them instead of copying the data */
+	static const size_t MIN_LEND_PAGES	= 4;
+
+	/**
+	 * A message is usually followed by its data. Large messages with page-aligned data may carry
+	 * the frames of the sender instead, which are lent to the message copy-on-write. In this case,
+	 * the message is followed by <pages> frame-numbers and the remaining bytes of the last,
+	 * incomplete page.
+	 */
 	struct Message : public esc::SListItem {
 		static void *operator new(size_t size, size_t msgSize) {
 			return Cache::alloc(size + msgSize);
@@ -32,14 +46,30 @@ class VFSChannel : public VFSNode {
 			Cache::free(ptr);
 		}
 
-		explicit Message(size_t _length) : esc::SListItem(), id(), length(_length) {
+		explicit Message(size_t _length) : esc::SListItem(), id(), length(_length), pages() {
+		}
+		~Message();
+
+		frameno_t *frames() {
+			return reinterpret_cast<frameno_t*>(this + 1);
 		}
 
 		msgid_t id;
 		size_t length;
+		size_t pages;
 	};
 
 public:
+	/**
+	 * The item to put a channel into the ready-list of its device
+	 */
+	struct ReadyItem : public esc::DListItem {
+		explicit ReadyItem(VFSChannel *c) : esc::DListItem(), chan(c), queued(false) {
+		}
+		VFSChannel *chan;
+		bool queued;
+	};
+
 	/**
 	 * Creates a new channel for given process
 	 *
@@ -71,6 +101,11 @@ public:
 		handler = tid;
 	}
 
+	/**
+	 * @return true if the driver allows us to keep the content of its files in the page cache
+	 */
+	bool usePageCache() const;
+
 	/**
 	 * Checks whether the channel has work to do for the server
 	 *
@@ -159,8 +194,14 @@ protected:
 	virtual void invalidate();
 
 private:
+	static Message *createMsg(USER const void *data,size_t size,int *res);
+	static Message *lendMsg(USER const void *data,size_t size,int *res);
+	static int copyMsg(USER void *data,Message *msg);
 	static Message *getMsg(esc::SList<Message> *list,msgid_t mid,ushort flags);
 	uint getReceiveFlags() const;
+	ssize_t readMsg(pid_t pid,OpenFile *file,void *buffer,off_t offset,size_t count);
+	ssize_t readCached(pid_t pid,OpenFile *file,void *buffer,off_t offset,size_t count);
+	bool isCacheable(pid_t pid);
 	int isSupported(int op) const;
 	int openForDriver();
 	void closeForDriver();
@@ -170,9 +211,13 @@ private:
 	bool closed;
 	void *shmem;
 	size_t shmemSize;
+	/* whether the file may be read via the page cache (-1 = not known yet) */
+	int cacheable;
 	/* a list for sending messages to the device */
 	esc::SList<Message> sendList;
 	/* a list for reading messages from the device */
 	esc::SList<Message> recvList;
+	/* is in the ready-list of the device as long as the send-list is not empty */
+	ReadyItem readyItem;
 	static uint16_t nextRid;
 };
@@ -19,11 +19,14 @@
 
 #pragma once
 
+#include <esc/col/dlist.h>
 #include <sys/messages.h>
+#include <vfs/channel.h>
 #include <vfs/node.h>
 #include <common.h>
 #include <errno.h>
 #include <semaphore.h>
+#include <spinlock.h>
 
 class VFSDevice : public VFSNode {
 public:
@@ -84,16 +87,43 @@ public:
 	}
 
 	/**
-	 * Tells the server that the given client has been removed. This way, it can reset the internal
-	 * state that stores which client will be served next.
+	 * Puts the given channel at the end of the ready-list, if it is not already in there. Should be
+	 * called whenever a message is added to the send-list of the channel.
+	 *
+	 * @param chan the channel
+	 */
+	void addReady(VFSChannel *chan) {
+		LockGuard<SpinLock> g(&readyLock);
+		if(!chan->readyItem.queued) {
+			readyList.append(&chan->readyItem);
+			chan->readyItem.queued = true;
+		}
+	}
+
+	/**
+	 * Removes the given channel from the ready-list, if it is in there. Should be called whenever
+	 * the send-list of the channel becomes empty.
+	 *
+	 * @param chan the channel
+	 */
+	void removeReady(VFSChannel *chan) {
+		LockGuard<SpinLock> g(&readyLock);
+		if(chan->readyItem.queued) {
+			readyList.remove(&chan->readyItem);
+			chan->readyItem.queued = false;
+		}
+	}
+
+	/**
+	 * Tells the server that the given client has been removed. This way, it can remove it from the
+	 * list of clients that should be served.
 	 *
 	 * @param client the client-node
 	 */
-	void clientRemoved(const VFSNode *client) {
-		/* we don't have to lock this, because its only called in unref(), which can only
-		 * be called when the treelock is held. i.e. it is not possible during getwork() */
-		if(lastClient == client)
-			lastClient = client->next;
+	void clientRemoved(VFSChannel *client) {
+		/* we can't hold the waitlock here, because its only called in unref(), which holds the
+		 * treelock. but the ready-list has its own lock */
+		removeReady(client);
 	}
 
 	/**
@@ -117,6 +147,8 @@ private:
 	uint funcs;
 	/* total number of messages in all channels (for the device, not the clients) */
 	ulong msgCount;
-	/* the last served client */
-	const VFSNode *lastClient;
+	/* the channels that have messages for us, in the order in which they should be served */
+	esc::DList<VFSChannel::ReadyItem> readyList;
+	/* protects the ready-list; always acquired last */
+	SpinLock readyLock;
 };
@@ -55,6 +55,8 @@ class VFSInfo {
 	static void cpuReadCallback(VFSNode *node,size_t *dataSize,void **buffer);
 	static void statsReadCallback(VFSNode *node,size_t *dataSize,void **buffer);
 	static void memUsageReadCallback(VFSNode *node,size_t *dataSize,void **buffer);
+	static void swapReadCallback(VFSNode *node,size_t *dataSize,void **buffer);
+	static void zeroPoolReadCallback(VFSNode *node,size_t *dataSize,void **buffer);
 
 public:
 	/**
@@ -71,6 +73,27 @@ public:
 	GEN_INFO_FILECLASS(CPUFile,"cpu",cpuReadCallback);
 	GEN_INFO_FILECLASS(StatsFile,"stats",statsReadCallback);
 	GEN_INFO_FILECLASS(MemUsageFile,"memusage",memUsageReadCallback);
+	GEN_INFO_FILECLASS(SwapFile,"swap",swapReadCallback);
+
+	/**
+	 * Shows the pool of pre-zeroed frames. Writing a number to it sets the target size of the pool.
+	 */
+	class ZeroPoolFile : public VFSFile {
+	public:
+		explicit ZeroPoolFile(pid_t pid,VFSNode *parent,bool &success)
+			: VFSFile(pid,parent,(char*)"zeropool",FILE_DEF_MODE,success) {
+		}
+		virtual ssize_t read(pid_t pid,OpenFile *,void *buffer,off_t offset,size_t count) override {
+			ssize_t res = VFSInfo::readHelper(pid,this,buffer,offset,count,0,zeroPoolReadCallback);
+			acctime = Timer::getTime();
+			return res;
+		}
+		virtual ssize_t write(pid_t pid,OpenFile *,const void *buffer,off_t offset,
+		                      size_t count) override;
+		virtual int truncate(pid_t,off_t) override {
+			return 0;
+		}
+	};
 
 	static ssize_t readHelper(pid_t pid,VFSNode *node,void *buffer,off_t offset,
 			size_t count,size_t dataSize,read_func callback);
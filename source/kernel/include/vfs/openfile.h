@@ -167,6 +167,10 @@ public:
 	bool isDevice() const {
 		return flags & VFS_DEVICE;
 	}
+	/**
+	 * @return true if the content of this file may be kept in the page cache
+	 */
+	bool usePageCache() const;
 	/**
 	 * @return whether the file should be used in blocking-mode
 	 */
@@ -145,9 +145,6 @@ void ThreadBase::doSwitch() {
 	if(EXPECT_TRUE(n->getTid() != old->getTid())) {
 		if(!Thread::save(&old->saveArea)) {
 			setRunning(n);
-			if(EXPECT_FALSE(PhysMem::shouldSetRegTimestamp()))
-				VirtMem::setTimestamp(n,cycles);
-
 			SMP::schedule(n->getCPU(),n,cycles);
 			n->stats.cycleStart = CPU::rdtsc();
 			Thread::resume(n->getProc()->getPageDir()->getPhysAddr() | DIR_MAP_AREA,&n->saveArea,n->kstackFrame);
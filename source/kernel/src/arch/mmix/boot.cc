@@ -52,6 +52,8 @@ static const BootTask tasks[] = {
 	{"Preinit processes...",Proc::preinit},
 	{"Initializing dynarray...",DynArray::init},
 	{"Initializing SMP...",SMP::init},
+	{"Initializing cache magazines...",Cache::init},
+	{"Initializing frame caches...",PhysMem::initCaches},
 	{"Initializing timer...",Timer::init},
 	{"Initializing VFS...",VFS::init},
 	{"Initializing processes...",Proc::init},
@@ -71,6 +71,8 @@ static const BootTask tasks[] = {
 	{"Initializing ACPI...",ACPI::init},
 	{"Initializing SMP...",SMP::init},
 	{"Initializing GDT for BSP...",GDT::initBSP},
+	{"Initializing cache magazines...",Cache::init},
+	{"Initializing frame caches...",PhysMem::initCaches},
 	{"Initializing CPU...",CPU::detect},
 	{"Initializing MTRRs...",MTRR::init},
 	{"Initializing FPU...",FPU::init},
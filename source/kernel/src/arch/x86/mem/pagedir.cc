@@ -103,7 +103,9 @@ uintptr_t PageDir::mapToTemp(frameno_t frame) {
 	PageDir *cur = Proc::getCurPageDir();
 	cur->lock.down();
 	PageTables::RangeAllocator alloc(frame);
-	cur->map(TEMP_MAP_PAGE,1,alloc,PG_PRESENT | PG_WRITABLE | PG_SUPERVISOR);
+	/* no shootdown here: the page is only used with the lock held and every CPU that takes the
+	 * lock maps it again, which flushes the stale entry locally */
+	cur->pts.map(TEMP_MAP_PAGE,1,alloc,PG_PRESENT | PG_WRITABLE | PG_SUPERVISOR);
 	return TEMP_MAP_PAGE;
 }
 
@@ -135,22 +137,25 @@ void PageDirBase::copyFromFrame(frameno_t frame,void *dst) {
 int PageDirBase::clone(PageDir *dst,uintptr_t virtSrc,uintptr_t virtDst,size_t count,bool share) {
 	PageDir *pdir = static_cast<PageDir*>(this);
 	int res = pdir->pts.clone(&dst->pts,virtSrc,virtDst,count,share);
-	if(res >= 0)
-		SMP::flushTLB(pdir);
+	if(res >= 0 && !share)
+		SMP::flushTLB(pdir,virtSrc,count);
 	return res;
 }
 
 int PageDirBase::map(uintptr_t virt,size_t count,PageTables::Allocator &alloc,uint flags) {
 	PageDir *pdir = static_cast<PageDir*>(this);
 	int res = pdir->pts.map(virt,count,alloc,flags);
-	if(res == 1)
-		SMP::flushTLB(pdir);
+	if(res == 1) {
+		SMP::flushTLB(pdir,virt,count);
+		res = 0;
+	}
 	return res;
 }
 
 void PageDirBase::unmap(uintptr_t virt,size_t count,PageTables::Allocator &alloc) {
 	PageDir *pdir = static_cast<PageDir*>(this);
+	/* all pages are flushed in one round, which uses invlpg for small ranges */
 	int res = pdir->pts.unmap(virt,count,alloc);
 	if(res == 1)
-		SMP::flushTLB(pdir);
+		SMP::flushTLB(pdir,virt,count);
 }
@@ -22,6 +22,7 @@
 #include <arch/x86/ioapic.h>
 #include <arch/x86/lapic.h>
 #include <arch/x86/mpconfig.h>
+#include <atomic.h>
 #include <mem/cache.h>
 #include <mem/pagedir.h>
 #include <task/smp.h>
@@ -36,18 +37,24 @@
 #include <video.h>
 
 static const uintptr_t TRAMPOLINE_ADDR		= 0x7000;
+/* up to this number of pages, we use invlpg for shootdowns instead of flushing the whole TLB */
+static const size_t MAX_INVLPG_PAGES		= 32;
 
 EXTERN_C void apEntry();
 
 cpuid_t *SMP::log2Phys;
+volatile uint8_t *SMP::flushPending;
+uintptr_t SMP::flushAddr;
+size_t SMP::flushPages;
+volatile size_t SMP::flushAcks;
 
 static SpinLock smpLock;
+static SpinLock flushLock;
 static volatile size_t seenAPs = 0;
 
 extern volatile uint waiting;
 extern volatile uint waitlock;
 extern volatile uint halting;
-extern volatile uint flushed;
 
 bool SMPBase::initArch() {
 	enabled = Config::get(Config::SMP);
@@ -68,6 +75,9 @@ bool SMPBase::initArch() {
 	cpuid_t id = LAPIC::getId();
 	SMP::log2Phys = (cpuid_t*)Cache::alloc(getCPUCount() * sizeof(cpuid_t));
 	SMP::log2Phys[0] = id;
+	SMP::flushPending = (volatile uint8_t*)Cache::calloc(getCPUCount(),sizeof(uint8_t));
+	if(!SMP::log2Phys || !SMP::flushPending)
+		Util::panic("Unable to allocate memory for SMP");
 	return enabled;
 }
 
@@ -132,26 +142,46 @@ void SMPBase::haltOthers() {
 	}
 }
 
-void SMPBase::ensureTLBFlushed() {
-	if(smpLock.tryDown()) {
-		cpuid_t cur = getCurId();
-		flushed = 0;
-		size_t count = 0;
-		for(auto cpu = begin(); cpu != end(); ++cpu) {
-			if(cpu->id != cur && cpu->ready) {
-				sendIPI(cpu->id,IPI_FLUSH_TLB_ACK);
-				count++;
-			}
+void SMPBase::flushTLB(PageDir *pdir,uintptr_t virt,size_t count) {
+	if(!cpus || cpuCount == 1)
+		return;
+
+	/* other CPUs might wait for us to flush, while we wait for the lock */
+	cpuid_t cur = getCurId();
+	while(!flushLock.tryDown()) {
+		SMP::handleFlush(cur);
+		::CPU::pause();
+	}
+
+	SMP::flushAddr = virt;
+	SMP::flushPages = count <= MAX_INVLPG_PAGES ? count : 0;
+	SMP::flushAcks = 0;
+	size_t targets = 0;
+	for(auto cpu = begin(); cpu != end(); ++cpu) {
+		if(cpu->id != cur && cpu->ready && pdir->isLoadedOn(cpu->id)) {
+			SMP::flushPending[cpu->id] = true;
+			sendIPI(cpu->id,IPI_FLUSH_TLB);
+			targets++;
 		}
-		/* wait until all CPUs have flushed their TLB */
-		while(halting == 0 && flushed < count)
-			::CPU::pause();
-		smpLock.up();
 	}
+
+	/* wait until all of them have flushed their TLB, because the caller might free the frames */
+	while(halting == 0 && SMP::flushAcks < targets)
+		::CPU::pause();
+	flushLock.up();
+}
+
+void SMP::handleFlush(cpuid_t id) {
+	if(!Atomic::cmpnswap(flushPending + id,(uint8_t)true,(uint8_t)false))
+		return;
+
+	if(flushPages == 0)
+		PageDir::flushTLB();
 	else {
-		::CPU::setCR3(::CPU::getCR3());
-		Atomic::fetch_and_add(&flushed,+1);
+		for(size_t i = 0; i < flushPages; ++i)
+			PageDir::flushAddr(flushAddr + i * PAGE_SIZE);
 	}
+	Atomic::fetch_and_add(&flushAcks,+1);
 }
 
 void SMP::apIsRunning() {
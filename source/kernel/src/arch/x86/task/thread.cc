@@ -24,8 +24,6 @@
 #include <task/thread.h>
 #include <common.h>
 
-static SpinLock switchLock;
-
 int ThreadBase::initArch(Thread *t) {
 	t->kernelStack = t->getProc()->getPageDir()->createKernelStack();
 	t->fpuState = NULL;
@@ -124,31 +122,32 @@ void ThreadBase::finishThreadStart(A_UNUSED Thread *t,Thread *nt,const void *arg
 }
 
 void Thread::initialSwitch() {
-	switchLock.down();
 	cpuid_t cpu = GDT::getCPUId();
+	SpinLock *switchLock = Sched::getSwitchLock(cpu);
+	switchLock->down();
 	Thread *cur = Sched::perform(NULL,cpu);
 	cur->stats.schedCount++;
-	if(PhysMem::shouldSetRegTimestamp())
-		VirtMem::setTimestamp(cur,Timer::getRuntime());
 	GDT::prepareRun(cpu,true,cur);
 	cur->setCPU(cpu);
 	FPU::lockFPU();
 	cur->stats.cycleStart = CPU::rdtsc();
-	Thread::resume(cur->getProc()->getPageDir()->getPhysAddr(),&cur->saveArea,&switchLock,true);
+	cur->getProc()->getPageDir()->setLoadedOn(cpu,true);
+	Thread::resume(cur->getProc()->getPageDir()->getPhysAddr(),&cur->saveArea,switchLock,true);
 }
 
 void ThreadBase::doSwitch() {
 	Thread *old = Thread::getRunning();
+	cpuid_t cpu = old->getCPU();
 	/* lock this, because Sched::perform() may make us ready and we can't be chosen by another CPU
 	 * until we've really switched the thread (kernelstack, ...) */
-	switchLock.down();
+	SpinLock *switchLock = Sched::getSwitchLock(cpu);
+	switchLock->down();
 
 	/* update runtime-stats */
 	uint64_t cycles = CPU::rdtsc();
 	uint64_t runtime = cycles - old->stats.cycleStart;
 	old->stats.runtime += runtime;
 	old->stats.curCycleCount += runtime;
-	cpuid_t cpu = old->getCPU();
 
 	/* choose a new thread to run */
 	Thread *n = Sched::perform(old,cpu);
@@ -156,12 +155,9 @@ void ThreadBase::doSwitch() {
 
 	/* switch thread */
 	if(EXPECT_TRUE(n->getTid() != old->getTid())) {
-		if(EXPECT_FALSE(PhysMem::shouldSetRegTimestamp()))
-			VirtMem::setTimestamp(n,cycles);
 		GDT::prepareRun(cpu,n->getProc() != old->getProc(),n);
-		if(cpu != n->getCPU())
-			n->getStats().migrations++;
-		n->setCPU(cpu);
+		/* note that Sched::perform() has already moved it to our CPU, if necessary */
+		assert(n->getCPU() == cpu);
 
 		/* some stats for SMP */
 		SMP::schedule(cpu,n,cycles);
@@ -174,12 +170,17 @@ void ThreadBase::doSwitch() {
 			n->stats.cycleStart = CPU::rdtsc();
 			uintptr_t pdir = n->getProc()->getPageDir()->getPhysAddr();
 			bool chgpdir = n->getProc() != old->getProc();
-			Thread::resume(pdir,&n->saveArea,&switchLock,chgpdir);
+			/* the old pagedir is not accessed anymore, so that we don't need shootdowns for it */
+			if(chgpdir) {
+				n->getProc()->getPageDir()->setLoadedOn(cpu,true);
+				old->getProc()->getPageDir()->setLoadedOn(cpu,false);
+			}
+			Thread::resume(pdir,&n->saveArea,switchLock,chgpdir);
 		}
 	}
 	else {
 		SMP::schedule(cpu,n,cycles);
 		n->stats.cycleStart = CPU::rdtsc();
-		switchLock.up();
+		switchLock->up();
 	}
 }
@@ -39,6 +39,7 @@
 #include <mem/copyonwrite.h>
 #include <mem/cache.h>
 #include <mem/kheap.h>
+#include <mem/pagecache.h>
 #include <mem/pagedir.h>
 #include <mem/physmem.h>
 #include <mem/physmemareas.h>
@@ -92,6 +93,7 @@ static View views[] = {
 	{"gft",			OpenFile::printAll},
 	{"msgs",		VFS::printMsgs},
 	{"cow",			CopyOnWrite::print},
+	{"pcache",		PageCache::print},
 	{"cache",		Cache::print},
 	{"kheap",		KHeap::print},
 	{"pdirall",		view_pdirall},
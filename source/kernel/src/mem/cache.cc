@@ -20,6 +20,7 @@
 #include <mem/cache.h>
 #include <mem/kheap.h>
 #include <mem/pagedir.h>
+#include <task/smp.h>
 #include <assert.h>
 #include <common.h>
 #include <log.h>
@@ -51,10 +52,21 @@ Cache::Entry Cache::caches[] = {
 	{8192,0,0,NULL},
 	{16384,0,0,NULL},
 };
+Cache::PerCPU *Cache::perCPU = NULL;
 #if DEBUGGING
 bool Cache::aafEnabled = false;
 #endif
 
+void Cache::init() {
+	static_assert(ARRAY_SIZE(caches) == CACHE_COUNT,"CACHE_COUNT is wrong");
+
+	PerCPU *cpus = (PerCPU*)calloc(SMP::getCPUCount(),sizeof(PerCPU));
+	if(!cpus)
+		Util::panic("Unable to create per-cpu-magazines");
+	/* from now on, we use the magazines. note that we're still running on the BSP only */
+	perCPU = cpus;
+}
+
 size_t Cache::totalObjSize(size_t sz) {
 	/* ensure that all objects are 16 bytes aligned, thus, use 16 bytes before and behind. */
 	return sz + sizeof(uint64_t) * 4;
@@ -140,8 +152,17 @@ void Cache::free(void *p) {
 	/* check guard */
 	assert(area[(objSize / sizeof(ulong)) + (16 / sizeof(ulong))] == GUARD_MAGIC);
 
-	/* put on freelist */
 	Entry *c = caches + area[0];
+	/* the kernel is not preemptible, so we can use the magazine of our CPU without a lock */
+	if(EXPECT_TRUE(perCPU)) {
+		Magazine *m = perCPU[SMP::getCurId()].mags + area[0];
+		if(EXPECT_FALSE(m->count == MAG_SIZE))
+			flush(c,m,MAG_BATCH);
+		m->objs[m->count++] = area;
+		return;
+	}
+
+	/* put on freelist */
 	LockGuard<SpinLock> g(&lock);
 	area[0] = (ulong)c->freeList;
 	c->freeList = area;
@@ -157,8 +178,19 @@ size_t Cache::getOccMem() {
 
 size_t Cache::getUsedMem() {
 	size_t count = 0;
-	for(size_t i = 0; i < ARRAY_SIZE(caches); i++)
-		count += (caches[i].totalObjs - caches[i].freeObjs) * totalObjSize(caches[i].objSize);
+	for(size_t i = 0; i < ARRAY_SIZE(caches); i++) {
+		size_t used = caches[i].totalObjs - caches[i].freeObjs - magazineObjs(i);
+		count += used * totalObjSize(caches[i].objSize);
+	}
+	return count;
+}
+
+size_t Cache::magazineObjs(size_t i) {
+	size_t count = 0;
+	if(perCPU) {
+		for(size_t j = 0; j < SMP::getCPUCount(); j++)
+			count += perCPU[j].mags[i].count;
+	}
 	return count;
 }
 
@@ -173,9 +205,16 @@ void Cache::print(OStream &os) {
 	os.writef("Total: %zu bytes\n",total);
 	for(size_t i = 0; i < ARRAY_SIZE(caches); i++) {
 		size_t mem = caches[i].totalObjs * totalObjSize(caches[i].objSize);
-		os.writef("Cache %zu [size=%zu, total=%zu, free=%zu, pages=%zu]:\n",i,caches[i].objSize,
-				caches[i].totalObjs,caches[i].freeObjs,BYTES_2_PAGES(mem));
-		printBar(os,mem,maxMem,caches[i].totalObjs,caches[i].freeObjs);
+		size_t mags = magazineObjs(i);
+		os.writef("Cache %zu [size=%zu, total=%zu, free=%zu, inmags=%zu, pages=%zu]:\n",i,
+				caches[i].objSize,caches[i].totalObjs,caches[i].freeObjs,mags,BYTES_2_PAGES(mem));
+		printBar(os,mem,maxMem,caches[i].totalObjs,caches[i].freeObjs + mags);
+	}
+	if(perCPU) {
+		for(size_t i = 0; i < SMP::getCPUCount(); i++) {
+			os.writef("CPU %zu magazines [hits=%lu, misses=%lu]\n",
+				i,perCPU[i].hits,perCPU[i].misses);
+		}
 	}
 }
 
@@ -192,7 +231,55 @@ void Cache::printBar(OStream &os,size_t mem,size_t maxMem,size_t total,size_t fr
 }
 
 void *Cache::get(Entry *c,size_t i) {
+	ulong *area;
+	if(EXPECT_TRUE(perCPU)) {
+		PerCPU *cpu = perCPU + SMP::getCurId();
+		Magazine *m = cpu->mags + i;
+		if(EXPECT_FALSE(m->count == 0)) {
+			cpu->misses++;
+			if(!refill(c,m))
+				return NULL;
+		}
+		else
+			cpu->hits++;
+		area = (ulong*)m->objs[--m->count];
+	}
+	else {
+		LockGuard<SpinLock> g(&lock);
+		area = (ulong*)take(c);
+		if(area == NULL)
+			return NULL;
+	}
+
+	/* store size and put guards in front and behind the area */
+	area[0] = i;
+	area[1] = GUARD_MAGIC;
+	area[(c->objSize / sizeof(ulong)) + (16 / sizeof(ulong))] = GUARD_MAGIC;
+	return (void*)((uintptr_t)area + 16);
+}
+
+bool Cache::refill(Entry *c,Magazine *m) {
+	LockGuard<SpinLock> g(&lock);
+	while(m->count < MAG_BATCH) {
+		void *obj = take(c);
+		if(obj == NULL)
+			break;
+		m->objs[m->count++] = obj;
+	}
+	return m->count > 0;
+}
+
+void Cache::flush(Entry *c,Magazine *m,size_t count) {
 	LockGuard<SpinLock> g(&lock);
+	for(size_t j = 0; j < count; j++) {
+		ulong *area = (ulong*)m->objs[--m->count];
+		area[0] = (ulong)c->freeList;
+		c->freeList = area;
+	}
+	c->freeObjs += count;
+}
+
+void *Cache::take(Entry *c) {
 	if(!c->freeList) {
 		size_t pageCount = BYTES_2_PAGES(MIN_OBJ_COUNT * c->objSize);
 		size_t bytes = pageCount * PAGE_SIZE;
@@ -220,11 +307,6 @@ void *Cache::get(Entry *c,size_t i) {
 	/* get first from freelist */
 	ulong *area = (ulong*)c->freeList;
 	c->freeList = (void*)area[0];
-
-	/* store size and put guards in front and behind the area */
-	area[0] = i;
-	area[1] = GUARD_MAGIC;
-	area[(c->objSize / sizeof(ulong)) + (16 / sizeof(ulong))] = GUARD_MAGIC;
 	c->freeObjs--;
-	return (void*)((uintptr_t)area + 16);
+	return area;
 }
@@ -17,99 +17,76 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
-#include <mem/cache.h>
 #include <mem/copyonwrite.h>
 #include <mem/pagedir.h>
+#include <mem/physmem.h>
 #include <task/proc.h>
 #include <assert.h>
+#include <atomic.h>
 #include <common.h>
-#include <spinlock.h>
+#include <ostream.h>
 #include <string.h>
-#include <util.h>
-#include <video.h>
 
-esc::SList<CopyOnWrite::Entry> CopyOnWrite::frames[HEAP_SIZE];
-SpinLock CopyOnWrite::lock;
+volatile uint32_t *CopyOnWrite::refs;
+size_t CopyOnWrite::refsSize;
+volatile size_t CopyOnWrite::frameCount = 0;
+
+void CopyOnWrite::init(size_t frames) {
+	size_t pages = BYTES_2_PAGES(frames * sizeof(uint32_t));
+	refs = (volatile uint32_t*)PageDir::makeAccessible(0,pages);
+	memclear((void*)refs,pages * PAGE_SIZE);
+	refsSize = frames;
+}
 
 size_t CopyOnWrite::pagefault(uintptr_t address,frameno_t frameNumber) {
-	LockGuard<SpinLock> g(&lock);
-	/* find the cow-entry */
-	Entry *cow = getByFrame(frameNumber,true);
-	vassert(cow != NULL,"No COW entry for frame %#x and address %p",frameNumber,address);
+	vassert(frameNumber < refsSize && refs[frameNumber] > 0,
+		"No COW entry for frame %#x and address %p",frameNumber,address);
 
-	/* if there is another process who wants to get the frame, we make a copy for us */
-	/* otherwise we keep the frame for ourself */
-	if(cow->refCount == 0) {
+	/* if we're the last user, we keep the frame for ourself */
+	if(Atomic::cmpnswap(refs + frameNumber,(uint32_t)1,(uint32_t)0)) {
+		Atomic::fetch_and_add(&frameCount,-1);
 		PageTables::NoAllocator noalloc;
 		PageDir::mapToCur(address,1,noalloc,PG_PRESENT | PG_WRITABLE);
-	}
-	else {
-		PageTables::UAllocator ualloc;
-		/* can't fail, we've already allocated the frame */
-		PageDir::mapToCur(address,1,ualloc,PG_PRESENT | PG_WRITABLE);
+		return 1;
 	}
 
-	/* copy? */
-	if(cow->refCount > 0)
-		PageDir::copyFromFrame(frameNumber,(void*)(ROUND_PAGE_DN(address)));
-	else
-		delete cow;
+	/* otherwise we make a copy for us. we keep our reference until we're done, so that the other
+	 * users can't take the frame and change it in the meantime */
+	PageTables::UAllocator ualloc;
+	/* can't fail, we've already allocated the frame */
+	PageDir::mapToCur(address,1,ualloc,PG_PRESENT | PG_WRITABLE);
+	PageDir::copyFromFrame(frameNumber,(void*)(ROUND_PAGE_DN(address)));
+
+	/* if all others have copied it as well or are gone, nobody uses the frame anymore */
+	if(release(frameNumber) == 0)
+		PhysMem::free(frameNumber,PhysMem::USR);
 	return 1;
 }
 
 bool CopyOnWrite::add(frameno_t frameNo) {
-	LockGuard<SpinLock> g(&lock);
-	Entry *cow = getByFrame(frameNo,false);
-	if(!cow) {
-		cow = new Entry(frameNo);
-		if(cow == NULL)
-			return false;
-		frames[frameNo % HEAP_SIZE].append(cow);
-	}
-	cow->refCount++;
+	vassert(frameNo < refsSize,"Frame %#x is out of range",frameNo);
+	if(Atomic::fetch_and_add(refs + frameNo,+1) == 0)
+		Atomic::fetch_and_add(&frameCount,+1);
 	return true;
 }
 
 size_t CopyOnWrite::remove(frameno_t frameNo,bool *foundOther) {
-	LockGuard<SpinLock> g(&lock);
-	/* find the cow-entry */
-	Entry *cow = getByFrame(frameNo,true);
-	vassert(cow != NULL,"For frameNo %#x",frameNo);
-
-	*foundOther = cow->refCount > 0;
-	if(cow->refCount == 0)
-		delete cow;
+	vassert(frameNo < refsSize && refs[frameNo] > 0,"For frameNo %#x",frameNo);
+	*foundOther = release(frameNo) > 0;
 	return 1;
 }
 
-size_t CopyOnWrite::getFrmCount() {
-	LockGuard<SpinLock> g(&lock);
-	size_t count = 0;
-	for(size_t i = 0; i < HEAP_SIZE; i++)
-		count += frames[i].length();
-	return count;
-}
-
 void CopyOnWrite::print(OStream &os) {
 	os.writef("COW-Frames: (%zu frames)\n",getFrmCount());
-	for(size_t i = 0; i < HEAP_SIZE; i++) {
-		os.writef("\t%zu:\n",i);
-		for(auto it = frames[i].cbegin(); it != frames[i].cend(); ++it)
-			os.writef("\t\t%#x (%zu refs)\n",it->frameNumber,it->refCount);
+	for(size_t i = 0; i < refsSize; i++) {
+		if(refs[i] > 0)
+			os.writef("\t%#zx (%u refs)\n",i,refs[i]);
 	}
 }
 
-CopyOnWrite::Entry *CopyOnWrite::getByFrame(frameno_t frameNo,bool dec) {
-	esc::SList<Entry> *list = frames + (frameNo % HEAP_SIZE);
-	Entry *p = NULL;
-	for(auto it = list->begin(); it != list->end(); p = &*it, ++it) {
-		if(it->frameNumber == frameNo) {
-			if(dec) {
-				if(--it->refCount == 0)
-					list->removeAt(p,&*it);
-			}
-			return &*it;
-		}
-	}
-	return NULL;
+uint32_t CopyOnWrite::release(frameno_t frameNo) {
+	uint32_t left = Atomic::fetch_and_add(refs + frameNo,-1) - 1;
+	if(left == 0)
+		Atomic::fetch_and_add(&frameCount,-1);
+	return left;
 }
@@ -27,11 +27,15 @@
 #include <util.h>
 #include <video.h>
 
-KHeap::MemArea *KHeap::usableList = NULL;
+KHeap::MemArea *KHeap::buckets[BUCKET_COUNT] = {NULL};
+size_t KHeap::bucketMask = 0;
+KHeap::MemArea *KHeap::startMap[OCC_MAP_SIZE] = {NULL};
+KHeap::MemArea *KHeap::endMap[OCC_MAP_SIZE] = {NULL};
 KHeap::MemArea *KHeap::freeList = NULL;
 KHeap::MemArea *KHeap::occupiedMap[OCC_MAP_SIZE] = {NULL};
 size_t KHeap::memUsage = 0;
 size_t KHeap::pages = 0;
+size_t KHeap::lookupSteps = 0;
 SpinLock KHeap::lock;
 
 void *KHeap::alloc(size_t size) {
@@ -43,51 +47,35 @@ void *KHeap::alloc(size_t size) {
 
 	LockGuard<SpinLock> g(&lock);
 
-	/* find a suitable area */
-	MemArea *prev = NULL;
-	MemArea *area = usableList;
-	while(area != NULL) {
-		if(area->size >= size)
-			break;
-		prev = area;
-		area = area->next;
+	/* make sure that we have an area for the split */
+	if(freeList == NULL) {
+		if(!loadNewAreas())
+			return NULL;
 	}
 
-	/* no area found? */
+	/* find a suitable area */
+	MemArea *area = findUsable(size);
 	if(area == NULL) {
-		if(!loadNewSpace(size))
+		area = loadNewSpace(size);
+		if(area == NULL)
 			return NULL;
-		/* we can assume that it fits */
-		area = usableList;
-		/* remove from usable-list */
-		usableList = area->next;
-	}
-	else {
-		/* remove from usable-list */
-		if(prev == NULL)
-			usableList = area->next;
-		else
-			prev->next = area->next;
 	}
+	removeUsable(area);
 
 	/* is there space left? */
 	if(size < area->size) {
-		if(freeList == NULL) {
-			if(!loadNewAreas()) {
-				/* TODO we may have changed something... */
-				return NULL;
-			}
+		/* loadNewSpace might have taken the last area; if we can't split, use it completely */
+		if(freeList != NULL || loadNewAreas()) {
+			/* split the area */
+			MemArea *narea = freeList;
+			freeList = freeList->next;
+			narea->address = (void*)((uintptr_t)area->address + size);
+			narea->size = area->size - size;
+			area->size = size;
+			insertUsable(narea);
 		}
-
-		/* split the area */
-		MemArea *narea = freeList;
-		freeList = freeList->next;
-		narea->address = (void*)((uintptr_t)area->address + size);
-		narea->size = area->size - size;
-		area->size = size;
-		/* insert in usable-list */
-		narea->next = usableList;
-		usableList = narea;
+		else
+			size = area->size;
 	}
 
 	/* insert in occupied-map */
@@ -138,86 +126,27 @@ void KHeap::free(void *addr) {
 	if(area == NULL)
 		return;
 
-	/* find the previous and next free areas */
-	MemArea *prev = NULL;
-	MemArea *next = NULL;
-	MemArea *tprev = NULL;
-	MemArea *pprev = NULL;
-	MemArea *nprev = NULL;
-	MemArea *a = usableList;
-	while(a != NULL) {
-		if((uintptr_t)a->address + a->size == (uintptr_t)begin) {
-			prev = a;
-			pprev = tprev;
-		}
-		if((uintptr_t)a->address == (uintptr_t)begin + area->size) {
-			next = a;
-			nprev = tprev;
-		}
-		/* do we have both? */
-		if(prev && next)
-			break;
-		tprev = a;
-		a = a->next;
-	}
-
 	/* remove area from occupied-map */
 	if(oprev)
 		oprev->next = area->next;
 	else
 		occupiedMap[getHash(begin)] = area->next;
 
-	/* see what we have to merge */
-	if(prev && next) {
-		/* merge prev & area & next */
-		area->size += prev->size + next->size;
+	/* merge with the previous and next free area, if there are any */
+	MemArea *prev = findByEnd((uintptr_t)begin);
+	if(prev) {
+		removeUsable(prev);
 		area->address = prev->address;
-		/* remove prev and next from the list */
-		if(nprev)
-			nprev->next = next->next;
-		else
-			usableList = next->next;
-		/* special-case if next is the previous of prev */
-		if(pprev == next) {
-			if(nprev)
-				nprev->next = prev->next;
-			else
-				usableList = prev->next;
-		}
-		else {
-			if(pprev)
-				pprev->next = prev->next;
-			else
-				usableList = prev->next;
-		}
-		/* put area on the usable-list */
-		area->next = usableList;
-		usableList = area;
-		/* put prev and next on the freelist */
-		prev->next = next;
-		next->next = freeList;
-		freeList = prev;
-	}
-	else if(prev) {
-		/* merge preg & area */
-		prev->size += area->size;
-		/* put area on the freelist */
-		area->next = freeList;
-		freeList = area;
-	}
-	else if(next) {
-		/* merge area & next */
-		next->address = area->address;
-		next->size += area->size;
-		/* put area on the freelist */
-		area->next = freeList;
-		freeList = area;
+		area->size += prev->size;
+		putFree(prev);
 	}
-	else {
-		/* insert area in usableList */
-		area->next = usableList;
-		usableList = area;
+	MemArea *next = findByStart((uintptr_t)area->address + area->size);
+	if(next) {
+		removeUsable(next);
+		area->size += next->size;
+		putFree(next);
 	}
+	insertUsable(area);
 }
 
 void *KHeap::realloc(void *addr,size_t size) {
@@ -249,44 +178,27 @@ void *KHeap::realloc(void *addr,size_t size) {
 		if(size < area->size)
 			return addr;
 
-		a = usableList;
-		MemArea *prev = NULL;
-		while(a != NULL) {
-			/* found the area behind? */
-			if((uintptr_t)a->address == (uintptr_t)area->address + area->size) {
-				/* if the size of both is big enough we can use them */
-				if(area->size + a->size >= size) {
-					/* space left? */
-					if(size < area->size + a->size) {
-						/* so move the area forward */
-						a->address = (void*)((uintptr_t)area->address + size);
-						a->size = (area->size + a->size) - size;
-					}
-					/* otherwise we don't need a anymore */
-					else {
-						/* remove a from usable-list */
-						if(prev == NULL)
-							usableList = a->next;
-						else
-							prev->next = a->next;
-						/* free a */
-						a->next = freeList;
-						freeList = a;
-					}
-
-					area->size = size;
-					/* reset guards */
-					begin[0] = size - sizeof(ulong) * 3;
-					begin[1] = GUARD_MAGIC;
-					begin[size / sizeof(ulong) - 1] = GUARD_MAGIC;
-					return begin + 2;
-				}
-
-				/* makes no sense to continue since we've found the area behind */
-				break;
+		/* if the size of the area behind and ours is big enough we can use them */
+		a = findByStart((uintptr_t)area->address + area->size);
+		if(a && area->size + a->size >= size) {
+			removeUsable(a);
+			/* space left? */
+			if(size < area->size + a->size) {
+				/* so move the area forward */
+				a->address = (void*)((uintptr_t)area->address + size);
+				a->size = (area->size + a->size) - size;
+				insertUsable(a);
 			}
-			prev = a;
-			a = a->next;
+			/* otherwise we don't need a anymore */
+			else
+				putFree(a);
+
+			area->size = size;
+			/* reset guards */
+			begin[0] = size - sizeof(ulong) * 3;
+			begin[1] = GUARD_MAGIC;
+			begin[size / sizeof(ulong) - 1] = GUARD_MAGIC;
+			return begin + 2;
 		}
 	}
 
@@ -315,10 +227,9 @@ size_t KHeap::getUsedMem() {
 
 size_t KHeap::getFreeMem() {
 	size_t c = 0;
-	MemArea *a = usableList;
-	while(a != NULL) {
-		c += a->size;
-		a = a->next;
+	for(size_t i = 0; i < BUCKET_COUNT; i++) {
+		for(MemArea *a = buckets[i]; a != NULL; a = a->next)
+			c += a->size;
 	}
 	return c;
 }
@@ -326,16 +237,21 @@ size_t KHeap::getFreeMem() {
 void KHeap::print(OStream &os) {
 	os.writef("Used=%zu, free=%zu, pages=%zu\n",getUsedMem(),getFreeMem(),
 			memUsage / PAGE_SIZE);
-	os.writef("UsableList:\n");
-	MemArea *area = usableList;
-	while(area != NULL) {
-		os.writef("\t%p: addr=%p, size=0x%zx\n",area,area->address,area->size);
-		area = area->next;
+	os.writef("Buckets:\n");
+	for(size_t i = 0; i < BUCKET_COUNT; i++) {
+		MemArea *area = buckets[i];
+		if(area != NULL) {
+			os.writef("\t%zu:\n",i);
+			while(area != NULL) {
+				os.writef("\t\t%p: addr=%p, size=0x%zx\n",area,area->address,area->size);
+				area = area->next;
+			}
+		}
 	}
 
 	os.writef("OccupiedMap:\n");
 	for(size_t i = 0; i < OCC_MAP_SIZE; i++) {
-		area = occupiedMap[i];
+		MemArea *area = occupiedMap[i];
 		if(area != NULL) {
 			os.writef("\t%d:\n",i);
 			while(area != NULL) {
@@ -346,10 +262,10 @@ void KHeap::print(OStream &os) {
 	}
 }
 
-bool KHeap::doAddMemory(uintptr_t addr,size_t size) {
+KHeap::MemArea *KHeap::doAddMemory(uintptr_t addr,size_t size) {
 	if(freeList == NULL) {
 		if(!loadNewAreas())
-			return false;
+			return NULL;
 	}
 
 	/* take one area from the freelist and put the memory in it */
@@ -357,17 +273,30 @@ bool KHeap::doAddMemory(uintptr_t addr,size_t size) {
 	freeList = freeList->next;
 	area->address = (void*)addr;
 	area->size = size;
-	/* put area in the usable-list */
-	area->next = usableList;
-	usableList = area;
 	memUsage += size;
-	return true;
+
+	/* merge it with adjacent usable areas */
+	MemArea *prev = findByEnd(addr);
+	if(prev) {
+		removeUsable(prev);
+		area->address = prev->address;
+		area->size += prev->size;
+		putFree(prev);
+	}
+	MemArea *next = findByStart(addr + size);
+	if(next) {
+		removeUsable(next);
+		area->size += next->size;
+		putFree(next);
+	}
+	insertUsable(area);
+	return area;
 }
 
-bool KHeap::loadNewSpace(size_t size) {
+KHeap::MemArea *KHeap::loadNewSpace(size_t size) {
 	/* check for overflow */
 	if(size + PAGE_SIZE < PAGE_SIZE)
-		return false;
+		return NULL;
 
 	/* note that we assume here that we won't check the same pages than loadNewAreas() did... */
 
@@ -375,7 +304,7 @@ bool KHeap::loadNewSpace(size_t size) {
 	size_t count = BYTES_2_PAGES(size);
 	uintptr_t addr = allocSpace(count);
 	if(addr == 0)
-		return false;
+		return NULL;
 
 	return doAddMemory(addr,count * PAGE_SIZE);
 }
@@ -403,6 +332,98 @@ bool KHeap::loadNewAreas() {
 	return true;
 }
 
+KHeap::MemArea *KHeap::findUsable(size_t size) {
+	/* all areas in the buckets above floor(log2(size)) are large enough */
+	size_t bucket = getBucket(size);
+	size_t mask = bucket + 1 < BUCKET_COUNT ? bucketMask & ~((2UL << bucket) - 1) : 0;
+	/* if size is a power of 2, the areas in its own bucket fit as well */
+	if((size & (size - 1)) == 0)
+		mask |= bucketMask & (1UL << bucket);
+	if(mask) {
+		lookupSteps++;
+		return buckets[__builtin_ctzl(mask)];
+	}
+
+	/* otherwise, search the bucket of size itself */
+	for(MemArea *a = buckets[bucket]; a != NULL; a = a->next) {
+		lookupSteps++;
+		if(a->size >= size)
+			return a;
+	}
+	return NULL;
+}
+
+KHeap::MemArea *KHeap::findByStart(uintptr_t addr) {
+	for(MemArea *a = startMap[getHash((void*)addr)]; a != NULL; a = a->nextStart) {
+		lookupSteps++;
+		if((uintptr_t)a->address == addr)
+			return a;
+	}
+	return NULL;
+}
+
+KHeap::MemArea *KHeap::findByEnd(uintptr_t addr) {
+	for(MemArea *a = endMap[getHash((void*)addr)]; a != NULL; a = a->nextEnd) {
+		lookupSteps++;
+		if((uintptr_t)a->address + a->size == addr)
+			return a;
+	}
+	return NULL;
+}
+
+void KHeap::insertUsable(MemArea *area) {
+	/* put it in the bucket */
+	size_t bucket = getBucket(area->size);
+	area->prev = NULL;
+	area->next = buckets[bucket];
+	if(area->next)
+		area->next->prev = area;
+	buckets[bucket] = area;
+	bucketMask |= 1UL << bucket;
+
+	/* and in the maps */
+	MemArea **list = startMap + getHash(area->address);
+	area->nextStart = *list;
+	*list = area;
+	list = endMap + getHash((void*)((uintptr_t)area->address + area->size));
+	area->nextEnd = *list;
+	*list = area;
+}
+
+void KHeap::removeUsable(MemArea *area) {
+	/* remove it from the bucket */
+	size_t bucket = getBucket(area->size);
+	if(area->prev)
+		area->prev->next = area->next;
+	else {
+		buckets[bucket] = area->next;
+		if(area->next == NULL)
+			bucketMask &= ~(1UL << bucket);
+	}
+	if(area->next)
+		area->next->prev = area->prev;
+
+	/* and from the maps */
+	MemArea **list = startMap + getHash(area->address);
+	while(*list != area)
+		list = &(*list)->nextStart;
+	*list = area->nextStart;
+	list = endMap + getHash((void*)((uintptr_t)area->address + area->size));
+	while(*list != area)
+		list = &(*list)->nextEnd;
+	*list = area->nextEnd;
+}
+
+void KHeap::putFree(MemArea *area) {
+	area->next = freeList;
+	freeList = area;
+}
+
+size_t KHeap::getBucket(size_t size) {
+	assert(size > 0);
+	return BUCKET_COUNT - 1 - __builtin_clzl(size);
+}
+
 size_t KHeap::getHash(void *addr) {
 	/* the algorithm distributes the entries more equally in the occupied-map. */
 	/* borrowed from java.util.HashMap :) */
@@ -0,0 +1,311 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <mem/pagecache.h>
+#include <mem/pagedir.h>
+#include <mem/physmem.h>
+#include <assert.h>
+#include <common.h>
+#include <ostream.h>
+#include <spinlock.h>
+
+esc::Treap<PageCache::FileNode> PageCache::files;
+PageCache::Page *PageCache::pages[HASH_SIZE];
+PageCache::Page *PageCache::frames[HASH_SIZE];
+ulong PageCache::gens[HASH_SIZE];
+PageCache::Page *PageCache::unusedHead = NULL;
+PageCache::Page *PageCache::unusedTail = NULL;
+size_t PageCache::pageCount = 0;
+size_t PageCache::unusedCount = 0;
+ulong PageCache::hits = 0;
+ulong PageCache::misses = 0;
+ulong PageCache::reclaimed = 0;
+SpinLock PageCache::lock;
+
+frameno_t PageCache::get(const FileId &id,size_t pageNo,size_t *size) {
+	LockGuard<SpinLock> g(&lock);
+	Page *p = find(id,pageNo);
+	if(p == NULL) {
+		misses++;
+		return PhysMem::INVALID_FRAME;
+	}
+
+	hits++;
+	doRef(p);
+	*size = p->size;
+	return p->frame;
+}
+
+ulong PageCache::getGeneration(const FileId &id) {
+	LockGuard<SpinLock> g(&lock);
+	return gens[fileHash(id)];
+}
+
+frameno_t PageCache::insert(const FileId &id,size_t pageNo,frameno_t frame,size_t size,
+		ulong gen) {
+	/* allocate it first; we can't do that with the lock held */
+	Page *np = new Page(NULL,pageNo,frame,size);
+	if(np == NULL)
+		return PhysMem::INVALID_FRAME;
+	FileNode *nfn = new FileNode(id);
+
+	Page *old = NULL;
+	{
+		LockGuard<SpinLock> g(&lock);
+		/* the file has changed while the caller read the content */
+		if(gens[fileHash(id)] != gen) {
+			frame = PhysMem::INVALID_FRAME;
+			goto done;
+		}
+
+		/* somebody else might have loaded it in the meantime */
+		Page *p = find(id,pageNo);
+		if(p && p->size == size) {
+			doRef(p);
+			frame = p->frame;
+			goto done;
+		}
+
+		/* the old page is outdated; replace it. do that first, because the file-node is deleted
+		 * if it was the last page of the file */
+		if(p) {
+			detach(p);
+			if(p->refs == 0) {
+				remove(p);
+				old = p;
+			}
+		}
+
+		FileNode *fn = files.find(id);
+		if(fn == NULL) {
+			if(nfn == NULL) {
+				frame = PhysMem::INVALID_FRAME;
+				goto done;
+			}
+			files.insert(nfn);
+			fn = nfn;
+			nfn = NULL;
+		}
+
+		np->file = fn;
+		np->refs = 1;
+		fn->pages.append(np);
+		Page **list = pages + pageHash(id,pageNo);
+		np->hnext = *list;
+		*list = np;
+		list = frames + frameHash(frame);
+		np->fnext = *list;
+		*list = np;
+		pageCount++;
+		np = NULL;
+	}
+
+done:
+	if(old) {
+		PhysMem::free(old->frame,PhysMem::USR);
+		delete old;
+	}
+	delete nfn;
+	delete np;
+	return frame;
+}
+
+void PageCache::add(const FileId &id,size_t pageNo,const void *buffer,size_t size,ulong gen) {
+	/* caching is optional; don't swap for it */
+	if(!PhysMem::reserve(1,false))
+		return;
+	frameno_t frame = PhysMem::allocate(PhysMem::USR);
+	if(frame == PhysMem::INVALID_FRAME) {
+		PhysMem::unreserve(1);
+		return;
+	}
+
+	PageDir::copyToFrame(frame,buffer);
+	frameno_t cached = insert(id,pageNo,frame,size,gen);
+	if(cached != frame)
+		PhysMem::free(frame,PhysMem::USR);
+	if(cached != PhysMem::INVALID_FRAME)
+		release(cached);
+}
+
+void PageCache::ref(frameno_t frame) {
+	LockGuard<SpinLock> g(&lock);
+	Page *p = findByFrame(frame);
+	vassert(p != NULL,"Frame %#x is not in the page cache",frame);
+	doRef(p);
+}
+
+void PageCache::release(frameno_t frame) {
+	Page *p;
+	{
+		LockGuard<SpinLock> g(&lock);
+		p = findByFrame(frame);
+		vassert(p != NULL && p->refs > 0,"Frame %#x is not in the page cache",frame);
+		if(--p->refs > 0)
+			return;
+
+		/* keep it for later, if it's still up to date */
+		if(p->file) {
+			appendUnused(p);
+			return;
+		}
+		remove(p);
+	}
+
+	PhysMem::free(p->frame,PhysMem::USR);
+	delete p;
+}
+
+void PageCache::invalidate(const FileId &id) {
+	Page *free = NULL;
+	{
+		LockGuard<SpinLock> g(&lock);
+		/* prevent that content that has been read before is added afterwards */
+		gens[fileHash(id)]++;
+		FileNode *fn = files.find(id);
+		if(fn == NULL)
+			return;
+
+		/* note that the file-node is deleted together with the last page */
+		for(size_t count = fn->pages.length(); count > 0; --count) {
+			Page *p = &*fn->pages.begin();
+			detach(p);
+			/* pages in use are freed on the last release */
+			if(p->refs == 0) {
+				remove(p);
+				p->hnext = free;
+				free = p;
+			}
+		}
+	}
+
+	while(free) {
+		Page *next = free->hnext;
+		PhysMem::free(free->frame,PhysMem::USR);
+		delete free;
+		free = next;
+	}
+}
+
+size_t PageCache::reclaim(size_t count) {
+	size_t total = 0;
+	while(total < count) {
+		Page *p;
+		{
+			LockGuard<SpinLock> g(&lock);
+			/* the oldest unused page is at the head */
+			p = unusedHead;
+			if(p == NULL)
+				break;
+			detach(p);
+			remove(p);
+			reclaimed++;
+		}
+
+		PhysMem::free(p->frame,PhysMem::USR);
+		delete p;
+		total++;
+	}
+	return total;
+}
+
+PageCache::Page *PageCache::find(const FileId &id,size_t pageNo) {
+	for(Page *p = pages[pageHash(id,pageNo)]; p != NULL; p = p->hnext) {
+		if(p->pageNo == pageNo && p->file->key() == id)
+			return p;
+	}
+	return NULL;
+}
+
+PageCache::Page *PageCache::findByFrame(frameno_t frame) {
+	for(Page *p = frames[frameHash(frame)]; p != NULL; p = p->fnext) {
+		if(p->frame == frame)
+			return p;
+	}
+	return NULL;
+}
+
+void PageCache::doRef(Page *p) {
+	if(p->refs++ == 0)
+		removeUnused(p);
+}
+
+void PageCache::detach(Page *p) {
+	if(p->file == NULL)
+		return;
+
+	Page **list = pages + pageHash(p->file->key(),p->pageNo);
+	while(*list != p)
+		list = &(*list)->hnext;
+	*list = p->hnext;
+	p->hnext = NULL;
+
+	FileNode *fn = p->file;
+	fn->pages.remove(p);
+	if(fn->pages.length() == 0) {
+		files.remove(fn);
+		delete fn;
+	}
+	p->file = NULL;
+}
+
+void PageCache::remove(Page *p) {
+	assert(p->file == NULL && p->refs == 0);
+	Page **list = frames + frameHash(p->frame);
+	while(*list != p)
+		list = &(*list)->fnext;
+	*list = p->fnext;
+	p->fnext = NULL;
+
+	if(p->lprev || p->lnext || unusedHead == p)
+		removeUnused(p);
+	pageCount--;
+}
+
+void PageCache::appendUnused(Page *p) {
+	p->lprev = unusedTail;
+	p->lnext = NULL;
+	if(unusedTail)
+		unusedTail->lnext = p;
+	else
+		unusedHead = p;
+	unusedTail = p;
+	unusedCount++;
+}
+
+void PageCache::removeUnused(Page *p) {
+	if(p->lprev)
+		p->lprev->lnext = p->lnext;
+	else
+		unusedHead = p->lnext;
+	if(p->lnext)
+		p->lnext->lprev = p->lprev;
+	else
+		unusedTail = p->lprev;
+	p->lprev = p->lnext = NULL;
+	unusedCount--;
+}
+
+void PageCache::print(OStream &os) {
+	LockGuard<SpinLock> g(&lock);
+	os.writef("Pages: %zu (%zu unused)\n",pageCount,unusedCount);
+	os.writef("Hits: %lu, misses: %lu, reclaimed: %lu\n",hits,misses,reclaimed);
+	os.writef("Files:\n");
+	files.print(os);
+}
@@ -55,9 +55,31 @@ int PageTables::clone(PageTables *dst,uintptr_t virtSrc,uintptr_t virtDst,size_t
 	size_t orgCount = count;
 	assert(this != dst && (this == cur || dst == cur));
 	while(count > 0) {
+		base = virtSrc;
 		pte_t *spt = getPTE(virtSrc,&base);
 		pte_t pte = *spt;
 
+		if(pte & PTE_LARGE) {
+			/* shared large pages can be copied as a whole */
+			if(share && base == virtSrc && count >= PT_ENTRY_COUNT &&
+					(virtDst & (LARGE_PAGE_SIZE - 1)) == 0) {
+				pte_t *dpt = dst->getLargePTE(virtDst,pte & ~PTE_FRAMENO_MASK,noalloc);
+				if(dpt == NULL)
+					goto error;
+				if(*dpt == 0) {
+					*dpt = pte;
+					virtSrc += LARGE_PAGE_SIZE;
+					virtDst += LARGE_PAGE_SIZE;
+					count -= PT_ENTRY_COUNT;
+					continue;
+				}
+			}
+
+			/* otherwise, copy the part of it as a small page */
+			pte = ((PTE_FRAMENO(pte) + (virtSrc - base) / PAGE_SIZE) << PAGE_BITS) |
+				(pte & ~(PTE_FRAMENO_MASK | PTE_LARGE));
+		}
+
 		/* when shared, simply copy the flags; otherwise: if present, we use copy-on-write */
 		if((pte & PTE_WRITABLE) && (!share && (pte & PTE_PRESENT)))
 			pte &= ~PTE_WRITABLE;
@@ -118,6 +140,11 @@ int PageTables::mapPage(uintptr_t virt,frameno_t frame,pte_t flags,Allocator &al
 			if(crtPageTable(pt + idx,flags,alloc) < 0)
 				return -ENOMEM;
 		}
+		/* we change only a part of a large page; so we need a page-table for it now */
+		else if(pt[idx] & PTE_LARGE) {
+			if(splitLarge(pt + idx,alloc) < 0)
+				return -ENOMEM;
+		}
 		pt = reinterpret_cast<pte_t*>(DIR_MAP_AREA + (pt[idx] & PTE_FRAMENO_MASK));
 		bits -= PT_BPL;
 	}
@@ -131,6 +158,38 @@ int PageTables::mapPage(uintptr_t virt,frameno_t frame,pte_t flags,Allocator &al
 	return wasPresent;
 }
 
+pte_t *PageTables::getLargePTE(uintptr_t virt,pte_t flags,Allocator &alloc) {
+	pte_t *pt = reinterpret_cast<pte_t*>(DIR_MAP_AREA + root);
+	uint bits = PT_BITS - PT_BPL;
+	for(int i = 0; i < PT_LEVELS - 2; ++i) {
+		uintptr_t idx = (virt >> bits) & (PT_ENTRY_COUNT - 1);
+		if(pt[idx] == 0) {
+			if(crtPageTable(pt + idx,flags,alloc) < 0)
+				return NULL;
+		}
+		pt = reinterpret_cast<pte_t*>(DIR_MAP_AREA + (pt[idx] & PTE_FRAMENO_MASK));
+		bits -= PT_BPL;
+	}
+	return pt + ((virt >> bits) & (PT_ENTRY_COUNT - 1));
+}
+
+int PageTables::splitLarge(pte_t *pte,Allocator &alloc) {
+	frameno_t frame = alloc.allocPT();
+	if(frame == PhysMem::INVALID_FRAME)
+		return -ENOMEM;
+
+	/* map the same frames with small pages. note that the TLB entry for the large page stays
+	 * valid until the caller flushes the changed page */
+	pte_t *pt = reinterpret_cast<pte_t*>(DIR_MAP_AREA + (frame << PAGE_BITS));
+	frameno_t first = PTE_FRAMENO(*pte);
+	pte_t flags = *pte & ~(PTE_FRAMENO_MASK | PTE_LARGE);
+	for(size_t i = 0; i < PT_ENTRY_COUNT; ++i)
+		pt[i] = ((first + i) << PAGE_BITS) | flags;
+
+	*pte = (frame << PAGE_BITS) | PTE_PRESENT | PTE_WRITABLE | PTE_EXISTS | (*pte & PTE_NOTSUPER);
+	return 0;
+}
+
 pte_t *PageTables::getPTE(uintptr_t virt,uintptr_t *base) const {
 	pte_t *pt = reinterpret_cast<pte_t*>(DIR_MAP_AREA + root);
 	uint bits = PT_BITS - PT_BPL;
@@ -165,7 +224,7 @@ frameno_t PageTables::unmapPage(uintptr_t virt) {
 bool PageTables::gc(uintptr_t virt,pte_t pte,int level,uint bits,Allocator &alloc) {
 	if(~pte & PTE_EXISTS)
 		return true;
-	if(level == 0)
+	if(level == 0 || (level < PT_LEVELS && (pte & PTE_LARGE)))
 		return false;
 
 	pte_t *pt = reinterpret_cast<pte_t*>(DIR_MAP_AREA + (pte & PTE_FRAMENO_MASK));
@@ -213,6 +272,32 @@ int PageTables::map(uintptr_t virt,size_t count,Allocator &alloc,uint flags) {
 
 	bool needShootdown = false;
 	while(count > 0) {
+		/* use a large page, if the area is suitable and the allocator can provide the frames */
+		if(LARGE_PAGE_SIZE > 0 && (flags & (PG_PRESENT | PG_SUPERVISOR)) == PG_PRESENT &&
+				(virt & (LARGE_PAGE_SIZE - 1)) == 0 && count >= PT_ENTRY_COUNT) {
+			pte_t *pte = getLargePTE(virt,pteFlags,alloc);
+			if(pte == NULL)
+				goto error;
+
+			/* don't replace page-tables */
+			if(*pte == 0 || (*pte & PTE_LARGE)) {
+				frameno_t frame = alloc.allocLarge();
+				if(frame == 0 && (*pte & PTE_LARGE))
+					frame = PTE_FRAMENO(*pte);
+				if(frame != 0 && frame != PhysMem::INVALID_FRAME) {
+					bool wasPresent = *pte & PTE_PRESENT;
+					*pte = (frame << PAGE_BITS) | pteFlags | PTE_LARGE;
+					needShootdown |= wasPresent;
+					if(this == cur)
+						flushAddr(virt,wasPresent);
+
+					virt += LARGE_PAGE_SIZE;
+					count -= PT_ENTRY_COUNT;
+					continue;
+				}
+			}
+		}
+
 		frameno_t frame = 0;
 		if(flags & PG_PRESENT) {
 			frame = alloc.allocPage();
@@ -245,7 +330,7 @@ int PageTables::unmap(uintptr_t virt,size_t count,Allocator &alloc) {
 	size_t pti = PT_ENTRY_COUNT;
 	size_t lastPti = PT_ENTRY_COUNT;
 	bool needShootdown = false;
-	while(count-- > 0) {
+	while(count > 0) {
 		/* remove and free page-table, if necessary */
 		pti = index(virt,1);
 		if(pti != lastPti) {
@@ -254,6 +339,31 @@ int PageTables::unmap(uintptr_t virt,size_t count,Allocator &alloc) {
 			lastPti = pti;
 		}
 
+		/* remove large pages at once, if they are completely unmapped. otherwise split them */
+		uintptr_t base = virt;
+		pte_t *pte = getPTE(virt,&base);
+		if(pte && (*pte & PTE_LARGE)) {
+			if(base == virt && count >= PT_ENTRY_COUNT) {
+				frameno_t frame = PTE_FRAMENO(*pte);
+				bool wasPresent = *pte & PTE_PRESENT;
+				*pte = 0;
+				if(wasPresent) {
+					for(size_t i = 0; i < PT_ENTRY_COUNT; ++i)
+						alloc.freePage(frame + i);
+					if(this == cur)
+						flushAddr(virt,true);
+					needShootdown = true;
+				}
+
+				virt += LARGE_PAGE_SIZE;
+				count -= PT_ENTRY_COUNT;
+				continue;
+			}
+			if(splitLarge(pte,alloc) < 0)
+				Util::panic("Not enough memory to split large page at %p",base);
+		}
+		count--;
+
 		/* remove page and free if necessary */
 		frameno_t frame = unmapPage(virt);
 		if(frame) {
@@ -281,6 +391,8 @@ size_t PageTables::countEntries(pte_t pte,int level) const {
 		if(pt[i] & PTE_PRESENT) {
 			if(level == 1)
 				count++;
+			else if(pt[i] & PTE_LARGE)
+				count += (size_t)1 << (PT_BPL * (level - 1));
 			else if(level > 1)
 				count += countEntries(pt[i],level - 1);
 		}
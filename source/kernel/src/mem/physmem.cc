@@ -18,6 +18,9 @@
  */
 
 #include <esc/ipc/ipcbuf.h>
+#include <mem/cache.h>
+#include <mem/copyonwrite.h>
+#include <mem/pagecache.h>
 #include <mem/pagedir.h>
 #include <mem/physmem.h>
 #include <mem/physmemareas.h>
@@ -25,13 +28,17 @@
 #include <mem/virtmem.h>
 #include <sys/messages.h>
 #include <task/proc.h>
+#include <task/smp.h>
 #include <task/thread.h>
+#include <task/timer.h>
 #include <vfs/openfile.h>
 #include <vfs/vfs.h>
 #include <assert.h>
+#include <atomic.h>
 #include <boot.h>
 #include <common.h>
 #include <config.h>
+#include <cpu.h>
 #include <errno.h>
 #include <log.h>
 #include <spinlock.h>
@@ -61,6 +68,14 @@ SpinLock PhysMem::contLock;
 PhysMem::StackFrames PhysMem::lower;
 PhysMem::StackFrames PhysMem::upper;
 SpinLock PhysMem::defLock;
+PhysMem::FrameCache *PhysMem::frameCaches = NULL;
+frameno_t PhysMem::zeroPool[ZERO_POOL_MAX];
+size_t PhysMem::zeroCount = 0;
+size_t PhysMem::zeroTarget = ZERO_POOL_DEF;
+volatile size_t PhysMem::zeroFrames = 0;
+ulong PhysMem::zeroHits = 0;
+ulong PhysMem::zeroMisses = 0;
+SpinLock PhysMem::zeroLock;
 
 bool PhysMem::initialized = false;
 
@@ -70,9 +85,11 @@ size_t PhysMem::swappedIn = 0;
 bool PhysMem::swapEnabled = false;
 bool PhysMem::swapping = false;
 Thread *PhysMem::swapperThread = NULL;
+volatile ulong PhysMem::swapInHist[SWAP_HIST_SIZE];
+volatile ulong PhysMem::swapOutHist[SWAP_HIST_SIZE];
 size_t PhysMem::cframes = 0;	/* critical frames; for dynarea, cache and heap */
 size_t PhysMem::kframes = 0;	/* kernel frames: for pagedirs, page-tables, kstacks, ... */
-size_t PhysMem::uframes = 0;	/* user frames */
+volatile size_t PhysMem::uframes = 0;	/* user frames */
 
 /* swap-in jobs */
 PhysMem::SwapInJob PhysMem::siJobs[SWAPIN_JOB_COUNT];
@@ -96,6 +113,7 @@ uintptr_t PhysMem::lowerEnd() {
 void PhysMem::init() {
 	/* walk through the memory-map and mark all free areas as free */
 	const Boot::Info *info = Boot::getInfo();
+	uintptr_t memEnd = 0;
 	for(size_t i = 0; i < info->mmapCount; ++i) {
 		if(info->mmap[i].type == Boot::MemMap::MEM_AVAILABLE) {
 			/* take care that we don't add memory that we can't access */
@@ -111,6 +129,7 @@ void PhysMem::init() {
 				end = (1ULL << PHYS_BITS) - 1;
 			}
 			PhysMemAreas::add((uintptr_t)info->mmap[i].baseAddr,end);
+			memEnd = MAX(memEnd,(uintptr_t)end);
 		}
 	}
 	totalMem = PhysMemAreas::getAvailable();
@@ -162,6 +181,9 @@ void PhysMem::init() {
 	/* mark all free */
 	memclear(bitmap,BITMAP_PAGE_COUNT / 8);
 
+	/* the reference counts for copy-on-write need contiguous memory as well */
+	CopyOnWrite::init(memEnd / PAGE_SIZE + 1);
+
 	/* now mark the remaining memory as free on stack */
 	for(const PhysMemAreas::MemArea *area = PhysMemAreas::get(); area != NULL; area = area->next)
 		markRangeUsed(area->addr,area->addr + area->size,false);
@@ -204,6 +226,14 @@ void PhysMem::init() {
 	}
 }
 
+void PhysMem::initCaches() {
+	FrameCache *caches = (FrameCache*)Cache::calloc(SMP::getCPUCount(),sizeof(FrameCache));
+	if(!caches)
+		Util::panic("Unable to create per-cpu frame caches");
+	/* calloc gives us unlocked spinlocks and empty caches */
+	frameCaches = caches;
+}
+
 size_t PhysMem::getFreeFrames(uint types) {
 	/* no lock; just intended for debugging and information */
 	size_t count = 0;
@@ -256,7 +286,7 @@ void PhysMem::freeContiguous(frameno_t first,size_t count) {
 bool PhysMem::reserve(size_t frameCount,bool swap) {
 	defLock.down();
 	size_t free = getFreeDef();
-	uframes += frameCount;
+	Atomic::fetch_and_add(&uframes,frameCount);
 	/* enough user-memory available? */
 	if(free >= frameCount && free - frameCount >= kframes + cframes) {
 		defLock.up();
@@ -267,7 +297,10 @@ bool PhysMem::reserve(size_t frameCount,bool swap) {
 	Thread *t = Thread::getRunning();
 	if(!swap || !swapEnabled || !swapperThread || t->getTid() == swapperThread->getTid()) {
 		defLock.up();
-		uframes -= frameCount;
+		Atomic::fetch_and_add(&uframes,-frameCount);
+		/* the unused pages of the page cache can be dropped without swapping */
+		if(PageCache::reclaim(frameCount) > 0)
+			return reserve(frameCount,swap);
 		return false;
 	}
 
@@ -287,6 +320,11 @@ bool PhysMem::reserve(size_t frameCount,bool swap) {
 	return true;
 }
 
+void PhysMem::unreserve(size_t frameCount) {
+	assert(uframes >= frameCount);
+	Atomic::fetch_and_add(&uframes,-frameCount);
+}
+
 frameno_t PhysMem::allocFrame(bool forceLower) {
 	/* prefer lower pages */
 	if(!forceLower && (size_t)(lower.frames - lower.begin) <= kframes) {
@@ -310,7 +348,78 @@ void PhysMem::freeFrame(frameno_t frame) {
 	}
 }
 
+frameno_t PhysMem::allocUser() {
+	/* the kernel is not preemptible, so we stay on this CPU */
+	FrameCache *fc = frameCaches + SMP::getCurId();
+	frameno_t frame = PhysMem::INVALID_FRAME;
+	fc->lock.down();
+	if(EXPECT_FALSE(fc->count == 0)) {
+		fc->misses++;
+		refill(fc);
+	}
+	else
+		fc->hits++;
+	if(EXPECT_TRUE(fc->count > 0))
+		frame = fc->frames[--fc->count];
+	fc->lock.up();
+
+	/* if the stacks are exhausted, other CPUs might still have some. the pre-zeroed frames are
+	 * our last resort */
+	if(EXPECT_FALSE(frame == PhysMem::INVALID_FRAME))
+		frame = steal(fc);
+	if(EXPECT_FALSE(frame == PhysMem::INVALID_FRAME))
+		frame = takeZeroed();
+	if(EXPECT_TRUE(frame != PhysMem::INVALID_FRAME)) {
+		assert(uframes > 0);
+		Atomic::fetch_and_add(&uframes,-1);
+	}
+	printAllocFree("[A] %x 1 ",frame);
+	return frame;
+}
+
+void PhysMem::refill(FrameCache *fc) {
+	LockGuard<SpinLock> g(&defLock);
+	/* the frames for the kernel have to stay on the stacks */
+	size_t free = getStackFrames();
+	if(free <= kframes + cframes)
+		return;
+
+	size_t count = MIN(FRAME_CACHE_BATCH,free - (kframes + cframes));
+	while(count-- > 0) {
+		frameno_t frame = allocFrame(false);
+		if(frame == PhysMem::INVALID_FRAME)
+			break;
+		fc->frames[fc->count++] = frame;
+	}
+}
+
+void PhysMem::drain(FrameCache *fc,size_t count) {
+	LockGuard<SpinLock> g(&defLock);
+	/* give the oldest frames back and keep the recently freed ones, which are probably still in
+	 * the CPU cache */
+	for(size_t i = 0; i < count; ++i)
+		freeFrame(fc->frames[i]);
+	memmove(fc->frames,fc->frames + count,(fc->count - count) * sizeof(frameno_t));
+	fc->count -= count;
+}
+
+frameno_t PhysMem::steal(FrameCache *own) {
+	for(size_t i = 0; i < SMP::getCPUCount(); ++i) {
+		FrameCache *fc = frameCaches + i;
+		if(fc == own)
+			continue;
+
+		LockGuard<SpinLock> g(&fc->lock);
+		if(fc->count > 0)
+			return fc->frames[--fc->count];
+	}
+	return PhysMem::INVALID_FRAME;
+}
+
 frameno_t PhysMem::allocate(FrameType type) {
+	if(EXPECT_TRUE(type == USR && frameCaches))
+		return allocUser();
+
 	LockGuard<SpinLock> g(&defLock);
 	/* remove the memory from the available one when we're not yet initialized */
 	frameno_t frame = PhysMem::INVALID_FRAME;
@@ -338,9 +447,9 @@ frameno_t PhysMem::allocate(FrameType type) {
 				break;
 
 			default:
-				if(getFreeDef() > (kframes + cframes)) {
+				if(getStackFrames() > (kframes + cframes)) {
 					assert(uframes > 0);
-					uframes--;
+					Atomic::fetch_and_add(&uframes,-1);
 					frame = allocFrame(false);
 				}
 				break;
@@ -351,8 +460,18 @@ frameno_t PhysMem::allocate(FrameType type) {
 }
 
 void PhysMem::free(frameno_t frame,FrameType type) {
-	LockGuard<SpinLock> g(&defLock);
 	printAllocFree("[F] %x 1 ",frame);
+	/* put user frames that belong onto the stacks into the cache of the current CPU */
+	if(EXPECT_TRUE(type == USR && frameCaches && frame >= bitmapStartFrame() + BITMAP_PAGE_COUNT)) {
+		FrameCache *fc = frameCaches + SMP::getCurId();
+		LockGuard<SpinLock> g(&fc->lock);
+		if(EXPECT_FALSE(fc->count == FRAME_CACHE_SIZE))
+			drain(fc,FRAME_CACHE_BATCH);
+		fc->frames[fc->count++] = frame;
+		return;
+	}
+
+	LockGuard<SpinLock> g(&defLock);
 	if(type == CRIT)
 		cframes++;
 	else if(type == KERN)
@@ -360,6 +479,73 @@ void PhysMem::free(frameno_t frame,FrameType type) {
 	markUsed(frame,false);
 }
 
+frameno_t PhysMem::getZeroed(frameno_t frame) {
+	frameno_t zframe = takeZeroed();
+	if(zframe == PhysMem::INVALID_FRAME) {
+		zeroMisses++;
+		return frame;
+	}
+
+	/* the frame count stays the same, because we give <frame> back */
+	zeroHits++;
+	free(frame,USR);
+	return zframe;
+}
+
+frameno_t PhysMem::takeZeroed() {
+	LockGuard<SpinLock> g(&zeroLock);
+	if(zeroCount == 0)
+		return PhysMem::INVALID_FRAME;
+	Atomic::fetch_and_add(&zeroFrames,-1);
+	return zeroPool[--zeroCount];
+}
+
+bool PhysMem::fillZeroPool() {
+	if(!initialized || zeroCount >= zeroTarget)
+		return false;
+
+	/* take it from the stacks, but leave the frames for the kernel there */
+	frameno_t frame;
+	{
+		LockGuard<SpinLock> g(&defLock);
+		if(getStackFrames() <= kframes + cframes)
+			return false;
+		frame = allocFrame(false);
+		if(frame == PhysMem::INVALID_FRAME)
+			return false;
+		Atomic::fetch_and_add(&zeroFrames,+1);
+	}
+
+	uintptr_t addr = PageDir::getAccess(frame);
+	memclear((void*)addr,PAGE_SIZE);
+	PageDir::removeAccess(frame);
+
+	zeroLock.down();
+	/* the target might have been lowered in the meantime */
+	if(zeroCount < zeroTarget) {
+		zeroPool[zeroCount++] = frame;
+		zeroLock.up();
+		return true;
+	}
+	zeroLock.up();
+
+	LockGuard<SpinLock> g(&defLock);
+	Atomic::fetch_and_add(&zeroFrames,-1);
+	freeFrame(frame);
+	return false;
+}
+
+void PhysMem::setZeroPoolTarget(size_t frames) {
+	zeroTarget = MIN(frames,ZERO_POOL_MAX);
+
+	/* free the frames that exceed the new target */
+	frameno_t frame;
+	while(zeroCount > zeroTarget && (frame = takeZeroed()) != PhysMem::INVALID_FRAME) {
+		LockGuard<SpinLock> g(&defLock);
+		freeFrame(frame);
+	}
+}
+
 int PhysMem::swapIn(uintptr_t addr) {
 	if(!swapEnabled)
 		return -EFAULT;
@@ -391,9 +577,11 @@ int PhysMem::swapIn(uintptr_t addr) {
 	if(!swapping)
 		Sched::wakeup(EV_SWAP_WORK,0);
 	/* wait until its done */
+	uint64_t start = CPU::rdtsc();
 	t->block();
 	defLock.up();
 	Thread::switchNoSigs();
+	addLatency(swapInHist,CPU::rdtsc() - start);
 	return 0;
 }
 
@@ -431,8 +619,14 @@ void PhysMem::swapper() {
 			swapping = true;
 			defLock.up();
 
-			VirtMem::swapOut(pid,swapFile,amount);
-			swappedOut += amount;
+			/* dropping unused pages from the page cache is cheaper than swapping */
+			size_t dropped = PageCache::reclaim(amount);
+			if(dropped < amount) {
+				uint64_t start = CPU::rdtsc();
+				VirtMem::swapOut(pid,swapFile,amount - dropped);
+				addLatency(swapOutHist,CPU::rdtsc() - start);
+				swappedOut += amount - dropped;
+			}
 
 			defLock.down();
 			swapping = false;
@@ -477,6 +671,12 @@ void PhysMem::print(OStream &os) {
 	os.writef("UFrames: %zu\n",uframes);
 	os.writef("Swapped out: %zu\n",swappedOut);
 	os.writef("Swapped in: %zu\n",swappedIn);
+	if(frameCaches) {
+		for(size_t i = 0; i < SMP::getCPUCount(); ++i) {
+			os.writef("CPU %zu frame cache: %zu frames [hits=%lu, misses=%lu]\n",
+				i,frameCaches[i].count,frameCaches[i].hits,frameCaches[i].misses);
+		}
+	}
 	os.writef("\n");
 	os.writef("Swap-in-jobs:\n");
 	for(SwapInJob *job = siJobList; job != NULL; job = job->next) {
@@ -485,6 +685,41 @@ void PhysMem::print(OStream &os) {
 	}
 }
 
+void PhysMem::printSwap(OStream &os) {
+	os.writef("Swapped out: %zu\n",swappedOut);
+	os.writef("Swapped in: %zu\n",swappedIn);
+	os.writef("Swap space: %zu of %zu KiB free\n",
+		SwapMap::freeSpace() / 1024,SwapMap::totalSpace() / 1024);
+	printLatency(os,"Swap-out",swapOutHist);
+	printLatency(os,"Swap-in",swapInHist);
+}
+
+void PhysMem::addLatency(volatile ulong *hist,uint64_t cycles) {
+	uint64_t usecs = Timer::cyclesToTime(cycles);
+	size_t i = 0;
+	while(i < SWAP_HIST_SIZE - 1 && usecs >= (1ULL << i))
+		i++;
+	Atomic::fetch_and_add(hist + i,1);
+}
+
+void PhysMem::printLatency(OStream &os,const char *name,volatile ulong *hist) {
+	os.writef("%s latency:\n",name);
+	for(size_t i = 0; i < SWAP_HIST_SIZE; ++i) {
+		if(hist[i] == 0)
+			continue;
+		if(i == SWAP_HIST_SIZE - 1)
+			os.writef("\t>= %8Lu us: %lu\n",1ULL << (i - 1),hist[i]);
+		else
+			os.writef("\t<  %8Lu us: %lu\n",1ULL << i,hist[i]);
+	}
+}
+
+void PhysMem::printZeroPool(OStream &os) {
+	os.writef("Frames: %zu of %zu\n",zeroCount,zeroTarget);
+	os.writef("Maximum: %zu\n",ZERO_POOL_MAX);
+	os.writef("Hits: %lu, misses: %lu\n",zeroHits,zeroMisses);
+}
+
 void PhysMem::printStack(OStream &os) {
 	struct {
 		const char *name;
@@ -518,9 +753,22 @@ void PhysMem::printCont(OStream &os) {
 }
 
 size_t PhysMem::getFreeDef() {
+	return getStackFrames() + getCachedFrames() + zeroFrames;
+}
+
+size_t PhysMem::getStackFrames() {
 	return (lower.frames - lower.begin) + (upper.frames - upper.begin);
 }
 
+size_t PhysMem::getCachedFrames() {
+	size_t count = 0;
+	if(frameCaches) {
+		for(size_t i = 0; i < SMP::getCPUCount(); ++i)
+			count += frameCaches[i].count;
+	}
+	return count;
+}
+
 void PhysMem::markRangeUsed(uintptr_t from,uintptr_t to,bool used) {
 	doMarkRangeUsed(from,to,used);
 }
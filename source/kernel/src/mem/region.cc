@@ -21,6 +21,7 @@
 #include <mem/physmem.h>
 #include <mem/region.h>
 #include <mem/swapmap.h>
+#include <mem/vmtree.h>
 #include <task/proc.h>
 #include <vfs/openfile.h>
 #include <vfs/vfs.h>
@@ -53,13 +54,15 @@
 Region::Region(OpenFile *f,size_t bCount,size_t lCount,size_t off,ulong pgFlags,
                ulong _flags,bool &success)
 		: flags(_flags), file(f), offset(off), loadCount(lCount), byteCount(bCount),
-		  timestamp(0), pfSize(), pageFlags(), vms(), lock() {
+		  clockHand(0), faultNext(), faultWindow(FAULT_WINDOW_MIN), pfSize(), pageFlags(), vms(),
+		  vmregs(), lock() {
 	init(pgFlags,success);
 }
 
 Region::Region(const Region &reg,VirtMem *vm,bool &success)
 		: flags(reg.flags), file(reg.file), offset(reg.offset), loadCount(reg.loadCount),
-		  byteCount(reg.byteCount), timestamp(0), pfSize(), pageFlags(), vms(), lock() {
+		  byteCount(reg.byteCount), clockHand(0), faultNext(), faultWindow(FAULT_WINDOW_MIN), pfSize(),
+		  pageFlags(), vms(), vmregs(), lock() {
 	assert(!(flags & RF_SHAREABLE));
 	init(-1,success);
 	if(!success)
@@ -117,6 +120,35 @@ Region::~Region() {
 	Cache::free(pageFlags);
 }
 
+bool Region::remFrom(VirtMem *vm) {
+	for(VMRegion *vmreg = vmregs; vmreg != NULL; vmreg = vmreg->regNext) {
+		if(vmreg->getVM() == vm) {
+			remVMReg(vmreg);
+			break;
+		}
+	}
+	return vms.remove(vm);
+}
+
+void Region::addVMReg(VMRegion *vm) {
+	vm->regNext = vmregs;
+	vmregs = vm;
+}
+
+void Region::remVMReg(VMRegion *vm) {
+	VMRegion *p = NULL;
+	for(VMRegion *v = vmregs; v != NULL; p = v, v = v->regNext) {
+		if(v == vm) {
+			if(p)
+				p->regNext = v->regNext;
+			else
+				vmregs = v->regNext;
+			v->regNext = NULL;
+			break;
+		}
+	}
+}
+
 size_t Region::pageCount(size_t *swapped,size_t *cow) const {
 	size_t c = 0,pcount = BYTES_2_PAGES(byteCount);
 	assert(this != NULL);
@@ -190,18 +222,19 @@ void Region::print(OStream &os,uintptr_t virt) const {
 		file->print(os);
 		os.writef("\n");
 	}
-	os.writef("\tTimestamp: %Lu\n",timestamp);
+	os.writef("\tClock hand: %zu\n",clockHand);
 	os.writef("\tProcesses: ");
 	for(auto it = vms.cbegin(); it != vms.cend(); ++it)
 		os.writef("%d ",(*it)->getProc()->getPid());
 	os.writef("\n");
 	os.writef("\tPages (%d):\n",BYTES_2_PAGES(byteCount));
 	for(size_t i = 0, x = BYTES_2_PAGES(byteCount); i < x; i++) {
-		os.writef("\t\t%d: (%p) (swblk %d) %c%c%c\n",i,virt + i * PAGE_SIZE,
+		os.writef("\t\t%d: (%p) (swblk %d) %c%c%c%c\n",i,virt + i * PAGE_SIZE,
 				(pageFlags[i] & PF_SWAPPED) ? getSwapBlock(i) : 0,
 				(pageFlags[i] & PF_COPYONWRITE) ? 'c' : '-',
 				(pageFlags[i] & PF_DEMANDLOAD) ? 'l' : '-',
-				(pageFlags[i] & PF_SWAPPED) ? 's' : '-');
+				(pageFlags[i] & PF_SWAPPED) ? 's' : '-',
+				(pageFlags[i] & PF_CACHED) ? 'p' : '-');
 	}
 }
 
@@ -33,7 +33,7 @@
 size_t SwapMap::totalBlocks = 0;
 size_t SwapMap::freeBlocks = 0;
 SwapMap::Block *SwapMap::swapBlocks = NULL;
-SwapMap::Block *SwapMap::freeList = NULL;
+size_t SwapMap::rover = 0;
 SpinLock SwapMap::lock;
 
 bool SwapMap::init(size_t swapSize) {
@@ -43,37 +43,47 @@ bool SwapMap::init(size_t swapSize) {
 	if(swapBlocks == NULL)
 		return false;
 
-	/* build freelist */
-	freeList = swapBlocks + 0;
-	swapBlocks[0].refCount = 0;
-	swapBlocks[0].next = NULL;
-	for(size_t i = 1; i < totalBlocks; i++) {
-		swapBlocks[i].next = freeList;
+	for(size_t i = 0; i < totalBlocks; i++)
 		swapBlocks[i].refCount = 0;
-		freeList = swapBlocks + i;
-	}
+	rover = totalBlocks;
 	return true;
 }
 
-ulong SwapMap::alloc() {
+ulong SwapMap::alloc(size_t count) {
 	LockGuard<SpinLock> g(&lock);
-	if(!freeList)
+	if(count == 0 || freeBlocks < count)
 		return INVALID;
-	Block *block = freeList;
-	freeList = freeList->next;
-	block->refCount = 1;
-	freeBlocks--;
-	return block - swapBlocks;
+
+	/* search downwards from the last allocation for <count> free blocks in a row. thus, the
+	 * blocks that are swapped out one after another end up next to each other on the disk */
+	size_t run = 0;
+	size_t pos = rover;
+	for(size_t i = 0; i < totalBlocks + count; i++) {
+		/* wrap around; runs can't go beyond the end */
+		if(pos == 0) {
+			pos = totalBlocks;
+			run = 0;
+		}
+		pos--;
+
+		if(swapBlocks[pos].refCount > 0)
+			run = 0;
+		else if(++run == count) {
+			for(size_t j = 0; j < count; j++)
+				swapBlocks[pos + j].refCount = 1;
+			freeBlocks -= count;
+			rover = pos;
+			return pos;
+		}
+	}
+	return INVALID;
 }
 
 void SwapMap::free(ulong block) {
 	LockGuard<SpinLock> g(&lock);
 	assert(block < totalBlocks);
-	if(--swapBlocks[block].refCount == 0) {
-		swapBlocks[block].next = freeList;
-		freeList = swapBlocks + block;
+	if(--swapBlocks[block].refCount == 0)
 		freeBlocks++;
-	}
 }
 
 void SwapMap::print(OStream &os) {
@@ -19,13 +19,13 @@
 
 #include <mem/cache.h>
 #include <mem/copyonwrite.h>
+#include <mem/pagecache.h>
 #include <mem/pagedir.h>
 #include <mem/region.h>
 #include <mem/shfiles.h>
 #include <mem/swapmap.h>
 #include <mem/virtmem.h>
 #include <task/proc.h>
-#include <task/smp.h>
 #include <task/thread.h>
 #include <vfs/openfile.h>
 #include <vfs/vfs.h>
@@ -48,7 +48,7 @@
 
 #define DEBUG_SWAP			0
 
-static uint8_t buffer[PAGE_SIZE];
+static uint8_t buffer[PAGE_SIZE * PhysMem::MAX_SWAP_AT_ONCE];
 
 void VirtMem::acquire() const {
 	proc->lock(PLOCK_PROG);
@@ -71,7 +71,12 @@ uintptr_t VirtMem::mapphys(uintptr_t *phys,size_t bCount,size_t align,int flags)
 	uint mapflags = MAP_NOMAP;
 	if(!(flags & MAP_PHYS_MAP)) {
 		if(align) {
-			ssize_t first = PhysMem::allocateContiguous(pages,align / PAGE_SIZE);
+			ssize_t first = -ENOMEM;
+			/* try to get memory that can be mapped with large pages first */
+			if(LARGE_PAGE_SIZE > 0 && bCount >= LARGE_PAGE_SIZE && align < LARGE_PAGE_SIZE)
+				first = PhysMem::allocateContiguous(pages,LARGE_PAGE_SIZE / PAGE_SIZE);
+			if(first < 0)
+				first = PhysMem::allocateContiguous(pages,align / PAGE_SIZE);
 			if(first < 0)
 				return first;
 			firstFrame = first;
@@ -201,8 +206,14 @@ int VirtMem::map(uintptr_t *addr,size_t length,size_t loadCount,int prot,int fla
 		/* find a suitable place */
 		if(rflags & MAP_STACK)
 			virt = findFreeStack(length,rflags);
-		else
-			virt = freemap.allocate(ROUND_PAGE_UP(length));
+		else {
+			/* physical mappings can use large pages, if they are aligned accordingly */
+			virt = 0;
+			if(LARGE_PAGE_SIZE > 0 && (rflags & MAP_NOMAP) && length >= LARGE_PAGE_SIZE)
+				virt = freemap.allocate(ROUND_PAGE_UP(length),LARGE_PAGE_SIZE);
+			if(virt == 0)
+				virt = freemap.allocate(ROUND_PAGE_UP(length));
+		}
 		if(virt == 0)
 			goto errProc;
 	}
@@ -283,21 +294,22 @@ int VirtMem::protect(uintptr_t addr,ulong flags) {
 	if(!vmreg || (vmreg->reg->getFlags() & (RF_NOFREE | RF_STACK)))
 		goto error;
 
-	/* check if COW is enabled for a page */
+	/* check if COW is enabled for a page. pages of the page cache can't become writable */
 	pgcount = BYTES_2_PAGES(vmreg->reg->getByteCount());
 	for(size_t i = 0; i < pgcount; i++) {
 		if(vmreg->reg->getPageFlags(i) & PF_COPYONWRITE)
 			goto error;
+		if((flags & RF_WRITABLE) && (vmreg->reg->getPageFlags(i) & PF_CACHED))
+			goto error;
 	}
 
 	/* change reg flags */
 	vmreg->reg->setFlags((vmreg->reg->getFlags() & ~(RF_WRITABLE | RF_EXECUTABLE)) | flags);
 
 	/* change mapping */
-	for(auto mp = vmreg->reg->vmbegin(); mp != vmreg->reg->vmend(); ++mp) {
+	for(VMRegion *mpreg = vmreg->reg->getVMRegs(); mpreg != NULL; mpreg = mpreg->regNext) {
 		/* the region may be mapped to a different virtual address */
-		VMRegion *mpreg = (*mp)->regtree.getByReg(vmreg->reg);
-		assert(mpreg != NULL);
+		VirtMem *mp = mpreg->getVM();
 		for(size_t i = 0; i < pgcount; i++) {
 			/* determine flags; we can't always mark it present.. */
 			uint mapFlags = 0;
@@ -308,7 +320,7 @@ int VirtMem::protect(uintptr_t addr,ulong flags) {
 			if(flags & RF_WRITABLE)
 				mapFlags |= PG_WRITABLE;
 			/* can't fail because of NoAllocator and because the page-table is always present */
-			sassert((*mp)->getPageDir()->map(mpreg->virt() + i * PAGE_SIZE,1,alloc,mapFlags) == 0);
+			sassert(mp->getPageDir()->map(mpreg->virt() + i * PAGE_SIZE,1,alloc,mapFlags) == 0);
 		}
 	}
 	res = 0;
@@ -389,54 +401,78 @@ int VirtMem::populatePages(VMRegion *vm,size_t count) {
 }
 
 void VirtMem::swapOut(pid_t pid,OpenFile *file,size_t count) {
+	size_t pages[PhysMem::MAX_SWAP_AT_ONCE];
 	while(count > 0) {
-		Region *reg = getLRURegion();
+		size_t found;
+		Region *reg = getSwapPages(pages,MIN(count,PhysMem::MAX_SWAP_AT_ONCE),&found);
 		if(reg == NULL)
 			Util::panic("No pages to swap out");
 
-		/* the list of processes may have changed in the meantime; we can't swap out in this case */
-		while(count > 0) {
-			/* get page to swap out */
-			ssize_t index = getPgIdxForSwap(reg);
-			if(index < 0)
-				break;
-
-			/* get VM-region of first process */
-			VirtMem *vm = *reg->vmbegin();
-			VMRegion *vmreg = vm->regtree.getByReg(reg);
+		/* get VM-region of first process */
+		VMRegion *vmreg = reg->getVMRegs();
+		VirtMem *vm = vmreg->getVM();
+
+		/* pages of the page cache don't need to be written out; we just let them fault
+		 * again, which will take them from the cache, if it's still there. but this only frees a
+		 * frame if nobody else uses the page */
+		size_t total = 0;
+		for(size_t i = 0; i < found; ++i) {
+			if(reg->getPageFlags(pages[i]) & PF_CACHED) {
+				uintptr_t virt = vmreg->virt() + pages[i] * PAGE_SIZE;
+				frameno_t frameNo = vm->getPageDir()->getFrameNo(virt);
+				setDropped(reg,pages[i]);
+				PageCache::release(frameNo);
+				if(PageCache::reclaim(1) > 0)
+					count--;
+			}
+			else
+				pages[total++] = pages[i];
+		}
 
-			/* find swap-block */
-			ulong block = SwapMap::alloc();
+		for(size_t i = 0; i < total; ) {
+			/* find contiguous swap-blocks to write them at once; if the swap-device is too
+			 * fragmented for that, take them one by one */
+			size_t num = total - i;
+			ulong block = SwapMap::alloc(num);
+			if(block == SwapMap::INVALID) {
+				num = 1;
+				block = SwapMap::alloc(num);
+			}
 			assert(block != SwapMap::INVALID);
 
+			for(size_t j = 0; j < num; ++j) {
+				size_t index = pages[i + j];
+
 #if DEBUG_SWAP
-			Log::get().writef("OUT: %d of region %x (block %d)\n",index,vmreg->reg,block);
-			for(auto mp = reg->vmbegin(); mp != reg->vmend(); ++mp) {
-				VMRegion *mpreg = (*mp)->regtree.getByReg(reg);
-				Log::get().writef("\tProcess %d:%s -> page %p\n",(*mp)->getProc()->getPid(),
-						(*mp)->getProc()->getProgram(),mpreg->virt() + index * PAGE_SIZE);
-			}
-			Log::get().writef("\n");
+				Log::get().writef("OUT: %d of region %x (block %d)\n",index,vmreg->reg,block + j);
+				for(VMRegion *mpreg = reg->getVMRegs(); mpreg != NULL; mpreg = mpreg->regNext) {
+					VirtMem *mp = mpreg->getVM();
+					Log::get().writef("\tProcess %d:%s -> page %p\n",mp->getProc()->getPid(),
+							mp->getProc()->getProgram(),mpreg->virt() + index * PAGE_SIZE);
+				}
+				Log::get().writef("\n");
 #endif
 
-			/* get the frame first, because the page has to be present */
-			frameno_t frameNo = vm->getPageDir()->getFrameNo(vmreg->virt() + index * PAGE_SIZE);
-			/* unmap the page in all processes and ensure that all CPUs have flushed their TLB */
-			/* this way we know that nobody can still access the page; if someone tries, he will
-			 * cause a page-fault and will wait until we release the region-mutex */
-			setSwappedOut(reg,index);
-			reg->setSwapBlock(index,block);
-			SMP::ensureTLBFlushed();
-
-			/* copy to a temporary buffer because we can't use the temp-area when switching threads */
-			PageDir::copyFromFrame(frameNo,buffer);
-			PhysMem::free(frameNo,PhysMem::USR);
+				/* get the frame first, because the page has to be present */
+				frameno_t frameNo = vm->getPageDir()->getFrameNo(vmreg->virt() + index * PAGE_SIZE);
+				/* unmap the page in all processes. this waits until all CPUs that use one of them
+				 * have flushed their TLB, so that nobody can still access the page; if someone
+				 * tries, he will cause a page-fault and will wait until we release the region-mutex */
+				setSwappedOut(reg,index);
+				reg->setSwapBlock(index,block + j);
+
+				/* copy to a temporary buffer because we can't use the temp-area when switching
+				 * threads */
+				PageDir::copyFromFrame(frameNo,buffer + j * PAGE_SIZE);
+				PhysMem::free(frameNo,PhysMem::USR);
+			}
 
 			/* write out on disk */
 			sassert(file->seek(pid,block * PAGE_SIZE,SEEK_SET) >= 0);
-			sassert(file->write(pid,buffer,PAGE_SIZE) == PAGE_SIZE);
+			sassert(file->write(pid,buffer,num * PAGE_SIZE) == (ssize_t)(num * PAGE_SIZE));
 
-			count--;
+			i += num;
+			count -= num;
 		}
 		reg->release();
 	}
@@ -458,10 +494,10 @@ bool VirtMem::swapIn(pid_t pid,OpenFile *file,Thread *t,uintptr_t addr) {
 
 #if DEBUG_SWAP
 	Log::get().writef("IN: %d of region %x (block %d)\n",index,vmreg->reg,block);
-	for(auto mp = vmreg->reg->vmbegin(); mp != vmreg->reg->vmend(); ++mp) {
-		VMRegion *mpreg = (*mp)->regtree.getByReg(vmreg->reg);
-		Log::get().writef("\tProcess %d:%s -> page %p\n",(*mp)->getProc()->getPid(),
-				(*mp)->getProc()->getProgram(),mpreg->virt() + index * PAGE_SIZE);
+	for(VMRegion *mpreg = vmreg->reg->getVMRegs(); mpreg != NULL; mpreg = mpreg->regNext) {
+		VirtMem *mp = mpreg->getVM();
+		Log::get().writef("\tProcess %d:%s -> page %p\n",mp->getProc()->getPid(),
+				mp->getProc()->getProgram(),mpreg->virt() + index * PAGE_SIZE);
 	}
 	Log::get().writef("\n");
 #endif
@@ -482,24 +518,6 @@ bool VirtMem::swapIn(pid_t pid,OpenFile *file,Thread *t,uintptr_t addr) {
 	return true;
 }
 
-void VirtMem::setTimestamp(Thread *t,uint64_t timestamp) {
-	/* ignore setting the timestamp if the process is currently locked; its not that critical and
-	 * we can't wait for the mutex here because this is called from Thread::switchAway() and the wait
-	 * for the mutex would call that as well */
-	VirtMem *vm = t->getProc()->getVM();
-	if(vm->tryAquire()) {
-		for(size_t i = 0; i < STACK_REG_COUNT; i++) {
-			if(t->getStackRegion(i))
-				t->getStackRegion(i)->reg->setTimestamp(timestamp);
-		}
-		for(auto reg = vm->regtree.begin(); reg != vm->regtree.end(); ++reg) {
-			if(!(reg->reg->getFlags() & RF_STACK))
-				reg->reg->setTimestamp(timestamp);
-		}
-		vm->release();
-	}
-}
-
 size_t VirtMem::getMemUsage(size_t *pages) const {
 	size_t rpages = 0;
 	*pages = 0;
@@ -591,7 +609,7 @@ int VirtMem::doPagefault(uintptr_t addr,VMRegion *vm,bool write) {
 	if(flags & PF_DEMANDLOAD) {
 		res = demandLoad(vm,addr);
 		if(res == 0)
-			vm->reg->setPageFlags(page,flags & ~PF_DEMANDLOAD);
+			vm->reg->setPageFlags(page,vm->reg->getPageFlags(page) & ~PF_DEMANDLOAD);
 	}
 	else if(flags & PF_SWAPPED)
 		res = PhysMem::swapIn(addr);
@@ -604,7 +622,7 @@ int VirtMem::doPagefault(uintptr_t addr,VMRegion *vm,bool write) {
 		res = 0;
 	}
 	else {
-		vassert(flags == 0,"Flags: %x",flags);
+		vassert((flags & ~PF_CACHED) == 0,"Flags: %x",flags);
 		/* its ok if its either a read-access or a write-access on a writeable region */
 		/* note: this map happen if e.g. two threads of a process cause a page-fault simultanously.
 		 * of course, only one thread gets the region-mutex and handles the page-fault. the other
@@ -691,7 +709,10 @@ void VirtMem::doUnmap(VMRegion *vm) {
 			if(vm->reg->getPageFlags(i) & PF_SWAPPED)
 				addSwap(-1);
 			else if(!(vm->reg->getPageFlags(i) & (PF_COPYONWRITE | PF_DEMANDLOAD))) {
-				if(freeFrame) {
+				/* the frame belongs to the page cache, which might keep it */
+				if(vm->reg->getPageFlags(i) & PF_CACHED)
+					PageCache::release(getPageDir()->getFrameNo(virt));
+				else if(freeFrame) {
 					if(frameNo == 0)
 						frameNo = getPageDir()->getFrameNo(virt);
 					PhysMem::free(frameNo,PhysMem::USR);
@@ -721,11 +742,12 @@ void VirtMem::doUnmap(VMRegion *vm) {
 		/* remove from shared tree */
 		if(vm->reg->getFlags() & RF_SHAREABLE)
 			ShFiles::remove(vm);
-		/* now destroy region */
-		vm->reg->release();
-		/* do the remove BEFORE the free */
+		/* remove it while we hold the lock, because that walks the vmregs of the region. and do
+		 * the remove BEFORE the free */
 		Region *r = vm->reg;
 		regtree.remove(vm);
+		/* now destroy region */
+		r->release();
 		delete r;
 	}
 	else {
@@ -744,8 +766,10 @@ void VirtMem::doUnmap(VMRegion *vm) {
 		/* give the memory back to the free-area, if its in there */
 		if(vm->virt() >= FREE_AREA_BEGIN)
 			freemap.free(vm->virt(),ROUND_PAGE_UP(vm->reg->getByteCount()));
-		vm->reg->release();
+		/* others might still use the region, so remove it while we hold the lock */
+		Region *r = vm->reg;
 		regtree.remove(vm);
+		r->release();
 	}
 }
 
@@ -922,6 +946,11 @@ int VirtMem::cloneAll(VirtMem *dst) {
 				for(j = 0; j < pageCount; j++) {
 					if(vm->reg->getPageFlags(j) & PF_SWAPPED)
 						dst->addSwap(1);
+					/* pages of the page cache are never written, so that we can simply share them */
+					else if(vm->reg->getPageFlags(j) & PF_CACHED) {
+						PageCache::ref(getPageDir()->getFrameNo(virt));
+						dst->addOwn(1);
+					}
 					/* not when demand-load or swapping is outstanding since we've not loaded it
 					 * from disk yet */
 					else if(!(vm->reg->getPageFlags(j) & (PF_DEMANDLOAD | PF_SWAPPED))) {
@@ -965,7 +994,9 @@ errorPages:
 	/* undo the stats-change for this and remove the frames from copy-on-write */
 	for(; j-- > 0; ) {
 		virt -= PAGE_SIZE;
-		if(!(vm->reg->getPageFlags(j) & (PF_DEMANDLOAD | PF_SWAPPED))) {
+		if(vm->reg->getPageFlags(j) & PF_CACHED)
+			PageCache::release(getPageDir()->getFrameNo(virt));
+		else if(!(vm->reg->getPageFlags(j) & (PF_DEMANDLOAD | PF_SWAPPED))) {
 			bool other;
 			frameno_t frameNo = getPageDir()->getFrameNo(virt);
 			CopyOnWrite::remove(frameNo,&other);
@@ -1004,6 +1035,105 @@ errorRel:
 	return -ENOMEM;
 }
 
+/**
+ * Checks whether the <count> pages at <addr> in <vm> can be lent or replaced by lent frames.
+ * Private file mappings are allowed, because their loaded pages are private copies, just like
+ * after a fork. This includes the data region, i.e. the heap.
+ */
+static bool canLend(const VMRegion *vm,uintptr_t addr,size_t count) {
+	ulong rflags = vm->reg->getFlags();
+	if((rflags & (RF_SHAREABLE | RF_NOFREE | RF_WRITABLE)) != RF_WRITABLE)
+		return false;
+	return addr + count * PAGE_SIZE <= vm->virt() + ROUND_PAGE_UP(vm->reg->getByteCount());
+}
+
+bool VirtMem::lendPages(uintptr_t addr,size_t count,frameno_t *frames) {
+	bool res = false;
+	acquire();
+	VMRegion *vm = regtree.getByAddr(addr);
+	if(vm && canLend(vm,addr,count)) {
+		vm->reg->acquire();
+		size_t first = (addr - vm->virt()) / PAGE_SIZE;
+
+		/* all pages have to be present; swapped, demand-loaded and cached ones are copied */
+		size_t i;
+		for(i = 0; i < count; ++i) {
+			if((vm->reg->getPageFlags(first + i) & ~PF_COPYONWRITE) ||
+					!getPageDir()->isPresent(addr + i * PAGE_SIZE))
+				break;
+		}
+
+		if(i == count) {
+			for(i = 0; i < count; ++i) {
+				frames[i] = getPageDir()->getFrameNo(addr + i * PAGE_SIZE);
+				/* one reference for us, if not already done, and one for the borrower */
+				if(!(vm->reg->getPageFlags(first + i) & PF_COPYONWRITE)) {
+					CopyOnWrite::add(frames[i]);
+					vm->reg->setPageFlags(first + i,PF_COPYONWRITE);
+					addShared(1);
+					addOwn(-1);
+				}
+				CopyOnWrite::add(frames[i]);
+			}
+
+			/* write-protect them; the NoAllocator keeps the frames */
+			uint mapFlags = PG_PRESENT;
+			if(vm->reg->getFlags() & RF_EXECUTABLE)
+				mapFlags |= PG_EXECUTABLE;
+			PageTables::NoAllocator noalloc;
+			getPageDir()->map(addr,count,noalloc,mapFlags);
+			res = true;
+		}
+		vm->reg->release();
+	}
+	release();
+	return res;
+}
+
+size_t VirtMem::borrowPages(uintptr_t addr,size_t count,frameno_t *frames) {
+	size_t res = 0;
+	acquire();
+	VMRegion *vm = regtree.getByAddr(addr);
+	if(vm && canLend(vm,addr,count)) {
+		vm->reg->acquire();
+		size_t first = (addr - vm->virt()) / PAGE_SIZE;
+		uint mapFlags = PG_PRESENT;
+		if(vm->reg->getFlags() & RF_EXECUTABLE)
+			mapFlags |= PG_EXECUTABLE;
+
+		for(size_t i = 0; i < count; ++i) {
+			uintptr_t virt = addr + i * PAGE_SIZE;
+			ulong pflags = vm->reg->getPageFlags(first + i);
+			/* the page-tables have to exist already, so that we don't need to allocate frames */
+			if((pflags & ~PF_COPYONWRITE) || !getPageDir()->isPresent(virt))
+				continue;
+
+			frameno_t old = getPageDir()->getFrameNo(virt);
+			PageTables::RangeAllocator alloc(frames[i]);
+			getPageDir()->map(virt,1,alloc,mapFlags);
+
+			/* now we can get rid of the old frame */
+			if(pflags & PF_COPYONWRITE) {
+				bool foundOther;
+				CopyOnWrite::remove(old,&foundOther);
+				if(!foundOther)
+					PhysMem::free(old,PhysMem::USR);
+			}
+			else {
+				PhysMem::free(old,PhysMem::USR);
+				vm->reg->setPageFlags(first + i,PF_COPYONWRITE);
+				addShared(1);
+				addOwn(-1);
+			}
+			frames[i] = PhysMem::INVALID_FRAME;
+			res++;
+		}
+		vm->reg->release();
+	}
+	release();
+	return res;
+}
+
 int VirtMem::growStackTo(VMRegion *vm,uintptr_t addr) {
 	int res = -EFAULT;
 	acquire();
@@ -1216,70 +1346,83 @@ void VirtMem::print(OStream &os) const {
 }
 
 int VirtMem::demandLoad(VMRegion *vm,uintptr_t addr) {
-	int res;
+	size_t page = (addr - vm->virt()) / PAGE_SIZE;
+	if(isCacheable(vm->reg,page)) {
+		OpenFile *file = vm->reg->getFile();
+		size_t size;
+		frameno_t frame = PageCache::get(FileId(file->getDev(),file->getNodeNo()),
+			vm->reg->getOffset() / PAGE_SIZE + page,&size);
+		if(frame != PhysMem::INVALID_FRAME) {
+			/* we need the whole page; if it's not complete, the file has changed */
+			if(size == PAGE_SIZE) {
+				mapDemandLoaded(vm,addr,frame);
+				vm->reg->setPageFlags(page,vm->reg->getPageFlags(page) | PF_CACHED);
+				return 0;
+			}
+			PageCache::release(frame);
+		}
+	}
 
-	/* calculate the number of bytes to load and zero */
-	size_t loadCount = 0, zeroCount;
+	/* pages that are backed by the file are loaded together with the following ones */
 	if(addr - vm->virt() < vm->reg->getLoadCount())
-		loadCount = MIN(PAGE_SIZE,vm->reg->getLoadCount() - (addr - vm->virt()));
-	zeroCount = MIN(PAGE_SIZE,vm->reg->getByteCount() - (addr - vm->virt())) - loadCount;
-
-	/* load from file */
-	if(loadCount)
-		res = loadFromFile(vm,addr,loadCount);
-	else
-		res = 0;
-
-	/* zero the rest, if necessary */
-	if(res == 0 && zeroCount) {
-		/* do the memclear before the mapping to ensure that it's ready when the first CPU sees it */
-		frameno_t frame = loadCount ? Proc::getCurPageDir()->getFrameNo(addr)
-									: Thread::getRunning()->getFrame();
+		return loadFromFile(vm,addr,faultAround(vm,addr));
+
+	/* the others are just cleared. prefer a frame that the idle-threads have cleared already.
+	 * otherwise, do the memclear before the mapping to ensure that it's ready when the first CPU
+	 * sees it */
+	frameno_t reserved = Thread::getRunning()->getFrame();
+	frameno_t frame = PhysMem::getZeroed(reserved);
+	if(frame == reserved) {
+		size_t zeroCount = MIN(PAGE_SIZE,vm->reg->getByteCount() - (addr - vm->virt()));
 		uintptr_t frameAddr = PageDir::getAccess(frame);
-		memclear((void*)(frameAddr + loadCount),zeroCount);
+		memclear((void*)frameAddr,zeroCount);
 		PageDir::removeAccess(frame);
-		/* if the pages weren't present so far, map them into every process that has this region */
-		if(!loadCount) {
-			uint mapFlags = PG_PRESENT;
-			if(vm->reg->getFlags() & RF_WRITABLE)
-				mapFlags |= PG_WRITABLE;
-			/* this doesn't seem to make a lot of sense but is necessary for initloader */
-			if(vm->reg->getFlags() & RF_EXECUTABLE)
-				mapFlags |= PG_EXECUTABLE;
-			for(auto mp = vm->reg->vmbegin(); mp != vm->reg->vmend(); ++mp) {
-				/* the region may be mapped to a different virtual address */
-				PageTables::RangeAllocator alloc(frame);
-				VMRegion *mpreg = (*mp)->regtree.getByReg(vm->reg);
-				/* can't fail */
-				sassert((*mp)->getPageDir()->map(mpreg->virt() + (addr - vm->virt()),1,alloc,mapFlags) == 0);
-				if(vm->reg->getFlags() & RF_SHAREABLE)
-					(*mp)->addShared(1);
-				else
-					(*mp)->addOwn(1);
-			}
-		}
 	}
-	return res;
+	mapDemandLoaded(vm,addr,frame);
+	return 0;
+}
+
+size_t VirtMem::faultAround(VMRegion *vm,uintptr_t addr) {
+	size_t page = (addr - vm->virt()) / PAGE_SIZE;
+	size_t window = vm->reg->getFaultWindow(page);
+
+	/* take the following pages as well, as long as they are still to be loaded from file */
+	size_t loadPages = BYTES_2_PAGES(vm->reg->getLoadCount());
+	size_t count = 1;
+	while(count < window && page + count < loadPages &&
+			vm->reg->getPageFlags(page + count) == PF_DEMANDLOAD)
+		count++;
+
+	/* we need a frame for each of them. but the additional pages are not worth swapping */
+	Thread *t = Thread::getRunning();
+	size_t frames = t->getReservedFrmCnt();
+	if(frames < count)
+		frames += t->tryReserveFrames(count - frames);
+	return MAX(1,MIN(count,frames));
 }
 
-int VirtMem::loadFromFile(VMRegion *vm,uintptr_t addr,size_t loadCount) {
-	uint mapFlags;
-	frameno_t frame;
+int VirtMem::loadFromFile(VMRegion *vm,uintptr_t addr,size_t pages) {
 	void *tempBuf;
+	ulong gen;
 	/* note that we currently ignore that the file might have changed in the meantime */
 	ssize_t err;
-	off_t pos = vm->reg->getOffset() + (addr - vm->virt());
+	size_t offset = addr - vm->virt();
+	size_t loadCount = MIN(pages * PAGE_SIZE,vm->reg->getLoadCount() - offset);
+	off_t pos = vm->reg->getOffset() + offset;
 	if((err = vm->reg->getFile()->seek(proc->getPid(),pos,SEEK_SET)) < 0)
 		goto error;
 
 	/* first read into a temp-buffer because we can't mark the page as present until
 	 * its read from disk. and we can't use a temporary mapping when switching
 	 * threads. */
-	tempBuf = Cache::alloc(PAGE_SIZE);
+	tempBuf = Cache::alloc(pages * PAGE_SIZE);
 	if(tempBuf == NULL) {
 		err = -ENOMEM;
 		goto error;
 	}
+	/* if the file changes while we read it, the content must not end up in the page cache */
+	gen = PageCache::getGeneration(FileId(vm->reg->getFile()->getDev(),
+		vm->reg->getFile()->getNodeNo()));
 	err = vm->reg->getFile()->read(proc->getPid(),tempBuf,loadCount);
 	if(err != (ssize_t)loadCount) {
 		if(err >= 0)
@@ -1287,31 +1430,44 @@ int VirtMem::loadFromFile(VMRegion *vm,uintptr_t addr,size_t loadCount) {
 		goto errorFree;
 	}
 
-	/* copy into frame */
-	frame = PageDir::demandLoad(tempBuf,loadCount,vm->reg->getFlags());
+	for(size_t i = 0; i < pages; ++i) {
+		size_t poff = offset + i * PAGE_SIZE;
+		size_t count = MIN(PAGE_SIZE,loadCount - i * PAGE_SIZE);
 
-	/* free resources not needed anymore */
-	Cache::free(tempBuf);
+		/* copy into frame and zero the rest, if necessary */
+		frameno_t frame = PageDir::demandLoad((char*)tempBuf + i * PAGE_SIZE,count,
+			vm->reg->getFlags());
+		size_t zeroCount = MIN(PAGE_SIZE,vm->reg->getByteCount() - poff) - count;
+		if(zeroCount) {
+			uintptr_t frameAddr = PageDir::getAccess(frame);
+			memclear((void*)(frameAddr + count),zeroCount);
+			PageDir::removeAccess(frame);
+		}
 
-	/* map into all pagedirs */
-	{
-		mapFlags = PG_PRESENT;
-		if(vm->reg->getFlags() & RF_WRITABLE)
-			mapFlags |= PG_WRITABLE;
-		if(vm->reg->getFlags() & RF_EXECUTABLE)
-			mapFlags |= PG_EXECUTABLE;
-		for(auto mp = vm->reg->vmbegin(); mp != vm->reg->vmend(); ++mp) {
-			PageTables::RangeAllocator alloc(frame);
-			/* the region may be mapped to a different virtual address */
-			VMRegion *mpreg = (*mp)->regtree.getByReg(vm->reg);
-			/* can't fail */
-			sassert((*mp)->getPageDir()->map(mpreg->virt() + (addr - vm->virt()),1,alloc,mapFlags) == 0);
-			if(vm->reg->getFlags() & RF_SHAREABLE)
-				(*mp)->addShared(1);
-			else
-				(*mp)->addOwn(1);
+		/* put it into the page cache, if possible, so that others can use it as well */
+		ulong pflags = 0;
+		if(isCacheable(vm->reg,poff / PAGE_SIZE)) {
+			OpenFile *file = vm->reg->getFile();
+			frameno_t cached = PageCache::insert(FileId(file->getDev(),file->getNodeNo()),
+				(vm->reg->getOffset() + poff) / PAGE_SIZE,frame,PAGE_SIZE,gen);
+			if(cached != PhysMem::INVALID_FRAME) {
+				if(cached != frame)
+					PhysMem::free(frame,PhysMem::USR);
+				frame = cached;
+				pflags = PF_CACHED;
+			}
 		}
+
+		mapDemandLoaded(vm,addr + i * PAGE_SIZE,frame);
+		/* the demandload-flag of the page that caused the fault is removed by the caller */
+		if(i == 0)
+			pflags |= PF_DEMANDLOAD;
+		vm->reg->setPageFlags(poff / PAGE_SIZE,pflags);
 	}
+	vm->reg->setFaultEnd(offset / PAGE_SIZE + pages);
+
+	/* free resources not needed anymore */
+	Cache::free(tempBuf);
 	return 0;
 
 errorFree:
@@ -1322,83 +1478,124 @@ error:
 	return err;
 }
 
-Region *VirtMem::getLRURegion() {
-	Region *lru = NULL;
-	uint64_t ts = (uint64_t)-1;
-	VMTree *tree = VMTree::reqTree();
-	for(; tree != NULL; tree = tree->getNext()) {
+void VirtMem::mapDemandLoaded(VMRegion *vm,uintptr_t addr,frameno_t frame) {
+	uint mapFlags = PG_PRESENT;
+	if(vm->reg->getFlags() & RF_WRITABLE)
+		mapFlags |= PG_WRITABLE;
+	/* this doesn't seem to make a lot of sense but is necessary for initloader */
+	if(vm->reg->getFlags() & RF_EXECUTABLE)
+		mapFlags |= PG_EXECUTABLE;
+
+	/* map it into every process that has this region */
+	for(VMRegion *mpreg = vm->reg->getVMRegs(); mpreg != NULL; mpreg = mpreg->regNext) {
+		/* the region may be mapped to a different virtual address */
+		VirtMem *mp = mpreg->getVM();
+		PageTables::RangeAllocator alloc(frame);
+		/* can't fail */
+		sassert(mp->getPageDir()->map(mpreg->virt() + (addr - vm->virt()),1,alloc,mapFlags) == 0);
+		if(vm->reg->getFlags() & RF_SHAREABLE)
+			mp->addShared(1);
+		else
+			mp->addOwn(1);
+	}
+}
+
+Region *VirtMem::getSwapPages(size_t *pages,size_t max,size_t *count) {
+	size_t index;
+	VMTree *first = VMTree::reqTree();
+	VMTree *start = VMTree::getClockHand(&index);
+	if(start == NULL) {
+		start = first;
+		index = 0;
+	}
+
+	/* walk over all regions, starting at the clock hand. we might have to go around twice, because
+	 * the first round might only clear the accessed-bits */
+	size_t rounds = 0;
+	for(VMTree *tree = start; tree != NULL && rounds < 2; ) {
 		/* same as below; we have to try to acquire the mutex, otherwise we risk a deadlock */
 		if(tree->getVM()->tryAquire()) {
-			for(auto vm = tree->cbegin(); vm != tree->cend(); ++vm) {
-				size_t count = 0;
-				if(vm->reg->getTimestamp() >= ts)
+			size_t i = 0;
+			for(auto vm = tree->begin(); vm != tree->end(); ++vm, ++i) {
+				if(i < index)
 					continue;
 
 				/* we can't block here because otherwise we risk a deadlock. suppose that fs has to
-				 * swap out to get more memory. if we want to demand-load something before this operation
-				 * is finished and lock the region for that, the swapper will find this region at this
-				 * place locked. so we have to skip it in this case to be able to continue. */
+				 * swap out to get more memory. if we want to demand-load something before this
+				 * operation is finished and lock the region for that, the swapper will find this
+				 * region at this place locked. so we have to skip it in this case to be able to
+				 * continue. */
 				if(vm->reg->tryAquire()) {
 					/* skip locked regions */
 					if(~vm->reg->getFlags() & RF_LOCKED) {
-						size_t pages = BYTES_2_PAGES(vm->reg->getByteCount());
-						for(size_t j = 0; j < pages; j++) {
-							if(!(vm->reg->getPageFlags(j) & (PF_SWAPPED | PF_COPYONWRITE | PF_DEMANDLOAD))) {
-								count++;
-								break;
-							}
+						*count = getSwapPagesOf(vm->reg,pages,max);
+						if(*count > 0) {
+							VMTree::setClockHand(tree,i + 1);
+							tree->getVM()->release();
+							VMTree::relTree();
+							return vm->reg;
 						}
 					}
-					if(count > 0) {
-						if(lru)
-							lru->release();
-						ts = vm->reg->getTimestamp();
-						lru = vm->reg;
-					}
-					else
-						vm->reg->release();
+					vm->reg->release();
 				}
 			}
 			tree->getVM()->release();
 		}
+
+		index = 0;
+		tree = tree->getNext() ? tree->getNext() : first;
+		if(tree == start)
+			rounds++;
 	}
 	VMTree::relTree();
-	return lru;
+	return NULL;
 }
 
-ssize_t VirtMem::getPgIdxForSwap(const Region *reg) {
-	size_t pages = BYTES_2_PAGES(reg->getByteCount());
+size_t VirtMem::getSwapPagesOf(Region *reg,size_t *pages,size_t max) {
+	size_t total = BYTES_2_PAGES(reg->getByteCount());
+	size_t hand = reg->getClockHand();
+	if(hand >= total)
+		hand = 0;
+
+	/* give pages that have been accessed since the last visit of the hand a second chance */
 	size_t count = 0;
-	for(size_t i = 0; i < pages; i++) {
-		if(!(reg->getPageFlags(i) & (PF_SWAPPED | PF_COPYONWRITE | PF_DEMANDLOAD)))
-			count++;
-	}
-	if(count > 0) {
-		size_t index = Util::rand() % count;
-		for(size_t i = 0; i < pages; i++) {
-			if(!(reg->getPageFlags(i) & (PF_SWAPPED | PF_COPYONWRITE | PF_DEMANDLOAD))) {
-				if(index-- == 0)
-					return i;
-			}
-		}
+	for(size_t i = 0; i < total && count < max; ++i) {
+		size_t index = hand;
+		hand = (hand + 1) % total;
+		if(reg->getPageFlags(index) & (PF_SWAPPED | PF_COPYONWRITE | PF_DEMANDLOAD))
+			continue;
+		if(!clearAccessed(reg,index))
+			pages[count++] = index;
+	}
+	reg->setClockHand(hand);
+	return count;
+}
+
+bool VirtMem::clearAccessed(Region *reg,size_t index) {
+	bool accessed = false;
+	for(VMRegion *mpreg = reg->getVMRegs(); mpreg != NULL; mpreg = mpreg->regNext) {
+		/* the region may be mapped to a different virtual address */
+		VirtMem *mp = mpreg->getVM();
+		if(mp->getPageDir()->clearAccessed(mpreg->virt() + index * PAGE_SIZE))
+			accessed = true;
 	}
-	return -1;
+	return accessed;
 }
 
 void VirtMem::setSwappedOut(Region *reg,size_t index) {
 	uintptr_t offset = index * PAGE_SIZE;
 	PageTables::NoAllocator alloc;
 	reg->setPageFlags(index,reg->getPageFlags(index) | PF_SWAPPED);
-	for(auto mp = reg->vmbegin(); mp != reg->vmend(); ++mp) {
+	for(VMRegion *mpreg = reg->getVMRegs(); mpreg != NULL; mpreg = mpreg->regNext) {
 		/* the region may be mapped to a different virtual address */
-		VMRegion *mpreg = (*mp)->regtree.getByReg(reg);
+		VirtMem *mp = mpreg->getVM();
 		/* can't fail */
-		sassert((*mp)->getPageDir()->map(mpreg->virt() + offset,1,alloc,0) == 0);
+		sassert(mp->getPageDir()->map(mpreg->virt() + offset,1,alloc,0) == 0);
 		if(reg->getFlags() & RF_SHAREABLE)
-			(*mp)->addShared(-1);
+			mp->addShared(-1);
 		else
-			(*mp)->addOwn(-1);
-		(*mp)->addSwap(1);
+			mp->addOwn(-1);
+		mp->addSwap(1);
 	}
 }
 
@@ -1411,20 +1608,46 @@ void VirtMem::setSwappedIn(Region *reg,size_t index,frameno_t frameNo) {
 		flags |= PG_EXECUTABLE;
 	reg->setPageFlags(index,reg->getPageFlags(index) & ~PF_SWAPPED);
 	reg->setSwapBlock(index,0);
-	for(auto mp = reg->vmbegin(); mp != reg->vmend(); ++mp) {
+	for(VMRegion *mpreg = reg->getVMRegs(); mpreg != NULL; mpreg = mpreg->regNext) {
+		/* the region may be mapped to a different virtual address */
+		VirtMem *mp = mpreg->getVM();
 		PageTables::RangeAllocator alloc(frameNo);
+		/* can't fail */
+		sassert(mp->getPageDir()->map(mpreg->virt() + offset,1,alloc,flags) == 0);
+		if(reg->getFlags() & RF_SHAREABLE)
+			mp->addShared(1);
+		else
+			mp->addOwn(1);
+		mp->addSwap(-1);
+	}
+}
+
+void VirtMem::setDropped(Region *reg,size_t index) {
+	uintptr_t offset = index * PAGE_SIZE;
+	PageTables::NoAllocator alloc;
+	reg->setPageFlags(index,PF_DEMANDLOAD);
+	for(VMRegion *mpreg = reg->getVMRegs(); mpreg != NULL; mpreg = mpreg->regNext) {
 		/* the region may be mapped to a different virtual address */
-		VMRegion *mpreg = (*mp)->regtree.getByReg(reg);
+		VirtMem *mp = mpreg->getVM();
 		/* can't fail */
-		sassert((*mp)->getPageDir()->map(mpreg->virt() + offset,1,alloc,flags) == 0);
+		sassert(mp->getPageDir()->map(mpreg->virt() + offset,1,alloc,0) == 0);
 		if(reg->getFlags() & RF_SHAREABLE)
-			(*mp)->addShared(1);
+			mp->addShared(-1);
 		else
-			(*mp)->addOwn(1);
-		(*mp)->addSwap(-1);
+			mp->addOwn(-1);
 	}
 }
 
+bool VirtMem::isCacheable(const Region *reg,size_t page) {
+	/* only complete pages of read-only file mappings, which are aligned to the page-size */
+	OpenFile *file = reg->getFile();
+	if(!file || (reg->getFlags() & (RF_WRITABLE | RF_NOFREE)) || (reg->getOffset() % PAGE_SIZE))
+		return false;
+	if((page + 1) * PAGE_SIZE > reg->getLoadCount())
+		return false;
+	return file->usePageCache();
+}
+
 uintptr_t VirtMem::findFreeStack(size_t byteCount,A_UNUSED ulong rflags) {
 	/* leave a gap between the stacks as a guard */
 	if(byteCount > (MAX_STACK_PAGES - 1) * PAGE_SIZE)
@@ -45,10 +45,21 @@ void VMFreeMap::clear() {
 	list = NULL;
 }
 
-uintptr_t VMFreeMap::allocate(size_t size) {
+uintptr_t VMFreeMap::allocate(size_t size,size_t align) {
 	Area *a;
 	/* TODO is that correct on archs with page-size != 0x1000? */
 	assert((size & 0xFFF) == 0);
+
+	/* take it from the first area that contains an aligned part of that size */
+	if(align > PAGE_SIZE) {
+		for(a = list; a != NULL; a = a->next) {
+			uintptr_t addr = ROUND_UP(a->addr,align);
+			if(addr >= a->addr && addr + size <= a->addr + a->size)
+				return allocateAt(addr,size) ? addr : 0;
+		}
+		return 0;
+	}
+
 	Area *p = NULL;
 	for(a = list; a != NULL; p = a, a = a->next) {
 		if(a->size >= size)
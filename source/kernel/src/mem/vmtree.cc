@@ -31,12 +31,15 @@
 /**
  * We use a treap (combination of binary tree and heap) to be able to find vm-regions by an address
  * very quickly. To be able to walk through all vm-regions quickly as well, we maintain a linked
- * list of this vm-regions as well.
+ * list of this vm-regions as well. Additionally, each region knows the vm-regions that map it,
+ * so that we can find the mappings of a shared region without searching all trees.
  */
 
 Mutex VMTree::regMutex;
 VMTree *VMTree::regList;
 VMTree *VMTree::regListEnd;
+VMTree *VMTree::clockTree;
+size_t VMTree::clockIndex;
 
 bool VMRegion::matches(uintptr_t k) {
     return k >= virt() && k < virt() + ROUND_PAGE_UP(reg->getByteCount());
@@ -62,6 +65,9 @@ void VMTree::remTree(VMTree *tree) {
 				regList = t->next;
 			if(t == regListEnd)
 				regListEnd = p;
+			/* let the clock hand continue with the next one */
+			if(t == clockTree)
+				setClockHand(t->next,0);
 			break;
 		}
 	}
@@ -77,9 +83,9 @@ bool VMTree::available(uintptr_t addr,size_t size) const {
 }
 
 VMRegion *VMTree::getByReg(Region *reg) const {
-	for(auto vm = regs.cbegin(); vm != regs.cend(); ++vm) {
-		if(vm->reg == reg)
-			return const_cast<VMRegion*>(&*vm);
+	for(VMRegion *vm = reg->getVMRegs(); vm != NULL; vm = vm->regNext) {
+		if(vm->tree == this)
+			return vm;
 	}
 	return NULL;
 }
@@ -92,6 +98,8 @@ VMRegion *VMTree::add(Region *reg,uintptr_t addr) {
 	if(reg->getFile())
 		reg->getFile()->incRefs();
 	regs.insert(vm);
+	vm->tree = this;
+	reg->addVMReg(vm);
 	return vm;
 }
 
@@ -99,6 +107,9 @@ void VMTree::remove(VMRegion *reg) {
 	/* close file */
 	if(reg->reg->getFile())
 		reg->reg->getFile()->close(virtmem->getProc()->getPid());
+	if(lastHit == reg)
+		lastHit = NULL;
+	reg->reg->remVMReg(reg);
 	regs.remove(reg);
 	delete reg;
 }
@@ -125,6 +125,7 @@ const Syscalls::handler_func Syscalls::syscalls[] = {
 	gettimeofday,
 	utime,
 	truncate,
+	getworkv,
 #if defined(__x86__)
 	reqports,
 	relports,
@@ -74,6 +74,80 @@ int Syscalls::createdev(Thread *t,IntrptStackFrame *stack) {
 	SYSC_RET1(stack,nfd);
 }
 
+int Syscalls::getworkv(Thread *t,IntrptStackFrame *stack) {
+	int fd = SYSC_ARG1(stack) >> 2;
+	tWorkSlot *slots = (tWorkSlot*)SYSC_ARG2(stack);
+	size_t count = SYSC_ARG3(stack);
+	uint flags = SYSC_ARG1(stack) & 0x3;
+	Proc *p = t->getProc();
+	OpenFile *file;
+	size_t i;
+
+	/* validate pointers */
+	if(EXPECT_FALSE(count == 0 || count > GW_MAX_SLOTS))
+		SYSC_ERROR(stack,-EINVAL);
+	if(EXPECT_FALSE(!PageDir::isInUserSpace((uintptr_t)slots,count * sizeof(tWorkSlot))))
+		SYSC_ERROR(stack,-EFAULT);
+
+	/* translate to files */
+	file = FileDesc::request(p,fd);
+	if(EXPECT_FALSE(file == NULL))
+		SYSC_ERROR(stack,-EBADF);
+
+	ssize_t res = 0;
+	for(i = 0; i < count; ++i) {
+		/* copy the slot to prevent that it's changed after the check */
+		void *data = slots[i].msg;
+		size_t size = slots[i].size;
+		if(EXPECT_FALSE(!PageDir::isInUserSpace((uintptr_t)data,size))) {
+			res = -EFAULT;
+			break;
+		}
+
+		/* only the first one may block */
+		int clifd;
+		res = OpenFile::getWork(file,&clifd,i == 0 ? flags : GW_NOBLOCK);
+		if(res < 0)
+			break;
+
+		/* the client might have sent multiple messages that belong together (e.g., write). thus,
+		 * we take at most one message per client and let the handler receive the rest */
+		bool dup = false;
+		for(size_t j = 0; j < i; ++j) {
+			if(slots[j].fd == clifd) {
+				dup = true;
+				break;
+			}
+		}
+		if(dup)
+			break;
+
+		OpenFile *client = FileDesc::request(p,clifd);
+		if(EXPECT_FALSE(!client)) {
+			res = -EBADF;
+			break;
+		}
+
+		/* receive a message */
+		msgid_t mid = 0;
+		res = client->receiveMsg(p->getPid(),&mid,data,size,VFS_SIGNALS);
+		FileDesc::release(client);
+		if(EXPECT_FALSE(res < 0))
+			break;
+
+		slots[i].fd = clifd;
+		slots[i].mid = mid;
+	}
+
+	/* release files */
+	FileDesc::release(file);
+
+	/* report errors only if we haven't got anything */
+	if(EXPECT_FALSE(i == 0))
+		SYSC_ERROR(stack,res);
+	SYSC_RET1(stack,i);
+}
+
 int Syscalls::bindto(Thread *t,IntrptStackFrame *stack) {
 	int fd = SYSC_ARG1(stack);
 	tid_t tid = SYSC_ARG2(stack);
@@ -41,56 +41,120 @@
  * the beginning and end. Therefore we can dequeue the first, prepend, append and remove a thread
  * in O(1). Additionally the number of threads is limited by the kernel-heap (i.e. we don't need
  * a static storage of nodes for the linked list; we use the threads itself)
+ *
+ * Every CPU has its own ready-queues with its own lock. A thread belongs to the CPU that executed
+ * it last (Thread::getCPU()), so that it stays on that CPU as long as possible. The state of a
+ * thread is protected by the lock of the queue it belongs to. If a CPU has nothing to do, it
+ * steals a ready thread from another CPU, which is the only way a thread moves to another CPU.
  */
 
+struct Sched::RunQueue {
+	SpinLock lock;
+	/* held while the CPU switches threads (see Thread::doSwitch) */
+	SpinLock switchLock;
+	ulong readyMask;
+	esc::DList<Thread> queues[MAX_PRIO + 1];
+	size_t count;
+	Thread *idle;
+};
+
 SpinLock Sched::lock;
-ulong Sched::readyMask = 0;
-esc::DList<Thread> Sched::rdyQueues[MAX_PRIO + 1];
+Sched::RunQueue *Sched::runQueues;
 esc::DList<Thread> Sched::evlists[EV_COUNT];
-size_t Sched::rdyCount;
-Thread **Sched::idleThreads;
 
 void Sched::init() {
-	idleThreads = (Thread**)Cache::calloc(SMP::getCPUCount(),sizeof(Thread*));
-	if(!idleThreads)
-		Util::panic("Unable to allocate idle-threads array");
-	rdyCount = 0;
+	/* all zero is a valid state for the queues */
+	runQueues = (RunQueue*)Cache::calloc(SMP::getCPUCount(),sizeof(RunQueue));
+	if(!runQueues)
+		Util::panic("Unable to allocate ready-queues");
 }
 
 void Sched::addIdleThread(Thread *t) {
 	LockGuard<SpinLock> g(&lock);
 	for(size_t i = 0; i < SMP::getCPUCount(); ++i) {
-		if(idleThreads[i] == NULL) {
-			idleThreads[i] = t;
+		if(runQueues[i].idle == NULL) {
+			runQueues[i].idle = t;
 			break;
 		}
 	}
 }
 
+ulong Sched::getReadyMask(cpuid_t cpu) {
+	return runQueues[cpu].readyMask;
+}
+
+SpinLock *Sched::getSwitchLock(cpuid_t cpu) {
+	return &runQueues[cpu].switchLock;
+}
+
+Sched::RunQueue *Sched::lockQueue(Thread *t) {
+	while(1) {
+		RunQueue *rq = runQueues + t->getCPU();
+		rq->lock.down();
+		/* the thread might have been stolen in the meantime */
+		if(EXPECT_TRUE(rq == runQueues + t->getCPU()))
+			return rq;
+		rq->lock.up();
+	}
+}
+
 void Sched::enqueue(Thread *t) {
+	RunQueue *rq = runQueues + t->getCPU();
 	uint8_t prio = t->getPriority();
-	rdyQueues[prio].append(t);
-	readyMask |= 1UL << prio;
-	rdyCount++;
+	rq->queues[prio].append(t);
+	rq->readyMask |= 1UL << prio;
+	rq->count++;
 }
 
 void Sched::enqueueQuick(Thread *t) {
+	RunQueue *rq = runQueues + t->getCPU();
 	uint8_t prio = t->getPriority();
-	rdyQueues[prio].prepend(t);
-	readyMask |= 1UL << prio;
-	rdyCount++;
+	rq->queues[prio].prepend(t);
+	rq->readyMask |= 1UL << prio;
+	rq->count++;
 }
 
 void Sched::dequeue(Thread *t) {
+	RunQueue *rq = runQueues + t->getCPU();
 	uint8_t prio = t->getPriority();
-	rdyQueues[prio].remove(t);
-	if(rdyQueues[prio].length() == 0)
-		readyMask &= ~(1UL << prio);
-	rdyCount--;
+	rq->queues[prio].remove(t);
+	if(rq->queues[prio].length() == 0)
+		rq->readyMask &= ~(1UL << prio);
+	rq->count--;
 }
 
-Thread *Sched::perform(Thread *old,cpuid_t cpu) {
+void Sched::block(Thread *t) {
+	assert(t != NULL);
+	RunQueue *rq = lockQueue(t);
+	setBlocked(t);
+	rq->lock.up();
+}
+
+void Sched::unblock(Thread *t) {
+	assert(t != NULL);
 	LockGuard<SpinLock> g(&lock);
+	RunQueue *rq = lockQueue(t);
+	setReady(t);
+	rq->lock.up();
+}
+
+void Sched::unblockQuick(Thread *t) {
+	assert(t != NULL);
+	LockGuard<SpinLock> g(&lock);
+	RunQueue *rq = lockQueue(t);
+	setReadyQuick(t);
+	rq->lock.up();
+}
+
+Thread *Sched::perform(Thread *old,cpuid_t cpu) {
+	RunQueue *rq = runQueues + cpu;
+	/* if the old thread has a signal, we need the lock for the event-lists as well (it has to be
+	 * acquired first). if the signal arrives later, it will make the thread ready again anyway */
+	bool signal = old && (~old->getFlags() & T_IDLE) && old->hasSignal();
+	if(EXPECT_FALSE(signal))
+		lock.down();
+	rq->lock.down();
+
 	/* give the old thread a new state */
 	if(old) {
 		if(old->getFlags() & T_IDLE)
@@ -100,11 +164,13 @@ Thread *Sched::perform(Thread *old,cpuid_t cpu) {
 
 			/* we have to check for a signal here, because otherwise we might miss it */
 			/* (scenario: cpu0 unblocks t1 for signal, cpu1 runs t1 and blocks itself) */
-			if(old->getNewState() != Thread::ZOMBIE && old->hasSignal()) {
+			if(EXPECT_FALSE(signal) && old->getNewState() != Thread::ZOMBIE) {
 				/* we have to reset the newstate in this case and remove us from event */
 				old->setNewState(Thread::READY);
 				old->waitstart = 0;
 				removeFromEventlist(old);
+				rq->lock.up();
+				lock.up();
 				return old;
 			}
 
@@ -115,28 +181,36 @@ Thread *Sched::perform(Thread *old,cpuid_t cpu) {
 			}
 		}
 	}
+	if(EXPECT_FALSE(signal))
+		lock.up();
 
 	/* get new thread */
-	Thread *t;
-	for(ssize_t i = MAX_PRIO; i >= 0; i--) {
-		t = rdyQueues[i].removeFirst();
+	Thread *t = NULL;
+	for(ssize_t i = MAX_PRIO; t == NULL && i >= 0; i--) {
+		esc::DList<Thread> *q = rq->queues + i;
+		t = q->removeFirst();
+		/* if its the old thread again and we have more ready threads, don't take this one again.
+		 * because we assume that Thread::switchAway() has been called for a reason. therefore, it
+		 * should be better to take a thread with a lower priority than taking the same again */
+		if(t && t == old && rq->count > 1) {
+			q->append(t);
+			t = q->length() > 1 ? q->removeFirst() : NULL;
+		}
 		if(t) {
-			/* if its the old thread again and we have more ready threads, don't take this one again.
-			 * because we assume that Thread::switchAway() has been called for a reason. therefore, it
-			 * should be better to take a thread with a lower priority than taking the same again */
-			if(rdyCount > 1 && t == old) {
-				rdyQueues[i].append(t);
-				continue;
-			}
-			if(rdyQueues[i].length() == 0)
-				readyMask &= ~(1UL << i);
-			rdyCount--;
-			break;
+			if(q->length() == 0)
+				rq->readyMask &= ~(1UL << i);
+			rq->count--;
 		}
 	}
+
+	/* if we have nothing to do, help the others */
+	if(t == NULL && SMP::getCPUCount() > 1)
+		t = steal(cpu);
+
 	if(t == NULL) {
 		/* choose an idle-thread */
-		t = idleThreads[cpu];
+		t = rq->idle;
+		t->setCPU(cpu);
 		t->setState(Thread::RUNNING);
 	}
 	else {
@@ -144,14 +218,53 @@ Thread *Sched::perform(Thread *old,cpuid_t cpu) {
 		t->setNewState(Thread::READY);
 	}
 
-	/* if there is another thread ready, check if we have another cpu that we can start for it */
-	if(rdyCount > 0)
+	/* if there is another thread ready, check if we have another cpu that can steal it */
+	if(rq->count > 0)
 		SMP::wakeupCPU();
+	rq->lock.up();
 	return t;
 }
 
+Thread *Sched::steal(cpuid_t cpu) {
+	size_t cpus = SMP::getCPUCount();
+	for(size_t j = 1; j < cpus; ++j) {
+		RunQueue *vq = runQueues + (cpu + j) % cpus;
+		if(vq->count == 0)
+			continue;
+
+		/* don't steal a thread from a CPU that is currently switching threads, because the thread
+		 * it just put into its queue might not have been saved yet. note that we have to use
+		 * tryDown for both locks, because we already hold our own ones. */
+		if(!vq->switchLock.tryDown())
+			continue;
+		if(!vq->lock.tryDown()) {
+			vq->switchLock.up();
+			continue;
+		}
+
+		Thread *t = NULL;
+		for(ssize_t i = MAX_PRIO; t == NULL && i >= 0; i--) {
+			t = vq->queues[i].removeFirst();
+			if(t) {
+				if(vq->queues[i].length() == 0)
+					vq->readyMask &= ~(1UL << i);
+				vq->count--;
+				/* from now on, it belongs to us */
+				t->setCPU(cpu);
+				t->getStats().migrations++;
+			}
+		}
+
+		vq->lock.up();
+		vq->switchLock.up();
+		if(t)
+			return t;
+	}
+	return NULL;
+}
+
 void Sched::adjustPrio(Thread *t,uint64_t total) {
-	LockGuard<SpinLock> g(&lock);
+	RunQueue *rq = lockQueue(t);
 	/* if it is still blocked, add the time to the blocked time */
 	if(t->waitstart > 0) {
 		uint64_t now = CPU::rdtsc();
@@ -206,10 +319,12 @@ void Sched::adjustPrio(Thread *t,uint64_t total) {
 
 	/* reset blocked time */
 	t->stats.blocked = 0;
+	rq->lock.up();
 }
 
 void Sched::wait(Thread *t,uint event,evobj_t object) {
 	LockGuard<SpinLock> g(&lock);
+	RunQueue *rq = lockQueue(t);
 	assert(t->event == 0);
 	assert(Thread::getRunning() == t);
 	t->event = event;
@@ -217,6 +332,7 @@ void Sched::wait(Thread *t,uint event,evobj_t object) {
 	setBlocked(t);
 	if(event)
 		evlists[event - 1].append(t);
+	rq->lock.up();
 }
 
 void Sched::wakeup(uint event,evobj_t object,bool all) {
@@ -227,8 +343,10 @@ void Sched::wakeup(uint event,evobj_t object,bool all) {
 		auto old = it++;
 		assert(old->event == event);
 		if(old->evobject == 0 || old->evobject == object) {
+			RunQueue *rq = lockQueue(&*old);
 			removeFromEventlist(&*old);
 			setReady(&*old);
+			rq->lock.up();
 			if(!all)
 				break;
 		}
@@ -259,6 +377,9 @@ void Sched::setReady(Thread *t) {
 	else if(setReadyState(t)) {
 		assert(t->event == 0);
 		enqueue(t);
+		/* if it belongs to another CPU, make sure that somebody runs it */
+		if(t->getCPU() != SMP::getCurId())
+			SMP::wakeupCPU();
 	}
 }
 
@@ -283,6 +404,8 @@ void Sched::setReadyQuick(Thread *t) {
 	else if(setReadyState(t)) {
 		assert(t->event == 0);
 		enqueueQuick(t);
+		if(t->getCPU() != SMP::getCurId())
+			SMP::wakeupCPU();
 	}
 }
 
@@ -307,6 +430,7 @@ void Sched::setBlocked(Thread *t) {
 
 void Sched::removeThread(Thread *t) {
 	LockGuard<SpinLock> g(&lock);
+	RunQueue *rq = lockQueue(t);
 	switch(t->getState()) {
 		case Thread::RUNNING:
 			break;
@@ -322,6 +446,7 @@ void Sched::removeThread(Thread *t) {
 			break;
 	}
 	t->setNewState(Thread::ZOMBIE);
+	rq->lock.up();
 }
 
 bool Sched::setReadyState(Thread *t) {
@@ -341,11 +466,14 @@ bool Sched::setReadyState(Thread *t) {
 }
 
 void Sched::print(OStream &os) {
-	os.writef("Ready queues:\n");
-	for(size_t i = 0; i < ARRAY_SIZE(rdyQueues); i++) {
-		os.writef("\t[%d]:\n",i);
-		print(os,rdyQueues + i);
-		os.writef("\n");
+	for(size_t c = 0; c < SMP::getCPUCount(); c++) {
+		RunQueue *rq = runQueues + c;
+		os.writef("CPU %zu ready queues (%zu threads):\n",c,rq->count);
+		for(size_t i = 0; i < ARRAY_SIZE(rq->queues); i++) {
+			os.writef("\t[%d]:\n",i);
+			print(os,rq->queues + i);
+			os.writef("\n");
+		}
 	}
 }
 
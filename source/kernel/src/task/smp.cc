@@ -105,20 +105,6 @@ void SMPBase::wakeupCPU() {
 	}
 }
 
-void SMPBase::flushTLB(PageDir *pdir) {
-	if(!cpus || cpuCount == 1)
-		return;
-
-	cpuid_t cur = getCurId();
-	for(auto cpu = cpuList.cbegin(); cpu != cpuList.cend(); ++cpu) {
-		if(cpu->ready && cpu->id != cur) {
-			Thread *t = cpu->thread;
-			if(t && t->getProc()->getPageDir() == pdir)
-				sendIPI(cpu->id,IPI_FLUSH_TLB);
-		}
-	}
-}
-
 void SMPBase::callback(cpuid_t id) {
 	CPU *c = cpus[id];
 	assert(c->callback);
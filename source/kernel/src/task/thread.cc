@@ -182,6 +182,20 @@ bool ThreadBase::reserveFrames(size_t count,bool swap) {
 	return true;
 }
 
+size_t ThreadBase::tryReserveFrames(size_t count) {
+	if(!PhysMem::reserve(count,false))
+		return 0;
+
+	size_t i;
+	for(i = 0; i < count; i++) {
+		frameno_t frm = PhysMem::allocate(PhysMem::USR);
+		if(frm == PhysMem::INVALID_FRAME)
+			break;
+		reqFrames.append(frm);
+	}
+	return i;
+}
+
 int ThreadBase::create(Thread *src,Thread **dst,Proc *p,uint8_t tflags,bool cloneProc) {
 	int err = -ENOMEM;
 	Thread *t = new Thread(p,tflags);
@@ -200,6 +214,8 @@ int ThreadBase::create(Thread *src,Thread **dst,Proc *p,uint8_t tflags,bool clon
 		/* do that here to prevent that one see's a temporary priority, i.e. during the update-phase */
 		t->priority = p->getPriority();
 	}
+	/* start on the CPU of the creator; other CPUs will steal it if they have nothing to do */
+	t->cpu = src->cpu;
 
 	/* we don't want to destroy the process first because we have a pointer to it */
 	Proc::getRef(p->getPid());
@@ -377,3 +393,7 @@ void ThreadBase::remove() {
 	threads.remove(&threadListItem);
 	tidToThread[tid] = NULL;
 }
+
+bool thread_idleWork() {
+	return PhysMem::fillZeroPool();
+}
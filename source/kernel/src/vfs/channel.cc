@@ -21,6 +21,10 @@
 #include <esc/proto/file.h>
 #include <esc/proto/device.h>
 #include <mem/cache.h>
+#include <mem/copyonwrite.h>
+#include <mem/pagecache.h>
+#include <mem/pagedir.h>
+#include <mem/physmem.h>
 #include <mem/useraccess.h>
 #include <mem/virtmem.h>
 #include <sys/messages.h>
@@ -29,6 +33,7 @@
 #include <task/thread.h>
 #include <vfs/channel.h>
 #include <vfs/device.h>
+#include <vfs/fs.h>
 #include <vfs/node.h>
 #include <vfs/openfile.h>
 #include <vfs/vfs.h>
@@ -52,7 +57,7 @@ VFSChannel::VFSChannel(pid_t pid,VFSNode *p,bool &success)
 		/* otherwise, if root uses that device, the driver is unable to open this channel. */
 		: VFSNode(pid,generateId(pid),MODE_TYPE_CHANNEL | 0777,success), fd(-1),
 		  handler(static_cast<VFSDevice*>(p)->getCreator()), closed(false),
-		  shmem(NULL), shmemSize(0), sendList(), recvList() {
+		  shmem(NULL), shmemSize(0), cacheable(-1), sendList(), recvList(), readyItem(this) {
 	if(!success)
 		return;
 
@@ -88,10 +93,25 @@ int VFSChannel::isSupported(int op) const {
 	return 0;
 }
 
+bool VFSChannel::usePageCache() const {
+	return isSupported(DEV_PAGECACHE) == 0;
+}
+
+bool VFSChannel::isCacheable(pid_t pid) {
+	/* only regular files; directories change with every namespace operation, which doesn't
+	 * invalidate them. if we can't find out, don't risk serving outdated content */
+	if(cacheable == -1) {
+		struct stat info;
+		cacheable = VFSFS::fstat(pid,this,&info) == 0 && S_ISREG(info.st_mode);
+	}
+	return cacheable;
+}
+
 void VFSChannel::discardMsgs() {
 	LockGuard<SpinLock> g(&waitLock);
 	// remove from parent
 	static_cast<VFSDevice*>(getParent())->remMsgs(sendList.length());
+	static_cast<VFSDevice*>(getParent())->removeReady(this);
 
 	// now clear lists
 	sendList.deleteAll();
@@ -256,13 +276,77 @@ uint VFSChannel::getReceiveFlags() const {
 }
 
 ssize_t VFSChannel::read(pid_t pid,OpenFile *file,USER void *buffer,off_t offset,size_t count) {
-	ulong ibuffer[IPC_DEF_SIZE / sizeof(ulong)];
-	esc::IPCBuf ib(ibuffer,sizeof(ibuffer));
 	ssize_t res;
-
 	if((res = isSupported(DEV_READ)) < 0)
 		return res;
 
+	/* files of filesystems that allow it are read via the page cache */
+	if(file->getDev() != VFS_DEV_NO && usePageCache() && isCacheable(pid))
+		return readCached(pid,file,buffer,offset,count);
+	return readMsg(pid,file,buffer,offset,count);
+}
+
+ssize_t VFSChannel::readCached(pid_t pid,OpenFile *file,USER void *buffer,off_t offset,
+		size_t count) {
+	FileId id(file->getDev(),file->getNodeNo());
+	/* we can't access the frames directly, because copying to <buffer> might cause a thread
+	 * switch. thus, go through a temporary buffer */
+	uint8_t *tmp = (uint8_t*)Cache::alloc(MAX_READ_PAGES * PAGE_SIZE);
+	if(tmp == NULL)
+		return readMsg(pid,file,buffer,offset,count);
+
+	ssize_t res = 0;
+	size_t total = 0;
+	while(total < count) {
+		size_t pageNo = (offset + total) / PAGE_SIZE;
+		size_t pageOff = (offset + total) % PAGE_SIZE;
+		size_t avail,pages = 1;
+
+		frameno_t frame = PageCache::get(id,pageNo,&avail);
+		if(frame != PhysMem::INVALID_FRAME) {
+			PageDir::copyFromFrame(frame,tmp);
+			PageCache::release(frame);
+		}
+		else {
+			/* read all missing pages up to the end of the request at once */
+			pages = MIN(MAX_READ_PAGES,BYTES_2_PAGES(pageOff + count - total));
+			ulong gen = PageCache::getGeneration(id);
+			res = readMsg(pid,file,tmp,pageNo * PAGE_SIZE,pages * PAGE_SIZE);
+			if(res < 0)
+				break;
+			avail = res;
+
+			/* put them into the cache; the last one may be incomplete (end of file) */
+			for(size_t i = 0; i < pages && i * PAGE_SIZE < avail; ++i) {
+				size_t pageSize = MIN(PAGE_SIZE,avail - i * PAGE_SIZE);
+				memclear(tmp + i * PAGE_SIZE + pageSize,PAGE_SIZE - pageSize);
+				PageCache::add(id,pageNo + i,tmp + i * PAGE_SIZE,pageSize,gen);
+			}
+		}
+
+		/* end of file? */
+		if(avail <= pageOff) {
+			res = 0;
+			break;
+		}
+
+		size_t amount = MIN(avail - pageOff,count - total);
+		if((res = UserAccess::write((uint8_t*)buffer + total,tmp + pageOff,amount)) < 0)
+			break;
+		total += amount;
+		if(avail < pages * PAGE_SIZE)
+			break;
+	}
+
+	Cache::free(tmp);
+	return total > 0 ? (ssize_t)total : res;
+}
+
+ssize_t VFSChannel::readMsg(pid_t pid,OpenFile *file,USER void *buffer,off_t offset,size_t count) {
+	ulong ibuffer[IPC_DEF_SIZE / sizeof(ulong)];
+	esc::IPCBuf ib(ibuffer,sizeof(ibuffer));
+	ssize_t res;
+
 	/* send msg to driver */
 	bool useshm = useSharedMem(shmem,shmemSize,buffer,count);
 	ib << esc::FileRead::Request(offset,count,useshm ? ((uintptr_t)buffer - (uintptr_t)shmem) : -1);
@@ -488,24 +572,14 @@ ssize_t VFSChannel::send(A_UNUSED pid_t pid,ushort flags,msgid_t id,USER const v
 		list = &sendList;
 
 	/* create message and copy data to it */
-	msg1 = new (size1) Message(size1);
+	msg1 = createMsg(data1,size1,&res);
 	if(EXPECT_FALSE(msg1 == NULL))
-		return -ENOMEM;
-
-	if(EXPECT_TRUE(data1)) {
-		if(EXPECT_FALSE((res = UserAccess::read(msg1 + 1,data1,size1)) < 0))
-			goto errorMsg1;
-	}
+		return res;
 
 	if(EXPECT_FALSE(data2)) {
-		msg2 = new (size2) Message(size2);
-		if(EXPECT_FALSE(msg2 == NULL)) {
-			res = -ENOMEM;
+		msg2 = createMsg(data2,size2,&res);
+		if(EXPECT_FALSE(msg2 == NULL))
 			goto errorMsg1;
-		}
-
-		if(EXPECT_FALSE((res = UserAccess::read(msg2 + 1,data2,size2)) < 0))
-			goto errorMsg2;
 	}
 
 	{
@@ -526,6 +600,7 @@ ssize_t VFSChannel::send(A_UNUSED pid_t pid,ushort flags,msgid_t id,USER const v
 			static_cast<VFSDevice*>(parent)->addMsgs(1);
 			if(EXPECT_FALSE(msg2))
 				static_cast<VFSDevice*>(parent)->addMsgs(1);
+			static_cast<VFSDevice*>(parent)->addReady(this);
 			Sched::wakeup(EV_CLIENT,(evobj_t)parent,true);
 		}
 		else {
@@ -558,8 +633,6 @@ ssize_t VFSChannel::send(A_UNUSED pid_t pid,ushort flags,msgid_t id,USER const v
 #endif
 	return id;
 
-errorMsg2:
-	delete msg2;
 errorMsg1:
 	delete msg1;
 	return res;
@@ -614,8 +687,11 @@ ssize_t VFSChannel::receive(A_UNUSED pid_t pid,ushort flags,msgid_t *id,USER voi
 		waitLock.down();
 	}
 
-	if(event == EV_CLIENT)
+	if(event == EV_CLIENT) {
 		static_cast<VFSDevice*>(parent)->remMsgs(1);
+		if(sendList.length() == 0)
+			static_cast<VFSDevice*>(parent)->removeReady(this);
+	}
 	waitLock.up();
 
 #if PRINT_MSGS
@@ -633,8 +709,10 @@ ssize_t VFSChannel::receive(A_UNUSED pid_t pid,ushort flags,msgid_t *id,USER voi
 
 	/* copy data and id */
 	if(EXPECT_TRUE(data)) {
-		if(EXPECT_FALSE((res = UserAccess::write(data,msg + 1,msg->length)) < 0))
+		if(EXPECT_FALSE((res = copyMsg(data,msg)) < 0)) {
+			delete msg;
 			return res;
+		}
 	}
 	if(EXPECT_TRUE(id))
 		*id = msg->id;
@@ -644,6 +722,115 @@ ssize_t VFSChannel::receive(A_UNUSED pid_t pid,ushort flags,msgid_t *id,USER voi
 	return res;
 }
 
+VFSChannel::Message::~Message() {
+	/* drop the references to the frames that have not been taken over */
+	frameno_t *frms = frames();
+	for(size_t i = 0; i < pages; ++i) {
+		if(frms[i] != PhysMem::INVALID_FRAME) {
+			bool foundOther;
+			CopyOnWrite::remove(frms[i],&foundOther);
+			if(!foundOther)
+				PhysMem::free(frms[i],PhysMem::USR);
+		}
+	}
+}
+
+VFSChannel::Message *VFSChannel::createMsg(USER const void *data,size_t size,int *res) {
+	/* large messages are transferred page by page, if the sender allows us to lend its pages */
+	if(data && size >= MIN_LEND_PAGES * PAGE_SIZE && ((uintptr_t)data & (PAGE_SIZE - 1)) == 0 &&
+			PageDir::isInUserSpace((uintptr_t)data,size)) {
+		Message *msg = lendMsg(data,size,res);
+		if(msg || *res < 0)
+			return msg;
+	}
+
+	Message *msg = new (size) Message(size);
+	if(EXPECT_FALSE(msg == NULL)) {
+		*res = -ENOMEM;
+		return NULL;
+	}
+
+	if(EXPECT_TRUE(data)) {
+		if(EXPECT_FALSE((*res = UserAccess::read(msg + 1,data,size)) < 0)) {
+			delete msg;
+			return NULL;
+		}
+	}
+	return msg;
+}
+
+VFSChannel::Message *VFSChannel::lendMsg(USER const void *data,size_t size,int *res) {
+	size_t pages = size / PAGE_SIZE;
+	size_t rem = size % PAGE_SIZE;
+	Message *msg = new (pages * sizeof(frameno_t) + rem) Message(size);
+	if(EXPECT_FALSE(msg == NULL)) {
+		*res = -ENOMEM;
+		return NULL;
+	}
+
+	*res = 0;
+	VirtMem *vm = Thread::getRunning()->getProc()->getVM();
+	if(!vm->lendPages((uintptr_t)data,pages,msg->frames())) {
+		delete msg;
+		return NULL;
+	}
+	msg->pages = pages;
+
+	/* the last incomplete page is copied */
+	if(rem > 0) {
+		const uint8_t *src = (const uint8_t*)data + pages * PAGE_SIZE;
+		if(EXPECT_FALSE((*res = UserAccess::read(msg->frames() + pages,src,rem)) < 0)) {
+			delete msg;
+			return NULL;
+		}
+	}
+	return msg;
+}
+
+int VFSChannel::copyMsg(USER void *data,Message *msg) {
+	if(EXPECT_TRUE(msg->pages == 0))
+		return UserAccess::write(data,msg + 1,msg->length);
+
+	/* if the receiver's buffer is page-aligned, take over the lent frames */
+	frameno_t *frames = msg->frames();
+	uintptr_t addr = (uintptr_t)data;
+	if((addr & (PAGE_SIZE - 1)) == 0 && PageDir::isInUserSpace(addr,msg->length)) {
+		VirtMem *vm = Thread::getRunning()->getProc()->getVM();
+		vm->borrowPages(addr,msg->pages,frames);
+	}
+
+	/* copy the remaining ones. like in readCached, we can't access the frames directly while
+	 * copying to userspace, because that might cause a thread switch */
+	int res = 0;
+	uint8_t *tmp = NULL;
+	for(size_t i = 0; i < msg->pages; ++i) {
+		if(frames[i] == PhysMem::INVALID_FRAME)
+			continue;
+
+		void *dst = (uint8_t*)data + i * PAGE_SIZE;
+		if(!PageDir::isInUserSpace((uintptr_t)dst,PAGE_SIZE)) {
+			PageDir::copyFromFrame(frames[i],dst);
+			continue;
+		}
+
+		if(tmp == NULL && (tmp = (uint8_t*)Cache::alloc(PAGE_SIZE)) == NULL) {
+			res = -ENOMEM;
+			break;
+		}
+		PageDir::copyFromFrame(frames[i],tmp);
+		if((res = UserAccess::write(dst,tmp,PAGE_SIZE)) < 0)
+			break;
+	}
+	Cache::free(tmp);
+	if(res < 0)
+		return res;
+
+	size_t rem = msg->length - msg->pages * PAGE_SIZE;
+	if(rem > 0)
+		return UserAccess::write((uint8_t*)data + msg->pages * PAGE_SIZE,frames + msg->pages,rem);
+	return 0;
+}
+
 VFSChannel::Message *VFSChannel::getMsg(esc::SList<Message> *list,msgid_t mid,ushort flags) {
 	/* drivers get always the first message */
 	if(flags & VFS_DEVICE)
@@ -667,8 +854,8 @@ void VFSChannel::print(OStream &os) const {
 		name,sendList.length(),recvList.length(),closed,handler,fd,shmem ? shmemSize / 1024 : 0);
 	for(size_t i = 0; i < ARRAY_SIZE(lists); i++) {
 		for(auto it = lists[i]->cbegin(); it != lists[i]->cend(); ++it) {
-			os.writef("\t%s id=%u:%u len=%zu\n",i == 0 ? "->" : "<-",
-				it->id >> 16,it->id & 0xFFFF,it->length);
+			os.writef("\t%s id=%u:%u len=%zu lent=%zu\n",i == 0 ? "->" : "<-",
+				it->id >> 16,it->id & 0xFFFF,it->length,it->pages);
 		}
 	}
 }
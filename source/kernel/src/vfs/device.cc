@@ -33,7 +33,7 @@
 /* block- and file-devices are none-empty by default, because their data is always available */
 VFSDevice::VFSDevice(pid_t pid,VFSNode *p,char *n,mode_t m,uint type,uint ops,bool &success)
 		: VFSNode(pid,n,buildMode(type) | (m & MODE_PERM),success), creator(Thread::getRunning()->getTid()),
-		  funcs(ops), msgCount(0), lastClient() {
+		  funcs(ops), msgCount(0), readyList(), readyLock() {
 	if(!success)
 		return;
 
@@ -91,47 +91,30 @@ void VFSDevice::bindto(tid_t tid) {
 }
 
 int VFSDevice::getWork() {
-	const VFSNode *n,*first,*last;
-	bool valid;
-	/* this is a bit more complicated because we want to do it in a fair way. that means every
-	 * process that requests something should be served at some time. therefore we store the last
-	 * served client and continue from the next one. */
+	/* we want to do that in a fair way. that means every process that requests something should be
+	 * served at some time. therefore, the channels with pending messages are kept in a FIFO. we
+	 * serve the first one that is handled by us and move it to the end of the list afterwards. it
+	 * is removed as soon as its send-list is empty. */
 
-	/* search for a slot that needs work */
-	/* we don't need to lock the device-data here; the node with openDir() is sufficient */
-	/* because it can't be called twice because the waitLock in vfs prevents it. and nothing of the
-	 * device-data that is used here can be changed during this procedure. */
-	n = openDir(true,&valid);
+	/* the caller holds the waitLock, so that the send-lists can't change in the meantime */
 	/* if there are no messages at all or the node is invalid, stop right now */
-	if(!valid || msgCount == 0) {
-		closeDir(true);
+	if(!isAlive() || msgCount == 0)
 		return -ENOCLIENT;
-	}
-
-	Thread *t = Thread::getRunning();
-	tid_t ourself = t->getTid();
-	first = n;
-	last = lastClient;
-	n = last ? last->next : first;
 
-searchBegin:
-	while(n != NULL && n != last) {
-		/* data available? */
-		const VFSChannel *chan = static_cast<const VFSChannel*>(n);
-		if(chan->getHandler() == ourself && chan->hasWork()) {
-			lastClient = const_cast<VFSNode*>(n);
-			closeDir(true);
-			return static_cast<const VFSChannel*>(lastClient)->getFd();
+	tid_t ourself = Thread::getRunning()->getTid();
+	LockGuard<SpinLock> g(&readyLock);
+	for(auto it = readyList.begin(); it != readyList.end(); ++it) {
+		VFSChannel *chan = it->chan;
+		assert(chan->hasWork());
+		if(chan->getHandler() == ourself) {
+			/* if it has more messages, the others should be served first */
+			if(chan->sendList.length() > 1) {
+				readyList.remove(&*it);
+				readyList.append(&chan->readyItem);
+			}
+			return chan->getFd();
 		}
-		n = n->next;
 	}
-	if(lastClient) {
-		lastClient = NULL;
-		last = last->next;
-		n = first;
-		goto searchBegin;
-	}
-	closeDir(true);
 	return -ENOCLIENT;
 }
 
@@ -139,7 +122,7 @@ void VFSDevice::print(OStream &os) const {
 	bool valid;
 	const VFSNode *chan = openDir(false,&valid);
 	if(valid) {
-		os.writef("%s (creator=%d, lastClient=%s):\n",name,creator,lastClient ? lastClient->getName() : "-");
+		os.writef("%s (creator=%d, ready=%zu):\n",name,creator,readyList.length());
 		while(chan != NULL) {
 			os.pushIndent();
 			chan->print(os);
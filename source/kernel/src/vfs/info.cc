@@ -19,6 +19,7 @@
 
 #include <mem/cache.h>
 #include <mem/kheap.h>
+#include <mem/pagecache.h>
 #include <mem/pagedir.h>
 #include <mem/physmem.h>
 #include <mem/physmemareas.h>
@@ -48,6 +49,26 @@ void VFSInfo::init(VFSNode *sysNode) {
 	VFSNode::release(createObj<MemUsageFile>(KERNEL_PID,sysNode));
 	VFSNode::release(createObj<CPUFile>(KERNEL_PID,sysNode));
 	VFSNode::release(createObj<StatsFile>(KERNEL_PID,sysNode));
+	VFSNode::release(createObj<SwapFile>(KERNEL_PID,sysNode));
+	VFSNode::release(createObj<ZeroPoolFile>(KERNEL_PID,sysNode));
+}
+
+ssize_t VFSInfo::ZeroPoolFile::write(A_UNUSED pid_t pid,OpenFile *,USER const void *buffer,
+		A_UNUSED off_t offset,size_t count) {
+	char str[12];
+	if(count >= sizeof(str))
+		return -EINVAL;
+	int res = UserAccess::read(str,buffer,count);
+	if(res < 0)
+		return res;
+	str[count] = '\0';
+
+	int frames = atoi(str);
+	if(frames < 0)
+		return -EINVAL;
+	PhysMem::setZeroPoolTarget(frames);
+	modtime = Timer::getTime();
+	return count;
 }
 
 void VFSInfo::traceReadCallback(VFSNode *node,size_t *dataSize,void **buffer) {
@@ -204,6 +225,20 @@ void VFSInfo::statsReadCallback(A_UNUSED VFSNode *node,size_t *dataSize,void **b
 	*dataSize = os.getLength();
 }
 
+void VFSInfo::swapReadCallback(A_UNUSED VFSNode *node,size_t *dataSize,void **buffer) {
+	OStringStream os;
+	PhysMem::printSwap(os);
+	*buffer = os.keepString();
+	*dataSize = os.getLength();
+}
+
+void VFSInfo::zeroPoolReadCallback(A_UNUSED VFSNode *node,size_t *dataSize,void **buffer) {
+	OStringStream os;
+	PhysMem::printZeroPool(os);
+	*buffer = os.keepString();
+	*dataSize = os.getLength();
+}
+
 void VFSInfo::memUsageReadCallback(A_UNUSED VFSNode *node,size_t *dataSize,void **buffer) {
 	OStringStream os;
 
@@ -217,6 +252,8 @@ void VFSInfo::memUsageReadCallback(A_UNUSED VFSNode *node,size_t *dataSize,void
 	size_t pmem = PhysMem::getStackSize();
 	size_t dataShared,dataOwn,dataReal;
 	Proc::getMemUsage(&dataShared,&dataOwn,&dataReal);
+	ulong hits = PageCache::getHits();
+	ulong misses = PageCache::getMisses();
 	os.writef(
 		"%-11s%12zu\n"
 		"%-11s%12zu\n"
@@ -233,6 +270,10 @@ void VFSInfo::memUsageReadCallback(A_UNUSED VFSNode *node,size_t *dataSize,void
 		"%-11s%12zu\n"
 		"%-11s%12zu\n"
 		"%-11s%12zu\n"
+		"%-11s%12zu\n"
+		"%-11s%12lu\n"
+		"%-11s%12lu\n"
+		"%-11s%12lu\n"
 		,
 		"Total:",total,
 		"Used:",total - free,
@@ -248,7 +289,11 @@ void VFSInfo::memUsageReadCallback(A_UNUSED VFSNode *node,size_t *dataSize,void
 		"CacheUsage:",Cache::getUsedMem(),
 		"UserShared:",dataShared,
 		"UserOwn:",dataOwn,
-		"UserReal:",dataReal
+		"UserReal:",dataReal,
+		"PageCache:",PageCache::getPageCount() * PAGE_SIZE,
+		"PCacheHits:",hits,
+		"PCacheMiss:",misses,
+		"PCacheRate:",hits + misses ? (hits * 100) / (hits + misses) : 0
 	);
 	*buffer = os.keepString();
 	*dataSize = os.getLength();
@@ -19,6 +19,7 @@
 
 #include <esc/ipc/ipcbuf.h>
 #include <mem/cache.h>
+#include <mem/pagecache.h>
 #include <sys/messages.h>
 #include <task/proc.h>
 #include <vfs/channel.h>
@@ -317,6 +318,9 @@ ssize_t OpenFile::write(pid_t pid,USER const void *buffer,size_t count) {
 		LockGuard<SpinLock> g(&lock);
 		position += writtenBytes;
 	}
+	/* the cached content is outdated now */
+	if(writtenBytes > 0 && usePageCache())
+		PageCache::invalidate(FileId(devNo,nodeNo));
 
 	if(EXPECT_TRUE(writtenBytes > 0 && pid != KERNEL_PID)) {
 		Proc *p = Proc::getByPid(pid);
@@ -369,10 +373,16 @@ int OpenFile::truncate(pid_t pid,off_t length) {
 	else {
 		VFSChannel *chan = static_cast<VFSChannel*>(node);
 		res = VFSFS::truncate(pid,chan,length);
+		if(res == 0 && chan->usePageCache())
+			PageCache::invalidate(FileId(devNo,nodeNo));
 	}
 	return res;
 }
 
+bool OpenFile::usePageCache() const {
+	return devNo != VFS_DEV_NO && static_cast<VFSChannel*>(node)->usePageCache();
+}
+
 int OpenFile::cancel(pid_t pid,msgid_t mid) {
 	if(EXPECT_FALSE(!IS_CHANNEL(node->getMode())))
 		return -ENOTSUP;
@@ -20,6 +20,7 @@
 #include <fs/permissions.h>
 #include <mem/cache.h>
 #include <mem/dynarray.h>
+#include <mem/pagecache.h>
 #include <mem/pagedir.h>
 #include <sys/messages.h>
 #include <task/groups.h>
@@ -205,6 +206,9 @@ int VFS::openPath(pid_t pid,ushort flags,mode_t mode,const char *path,OpenFile *
 	/* store the path for debugging purposes */
 	if(!IS_NODE(fsFile))
 		(*file)->setPath(strdup(path));
+	/* if the file has been truncated or (re)created, the cached content is outdated */
+	if((flags & (VFS_CREATE | VFS_TRUNCATE)) && (*file)->usePageCache())
+		PageCache::invalidate(FileId((*file)->getDev(),(*file)->getNodeNo()));
 	VFSNode::release(node);
 
 	/* append? */
@@ -0,0 +1,96 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <mem/copyonwrite.h>
+#include <mem/physmem.h>
+#include <sys/test.h>
+#include <common.h>
+
+#include "testutils.h"
+
+/* forward declarations */
+static void test_cow();
+static void test_refs();
+static void test_frames();
+
+/* our test-module */
+sTestModule tModCOW = {
+	"Copy-on-write",
+	&test_cow
+};
+
+static void test_cow() {
+	test_refs();
+	test_frames();
+}
+
+static void test_refs() {
+	bool other;
+	test_caseStart("Adding and removing references");
+	checkMemoryBefore(false);
+
+	test_assertTrue(PhysMem::reserve(1,false));
+	frameno_t frame = PhysMem::allocate(PhysMem::USR);
+	size_t count = CopyOnWrite::getFrmCount();
+
+	/* parent and child */
+	test_assertTrue(CopyOnWrite::add(frame));
+	test_assertTrue(CopyOnWrite::add(frame));
+	test_assertSize(CopyOnWrite::getFrmCount(),count + 1);
+
+	test_assertSize(CopyOnWrite::remove(frame,&other),1);
+	test_assertTrue(other);
+	test_assertSize(CopyOnWrite::getFrmCount(),count + 1);
+	test_assertSize(CopyOnWrite::remove(frame,&other),1);
+	test_assertFalse(other);
+	test_assertSize(CopyOnWrite::getFrmCount(),count);
+
+	PhysMem::free(frame,PhysMem::USR);
+	checkMemoryAfter(false);
+	test_caseSucceeded();
+}
+
+static void test_frames() {
+	bool other;
+	frameno_t frames[4];
+	test_caseStart("Sharing multiple frames");
+	checkMemoryBefore(false);
+
+	size_t count = CopyOnWrite::getFrmCount();
+	test_assertTrue(PhysMem::reserve(ARRAY_SIZE(frames),false));
+	for(size_t i = 0; i < ARRAY_SIZE(frames); ++i) {
+		frames[i] = PhysMem::allocate(PhysMem::USR);
+		for(size_t j = 0; j <= i; ++j)
+			test_assertTrue(CopyOnWrite::add(frames[i]));
+	}
+	test_assertSize(CopyOnWrite::getFrmCount(),count + ARRAY_SIZE(frames));
+
+	/* frame i has i + 1 users */
+	for(size_t i = 0; i < ARRAY_SIZE(frames); ++i) {
+		for(size_t j = 0; j <= i; ++j) {
+			CopyOnWrite::remove(frames[i],&other);
+			test_assertInt(other,j < i);
+		}
+		PhysMem::free(frames[i],PhysMem::USR);
+	}
+	test_assertSize(CopyOnWrite::getFrmCount(),count);
+
+	checkMemoryAfter(false);
+	test_caseSucceeded();
+}
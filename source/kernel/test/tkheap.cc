@@ -37,6 +37,7 @@ static void test_kheap_t2();
 static void test_kheap_t3();
 static void test_kheap_t5();
 static void test_kheap_realloc();
+static void test_kheap_fragmentation();
 
 /* our test-module */
 sTestModule tModKHeap = {
@@ -47,6 +48,12 @@ sTestModule tModKHeap = {
 #define SINGLE_BYTE_COUNT 10000
 uint *ptrsSingle[SINGLE_BYTE_COUNT];
 
+#define FRAG_COUNT 4000
+#define FRAG_ALLOCS 100
+#define MAX_STEPS_PER_ALLOC 8
+uint *ptrsFrag[FRAG_COUNT];
+uint *ptrsFragAllocs[FRAG_ALLOCS];
+
 size_t sizes[] = {1,4,10,1023,1024,1025,2048,4097};
 uint *ptrs[ARRAY_SIZE(sizes)];
 size_t randFree1[] = {7,5,2,0,6,3,4,1};
@@ -88,7 +95,8 @@ static void test_kheap() {
 		&test_kheap_t2,
 		&test_kheap_t3,
 		&test_kheap_t5,
-		&test_kheap_realloc
+		&test_kheap_realloc,
+		&test_kheap_fragmentation
 	};
 
 	for(size_t i = 0; i < ARRAY_SIZE(tests); i++)
@@ -334,3 +342,39 @@ static void test_kheap_realloc() {
 
 	checkMemoryAfter(false);
 }
+
+static size_t test_lookupCost() {
+	size_t steps = KHeap::getLookupSteps();
+	for(size_t i = 0; i < FRAG_ALLOCS; i++)
+		ptrsFragAllocs[i] = (uint*)KHeap::alloc(64 + i * sizeof(uint));
+	for(size_t i = 0; i < FRAG_ALLOCS; i++)
+		KHeap::free(ptrsFragAllocs[i]);
+	return KHeap::getLookupSteps() - steps;
+}
+
+/* the number of areas we look at should not depend on the number of free areas. a linear search
+ * would look at all FRAG_COUNT / 2 holes per allocation, whereas we expect a small constant */
+static void test_kheap_fragmentation() {
+	test_caseStart("Lookup cost under fragmentation");
+	checkMemoryBefore(false);
+
+	size_t before = test_lookupCost();
+	tprintf("Lookup steps without fragmentation: %zu\n",before);
+
+	/* create lots of small holes that can't be merged */
+	for(size_t i = 0; i < FRAG_COUNT; i++)
+		ptrsFrag[i] = (uint*)KHeap::alloc(4 + (i % 8) * sizeof(uint));
+	for(size_t i = 0; i < FRAG_COUNT; i += 2)
+		KHeap::free(ptrsFrag[i]);
+
+	size_t after = test_lookupCost();
+	tprintf("Lookup steps with %d holes: %zu\n",FRAG_COUNT / 2,after);
+	test_assertTrue(after / FRAG_ALLOCS <= MAX_STEPS_PER_ALLOC);
+
+	/* now all holes should be merged again */
+	for(size_t i = 1; i < FRAG_COUNT; i += 2)
+		KHeap::free(ptrsFrag[i]);
+	test_assertTrue(test_lookupCost() / FRAG_ALLOCS <= MAX_STEPS_PER_ALLOC);
+
+	checkMemoryAfter(false);
+}
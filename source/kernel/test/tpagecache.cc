@@ -0,0 +1,231 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <mem/cache.h>
+#include <mem/pagecache.h>
+#include <mem/physmem.h>
+#include <sys/test.h>
+#include <vfs/node.h>
+#include <common.h>
+#include <string.h>
+
+#include "testutils.h"
+
+/* forward declarations */
+static void test_pagecache();
+static void test_insert();
+static void test_duplicate();
+static void test_replace();
+static void test_add();
+static void test_outdated();
+static void test_invalidate();
+static void test_reclaim();
+static frameno_t allocFrame();
+
+/* our test-module */
+sTestModule tModPageCache = {
+	"Page cache",
+	&test_pagecache
+};
+
+/* the kernel never caches files of the virtual filesystem, so that we can use it here */
+static FileId file(VFS_DEV_NO,1);
+
+static void test_pagecache() {
+	/* start with an empty cache */
+	PageCache::reclaim(PageCache::getPageCount());
+
+	test_insert();
+	test_duplicate();
+	test_replace();
+	test_add();
+	test_outdated();
+	test_invalidate();
+	test_reclaim();
+}
+
+static void test_insert() {
+	size_t size;
+	test_caseStart("Inserting, getting and releasing a page");
+	checkMemoryBefore(false);
+	ulong gen = PageCache::getGeneration(file);
+
+	frameno_t frame = allocFrame();
+	test_assertTrue(PageCache::insert(file,0,frame,PAGE_SIZE,gen) == frame);
+	test_assertTrue(PageCache::get(file,0,&size) == frame);
+	test_assertSize(size,PAGE_SIZE);
+	test_assertTrue(PageCache::get(file,1,&size) == PhysMem::INVALID_FRAME);
+	PageCache::release(frame);
+	PageCache::release(frame);
+
+	/* unused pages stay in the cache until they are reclaimed */
+	test_assertSize(PageCache::getPageCount(),1);
+	test_assertSize(PageCache::reclaim(10),1);
+	test_assertSize(PageCache::getPageCount(),0);
+	test_assertTrue(PageCache::get(file,0,&size) == PhysMem::INVALID_FRAME);
+
+	checkMemoryAfter(false);
+	test_caseSucceeded();
+}
+
+static void test_duplicate() {
+	test_caseStart("Inserting a page twice");
+	checkMemoryBefore(false);
+	ulong gen = PageCache::getGeneration(file);
+
+	frameno_t frame1 = allocFrame();
+	frameno_t frame2 = allocFrame();
+	test_assertTrue(PageCache::insert(file,4,frame1,PAGE_SIZE,gen) == frame1);
+	/* we get the existing one and have to free our frame */
+	test_assertTrue(PageCache::insert(file,4,frame2,PAGE_SIZE,gen) == frame1);
+	PhysMem::free(frame2,PhysMem::USR);
+	test_assertSize(PageCache::getPageCount(),1);
+
+	PageCache::release(frame1);
+	PageCache::release(frame1);
+	test_assertSize(PageCache::reclaim(10),1);
+
+	checkMemoryAfter(false);
+	test_caseSucceeded();
+}
+
+static void test_replace() {
+	size_t size;
+	test_caseStart("Replacing the only page of a file");
+	checkMemoryBefore(false);
+	ulong gen = PageCache::getGeneration(file);
+
+	frameno_t frame1 = allocFrame();
+	frameno_t frame2 = allocFrame();
+	test_assertTrue(PageCache::insert(file,3,frame1,100,gen) == frame1);
+	PageCache::release(frame1);
+	/* the file has grown; the old page is freed together with its file-node */
+	test_assertTrue(PageCache::insert(file,3,frame2,PAGE_SIZE,gen) == frame2);
+	test_assertSize(PageCache::getPageCount(),1);
+	test_assertTrue(PageCache::get(file,3,&size) == frame2);
+	test_assertSize(size,PAGE_SIZE);
+
+	PageCache::release(frame2);
+	PageCache::release(frame2);
+	test_assertSize(PageCache::reclaim(10),1);
+
+	checkMemoryAfter(false);
+	test_caseSucceeded();
+}
+
+static void test_add() {
+	size_t size;
+	test_caseStart("Adding a partial page");
+	checkMemoryBefore(false);
+
+	char *buffer = (char*)Cache::alloc(PAGE_SIZE);
+	memclear(buffer,PAGE_SIZE);
+	PageCache::add(file,2,buffer,100,PageCache::getGeneration(file));
+	Cache::free(buffer);
+
+	frameno_t frame = PageCache::get(file,2,&size);
+	test_assertTrue(frame != PhysMem::INVALID_FRAME);
+	test_assertSize(size,100);
+	PageCache::release(frame);
+	test_assertSize(PageCache::reclaim(10),1);
+
+	checkMemoryAfter(false);
+	test_caseSucceeded();
+}
+
+static void test_outdated() {
+	size_t size;
+	test_caseStart("Adding a page that has been read before an invalidation");
+	checkMemoryBefore(false);
+
+	char *buffer = (char*)Cache::alloc(PAGE_SIZE);
+	memclear(buffer,PAGE_SIZE);
+	ulong gen = PageCache::getGeneration(file);
+	/* the file is written while we read it */
+	PageCache::invalidate(file);
+	PageCache::add(file,2,buffer,PAGE_SIZE,gen);
+	Cache::free(buffer);
+	test_assertTrue(PageCache::get(file,2,&size) == PhysMem::INVALID_FRAME);
+
+	frameno_t frame = allocFrame();
+	test_assertTrue(PageCache::insert(file,2,frame,PAGE_SIZE,gen) == PhysMem::INVALID_FRAME);
+	PhysMem::free(frame,PhysMem::USR);
+	test_assertSize(PageCache::getPageCount(),0);
+
+	checkMemoryAfter(false);
+	test_caseSucceeded();
+}
+
+static void test_invalidate() {
+	size_t size;
+	test_caseStart("Invalidating a file with pages in use");
+	checkMemoryBefore(false);
+	ulong gen = PageCache::getGeneration(file);
+
+	frameno_t frame1 = allocFrame();
+	frameno_t frame2 = allocFrame();
+	test_assertTrue(PageCache::insert(file,0,frame1,PAGE_SIZE,gen) == frame1);
+	test_assertTrue(PageCache::insert(file,1,frame2,PAGE_SIZE,gen) == frame2);
+	PageCache::release(frame2);
+
+	/* the unused page is freed immediately, the other one on the last release */
+	PageCache::invalidate(file);
+	test_assertSize(PageCache::getPageCount(),1);
+	test_assertTrue(PageCache::get(file,0,&size) == PhysMem::INVALID_FRAME);
+	PageCache::release(frame1);
+	test_assertSize(PageCache::getPageCount(),0);
+
+	checkMemoryAfter(false);
+	test_caseSucceeded();
+}
+
+static void test_reclaim() {
+	size_t size;
+	frameno_t frames[3];
+	test_caseStart("Reclaiming the least recently used pages");
+	checkMemoryBefore(false);
+	ulong gen = PageCache::getGeneration(file);
+
+	for(size_t i = 0; i < ARRAY_SIZE(frames); ++i) {
+		frames[i] = allocFrame();
+		test_assertTrue(PageCache::insert(file,i,frames[i],PAGE_SIZE,gen) == frames[i]);
+	}
+	PageCache::release(frames[1]);
+	PageCache::release(frames[0]);
+	PageCache::release(frames[2]);
+
+	test_assertSize(PageCache::reclaim(1),1);
+	test_assertTrue(PageCache::get(file,1,&size) == PhysMem::INVALID_FRAME);
+	/* using a page again makes it the most recently used one */
+	test_assertTrue(PageCache::get(file,0,&size) == frames[0]);
+	PageCache::release(frames[0]);
+
+	test_assertSize(PageCache::reclaim(1),1);
+	test_assertTrue(PageCache::get(file,2,&size) == PhysMem::INVALID_FRAME);
+	test_assertSize(PageCache::reclaim(10),1);
+	test_assertSize(PageCache::getPageCount(),0);
+
+	checkMemoryAfter(false);
+	test_caseSucceeded();
+}
+
+static frameno_t allocFrame() {
+	test_assertTrue(PhysMem::reserve(1,false));
+	return PhysMem::allocate(PhysMem::USR);
+}
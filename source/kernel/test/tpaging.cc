@@ -32,6 +32,7 @@
 /* forward declarations */
 static void test_paging();
 static void test_paging_foreign();
+static void test_paging_large();
 static bool test_paging_cycle(uintptr_t addr,size_t count);
 static void test_paging_allocate(uintptr_t addr,size_t count);
 static void test_paging_access(uintptr_t addr,size_t count);
@@ -56,6 +57,7 @@ static void test_paging() {
 	}
 
 	test_paging_foreign();
+	test_paging_large();
 }
 
 static void test_paging_foreign() {
@@ -119,6 +121,40 @@ static void test_paging_foreign() {
 #endif
 }
 
+static void test_paging_large() {
+	uintptr_t addr = 0x40000000;
+	PageDir *pdir = Proc::getCurPageDir();
+	if(LARGE_PAGE_SIZE == 0)
+		return;
+
+	test_caseStart("Mapping a large page to %p and splitting it",addr);
+	checkMemoryBefore(true);
+
+	size_t pages = pdir->getPageCount();
+	ssize_t first = PhysMem::allocateContiguous(PT_ENTRY_COUNT,PT_ENTRY_COUNT);
+	test_assertTrue(first >= 0);
+	PageTables::RangeAllocator alloc(first);
+	PageDir::mapToCur(addr,PT_ENTRY_COUNT,alloc,PG_PRESENT | PG_WRITABLE);
+	test_assertSize(pdir->getPageCount(),pages + PT_ENTRY_COUNT);
+	test_assertTrue(pdir->getFrameNo(addr + PAGE_SIZE * 5) == (frameno_t)first + 5);
+	test_paging_access(addr,PT_ENTRY_COUNT);
+
+	/* unmap one page in the middle; the others have to stay */
+	PageTables::NoAllocator noalloc;
+	PageDir::unmapFromCur(addr + PAGE_SIZE,1,noalloc);
+	test_assertSize(pdir->getPageCount(),pages + PT_ENTRY_COUNT - 1);
+	test_assertFalse(pdir->isPresent(addr + PAGE_SIZE));
+	test_assertTrue(pdir->getFrameNo(addr) == (frameno_t)first);
+	test_assertTrue(pdir->getFrameNo(addr + PAGE_SIZE * 2) == (frameno_t)first + 2);
+	test_assertUInt(*(uint*)(addr + PAGE_SIZE * 2),0xDEADBEEF);
+
+	PageDir::unmapFromCur(addr,PT_ENTRY_COUNT,noalloc);
+	PhysMem::freeContiguous(first,PT_ENTRY_COUNT);
+
+	checkMemoryAfter(true);
+	test_caseSucceeded();
+}
+
 static bool test_paging_cycle(uintptr_t addr,size_t count) {
 	Thread *t = Thread::getRunning();
 	test_caseStart("Mapping %zu pages to %p",count,addr);
@@ -17,9 +17,11 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <mem/pagedir.h>
 #include <mem/physmem.h>
 #include <sys/test.h>
 #include <common.h>
+#include <string.h>
 
 #include "testutils.h"
 
@@ -30,6 +32,7 @@ static void test_mm();
 static void test_default();
 static void test_contiguous();
 static void test_contiguous_align();
+static void test_zeropool();
 static void test_mm_allocate();
 static void test_mm_free();
 
@@ -45,6 +48,7 @@ static void test_mm() {
 	test_default();
 	test_contiguous();
 	test_contiguous_align();
+	test_zeropool();
 }
 
 static void test_default() {
@@ -166,6 +170,45 @@ static void test_contiguous_align() {
 	test_caseSucceeded();
 }
 
+static void test_zeropool() {
+	test_caseStart("Using the pool of pre-zeroed frames");
+	size_t target = PhysMem::getZeroPoolTarget();
+	PhysMem::setZeroPoolTarget(0);
+	test_assertSize(PhysMem::getZeroPoolSize(),0);
+	test_assertFalse(PhysMem::fillZeroPool());
+
+	/* the pool counts as free memory */
+	checkMemoryBefore(false);
+	PhysMem::setZeroPoolTarget(2);
+	while(PhysMem::fillZeroPool())
+		;
+	test_assertSize(PhysMem::getZeroPoolSize(),2);
+
+	test_assertTrue(PhysMem::reserve(1,false));
+	frameno_t frame = PhysMem::allocate(PhysMem::USR);
+	uint8_t *addr = (uint8_t*)PageDir::getAccess(frame);
+	memset(addr,0xFF,PAGE_SIZE);
+	PageDir::removeAccess(frame);
+
+	/* we get a cleared frame in exchange */
+	frameno_t zframe = PhysMem::getZeroed(frame);
+	test_assertTrue(zframe != frame);
+	addr = (uint8_t*)PageDir::getAccess(zframe);
+	bool zeroed = true;
+	for(size_t i = 0; i < PAGE_SIZE; ++i)
+		zeroed &= addr[i] == 0;
+	PageDir::removeAccess(zframe);
+	test_assertTrue(zeroed);
+	PhysMem::free(zframe,PhysMem::USR);
+
+	PhysMem::setZeroPoolTarget(0);
+	test_assertSize(PhysMem::getZeroPoolSize(),0);
+	checkMemoryAfter(false);
+
+	PhysMem::setZeroPoolTarget(target);
+	test_caseSucceeded();
+}
+
 static void test_mm_allocate() {
 	ssize_t i = 0;
 	while(i < FRAME_COUNT) {
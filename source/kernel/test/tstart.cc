@@ -48,6 +48,8 @@ extern sTestModule tModEscCodes;
 extern sTestModule tModSwapMap;
 extern sTestModule tModVmm;
 extern sTestModule tModPmemAreas;
+extern sTestModule tModPageCache;
+extern sTestModule tModCOW;
 
 EXTERN_C void unittest_run();
 EXTERN_C void unittest_start();
@@ -87,6 +89,8 @@ void unittest_run() {
 	test_register(&tModSwapMap);
 	test_register(&tModVmm);
 	test_register(&tModPmemAreas);
+	test_register(&tModPageCache);
+	test_register(&tModCOW);
 	test_start();
 
 	/* stay here */
@@ -28,6 +28,7 @@ static void test_swapmap1();
 static void test_swapmap2();
 static void test_swapmap5();
 static void test_swapmap6();
+static void test_swapmap7();
 static void test_doStart(const char *title);
 static void test_finish();
 
@@ -44,6 +45,7 @@ static void test_swapmap() {
 	test_swapmap2();
 	test_swapmap5();
 	test_swapmap6();
+	test_swapmap7();
 }
 
 static void test_swapmap1() {
@@ -161,6 +163,31 @@ static void test_swapmap6() {
 	Cache::free(blocks);
 }
 
+static void test_swapmap7() {
+	size_t total = SwapMap::freeSpace() / PAGE_SIZE;
+	test_doStart("Testing contiguous alloc & free");
+
+	ulong block = SwapMap::alloc(4);
+	test_assertTrue(block != SwapMap::INVALID);
+	for(ulong i = 0; i < 4; i++)
+		test_assertTrue(SwapMap::isUsed(block + i));
+	test_assertFalse(SwapMap::isUsed(block - 1));
+
+	/* the next allocation continues below */
+	ulong next = SwapMap::alloc(2);
+	test_assertTrue(next == block - 2);
+
+	/* too large */
+	test_assertTrue(SwapMap::alloc(total) == SwapMap::INVALID);
+
+	for(ulong i = 0; i < 4; i++)
+		SwapMap::free(block + i);
+	SwapMap::free(next);
+	SwapMap::free(next + 1);
+
+	test_finish();
+}
+
 static void test_doStart(const char *title) {
 	test_caseStart(title);
 	spaceBefore = SwapMap::freeSpace();
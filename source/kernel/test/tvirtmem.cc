@@ -19,11 +19,14 @@
 
 #include <mem/kheap.h>
 #include <mem/pagedir.h>
+#include <mem/physmem.h>
+#include <mem/region.h>
 #include <mem/virtmem.h>
 #include <sys/test.h>
 #include <task/proc.h>
 #include <task/thread.h>
 #include <common.h>
+#include <string.h>
 #include <video.h>
 
 #include "testutils.h"
@@ -32,6 +35,7 @@
 static void test_vmm();
 static void test_1();
 static void test_2();
+static void test_3();
 
 /* our test-module */
 sTestModule tModVmm = {
@@ -42,6 +46,7 @@ sTestModule tModVmm = {
 static void test_vmm() {
 	test_1();
 	test_2();
+	test_3();
 }
 
 static void test_1() {
@@ -162,3 +167,49 @@ static void test_2() {
 
 	test_caseSucceeded();
 }
+
+static void test_3() {
+	VMRegion *src,*dst,*empty;
+	frameno_t frames[4];
+	Thread *t = Thread::getRunning();
+	Proc *p = t->getProc();
+	test_caseStart("Testing VirtMem::lendPages() and VirtMem::borrowPages()");
+
+	checkMemoryBefore(true);
+	t->reserveFrames(12);
+	test_assertTrue(p->getVM()->map(NULL,PAGE_SIZE * 4,PAGE_SIZE * 4,PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_POPULATE,NULL,0,&src) == 0);
+	test_assertTrue(p->getVM()->map(NULL,PAGE_SIZE * 4,PAGE_SIZE * 4,PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_POPULATE,NULL,0,&dst) == 0);
+	test_assertTrue(p->getVM()->map(NULL,PAGE_SIZE * 4,PAGE_SIZE * 4,PROT_READ | PROT_WRITE,
+			MAP_PRIVATE,NULL,0,&empty) == 0);
+	for(size_t i = 0; i < ARRAY_SIZE(frames); ++i)
+		memset((void*)(src->virt() + i * PAGE_SIZE),'a' + i,PAGE_SIZE);
+
+	/* pages that are not present can't be lent */
+	test_assertFalse(p->getVM()->lendPages(empty->virt(),ARRAY_SIZE(frames),frames));
+
+	test_assertTrue(p->getVM()->lendPages(src->virt(),ARRAY_SIZE(frames),frames));
+	for(size_t i = 0; i < ARRAY_SIZE(frames); ++i) {
+		test_assertTrue(src->reg->getPageFlags(i) & PF_COPYONWRITE);
+		test_assertTrue(p->getPageDir()->getFrameNo(src->virt() + i * PAGE_SIZE) == frames[i]);
+	}
+
+	/* not present pages can't be replaced either */
+	test_assertSize(p->getVM()->borrowPages(empty->virt(),ARRAY_SIZE(frames),frames),0);
+
+	test_assertSize(p->getVM()->borrowPages(dst->virt(),ARRAY_SIZE(frames),frames),4);
+	for(size_t i = 0; i < ARRAY_SIZE(frames); ++i) {
+		test_assertTrue(frames[i] == PhysMem::INVALID_FRAME);
+		test_assertTrue(dst->reg->getPageFlags(i) & PF_COPYONWRITE);
+		test_assertInt(*(char*)(dst->virt() + i * PAGE_SIZE),'a' + i);
+	}
+
+	p->getVM()->unmap(src);
+	p->getVM()->unmap(dst);
+	p->getVM()->unmap(empty);
+	t->discardFrames();
+	checkMemoryAfter(true);
+
+	test_caseSucceeded();
+}
@@ -101,12 +101,13 @@ static void test_vmreg_addAndRem(uintptr_t *addrs,const char *msg) {
 	/* remove */
 	for(size_t i = 0; i < TEST_REG_COUNT; i++) {
 		Region *r = regs[i]->reg;
-		delete regs[i]->reg;
 		tree.remove(regs[i]);
 		reg = tree.getByAddr(addrs[i]);
 		test_assertPtr(reg,NULL);
 		reg = tree.getByReg(r);
 		test_assertPtr(reg,NULL);
+		test_assertPtr(r->getVMRegs(),NULL);
+		delete r;
 
 		for(size_t j = i + 1; j < TEST_REG_COUNT; j++) {
 			reg = tree.getByAddr(addrs[j]);
@@ -25,7 +25,7 @@
 static const size_t DIRE_SIZE	= sizeof(struct dirent) - (NAME_MAX + 1);
 
 bool readdirto(DIR *dir,struct dirent *e) {
-	if(fread(e,1,DIRE_SIZE,dir) > 0) {
+	while(fread(e,1,DIRE_SIZE,dir) > 0) {
 		/* convert endianess */
 		e->d_namelen = le16tocpu(e->d_namelen);
 		e->d_reclen = le16tocpu(e->d_reclen);
@@ -36,16 +36,20 @@ bool readdirto(DIR *dir,struct dirent *e) {
 			return false;
 
 		/* now read the name */
-		if(fread(e->d_name,1,len,dir) > 0) {
-			/* if the record is longer, we have to skip the stuff until the next record */
-			if(e->d_reclen - DIRE_SIZE > len) {
-				len = (e->d_reclen - DIRE_SIZE - len);
-				if(fseek(dir,len,SEEK_CUR) < 0)
-					return false;
-			}
+		if(len > 0 && fread(e->d_name,1,len,dir) == 0)
+			return false;
+
+		/* if the record is longer, we have to skip the stuff until the next record */
+		if(e->d_reclen - DIRE_SIZE > len) {
+			size_t rem = e->d_reclen - DIRE_SIZE - len;
+			if(fseek(dir,rem,SEEK_CUR) < 0)
+				return false;
+		}
 
+		/* records without name are no entries (e.g. the index blocks of ext2), so skip them */
+		if(len > 0) {
 			/* ensure that it is null-terminated */
-			e->d_name[e->d_namelen] = '\0';
+			e->d_name[len] = '\0';
 			return true;
 		}
 	}
@@ -129,6 +129,7 @@ const struct Syscall syscalls[] = {
 	{"gettimeofday",	"%p"						},
 	{"utime",			"%d,%p"						},
 	{"truncate",		"%d,%u"						},
+	{"getworkv",		"%W,%p,%x"					},
 #if defined(__x86__)
 	{"reqports",   		"%d,%d"						},
 	{"relports",    	"%d,%d"						},
@@ -54,19 +54,27 @@ void Device::unset(msgid_t op) {
 }
 
 void Device::loop() {
-	ulong buf[IPC_DEF_SIZE / sizeof(ulong)];
+	ulong bufs[BATCH_SIZE][IPC_DEF_SIZE / sizeof(ulong)];
+	tWorkSlot slots[BATCH_SIZE];
+	for(size_t i = 0; i < BATCH_SIZE; ++i) {
+		slots[i].msg = bufs[i];
+		slots[i].size = sizeof(bufs[i]);
+	}
+
 	while(_run) {
-		msgid_t mid;
-		int fd = getwork(_id,&mid,buf,sizeof(buf),0);
-		if(EXPECT_FALSE(fd < 0)) {
+		int count = getworkv(_id,slots,BATCH_SIZE,0);
+		if(EXPECT_FALSE(count < 0)) {
 			/* just log that it failed. maybe a client has sent a message that was too big */
-			if(fd != -EINTR)
+			if(count != -EINTR)
 				printe("getwork failed");
 			continue;
 		}
 
-		IPCStream is(fd,buf,sizeof(buf),mid);
-		handleMsg(mid,is);
+		/* handle the whole batch before we ask for new messages */
+		for(int i = 0; i < count; ++i) {
+			IPCStream is(slots[i].fd,bufs[i],sizeof(bufs[i]),slots[i].mid);
+			handleMsg(slots[i].mid,is);
+		}
 	}
 }
 
@@ -25,29 +25,36 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define ALLOC_LOCK	0xF7180000
+/* protects the batch buffer */
+#define BATCH_LOCK	0xF7180005
 
 namespace fs {
 
-BlockCache::BlockCache(int fd,size_t blocks,size_t bsize)
-		: _blockCacheSize(blocks), _blockSize(bsize), _hashmap(new CBlock*[HASH_SIZE]()),
-		  _oldestBlock(NULL), _newestBlock(NULL), _freeBlocks(NULL),
-		  _blockCache(new CBlock[blocks]), _blockmem(), _blockshm(), _hits(), _misses() {
+BlockCache::BlockCache(int fd,size_t blocks,size_t bsize,CachePolicy::Type policy)
+		: _blockCacheSize(blocks), _blockSize(bsize), _hashSize(CachePolicy::hashSize(blocks)),
+		  _hashmap(new CBlock*[_hashSize]()), _policy(CachePolicy::create(policy,blocks)),
+		  _freeBlocks(NULL),
+		  _blockCache(new CBlock[blocks]), _blockmem(), _batchmem(), _blockshm(), _hits(), _misses(),
+		  _raNext(), _raWindow(1), _raBlocks(), _writes(), _writeBlocks() {
 	size_t i;
 	CBlock *bentry;
-	if(sharebuf(fd,_blockCacheSize * _blockSize,&_blockmem,&_blockshm,0) < 0) {
+	if(sharebuf(fd,(_blockCacheSize + MAX_BATCH) * _blockSize,&_blockmem,&_blockshm,0) < 0) {
 		if(_blockmem == NULL)
 			VTHROW("Unable to create block cache");
 		printe("Unable to share buffer with disk driver");
 	}
+	_batchmem = (char*)_blockmem + _blockCacheSize * _blockSize;
 	bentry = _blockCache;
 	for(i = 0; i < _blockCacheSize; i++) {
 		bentry->blockNo = 0;
 		bentry->buffer = (char*)_blockmem + i * _blockSize;
 		bentry->dirty = false;
 		bentry->refs = 0;
-		bentry->prev = (i < _blockCacheSize - 1) ? bentry + 1 : NULL;
+		bentry->queue = CBlock::FREE;
+		bentry->prev = NULL;
 		bentry->next = _freeBlocks;
 		bentry->hnext = NULL;
 		_freeBlocks = bentry;
@@ -57,39 +64,101 @@ BlockCache::BlockCache(int fd,size_t blocks,size_t bsize)
 
 BlockCache::~BlockCache() {
 	destroybuf(_blockmem,_blockshm);
+	delete _policy;
 	delete[] _hashmap;
 	delete[] _blockCache;
 }
 
+static int compareDirty(const void *a,const void *b) {
+	block_t ba = *static_cast<const block_t*>(a);
+	block_t bb = *static_cast<const block_t*>(b);
+	return ba < bb ? -1 : (ba > bb ? 1 : 0);
+}
+
 void BlockCache::flush() {
-	CBlock *bentry = _newestBlock;
-	while(bentry != NULL) {
-		sassert(tpool_lock(ALLOC_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
+	/* collect the dirty blocks and sort them by block number */
+	sassert(tpool_lock(ALLOC_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
+	size_t count = 0;
+	DirtyBlock *dirty = (DirtyBlock*)malloc(sizeof(DirtyBlock) * _blockCacheSize);
+	for(size_t i = 0; dirty && i < _blockCacheSize; ++i) {
+		CBlock *bentry = _blockCache + i;
 		if(bentry->dirty) {
-			acquire(bentry,READ);
-			writeBlocks(bentry->buffer,bentry->blockNo,1);
-			bentry->dirty = false;
-			doRelease(bentry,false);
+			dirty[count].blockNo = bentry->blockNo;
+			dirty[count].block = bentry;
+			count++;
 		}
-		sassert(tpool_unlock(ALLOC_LOCK) == 0);
-		bentry = bentry->next;
 	}
+	sassert(tpool_unlock(ALLOC_LOCK) == 0);
+	if(dirty == NULL) {
+		printe("Not enough memory to flush the block cache");
+		return;
+	}
+	qsort(dirty,count,sizeof(DirtyBlock),compareDirty);
+
+	/* write contiguous runs at once */
+	CBlock *run[MAX_BATCH];
+	size_t n = 0;
+	for(size_t i = 0; i < count; ++i) {
+		CBlock *bentry = dirty[i].block;
+		sassert(tpool_lock(ALLOC_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
+		/* the block might have been written or reused in the meantime */
+		if(bentry->blockNo != dirty[i].blockNo || !bentry->dirty) {
+			sassert(tpool_unlock(ALLOC_LOCK) == 0);
+			continue;
+		}
+
+		/* write the current run first if the block does not belong to it. we do that as well if
+		 * the block is in use, because we should not wait for it while holding other blocks */
+		if(n > 0 && (n == MAX_BATCH || bentry->blockNo != run[n - 1]->blockNo + 1 ||
+				bentry->refs > 0)) {
+			sassert(tpool_unlock(ALLOC_LOCK) == 0);
+			writeRun(run,n);
+			n = 0;
+			i--;
+			continue;
+		}
+		acquire(bentry,READ);
+		run[n++] = bentry;
+	}
+	if(n > 0)
+		writeRun(run,n);
+	free(dirty);
+}
+
+void BlockCache::writeRun(CBlock **blocks,size_t count) {
+	if(count == 1)
+		writeBlocks(blocks[0]->buffer,blocks[0]->blockNo,1);
+	else {
+		sassert(tpool_lock(BATCH_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
+		for(size_t i = 0; i < count; ++i)
+			memcpy((char*)_batchmem + i * _blockSize,blocks[i]->buffer,_blockSize);
+		writeBlocks(_batchmem,blocks[0]->blockNo,count);
+		sassert(tpool_unlock(BATCH_LOCK) == 0);
+	}
+
+	for(size_t i = 0; i < count; ++i) {
+		blocks[i]->dirty = false;
+		doRelease(blocks[i],true);
+	}
+	_writes++;
+	_writeBlocks += count;
 }
 
-void BlockCache::acquire(CBlock *b,A_UNUSED uint mode) {
-	assert(!(mode & WRITE) || b->refs == 0);
+void BlockCache::acquire(CBlock *b,uint mode) {
 	b->refs++;
 	sassert(tpool_unlock(ALLOC_LOCK) == 0);
-	sassert(tpool_lock((uint)b,(mode & WRITE) ? LOCK_EXCLUSIVE : 0) == 0);
+	sassert(tpool_lock((ulong)b,(mode & WRITE) ? LOCK_EXCLUSIVE : 0) == 0);
 }
 
-void BlockCache::doRelease(CBlock *b,bool unlockAlloc) {
+void BlockCache::doRelease(CBlock *b,bool unlockAlloc,bool invalid) {
 	sassert(tpool_lock(ALLOC_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
 	assert(b->refs > 0);
 	b->refs--;
+	if(invalid)
+		invalidate(b);
 	if(unlockAlloc)
 		sassert(tpool_unlock(ALLOC_LOCK) == 0);
-	sassert(tpool_unlock((uint)b) == 0);
+	sassert(tpool_unlock((ulong)b) == 0);
 }
 
 CBlock *BlockCache::doRequest(block_t blockNo,bool doRead,uint mode) {
@@ -99,48 +168,28 @@ CBlock *BlockCache::doRequest(block_t blockNo,bool doRead,uint mode) {
 	sassert(tpool_lock(ALLOC_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
 
 	/* search for the block. perhaps it's already in cache */
-	bentry = _hashmap[blockNo % HASH_SIZE];
-	while(bentry != NULL) {
-		if(bentry->blockNo == blockNo) {
-			/* remove from list and put at the beginning of the usedlist because it was
-			 * used most recently */
-			if(bentry->prev != NULL) {
-				/* update oldest */
-				if(_oldestBlock == bentry)
-					_oldestBlock = bentry->prev;
-				/* remove */
-				bentry->prev->next = bentry->next;
-				if(bentry->next)
-					bentry->next->prev = bentry->prev;
-				/* put at the beginning */
-				bentry->prev = NULL;
-				bentry->next = _newestBlock;
-				bentry->next->prev = bentry;
-				_newestBlock = bentry;
-			}
-			acquire(bentry,mode);
-			_hits++;
-			return bentry;
-		}
-		bentry = bentry->hnext;
+	bentry = lookup(blockNo);
+	if(bentry != NULL) {
+		_policy->access(bentry);
+		acquire(bentry,mode);
+		_hits++;
+		return bentry;
 	}
 
 	/* init cached block */
 	block = getBlock(blockNo);
+	if(block == NULL) {
+		sassert(tpool_unlock(ALLOC_LOCK) == 0);
+		return NULL;
+	}
 	block->blockNo = blockNo;
 	block->dirty = false;
 	block->refs = 0;
 
 	/* now read from disk */
-	if(doRead) {
-		/* we need always a write-tpool_lock because we have to read the content into it */
-		acquire(block,WRITE);
-		if(readBlocks(block->buffer,blockNo,1) != 0) {
-			block->blockNo = 0;
-			doRelease(block,true);
-			return NULL;
-		}
-		doRelease(block,false);
+	if(doRead && !fetch(block)) {
+		sassert(tpool_unlock(ALLOC_LOCK) == 0);
+		return NULL;
 	}
 
 	acquire(block,mode);
@@ -148,84 +197,140 @@ CBlock *BlockCache::doRequest(block_t blockNo,bool doRead,uint mode) {
 	return block;
 }
 
-CBlock *BlockCache::getBlock(block_t blockNo) {
-	CBlock *block = _freeBlocks;
-	if(block != NULL) {
-		/* remove from freelist and put in usedlist */
-		_freeBlocks = block->next;
-		if(_freeBlocks)
-			_freeBlocks->prev = NULL;
-		/* block->prev is already NULL */
-		block->next = _newestBlock;
-		if(block->next)
-			block->next->prev = block;
-		_newestBlock = block;
-		/* update oldest */
-		if(_oldestBlock == NULL)
-			_oldestBlock = block;
-		/* insert into hashmap */
-		CBlock **list = &_hashmap[blockNo % HASH_SIZE];
-		block->hnext = *list;
-		*list = block;
-		return block;
+bool BlockCache::fetch(CBlock *block) {
+	CBlock *blocks[MAX_BATCH];
+	block_t blockNo = block->blockNo;
+
+	/* if the previous miss was directly in front of us, we're reading a stream. thus, double the
+	 * number of blocks we read ahead. otherwise start again with no read-ahead */
+	if(blockNo == _raNext)
+		_raWindow = MIN(_raWindow * 2,MAX_BATCH);
+	else
+		_raWindow = 1;
+
+	/* we need always a write-lock because we have to read the content into it. take the locks
+	 * while holding ALLOC_LOCK so that nobody can get the not yet loaded blocks in between. this
+	 * can't block for long, because the blocks have no references */
+	size_t count = 0;
+	block->refs++;
+	blocks[count++] = block;
+	while(count < _raWindow && lookup(blockNo + count) == NULL) {
+		/* the references prevent getBlock from reusing the blocks we've already taken */
+		CBlock *b = getBlock(blockNo + count,true);
+		if(b == NULL)
+			break;
+		b->blockNo = blockNo + count;
+		b->dirty = false;
+		b->refs = 1;
+		blocks[count++] = b;
 	}
+	for(size_t i = 0; i < count; ++i)
+		sassert(tpool_lock((ulong)blocks[i],LOCK_EXCLUSIVE) == 0);
+	_raNext = blockNo + count;
+	sassert(tpool_unlock(ALLOC_LOCK) == 0);
 
-	/* take the oldest one */
-	block = _oldestBlock;
-	assert(block->refs == 0);
-	_oldestBlock = block->prev;
-	_oldestBlock->next = NULL;
-	/* remove from hashmap */
-	bool diffhash = block->blockNo % HASH_SIZE != blockNo % HASH_SIZE;
-	if(diffhash) {
-		CBlock **list = &_hashmap[block->blockNo % HASH_SIZE];
-		CBlock *b = *list, *p = NULL;
-		while(b != NULL) {
-			if(b == block) {
-				if(p)
-					p->hnext = b->hnext;
-				else
-					*list = b->hnext;
-				break;
-			}
-			p = b;
-			b = b->hnext;
+	bool res = false;
+	if(count > 1) {
+		sassert(tpool_lock(BATCH_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
+		if(readBlocks(_batchmem,blockNo,count) == 0) {
+			for(size_t i = 0; i < count; ++i)
+				memcpy(blocks[i]->buffer,(char*)_batchmem + i * _blockSize,_blockSize);
+			res = true;
 		}
+		sassert(tpool_unlock(BATCH_LOCK) == 0);
 	}
-	/* put at beginning of usedlist */
-	block->prev = NULL;
-	block->next = _newestBlock;
-	if(block->next)
-		block->next->prev = block;
-	_newestBlock = block;
-	/* insert into hashmap */
-	if(diffhash) {
-		CBlock **list = &_hashmap[blockNo % HASH_SIZE];
-		block->hnext = *list;
-		*list = block;
+	/* if that failed (e.g., at the end of the device), try to read just the requested block */
+	if(!res) {
+		res = readBlocks(block->buffer,blockNo,1) == 0;
+		for(size_t i = 1; i < count; ++i)
+			doRelease(blocks[i],true,true);
+		count = 1;
 	}
-	/* if it is dirty we have to write it first to disk */
-	if(block->dirty) {
-		acquire(block,READ);
-		writeBlocks(block->buffer,block->blockNo,1);
-		doRelease(block,false);
+
+	for(size_t i = 1; i < count; ++i)
+		doRelease(blocks[i],true);
+	_raBlocks += count - 1;
+
+	doRelease(block,false,!res);
+	return res;
+}
+
+CBlock *BlockCache::lookup(block_t blockNo) {
+	CBlock *bentry = _hashmap[blockNo & (_hashSize - 1)];
+	while(bentry != NULL) {
+		if(bentry->blockNo == blockNo)
+			return bentry;
+		bentry = bentry->hnext;
+	}
+	return NULL;
+}
+
+void BlockCache::hashInsert(CBlock *b) {
+	CBlock **list = &_hashmap[b->blockNo & (_hashSize - 1)];
+	b->hnext = *list;
+	*list = b;
+}
+
+void BlockCache::hashRemove(CBlock *b) {
+	CBlock **list = &_hashmap[b->blockNo & (_hashSize - 1)];
+	while(*list != NULL && *list != b)
+		list = &(*list)->hnext;
+	if(*list)
+		*list = b->hnext;
+	b->hnext = NULL;
+}
+
+void BlockCache::invalidate(CBlock *b) {
+	hashRemove(b);
+	_policy->remove(b);
+	b->blockNo = 0;
+	b->dirty = false;
+
+	/* put it into the freelist */
+	b->next = _freeBlocks;
+	_freeBlocks = b;
+}
+
+CBlock *BlockCache::getBlock(block_t blockNo,bool quiet) {
+	CBlock *block = _freeBlocks;
+	if(block != NULL)
+		_freeBlocks = block->next;
+	else {
+		/* let the policy choose one that is not in use */
+		block = _policy->victim();
+		if(block == NULL) {
+			if(!quiet)
+				printe("All cached blocks are in use");
+			return NULL;
+		}
+		hashRemove(block);
+
+		/* if it is dirty we have to write it first to disk. we keep the alloc-lock meanwhile,
+		 * because nobody should request the old block from disk before it has been written. since
+		 * it has no references, nobody uses it at the moment */
+		if(block->dirty)
+			writeBlocks(block->buffer,block->blockNo,1);
 	}
+
+	_policy->insert(block,blockNo);
+	block->blockNo = blockNo;
+	hashInsert(block);
 	return block;
 }
 
 void BlockCache::printStats(FILE *f) {
 	float hitrate;
 	size_t used = 0,dirty = 0;
-	CBlock *bentry = _newestBlock;
-	while(bentry != NULL) {
-		used++;
-		if(bentry->dirty)
+	for(size_t i = 0; i < _blockCacheSize; ++i) {
+		if(_blockCache[i].queue != CBlock::FREE)
+			used++;
+		if(_blockCache[i].dirty)
 			dirty++;
-		bentry = bentry->next;
 	}
 	fprintf(f,"\t\tTotal blocks: %zu\n",_blockCacheSize);
 	fprintf(f,"\t\tUsed blocks: %zu\n",used);
 	fprintf(f,"\t\tDirty blocks: %zu\n",dirty);
+	fprintf(f,"\t\tHash buckets: %zu\n",_hashSize);
 	fprintf(f,"\t\tHits: %lu\n",_hits);
 	fprintf(f,"\t\tMisses: %lu\n",_misses);
 	if(_hits == 0)
@@ -233,22 +338,15 @@ void BlockCache::printStats(FILE *f) {
 	else
 		hitrate = 100.0f / ((float)(_misses + _hits) / _hits);
 	fprintf(f,"\t\tHitrate: %.3f%%\n",hitrate);
+	fprintf(f,"\t\tRead-ahead blocks: %lu\n",_raBlocks);
+	fprintf(f,"\t\tWrites: %lu (%lu blocks)\n",_writes,_writeBlocks);
+	_policy->printStats(f);
 }
 
 #if DEBUGGING
 
 void BlockCache::print() {
-	size_t i = 0;
-	CBlock *block;
-	printf("Used blocks:\n\t");
-	block = _newestBlock;
-	while(block != NULL) {
-		if(++i % 8 == 0)
-			printf("\n\t");
-		printf("%zu ",block->blockNo);
-		block = block->next;
-	}
-	printf("\n");
+	_policy->print();
 }
 
 #endif
@@ -0,0 +1,236 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <fs/blockcache.h>
+#include <fs/cachepolicy.h>
+#include <sys/common.h>
+#include <assert.h>
+#include <stdio.h>
+
+namespace fs {
+
+/* marks an unused slot in A1out */
+static const block_t NO_BLOCK		= (block_t)-1;
+static const size_t MIN_HASH_SIZE	= 64;
+
+void BlockQueue::push(CBlock *b) {
+	assert(b->queue == CBlock::FREE);
+	b->queue = _id;
+	b->prev = NULL;
+	b->next = _head;
+	if(_head)
+		_head->prev = b;
+	else
+		_tail = b;
+	_head = b;
+	_count++;
+}
+
+void BlockQueue::remove(CBlock *b) {
+	assert(b->queue == _id);
+	if(b->prev)
+		b->prev->next = b->next;
+	else
+		_head = b->next;
+	if(b->next)
+		b->next->prev = b->prev;
+	else
+		_tail = b->prev;
+	b->prev = b->next = NULL;
+	b->queue = CBlock::FREE;
+	_count--;
+}
+
+CBlock *BlockQueue::popUnused() {
+	CBlock *b = _tail;
+	while(b != NULL && b->refs > 0)
+		b = b->prev;
+	if(b)
+		remove(b);
+	return b;
+}
+
+CachePolicy *CachePolicy::create(Type type,size_t blocks) {
+	if(type == LRU)
+		return new LRUPolicy();
+	return new TwoQPolicy(blocks);
+}
+
+size_t CachePolicy::hashSize(size_t entries) {
+	size_t size = MIN_HASH_SIZE;
+	while(size < entries)
+		size *= 2;
+	return size;
+}
+
+void LRUPolicy::insert(CBlock *b,block_t) {
+	_used.push(b);
+}
+
+void LRUPolicy::access(CBlock *b) {
+	/* put it at the beginning, because it was used most recently */
+	_used.remove(b);
+	_used.push(b);
+}
+
+void LRUPolicy::remove(CBlock *b) {
+	_used.remove(b);
+}
+
+CBlock *LRUPolicy::victim() {
+	return _used.popUnused();
+}
+
+void LRUPolicy::printStats(FILE *f) {
+	fprintf(f,"\t\tPolicy: LRU\n");
+}
+
+#if DEBUGGING
+
+void LRUPolicy::print() {
+	size_t i = 0;
+	printf("Used blocks:\n\t");
+	for(CBlock *b = _used.head(); b != NULL; b = b->next) {
+		if(++i % 8 == 0)
+			printf("\n\t");
+		printf("%zu ",b->blockNo);
+	}
+	printf("\n");
+}
+
+#endif
+
+TwoQPolicy::TwoQPolicy(size_t blocks)
+		: CachePolicy(), _inMax(MAX(blocks / 4,1)), _in(IN), _main(MAIN),
+		  _ghosts(new Ghost[MAX(blocks / 2,1)]), _ghostMax(MAX(blocks / 2,1)), _ghostCount(),
+		  _ghostPos(), _ghostMap(), _ghostMapSize(hashSize(_ghostMax)), _inHits(), _mainHits(),
+		  _ghostHits() {
+	_ghostMap = new Ghost*[_ghostMapSize]();
+	for(size_t i = 0; i < _ghostMax; ++i) {
+		_ghosts[i].blockNo = NO_BLOCK;
+		_ghosts[i].hnext = NULL;
+	}
+}
+
+TwoQPolicy::~TwoQPolicy() {
+	delete[] _ghostMap;
+	delete[] _ghosts;
+}
+
+void TwoQPolicy::insert(CBlock *b,block_t blockNo) {
+	/* if it has been evicted from A1in recently, it's not used only once */
+	if(forget(blockNo)) {
+		_main.push(b);
+		_ghostHits++;
+	}
+	else
+		_in.push(b);
+}
+
+void TwoQPolicy::access(CBlock *b) {
+	/* accesses to blocks in A1in are not considered; they might belong to the same scan */
+	if(b->queue == IN)
+		_inHits++;
+	else {
+		_main.remove(b);
+		_main.push(b);
+		_mainHits++;
+	}
+}
+
+void TwoQPolicy::remove(CBlock *b) {
+	if(b->queue == IN)
+		_in.remove(b);
+	else
+		_main.remove(b);
+}
+
+CBlock *TwoQPolicy::victim() {
+	/* take it from A1in, if that is beyond its share, or from Am. if there are only blocks in use
+	 * in that queue, use the other one */
+	bool fromIn = _in.count() > _inMax || _main.count() == 0;
+	CBlock *b = (fromIn ? _in : _main).popUnused();
+	if(b == NULL) {
+		fromIn = !fromIn;
+		b = (fromIn ? _in : _main).popUnused();
+	}
+
+	/* remember the blocks from A1in to detect whether they are used again */
+	if(b && fromIn)
+		remember(b->blockNo);
+	return b;
+}
+
+void TwoQPolicy::remember(block_t blockNo) {
+	/* replace the oldest ghost */
+	Ghost *g = _ghosts + _ghostPos;
+	if(g->blockNo != NO_BLOCK)
+		forget(g->blockNo);
+	_ghostPos = (_ghostPos + 1) % _ghostMax;
+
+	g->blockNo = blockNo;
+	Ghost **list = _ghostMap + (blockNo & (_ghostMapSize - 1));
+	g->hnext = *list;
+	*list = g;
+	_ghostCount++;
+}
+
+bool TwoQPolicy::forget(block_t blockNo) {
+	Ghost **list = _ghostMap + (blockNo & (_ghostMapSize - 1));
+	while(*list != NULL) {
+		Ghost *g = *list;
+		if(g->blockNo == blockNo) {
+			*list = g->hnext;
+			g->blockNo = NO_BLOCK;
+			g->hnext = NULL;
+			_ghostCount--;
+			return true;
+		}
+		list = &g->hnext;
+	}
+	return false;
+}
+
+void TwoQPolicy::printStats(FILE *f) {
+	fprintf(f,"\t\tPolicy: 2Q\n");
+	fprintf(f,"\t\tA1in: %zu of %zu blocks, %lu hits\n",_in.count(),_inMax,_inHits);
+	fprintf(f,"\t\tAm: %zu blocks, %lu hits\n",_main.count(),_mainHits);
+	fprintf(f,"\t\tA1out: %zu of %zu blocks, %lu hits\n",_ghostCount,_ghostMax,_ghostHits);
+}
+
+#if DEBUGGING
+
+void TwoQPolicy::print() {
+	BlockQueue *queues[] = {&_in,&_main};
+	const char *names[] = {"A1in","Am"};
+	for(size_t q = 0; q < ARRAY_SIZE(queues); ++q) {
+		size_t i = 0;
+		printf("%s:\n\t",names[q]);
+		for(CBlock *b = queues[q]->head(); b != NULL; b = b->next) {
+			if(++i % 8 == 0)
+				printf("\n\t");
+			printf("%zu ",b->blockNo);
+		}
+		printf("\n");
+	}
+}
+
+#endif
+
+}
@@ -0,0 +1,153 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <fs/common.h>
+#include <sys/common.h>
+#include <sys/sync.h>
+#include <assert.h>
+#include <mutex>
+
+/* the locks are kept in a hashmap, indexed by their identifier. the waiters of a lock block on a
+ * semaphore that is created on the first contention. */
+
+static const size_t LOCK_HASH_SIZE		= 64;
+
+struct LockEntry {
+	ulong ident;
+	uint flags;
+	/* -1 if somebody writes, >0 if we're reading */
+	int count;
+	/* the number of threads that hold the lock or want to acquire it */
+	int refs;
+	/* the number of threads that are waiting and have not been woken up yet */
+	int waits;
+	/* the semaphore to block on (-1 if not created yet) */
+	int sem;
+	LockEntry *next;
+};
+
+static std::mutex lockMutex;
+static LockEntry *lockMap[LOCK_HASH_SIZE];
+static LockEntry *freeEntries;
+
+static LockEntry *getEntry(ulong ident) {
+	LockEntry **list = lockMap + (ident / sizeof(ulong)) % LOCK_HASH_SIZE;
+	for(LockEntry *e = *list; e != NULL; e = e->next) {
+		if(e->ident == ident)
+			return e;
+	}
+
+	LockEntry *e = freeEntries;
+	if(e)
+		freeEntries = e->next;
+	else {
+		e = new LockEntry;
+		e->sem = -1;
+	}
+	e->ident = ident;
+	e->flags = 0;
+	e->count = 0;
+	e->refs = 0;
+	e->waits = 0;
+	e->next = *list;
+	*list = e;
+	return e;
+}
+
+static void putEntry(LockEntry *e) {
+	LockEntry **list = lockMap + (e->ident / sizeof(ulong)) % LOCK_HASH_SIZE;
+	LockEntry *p = NULL;
+	for(LockEntry *c = *list; c != e; p = c, c = c->next)
+		;
+	if(p)
+		p->next = e->next;
+	else
+		*list = e->next;
+	/* keep the semaphore; it will be reused with the entry */
+	e->next = freeEntries;
+	freeEntries = e;
+}
+
+static int waitFor(LockEntry *e) {
+	if(e->sem < 0) {
+		e->sem = semcrt(0);
+		if(e->sem < 0)
+			return e->sem;
+	}
+	e->waits++;
+	lockMutex.unlock();
+	IGNSIGS(semdown(e->sem));
+	lockMutex.lock();
+	return 0;
+}
+
+static void wakeupAll(LockEntry *e) {
+	/* we decrease the waits here to not wake up anybody twice */
+	for(; e->waits > 0; e->waits--)
+		semup(e->sem);
+}
+
+int tpool_lock(ulong ident,uint flags) {
+	int res = 0;
+	lockMutex.lock();
+	LockEntry *e = getEntry(ident);
+	e->refs++;
+	e->flags |= flags & LOCK_KEEP;
+
+	/* for fairness: if there is already somebody waiting, always wait */
+	if(e->waits > 0)
+		res = waitFor(e);
+	if(flags & LOCK_EXCLUSIVE) {
+		/* wait until there is no reader and writer anymore */
+		while(res == 0 && e->count != 0)
+			res = waitFor(e);
+		if(res == 0)
+			e->count = -1;
+	}
+	else {
+		/* wait until there are no writers anymore */
+		while(res == 0 && e->count < 0)
+			res = waitFor(e);
+		if(res == 0)
+			e->count++;
+	}
+
+	if(res < 0 && --e->refs == 0 && !(e->flags & LOCK_KEEP))
+		putEntry(e);
+	lockMutex.unlock();
+	return res;
+}
+
+int tpool_unlock(ulong ident) {
+	lockMutex.lock();
+	LockEntry *e = getEntry(ident);
+	assert(e->refs > 0 && e->count != 0);
+	if(e->count < 0)
+		e->count = 0;
+	else
+		e->count--;
+
+	/* let the waiters check again, whether they can get the lock now */
+	if(e->count == 0)
+		wakeupAll(e);
+	if(--e->refs == 0 && !(e->flags & LOCK_KEEP))
+		putEntry(e);
+	lockMutex.unlock();
+	return 0;
+}
@@ -22,6 +22,7 @@
 #include <sys/proc.h>
 #include <sys/stat.h>
 #include <sys/test.h>
+#include <dirent.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,6 +32,7 @@ static void test_basics(void);
 static void test_perms(void);
 static void test_rename(void);
 static void test_largeFile(void);
+static void test_largeDir(void);
 static void test_assertCan(const char *path,uint mode);
 static void test_assertCanNot(const char *path,uint mode,int err);
 static void fs_createFile(const char *name,const char *content);
@@ -51,6 +53,7 @@ static void test_fs(void) {
 		test_perms();
 		test_rename();
 		test_largeFile();
+		test_largeDir();
 	}
 	else
 		printf("WARNING: Detected readonly filesystem; skipping the test\n\n");
@@ -270,6 +273,55 @@ static void test_largeFile(void) {
 	test_caseSucceeded();
 }
 
+static void test_largeDir(void) {
+	/* with 1 KiB blocks, the root of the hash-tree is full after about 120 leaves, so that ext2
+	 * needs a second index level. readers without index support see its blocks as empty records */
+	static const char *prefix = "a_file_with_a_long_name_to_fill_the_leaves_";
+	const size_t count = 2500;
+	char path[MAX_PATH_LEN];
+	struct dirent e;
+	test_caseStart("Creating a large directory and listing it");
+
+	bool *seen = (bool*)calloc(count,sizeof(bool));
+	test_assertTrue(seen != NULL);
+	if(seen == NULL)
+		return;
+
+	test_assertInt(mkdir("/largedir",DIR_DEF_MODE),0);
+	for(size_t i = 0; i < count; ++i) {
+		snprintf(path,sizeof(path),"/largedir/%s%04zu",prefix,i);
+		fs_createFile(path,"");
+	}
+
+	/* every file has to show up exactly once */
+	size_t found = 0;
+	DIR *dir = opendir("/largedir");
+	test_assertTrue(dir != NULL);
+	if(dir != NULL) {
+		while(readdirto(dir,&e)) {
+			if(strcmp(e.d_name,".") == 0 || strcmp(e.d_name,"..") == 0)
+				continue;
+			test_assertTrue(strncmp(e.d_name,prefix,strlen(prefix)) == 0);
+			size_t no = strtoul(e.d_name + strlen(prefix),NULL,10);
+			test_assertTrue(no < count && !seen[no]);
+			if(no < count)
+				seen[no] = true;
+			found++;
+		}
+		closedir(dir);
+	}
+	test_assertSize(found,count);
+
+	for(size_t i = 0; i < count; ++i) {
+		snprintf(path,sizeof(path),"/largedir/%s%04zu",prefix,i);
+		test_assertInt(unlink(path),0);
+	}
+	test_assertInt(rmdir("/largedir"),0);
+	free(seen);
+
+	test_caseSucceeded();
+}
+
 static void test_assertCan(const char *path,uint mode) {
 	int fd = open(path,mode);
 	test_assertTrue(fd >= 0);
@@ -37,6 +37,7 @@ static uint32_t inodeCount = 0;
 static uint32_t blockGroups = 0;
 static Ext2BlockGrp *bgs = NULL;
 static const char *volumeLabel = "";
+static bool dirIndex = false;
 static int fd = -1;
 static const char *disk = NULL;
 static size_t disksize = 0;
@@ -128,6 +129,18 @@ static void initSuperblock(void) {
 		sb.volumeUid[i] = rand() % 0xFF;
 	strnzcpy(sb.volumeName,volumeLabel,sizeof(sb.volumeName));
 	sb.lastMountPath[0] = '\0';
+
+	/* features require revision 1. firstInode and inodeSize have the rev0 values anyway */
+	if(dirIndex) {
+		log("Enabling hash-indexed directories\n");
+		sb.revLevel = cputole32(EXT2_DYNAMIC_REV);
+		sb.featureCompat = cputole32(EXT2_FEATURE_COMPAT_DIR_INDEX);
+		for(size_t i = 0; i < ARRAY_SIZE(sb.hashSeed); ++i)
+			sb.hashSeed[i] = cputole32(rand());
+		sb.defHashVersion = EXT2_HASH_HALF_MD4;
+		/* the hash depends on the signedness of char, which the filesystem has to remember */
+		sb.flags = cputole32((char)-1 < 0 ? EXT2_FLAGS_SIGNED_HASH : EXT2_FLAGS_UNSIGNED_HASH);
+	}
 }
 
 static void writeBGDescs(void) {
@@ -247,13 +260,15 @@ static void createRootDir(uint32_t bno) {
 }
 
 static void usage(const char *name) {
-	fprintf(stderr,"Usage: %s [-b <blockSize>] [-N <inodes>] [-L <label>] [-G <blockGroups>] <disk>\n",name);
+	fprintf(stderr,"Usage: %s [-b <blockSize>] [-N <inodes>] [-L <label>] [-G <blockGroups>] [-d] <disk>\n",
+		name);
+	fprintf(stderr,"    -d: enable hash-indexed directories (dir_index)\n");
 	exit(EXIT_FAILURE);
 }
 
 int main(int argc,const char **argv) {
-	int res = ca_parse(argc,argv,CA_MAX1_FREE,"b=k N=k L=s G=k",
-		&blockSize,&inodeCount,&volumeLabel,&blockGroups);
+	int res = ca_parse(argc,argv,CA_MAX1_FREE,"b=k N=k L=s G=k d",
+		&blockSize,&inodeCount,&volumeLabel,&blockGroups,&dirIndex);
 	if(res < 0) {
 		printe("Invalid arguments: %s",ca_error(res));
 		usage(argv[0]);
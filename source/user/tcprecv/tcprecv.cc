@@ -23,12 +23,13 @@
 #include <sys/cmdargs.h>
 #include <sys/common.h>
 #include <sys/thread.h>
+#include <sys/time.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 using namespace esc;
 
-static char buffer[8192];
+static char buffer[64 * 1024];
 
 static void usage(const char *name) {
 	serr << "Usage: " << name << " <file> <port>\n";
@@ -61,10 +62,16 @@ int main(int argc,char **argv) {
 	sout.flush();
 
 	ssize_t res;
-	while(total > 0 && (res = client.receive(buffer,sizeof(buffer))) > 0) {
+	uint32_t received = 0;
+	uint64_t start = rdtsc();
+	while(received < total && (res = client.receive(buffer,sizeof(buffer))) > 0) {
 		if(file.write(buffer,res) != (size_t)res)
 			exitmsg("fwrite failed");
-		total -= res;
+		received += res;
 	}
+
+	uint64_t usecs = tsctotime(rdtsc() - start);
+	printf("%u bytes received, %.1lf s, %.1lf KB/s\n",
+		received,usecs / 1000000.0,received / (usecs / 1000.0));
 	return 0;
 }
@@ -29,7 +29,9 @@
 
 using namespace esc;
 
-static char buffer[8192];
+/* the write is answered as soon as it fits into the send buffer. thus, use large chunks to keep
+ * the buffer, and therefore the window of the connection, filled */
+static char buffer[128 * 1024];
 
 static void usage(const char *name) {
 	serr << "Usage: " << name << " <file> <ip> <port>\n";
@@ -19,6 +19,10 @@
 
 #include <sys/common.h>
 
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
 extern int mod_getpid(int,char**);
 extern int mod_yield(int,char**);
 extern int mod_fork(int,char**);
@@ -34,5 +38,14 @@ extern int mod_memops(int,char**);
 extern int mod_locks(int,char**);
 extern int mod_chgsize(int,char**);
 extern int mod_pagefault(int,char**);
+extern int mod_regions(int,char**);
 extern int mod_heap(int,char**);
 extern int mod_stdio(int,char**);
+extern int mod_kcache(int,char**);
+extern int mod_devclients(int,char**);
+extern int mod_startup(int,char**);
+extern int mod_tcpconns(int,char**);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,87 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/common.h>
+#include <sys/driver.h>
+#include <sys/io.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../modules.h"
+
+/* measures how long it takes the device to find the client that has work for it, depending on the
+ * number of open clients. only one client sends messages, all others are idle. */
+
+#define MAX_CLIENTS		256
+
+typedef struct {
+	char data[32];
+} sMsg;
+
+static size_t msgCount = 10000;
+static int fds[MAX_CLIENTS];
+
+static void dispatch(int dev,size_t clients) {
+	sMsg msg;
+	/* the last one is the worst case if all clients are checked in order */
+	int fd = fds[clients - 1];
+	uint64_t total = 0;
+	for(size_t i = 0; i < msgCount; i++) {
+		msgid_t mid = 0;
+		if(send(fd,0,&msg,sizeof(msg)) < 0)
+			printe("Message-sending failed");
+		uint64_t start = rdtsc();
+		if(getwork(dev,&mid,&msg,sizeof(msg),GW_NOBLOCK) < 0)
+			printe("Unable to get work");
+		total += rdtsc() - start;
+	}
+	printf("%4zu clients: %Lu cycles per getwork\n",clients,total / msgCount);
+	fflush(stdout);
+}
+
+int mod_devclients(int argc,char *argv[]) {
+	const char *path = "/dev/devclients";
+	if(argc > 2)
+		msgCount = atoi(argv[2]);
+
+	int dev = createdev(path,0111,DEV_TYPE_SERVICE,DEV_CLOSE);
+	if(dev < 0) {
+		printe("Unable to create device %s",path);
+		return 1;
+	}
+
+	size_t opened = 0;
+	for(size_t n = 1; n <= MAX_CLIENTS; n *= 4) {
+		for(; opened < n; ++opened) {
+			fds[opened] = open(path,O_MSGS);
+			if(fds[opened] < 0) {
+				printe("Unable to open device %s",path);
+				goto error;
+			}
+		}
+		dispatch(dev,n);
+	}
+
+error:
+	for(size_t i = 0; i < opened; ++i)
+		close(fds[i]);
+	close(dev);
+	return 0;
+}
@@ -17,16 +17,21 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <sys/arch.h>
 #include <sys/common.h>
+#include <sys/conf.h>
 #include <sys/proc.h>
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "../modules.h"
 
 #define TEST_COUNT		1000
+#define HEAP_PAGES		4096
+#define HEAP_COUNT		10
 
 static void firenforget(void) {
 	size_t i;
@@ -67,6 +72,51 @@ static void waitdead(void) {
 	printf("fork      : %Lu cycles/call\n",total / TEST_COUNT);
 }
 
+/* fork with a large heap, which makes all of its pages copy-on-write, and let <children> child
+ * processes write to all of them in parallel. the parent writes to them afterwards as well */
+static void largeHeap(long children) {
+	size_t i;
+	uint64_t forkTotal = 0;
+	uint64_t writeTotal = 0;
+	volatile char *heap = malloc(HEAP_PAGES * PAGE_SIZE);
+	if(!heap) {
+		printe("Unable to allocate heap");
+		return;
+	}
+	for(i = 0; i < HEAP_PAGES; ++i)
+		heap[i * PAGE_SIZE] = 0;
+
+	for(i = 0; i < HEAP_COUNT; ++i) {
+		uint64_t start = rdtsc();
+		for(long j = 0; j < children; ++j) {
+			uint64_t fstart = rdtsc();
+			int pid = fork();
+			if(pid == 0) {
+				for(size_t p = 0; p < HEAP_PAGES; ++p)
+					heap[p * PAGE_SIZE] = 1;
+				exit(0);
+			}
+			else if(pid < 0) {
+				printe("fork failed");
+				free((void*)heap);
+				return;
+			}
+			forkTotal += rdtsc() - fstart;
+		}
+
+		for(size_t p = 0; p < HEAP_PAGES; ++p)
+			heap[p * PAGE_SIZE] = 2;
+		for(long j = 0; j < children; ++j)
+			waitchild(NULL,-1);
+		writeTotal += rdtsc() - start;
+	}
+	printf("fork      : %Lu cycles/call (%d KiB heap)\n",
+		forkTotal / (HEAP_COUNT * children),HEAP_PAGES * PAGE_SIZE / 1024);
+	printf("cow       : %Lu cycles/page (%ld children)\n",
+		writeTotal / (HEAP_COUNT * (children + 1) * HEAP_PAGES),children);
+	free((void*)heap);
+}
+
 int mod_fork(A_UNUSED int argc,A_UNUSED char *argv[]) {
 	printf("Fire and forget...\n");
 	fflush(stdout);
@@ -74,5 +124,12 @@ int mod_fork(A_UNUSED int argc,A_UNUSED char *argv[]) {
 	printf("Wait until they're dead...\n");
 	fflush(stdout);
 	waitdead();
+
+	long cpus = sysconf(CONF_CPU_COUNT);
+	for(long n = 1; n <= MAX(cpus,1); n *= 2) {
+		printf("Large heap with %ld writer(s)...\n",n);
+		fflush(stdout);
+		largeHeap(n);
+	}
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,97 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/common.h>
+#include <sys/conf.h>
+#include <sys/driver.h>
+#include <sys/proc.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../modules.h"
+
+/* every message that is sent is allocated from the kernel's cache and freed again by getwork.
+ * thus, by running multiple processes that send messages to themself, we measure how well the
+ * cache scales with the number of CPUs. */
+
+typedef struct {
+	char data[32];
+} sMsg;
+
+static size_t msgCount = 100000;
+
+static void allocfree(int no) {
+	char path[32];
+	sMsg msg;
+	snprintf(path,sizeof(path),"/dev/kcache%d",no);
+
+	int dev = createdev(path,0111,DEV_TYPE_SERVICE,DEV_CLOSE);
+	if(dev < 0) {
+		printe("Unable to create device %s",path);
+		return;
+	}
+	int fd = open(path,O_MSGS);
+	if(fd < 0) {
+		printe("Unable to open device %s",path);
+		close(dev);
+		return;
+	}
+
+	uint64_t start = rdtsc();
+	for(size_t i = 0; i < msgCount; i++) {
+		msgid_t mid = 0;
+		if(send(fd,0,&msg,sizeof(msg)) < 0)
+			printe("Message-sending failed");
+		if(getwork(dev,&mid,&msg,sizeof(msg),GW_NOBLOCK) < 0)
+			printe("Unable to get work");
+	}
+	uint64_t end = rdtsc();
+	printf("[%d] %Lu cycles, per alloc+free: %Lu\n",no,end - start,(end - start) / msgCount);
+	fflush(stdout);
+
+	close(fd);
+	close(dev);
+}
+
+int mod_kcache(int argc,char *argv[]) {
+	long cpus = sysconf(CONF_CPU_COUNT);
+	if(argc > 2)
+		msgCount = atoi(argv[2]);
+	if(cpus < 1)
+		cpus = 1;
+
+	for(long n = 1; n <= cpus; n *= 2) {
+		printf("%ld process(es):\n",n);
+		fflush(stdout);
+		for(long i = 0; i < n; ++i) {
+			int pid = fork();
+			if(pid == 0) {
+				allocfree(i);
+				exit(EXIT_SUCCESS);
+			}
+			else if(pid < 0)
+				printe("fork failed");
+		}
+		for(long i = 0; i < n; ++i)
+			waitchild(NULL,-1);
+	}
+	return 0;
+}
@@ -19,11 +19,16 @@
 
 #include <sys/arch.h>
 #include <sys/common.h>
+#include <sys/conf.h>
 #include <sys/mman.h>
+#include <sys/proc.h>
+#include <sys/thread.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "../modules.h"
@@ -75,6 +80,77 @@ static void causePagefaults(const char *path) {
 	printf("%-30s: %Lu cycles maximum\n",path ? path : "NULL",max);
 }
 
+static void setZeroPool(const char *frames) {
+	int fd = open("/sys/zeropool",O_WRONLY);
+	if(fd < 0) {
+		printe("Unable to open /sys/zeropool");
+		return;
+	}
+	if(write(fd,frames,strlen(frames)) < 0)
+		printe("Unable to set zero pool size");
+	close(fd);
+}
+
+/* anonymous pages are cleared by the idle-threads in advance, as long as there are pre-zeroed
+ * frames left. thus, compare the latency with and without the pool and pause after every round
+ * to give the idle-threads a chance to refill it */
+static void zeroPoolPagefaults(void) {
+	static const char *sizes[] = {"0","64"};
+	for(size_t s = 0; s < ARRAY_SIZE(sizes); ++s) {
+		uint64_t total = 0;
+		setZeroPool(sizes[s]);
+		for(int j = 0; j < TEST_COUNT / 20; ++j) {
+			usleep(10000);
+			volatile char *addr = mmap(NULL,MAP_SIZE * PAGE_SIZE,0,PROT_READ | PROT_WRITE,
+				MAP_PRIVATE,-1,0);
+			if(!addr) {
+				printe("mmap failed");
+				return;
+			}
+
+			for(size_t i = 0; i < MAP_SIZE; ++i) {
+				uint64_t start = rdtsc();
+				*(addr + i * PAGE_SIZE) = 0;
+				total += rdtsc() - start;
+			}
+
+			if(munmap((void*)addr) != 0)
+				printe("munmap failed");
+		}
+		printf("zero pool with %-15s: %Lu cycles average\n",sizes[s],
+			total / ((TEST_COUNT / 20) * MAP_SIZE));
+	}
+}
+
+/* the frames for anonymous memory come from the per-CPU frame caches of the kernel. thus, let
+ * multiple processes cause pagefaults in parallel to see how well that scales */
+static void parallelPagefaults(void) {
+	long cpus = sysconf(CONF_CPU_COUNT);
+	if(cpus < 1)
+		cpus = 1;
+
+	for(long n = 1; n <= cpus; n *= 2) {
+		printf("%ld process(es):\n",n);
+		fflush(stdout);
+		uint64_t start = rdtsc();
+		for(long i = 0; i < n; ++i) {
+			int pid = fork();
+			if(pid == 0) {
+				causePagefaults(NULL);
+				fflush(stdout);
+				exit(EXIT_SUCCESS);
+			}
+			else if(pid < 0)
+				printe("fork failed");
+		}
+		for(long i = 0; i < n; ++i)
+			waitchild(NULL,-1);
+		uint64_t end = rdtsc();
+		printf("%-30s: %Lu cycles per pagefault\n","total",
+			(end - start) / (n * TEST_COUNT * MAP_SIZE));
+	}
+}
+
 int mod_pagefault(A_UNUSED int argc,A_UNUSED char *argv[]) {
 	size_t i;
 	size_t total = MAP_SIZE * PAGE_SIZE;
@@ -100,6 +176,8 @@ int mod_pagefault(A_UNUSED int argc,A_UNUSED char *argv[]) {
 	causePagefaults(NULL);
 	causePagefaults("/sys/test");
 	causePagefaults("/home/hrniels/testdir/bbc.bmp");
+	zeroPoolPagefaults();
+	parallelPagefaults();
 
 	if(unlink("/sys/test") < 0)
 		printe("Unable to unlink test-file");
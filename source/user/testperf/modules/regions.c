@@ -0,0 +1,170 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/arch.h>
+#include <sys/common.h>
+#include <sys/io.h>
+#include <sys/mman.h>
+#include <sys/proc.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../modules.h"
+
+#define REGION_COUNT	256
+#define REGION_PAGES	4
+#define TEST_COUNT		10
+#define MAX_SHARERS		16
+
+static volatile char *regions[REGION_COUNT];
+
+static bool mapRegions(void) {
+	for(size_t i = 0; i < REGION_COUNT; ++i) {
+		regions[i] = mmap(NULL,REGION_PAGES * PAGE_SIZE,0,PROT_READ | PROT_WRITE,MAP_PRIVATE,-1,0);
+		if(!regions[i]) {
+			printe("mmap failed");
+			return false;
+		}
+	}
+	return true;
+}
+
+static void unmapRegions(void) {
+	for(size_t i = 0; i < REGION_COUNT; ++i) {
+		if(munmap((void*)regions[i]) != 0)
+			printe("munmap failed");
+	}
+}
+
+/* every pagefault has to find the region of the faulting address first. walking through the
+ * pages of one region after another hits the same region again and again, whereas walking through
+ * the regions for every page hits a different region every time */
+static void faultRegions(bool interleaved) {
+	uint64_t total = 0;
+	for(int j = 0; j < TEST_COUNT; ++j) {
+		if(!mapRegions())
+			return;
+
+		for(size_t i = 0; i < REGION_COUNT * REGION_PAGES; ++i) {
+			size_t r = interleaved ? i % REGION_COUNT : i / REGION_PAGES;
+			size_t p = interleaved ? i / REGION_COUNT : i % REGION_PAGES;
+			uint64_t start = rdtsc();
+			*(regions[r] + p * PAGE_SIZE) = 0;
+			total += rdtsc() - start;
+		}
+
+		unmapRegions();
+	}
+	printf("%-30s: %Lu cycles average\n",interleaved ? "interleaved" : "sequential",
+		total / (TEST_COUNT * REGION_COUNT * REGION_PAGES));
+}
+
+/* pages of a shared region are mapped into all processes that share it, when it is loaded.
+ * thus, let a few children share the region and measure how expensive that gets */
+static void faultShared(const char *path,long sharers) {
+	uint64_t total = 0;
+	int fd = open(path,O_RDONLY);
+	if(fd < 0) {
+		printe("Unable to open '%s'",path);
+		return;
+	}
+
+	for(int j = 0; j < TEST_COUNT; ++j) {
+		int rfd,wfd;
+		volatile char *addr = mmap(NULL,REGION_PAGES * PAGE_SIZE,REGION_PAGES * PAGE_SIZE,
+			PROT_READ,MAP_SHARED,fd,0);
+		if(!addr) {
+			printe("mmap failed");
+			break;
+		}
+		if(pipe(&rfd,&wfd) < 0) {
+			printe("pipe failed");
+			munmap((void*)addr);
+			break;
+		}
+
+		/* the children just wait until we're done */
+		for(long i = 0; i < sharers; ++i) {
+			int pid = fork();
+			if(pid == 0) {
+				char c;
+				close(wfd);
+				IGNSIGS(read(rfd,&c,1));
+				exit(EXIT_SUCCESS);
+			}
+			else if(pid < 0)
+				printe("fork failed");
+		}
+
+		for(size_t i = 0; i < REGION_PAGES; ++i) {
+			uint64_t start = rdtsc();
+			(void)*(addr + i * PAGE_SIZE);
+			total += rdtsc() - start;
+		}
+
+		close(wfd);
+		close(rfd);
+		for(long i = 0; i < sharers; ++i)
+			waitchild(NULL,-1);
+		munmap((void*)addr);
+	}
+	close(fd);
+
+	printf("shared by %-2ld children %-11s: %Lu cycles average\n",sharers,"",
+		total / (TEST_COUNT * REGION_PAGES));
+}
+
+int mod_regions(A_UNUSED int argc,A_UNUSED char *argv[]) {
+	size_t total = REGION_PAGES * PAGE_SIZE;
+	char *buffer = malloc(total);
+	if(!buffer) {
+		printe("Unable to create buffer");
+		return 1;
+	}
+	int fd = creat("/sys/test",0600);
+	if(fd < 0) {
+		printe("open of /sys/test failed");
+		return 1;
+	}
+	memset(buffer,0x55,total);
+	if(write(fd,buffer,total) != (ssize_t)total) {
+		printe("write failed");
+		return 1;
+	}
+	close(fd);
+
+	printf("Pagefaults across %d regions with %d pages each...\n",REGION_COUNT,REGION_PAGES);
+	faultRegions(false);
+	faultRegions(true);
+	fflush(stdout);
+
+	printf("Pagefaults in a shared region...\n");
+	for(long n = 1; n <= MAX_SHARERS; n *= 2) {
+		faultShared("/sys/test",n);
+		fflush(stdout);
+	}
+
+	if(unlink("/sys/test") < 0)
+		printe("Unable to unlink test-file");
+	free(buffer);
+	return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/common.h>
+#include <sys/io.h>
+#include <sys/proc.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../modules.h"
+
+#define TEST_COUNT		100
+
+/* measures how long it takes to start a program until it has terminated. most of the time is
+ * spent on loading the binary and the libraries via pagefaults. */
+
+static uint64_t startProgram(const char *path) {
+	uint64_t start = rdtsc();
+	int pid = fork();
+	if(pid == 0) {
+		const char *args[] = {path,NULL};
+		int fd = open("/dev/null",O_WRONLY);
+		if(fd >= 0)
+			redirect(STDOUT_FILENO,fd);
+		execv(path,args);
+		exit(EXIT_FAILURE);
+	}
+	else if(pid < 0) {
+		printe("fork failed");
+		return 0;
+	}
+
+	sExitState state;
+	if(waitchild(&state,pid) < 0 || state.exitCode != EXIT_SUCCESS)
+		printe("Unable to run '%s'",path);
+	return rdtsc() - start;
+}
+
+int mod_startup(int argc,char *argv[]) {
+	const char *path = argc > 2 ? argv[2] : "/bin/echo";
+	uint64_t total = 0;
+	uint64_t min = ULLONG_MAX, max = 0;
+
+	/* the first start has to load the binary from disk */
+	printf("%-30s: %Lu cycles for the first start\n",path,startProgram(path));
+	for(int i = 0; i < TEST_COUNT; ++i) {
+		uint64_t duration = startProgram(path);
+		if(duration < min)
+			min = duration;
+		if(duration > max)
+			max = duration;
+		total += duration;
+	}
+
+	printf("%-30s: %Lu cycles average\n",path,total / TEST_COUNT);
+	printf("%-30s: %Lu cycles minimum\n",path,min);
+	printf("%-30s: %Lu cycles maximum\n",path,max);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <esc/proto/net.h>
+#include <esc/proto/socket.h>
+#include <sys/common.h>
+#include <sys/io.h>
+#include <sys/proc.h>
+#include <sys/thread.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../modules.h"
+
+using namespace esc;
+
+/* measures how expensive a message over a TCP connection gets, depending on the number of active
+ * connections. every message programs and cancels timeouts in the tcpip driver (retransmission and
+ * delayed ACK), so that this shows how the timeouts scale. since a process can't have that many
+ * files open, the connections are spread over several children, which run at the same time. */
+
+#define CONNS_PER_CHILD		256
+#define MAX_CHILDS			8
+#define ROUNDS				20
+#define BASE_PORT			2000
+
+static Socket *servers[CONNS_PER_CHILD];
+
+static int acceptThread(void *arg) {
+	Socket *listener = (Socket*)arg;
+	for(size_t i = 0; i < CONNS_PER_CHILD; ++i)
+		servers[i] = new Socket(listener->accept());
+	return 0;
+}
+
+static uint64_t sendMessages(int no,int readyfd,int gofd) {
+	Socket *clients[CONNS_PER_CHILD];
+	Socket::Addr addr;
+	addr.family = Socket::AF_INET;
+	addr.d.ipv4.addr = 0;
+	addr.d.ipv4.port = BASE_PORT + no;
+
+	Socket listener("/dev/socket",Socket::SOCK_STREAM,Socket::PROTO_TCP);
+	listener.bind(addr);
+	listener.listen();
+	int tid = startthread(acceptThread,&listener);
+	if(tid < 0) {
+		printe("Unable to start thread");
+		return 0;
+	}
+
+	addr.d.ipv4.addr = Net::IPv4Addr(127,0,0,1).value();
+	for(size_t i = 0; i < CONNS_PER_CHILD; ++i) {
+		clients[i] = new Socket("/dev/socket",Socket::SOCK_STREAM,Socket::PROTO_TCP);
+		// we want to see the costs of a message, not wait for delayed ACKs
+		clients[i]->setopt(Socket::OPT_TCP_NODELAY,1);
+		clients[i]->connect(addr);
+	}
+	IGNSIGS(join(tid));
+
+	// wait until all connections of all children are established
+	char c = 1;
+	if(write(readyfd,&c,1) != 1 || read(gofd,&c,1) != 1)
+		return 0;
+
+	uint64_t total = 0;
+	for(int j = 0; j < ROUNDS; ++j) {
+		for(size_t i = 0; i < CONNS_PER_CHILD; ++i) {
+			uint64_t start = rdtsc();
+			clients[i]->send(&c,1);
+			servers[i]->receive(&c,1);
+			total += rdtsc() - start;
+		}
+	}
+
+	for(size_t i = 0; i < CONNS_PER_CHILD; ++i) {
+		delete clients[i];
+		delete servers[i];
+	}
+	return total / (ROUNDS * CONNS_PER_CHILD);
+}
+
+static void child(int no,int readyfd,int gofd,int resfd) {
+	uint64_t res = 0;
+	try {
+		res = sendMessages(no,readyfd,gofd);
+	}
+	catch(const default_error &e) {
+		fprintf(stderr,"Child %d failed: %s\n",no,e.what());
+		// tell the parent, in case we haven't reported that we're ready yet
+		char c = 0;
+		IGNSIGS(write(readyfd,&c,1));
+	}
+	IGNSIGS(write(resfd,&res,sizeof(res)));
+}
+
+static void measure(int childs) {
+	int ready[2],go[2],result[2];
+	if(pipe(ready,ready + 1) < 0 || pipe(go,go + 1) < 0 || pipe(result,result + 1) < 0) {
+		printe("pipe failed");
+		return;
+	}
+
+	int started = 0;
+	for(; started < childs; ++started) {
+		int pid = fork();
+		if(pid == 0) {
+			close(ready[0]);
+			close(go[1]);
+			close(result[0]);
+			child(started,ready[1],go[0],result[1]);
+			exit(EXIT_SUCCESS);
+		}
+		else if(pid < 0) {
+			printe("fork failed");
+			break;
+		}
+	}
+	close(ready[1]);
+	close(go[0]);
+	close(result[1]);
+
+	// let all children start at the same time. if one failed, closing the pipe stops the others
+	char c = 0;
+	int i = 0;
+	for(; i < started; ++i) {
+		if(read(ready[0],&c,1) != 1 || c != 1)
+			break;
+	}
+	uint64_t total = 0;
+	if(i == childs) {
+		for(i = 0; i < started; ++i)
+			IGNSIGS(write(go[1],&c,1));
+		for(i = 0; i < started; ++i) {
+			uint64_t res;
+			if(read(result[0],&res,sizeof(res)) != sizeof(res) || res == 0)
+				break;
+			total += res;
+		}
+	}
+	close(go[1]);
+
+	if(i == childs) {
+		printf("%4d connections: %Lu cycles per message\n",childs * CONNS_PER_CHILD,
+			total / childs);
+	}
+	else
+		printf("%4d connections: failed\n",childs * CONNS_PER_CHILD);
+	fflush(stdout);
+
+	for(i = 0; i < started; ++i)
+		waitchild(NULL,-1);
+	close(ready[0]);
+	close(result[0]);
+}
+
+int mod_tcpconns(int argc,char *argv[]) {
+	int maxChilds = MAX_CHILDS;
+	if(argc > 2)
+		maxChilds = (atoi(argv[2]) + CONNS_PER_CHILD - 1) / CONNS_PER_CHILD;
+
+	for(int n = 1; n <= maxChilds; n *= 2)
+		measure(n);
+	return 0;
+}
@@ -18,6 +18,7 @@
  */
 
 #include <sys/common.h>
+#include <sys/conf.h>
 #include <sys/proc.h>
 #include <sys/sync.h>
 #include <sys/thread.h>
@@ -28,10 +29,10 @@
 
 #include "../modules.h"
 
-#define THREAD_COUNT	2
 #define SYSC_COUNT		100000
 
 static int sm;
+static int threadCount = 2;
 
 static int thread_func(A_UNUSED void *arg) {
 	int i;
@@ -47,30 +48,36 @@ static int thread_func(A_UNUSED void *arg) {
 
 static void intra_yield(void) {
 	int i;
-	for(i = 0; i < THREAD_COUNT; ++i) {
+	for(i = 0; i < threadCount; ++i) {
 		if(startthread(thread_func,NULL) < 0)
 			printe("startthread failed");
 	}
-	for(i = 0; i < THREAD_COUNT; ++i)
+	for(i = 0; i < threadCount; ++i)
 		semup(sm);
 	join(0);
 }
 
 static void inter_yield(void) {
 	int i;
-	for(i = 0; i < THREAD_COUNT; ++i) {
+	for(i = 0; i < threadCount; ++i) {
 		if(fork() == 0) {
 			thread_func(NULL);
 			exit(0);
 		}
 	}
-	for(i = 0; i < THREAD_COUNT; ++i)
+	for(i = 0; i < threadCount; ++i)
 		semup(sm);
-	for(i = 0; i < THREAD_COUNT; ++i)
+	for(i = 0; i < threadCount; ++i)
 		waitchild(NULL,-1);
 }
 
-int mod_yield(A_UNUSED int argc,A_UNUSED char *argv[]) {
+int mod_yield(int argc,char *argv[]) {
+	/* by default, use 2 threads per CPU to let them compete for the CPUs */
+	threadCount = argc > 2 ? atoi(argv[2]) : sysconf(CONF_CPU_COUNT) * 2;
+	if(threadCount < 2)
+		threadCount = 2;
+	printf("Using %d threads on %ld CPUs\n",threadCount,sysconf(CONF_CPU_COUNT));
+
 	sm = semcrt(0);
 	if(sm < 0)
 		error("Unable to create semaphore");
@@ -49,8 +49,13 @@ static sTestModule modules[] = {
 	{"locks",		mod_locks},
 	{"chgsize",		mod_chgsize},
 	{"pagefault",	mod_pagefault},
+	{"regions",		mod_regions},
 	{"heap",		mod_heap},
 	{"stdio",		mod_stdio},
+	{"kcache",		mod_kcache},
+	{"devclients",	mod_devclients},
+	{"startup",	mod_startup},
+	{"tcpconns",	mod_tcpconns},
 };
 
 int main(int argc,char *argv[]) {